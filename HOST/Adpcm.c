@@ -0,0 +1,192 @@
+/*
+ * SPU ADPCM encoder and decoder. Every block is encoded with all five filters and the two
+ * shifts around the one the input needs; the combination with the smallest error after
+ * decoding wins, so the encoder tracks the decoder exactly and errors don't add up.
+ */
+
+#include "Adpcm.h"
+
+#include <string.h>
+
+#define ADPCM_FILTERS 5
+#define ADPCM_MAX_SHIFT 12
+
+static const int s_filter0[ADPCM_FILTERS] = { 0, 60, 115, 98, 122 };
+static const int s_filter1[ADPCM_FILTERS] = { 0, 0, -52, -55, -60 };
+
+static int Clamp16(int value)
+{
+	return value < -32768 ? -32768 : (value > 32767 ? 32767 : value);
+}
+
+long AdpcmSize(long samples)
+{
+	return (samples + ADPCM_BLOCK_SAMPLES - 1) / ADPCM_BLOCK_SAMPLES * ADPCM_BLOCK_SIZE;
+}
+
+void AdpcmDecodeBlock(const u_char* block, AdpcmState* state, short* out)
+{
+	int shift = block[0] & 0x0f;
+	int filter = (block[0] >> 4) & 0x07;
+	int f0, f1, nibble, sample, i;
+
+	/* The hardware treats invalid values like this */
+	if (shift > ADPCM_MAX_SHIFT)
+	{
+		shift = 9;
+	}
+
+	if (filter >= ADPCM_FILTERS)
+	{
+		filter = 0;
+	}
+
+	f0 = s_filter0[filter];
+	f1 = s_filter1[filter];
+
+	for (i = 0; i < ADPCM_BLOCK_SAMPLES; ++i)
+	{
+		nibble = (block[2 + i / 2] >> ((i & 1) * 4)) & 0x0f;
+		sample = (int)((short)(nibble << 12)) >> shift;
+		sample = Clamp16(sample + ((state->s1 * f0 + state->s2 * f1 + 32) >> 6));
+
+		state->s2 = state->s1;
+		state->s1 = sample;
+		out[i] = (short)sample;
+	}
+}
+
+/* Encodes a block with the given filter and shift into nibbles. Returns the squared error. */
+static double EncodeNibbles(const short* samples, int filter, int shift, AdpcmState* state, u_char* nibbles)
+{
+	int f0 = s_filter0[filter];
+	int f1 = s_filter1[filter];
+	int s1 = state->s1, s2 = state->s2;
+	int predicted, residual, nibble, decoded, i;
+	double error = 0.0;
+
+	for (i = 0; i < ADPCM_BLOCK_SAMPLES; ++i)
+	{
+		predicted = (s1 * f0 + s2 * f1 + 32) >> 6;
+		residual = samples[i] - predicted;
+
+		/* Quantize to the nearest step, steps are 4096 >> shift */
+		nibble = (residual * (1 << shift) + (residual >= 0 ? 2048 : -2048)) / 4096;
+		if (nibble > 7) nibble = 7;
+		if (nibble < -8) nibble = -8;
+
+		decoded = Clamp16(((nibble << 12) >> shift) + predicted);
+		error += (double)(samples[i] - decoded) * (samples[i] - decoded);
+
+		nibbles[i] = (u_char)(nibble & 0x0f);
+		s2 = s1;
+		s1 = decoded;
+	}
+
+	return error;
+}
+
+/* Returns the largest shift whose steps can still reach the largest residual of the filter. */
+static int FindShift(const short* samples, int filter, AdpcmState* state)
+{
+	int f0 = s_filter0[filter];
+	int f1 = s_filter1[filter];
+	int s1 = state->s1, s2 = state->s2;
+	int residual, max = 0, shift, i;
+
+	/* Open loop, predicting from the input instead of the decoded samples */
+	for (i = 0; i < ADPCM_BLOCK_SAMPLES; ++i)
+	{
+		residual = samples[i] - ((s1 * f0 + s2 * f1 + 32) >> 6);
+		if (residual < 0) residual = -residual;
+		if (residual > max) max = residual;
+
+		s2 = s1;
+		s1 = samples[i];
+	}
+
+	for (shift = ADPCM_MAX_SHIFT; shift > 0; --shift)
+	{
+		if (max <= (7 << 12) >> shift)
+		{
+			break;
+		}
+	}
+
+	return shift;
+}
+
+void AdpcmEncodeBlock(const short* samples, int count, AdpcmState* state, u_char flags, u_char* out)
+{
+	short block[ADPCM_BLOCK_SAMPLES];
+	u_char nibbles[ADPCM_BLOCK_SAMPLES], best[ADPCM_BLOCK_SAMPLES];
+	int filter, shift, first, bestFilter = 0, bestShift = 0;
+	double error, bestError = -1.0;
+	int i;
+
+	memset(block, 0, sizeof(block));
+	memcpy(block, samples, count * sizeof(short));
+
+	for (filter = 0; filter < ADPCM_FILTERS; ++filter)
+	{
+		/* The shift found open loop, and one coarser step in case decoded samples drift off */
+		first = FindShift(block, filter, state);
+		for (shift = first; shift >= 0 && shift >= first - 1; --shift)
+		{
+			error = EncodeNibbles(block, filter, shift, state, nibbles);
+			if (bestError < 0.0 || error < bestError)
+			{
+				bestError = error;
+				bestFilter = filter;
+				bestShift = shift;
+				memcpy(best, nibbles, sizeof(best));
+			}
+		}
+	}
+
+	out[0] = (u_char)((bestFilter << 4) | bestShift);
+	out[1] = flags;
+	for (i = 0; i < ADPCM_BLOCK_SAMPLES; i += 2)
+	{
+		out[2 + i / 2] = (u_char)(best[i] | (best[i + 1] << 4));
+	}
+
+	/* Advance the state exactly like the decoder does */
+	AdpcmDecodeBlock(out, state, block);
+}
+
+long AdpcmEncode(const short* samples, long count, u_char* out)
+{
+	AdpcmState state = { 0, 0 };
+	long offset, size = 0;
+	int blockSamples;
+
+	for (offset = 0; offset < count; offset += ADPCM_BLOCK_SAMPLES)
+	{
+		blockSamples = count - offset < ADPCM_BLOCK_SAMPLES ? (int)(count - offset) : ADPCM_BLOCK_SAMPLES;
+		AdpcmEncodeBlock(samples + offset, blockSamples, &state,
+			offset + ADPCM_BLOCK_SAMPLES >= count ? ADPCM_FLAG_LOOP_END : 0, out + size);
+		size += ADPCM_BLOCK_SIZE;
+	}
+
+	return size;
+}
+
+long AdpcmDecode(const u_char* data, long size, short* out)
+{
+	AdpcmState state = { 0, 0 };
+	long offset, count = 0;
+
+	for (offset = 0; offset + ADPCM_BLOCK_SIZE <= size; offset += ADPCM_BLOCK_SIZE)
+	{
+		AdpcmDecodeBlock(data + offset, &state, out + count);
+		count += ADPCM_BLOCK_SAMPLES;
+
+		if (data[offset + 1] & ADPCM_FLAG_LOOP_END)
+		{
+			break;
+		}
+	}
+
+	return count;
+}
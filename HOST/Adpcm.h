@@ -0,0 +1,45 @@
+/*
+ * SPU ADPCM codec of the host tools.
+ *
+ * The SPU plays 4 bit ADPCM in blocks of 16 bytes: a header byte with the prediction filter
+ * and the shift, a flag byte with the loop flags, then 28 samples, two per byte, low nibble
+ * first. Each sample is predicted from the previous two decoded samples by one of five
+ * fixed filters.
+ */
+
+#ifndef _ADPCM_H_
+#define _ADPCM_H_
+
+#include <sys/types.h>
+
+#define ADPCM_BLOCK_SIZE		16
+#define ADPCM_BLOCK_SAMPLES		28
+
+/* Flags of the second byte of a block */
+#define ADPCM_FLAG_LOOP_END		0x01	/* Jump to the loop address after this block. */
+#define ADPCM_FLAG_LOOP_REPEAT	0x02	/* Keep playing after the jump, otherwise the voice is released. */
+#define ADPCM_FLAG_LOOP_START	0x04	/* This block is the loop address. */
+
+/* Decoder state carried from block to block. */
+typedef struct
+{
+	int s1, s2;
+} AdpcmState;
+
+/* Returns the size of the ADPCM data for the given number of samples. */
+long AdpcmSize(long samples);
+
+/*
+ * Encodes 16 bit samples. The last block is padded with silence and gets the loop end
+ * flag, so a voice playing it stops by itself. Returns the number of bytes written.
+ */
+long AdpcmEncode(const short* samples, long count, u_char* out);
+
+/* Decodes ADPCM data, 28 samples per block, until and including the first block with the loop end flag. Returns the number of samples. */
+long AdpcmDecode(const u_char* data, long size, short* out);
+
+/* Encodes and decodes a single block, for callers which stream. */
+void AdpcmEncodeBlock(const short* samples, int count, AdpcmState* state, u_char flags, u_char* out);
+void AdpcmDecodeBlock(const u_char* block, AdpcmState* state, short* out);
+
+#endif
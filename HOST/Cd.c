@@ -0,0 +1,947 @@
+/*
+ * Host implementation of the libcd functions used by the game.
+ *
+ * The disc is built in memory from the pack script (see HostCdMount), with the same PCK
+ * layout the MPACK tool writes: a TOC sector with the uppercase name, size and sector
+ * offset of every file, followed by the files, each starting on a new sector. Reads
+ * complete immediately, and can be made to fail (HostCdErrorEvery) to exercise the error
+ * handling of PckLib. XA files can be added (HostCdAddXaFile) and streamed with CdlReadS,
+ * which goes on in real time, a few sectors every vertical blank. Streams started with
+ * CdRead2(CdlModeStream) collect the sectors of STR movie frames in the ring buffer of the
+ * St functions instead of passing them to the ready callback.
+ */
+
+#include <sys/types.h>
+#include <libcd.h>
+#include <libetc.h>
+
+#include <ctype.h>
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SECTOR_SIZE			2048
+/* Sector of an XA file: subheader (file, channel, submode, coding and a copy) and data. */
+#define XA_SECTOR_SIZE		2336
+#define XA_SUBHEADER_SIZE	8
+/* Sectors a second at single speed. */
+#define SECTORS_PER_SECOND	75
+/* Files start after the system area, like on a mastered disc. */
+#define FIRST_FILE_SECTOR	24
+#define MAX_DISC_FILES		8
+#define MAX_XA_FILES		4
+
+/* Entries in a PCK TOC sector, see PckLib.h. */
+#define MAX_PCK_FILES		85
+#define PCK_NAME_LENGTH		16
+
+typedef struct
+{
+	char name[PCK_NAME_LENGTH];
+	int sector;
+	int size;
+} DiscFile;
+
+static u_char* s_disc = 0;
+static int s_discSectors = 0;
+static DiscFile s_files[MAX_DISC_FILES];
+static int s_fileCount = 0;
+
+/*
+ * XA files after the image, read from their file when the drive gets to them since music
+ * and movies are far larger than the heap of the renderer. Only the first 4 bytes of the
+ * subheaders are kept, sectors of the image have none.
+ */
+typedef struct
+{
+	FILE* file;
+	int first;
+	int sectors;
+	u_char* subheaders;
+} XaFile;
+
+static XaFile s_xaFiles[MAX_XA_FILES];
+static int s_xaCount = 0;
+
+/* Sector the next CdRead starts at. */
+static int s_position = 0;
+
+int HostCdErrorEvery = 0;
+
+/* Reads started so far, and whether the last one failed. */
+static u_long s_reads = 0;
+static int s_readFailed = 0;
+
+HostCdStats HostCd;
+
+/* Mode and filter of the drive, and whether it streams. */
+static u_char s_mode = 0;
+static CdlFILTER s_filter;
+static int s_streaming = 0;
+static CdlCB s_readyCallback = 0;
+
+/* Sectors the drive could have read by now (at its speed), and the part of one which is left over. */
+static long s_ticks = 0;
+static long s_tickRemainder = 0;
+/* Tick the last audio sector was played at, -1 if there was none since the stream started. */
+static long s_audioTick = -1;
+
+/* The sector passed to the ready callback with header and subheader, and how much of it CdGetSector fetched. */
+static u_char s_sector[12 + SECTOR_SIZE];
+static int s_sectorRead = 0;
+
+/* Sector header of STR movie frames: the id, the sector of the frame and the sectors it takes, the frame number. */
+#define ST_SECTOR_ID		0x0160
+#define ST_HEADER_SIZE		32
+#define ST_PAYLOAD			(SECTOR_SIZE - ST_HEADER_SIZE)
+#define MAX_RING_FRAMES		8
+
+typedef enum
+{
+	RING_FILLING,
+	RING_READY,
+	RING_TAKEN,
+	RING_FREE
+} RingState;
+
+/* A frame in the ring buffer: its header, then the data of its sectors one after the other. */
+typedef struct
+{
+	long offset;
+	long size;
+	u_long frame;
+	int sectors;
+	int received;
+	RingState state;
+} RingFrame;
+
+/* Ring buffer of CdRead2 streams, the frames in it from the oldest on, and whether the stream fills it. */
+static u_char* s_ring = 0;
+static long s_ringSize = 0;
+static RingFrame s_ringFrames[MAX_RING_FRAMES];
+static int s_ringFirst = 0;
+static int s_ringCount = 0;
+static int s_ringStream = 0;
+static u_long s_streamStart = 0;
+static u_long s_streamEnd = 0;
+static void (*s_frameCallback)() = 0;
+
+/******************************************************/
+/* Disc image */
+
+/* Grows the image to hold the given number of sectors. New sectors are zero. */
+static int ReserveSectors(int sectors)
+{
+	u_char* disc;
+
+	if (sectors <= s_discSectors)
+	{
+		return 1;
+	}
+
+	disc = (u_char*)realloc(s_disc, (size_t)sectors * SECTOR_SIZE);
+	if (disc == 0)
+	{
+		return 0;
+	}
+
+	memset(disc + (size_t)s_discSectors * SECTOR_SIZE, 0, (size_t)(sectors - s_discSectors) * SECTOR_SIZE);
+	s_disc = disc;
+	s_discSectors = sectors;
+	return 1;
+}
+
+/* Finds a file below root, matching every path component without regard to case. */
+static int ResolvePath(char* root, char* path, char* resolved, int size)
+{
+	char component[256];
+	struct dirent* entry;
+	DIR* dir;
+	int length, found;
+
+	snprintf(resolved, size, "%s", root);
+
+	while (*path != 0)
+	{
+		while (*path == '\\' || *path == '/')
+		{
+			path++;
+		}
+
+		for (length = 0; *path != 0 && *path != '\\' && *path != '/' && length < (int)sizeof(component) - 1; ++length)
+		{
+			component[length] = *path++;
+		}
+		component[length] = 0;
+
+		if (length == 0)
+		{
+			break;
+		}
+
+		dir = opendir(resolved);
+		if (dir == 0)
+		{
+			return 0;
+		}
+
+		found = 0;
+		while ((entry = readdir(dir)) != 0)
+		{
+			if (strcasecmp(entry->d_name, component) == 0)
+			{
+				length = (int)strlen(resolved);
+				snprintf(resolved + length, size - length, "/%s", entry->d_name);
+				found = 1;
+				break;
+			}
+		}
+
+		closedir(dir);
+		if (!found)
+		{
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+/* Appends a file to the pack which starts at the given sector. Returns 0 and prints the reason on failure. */
+static int AddPackFile(char* root, char* path, int packSector, int* packSectors)
+{
+	char resolved[1024];
+	u_char* toc = s_disc + (size_t)packSector * SECTOR_SIZE;
+	u_char* entry;
+	char* name;
+	FILE* file;
+	long size;
+	int count = toc[3];
+	int i, sectors, value;
+
+	if (count >= MAX_PCK_FILES)
+	{
+		fprintf(stderr, "%s: more than %d files in one pack\n", path, MAX_PCK_FILES);
+		return 0;
+	}
+
+	if (!ResolvePath(root, path, resolved, sizeof(resolved)) || (file = fopen(resolved, "rb")) == 0)
+	{
+		fprintf(stderr, "%s: not found below %s\n", path, root);
+		return 0;
+	}
+
+	fseek(file, 0, SEEK_END);
+	size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+
+	sectors = (int)((size + SECTOR_SIZE - 1) / SECTOR_SIZE);
+	if (!ReserveSectors(packSector + *packSectors + sectors))
+	{
+		fclose(file);
+		fprintf(stderr, "%s: out of memory\n", path);
+		return 0;
+	}
+
+	/* The TOC may have moved */
+	toc = s_disc + (size_t)packSector * SECTOR_SIZE;
+
+	if (fread(s_disc + (size_t)(packSector + *packSectors) * SECTOR_SIZE, 1, size, file) != (size_t)size)
+	{
+		fclose(file);
+		fprintf(stderr, "%s: read error\n", path);
+		return 0;
+	}
+
+	fclose(file);
+
+	/* Entry: Name[16] (upper case file name without directory), Size, Pos in sectors from the TOC */
+	name = strrchr(path, '\\') != 0 ? strrchr(path, '\\') + 1 : path;
+	name = strrchr(name, '/') != 0 ? strrchr(name, '/') + 1 : name;
+
+	entry = toc + 4 + count * (PCK_NAME_LENGTH + 8);
+	for (i = 0; i < PCK_NAME_LENGTH - 1 && name[i] != 0; ++i)
+	{
+		entry[i] = (u_char)toupper((u_char)name[i]);
+	}
+
+	value = (int)size;
+	memcpy(entry + PCK_NAME_LENGTH, &value, 4);
+	memcpy(entry + PCK_NAME_LENGTH + 4, packSectors, 4);
+
+	toc[3] = (u_char)(count + 1);
+	*packSectors += sectors;
+	return 1;
+}
+
+/* Returns the text between the first pair of quotes in the line. */
+static char* QuotedArgument(char* line)
+{
+	char* start = strchr(line, '"');
+	char* end;
+
+	if (start == 0 || (end = strchr(start + 1, '"')) == 0)
+	{
+		return 0;
+	}
+
+	*end = 0;
+	return start + 1;
+}
+
+int HostCdMount(char* script, char* root)
+{
+	char line[512];
+	char* p;
+	char* argument;
+	FILE* file;
+	DiscFile* pack = 0;
+	int packSectors = 0;
+	int lineNumber = 0;
+
+	file = fopen(script, "r");
+	if (file == 0)
+	{
+		fprintf(stderr, "%s: can't open\n", script);
+		return 0;
+	}
+
+	free(s_disc);
+	s_disc = 0;
+	s_discSectors = 0;
+
+	for (; s_xaCount > 0; --s_xaCount)
+	{
+		fclose(s_xaFiles[s_xaCount - 1].file);
+		free(s_xaFiles[s_xaCount - 1].subheaders);
+	}
+	s_fileCount = 0;
+
+	while (fgets(line, sizeof(line), file) != 0)
+	{
+		lineNumber++;
+
+		/* Comments start with a semicolon */
+		if ((p = strchr(line, ';')) != 0)
+		{
+			*p = 0;
+		}
+
+		for (p = line; isspace((u_char)*p); ++p)
+		{
+		}
+
+		if (*p == 0)
+		{
+			continue;
+		}
+
+		if (strncasecmp(p, "build,pck,", 10) == 0 && (argument = QuotedArgument(p)) != 0 && s_fileCount < MAX_DISC_FILES)
+		{
+			pack = &s_files[s_fileCount++];
+			snprintf(pack->name, sizeof(pack->name), "%s", argument);
+			pack->sector = s_discSectors > FIRST_FILE_SECTOR ? s_discSectors : FIRST_FILE_SECTOR;
+			packSectors = 1;
+
+			if (!ReserveSectors(pack->sector + 1))
+			{
+				break;
+			}
+
+			memcpy(s_disc + (size_t)pack->sector * SECTOR_SIZE, "PCK", 3);
+		}
+		else if (strncasecmp(p, "file,", 5) == 0 && pack != 0 && (argument = QuotedArgument(p)) != 0)
+		{
+			if (!AddPackFile(root, argument, pack->sector, &packSectors))
+			{
+				fclose(file);
+				return 0;
+			}
+		}
+		else if (strncasecmp(p, "endbuild", 8) == 0 && pack != 0)
+		{
+			pack->size = packSectors * SECTOR_SIZE;
+			pack = 0;
+		}
+		else
+		{
+			fprintf(stderr, "%s:%d: not understood\n", script, lineNumber);
+			fclose(file);
+			return 0;
+		}
+	}
+
+	fclose(file);
+
+	if (pack != 0 || s_fileCount == 0)
+	{
+		fprintf(stderr, "%s: no complete build block\n", script);
+		return 0;
+	}
+
+	return 1;
+}
+
+int HostCdAddXaFile(char* name, char* path)
+{
+	u_char subheader[XA_SUBHEADER_SIZE];
+	DiscFile* entry;
+	XaFile* xa;
+	FILE* file;
+	long size;
+	int i;
+
+	if (s_fileCount == MAX_DISC_FILES || s_xaCount == MAX_XA_FILES)
+	{
+		fprintf(stderr, "%s: too many files on the disc\n", path);
+		return 0;
+	}
+
+	file = fopen(path, "rb");
+	if (file == 0)
+	{
+		fprintf(stderr, "%s: can't open\n", path);
+		return 0;
+	}
+
+	fseek(file, 0, SEEK_END);
+	size = ftell(file);
+	if (size <= 0 || size % XA_SECTOR_SIZE != 0)
+	{
+		fprintf(stderr, "%s: not a whole number of XA sectors\n", path);
+		fclose(file);
+		return 0;
+	}
+
+	xa = &s_xaFiles[s_xaCount];
+	xa->sectors = (int)(size / XA_SECTOR_SIZE);
+	xa->subheaders = (u_char*)malloc((size_t)xa->sectors * 4);
+	if (xa->subheaders == 0)
+	{
+		fprintf(stderr, "%s: out of memory\n", path);
+		fclose(file);
+		return 0;
+	}
+
+	for (i = 0; i < xa->sectors; ++i)
+	{
+		fseek(file, (long)i * XA_SECTOR_SIZE, SEEK_SET);
+		if (fread(subheader, 1, sizeof(subheader), file) != sizeof(subheader))
+		{
+			fprintf(stderr, "%s: read error\n", path);
+			free(xa->subheaders);
+			fclose(file);
+			return 0;
+		}
+
+		memcpy(xa->subheaders + (size_t)i * 4, subheader, 4);
+	}
+
+	/* After the image and the XA files before */
+	xa->file = file;
+	xa->first = s_discSectors > FIRST_FILE_SECTOR ? s_discSectors : FIRST_FILE_SECTOR;
+	if (s_xaCount > 0 && xa->first < s_xaFiles[s_xaCount - 1].first + s_xaFiles[s_xaCount - 1].sectors)
+	{
+		xa->first = s_xaFiles[s_xaCount - 1].first + s_xaFiles[s_xaCount - 1].sectors;
+	}
+	s_xaCount++;
+
+	entry = &s_files[s_fileCount++];
+	snprintf(entry->name, sizeof(entry->name), "%s", name);
+	entry->sector = xa->first;
+	entry->size = xa->sectors * SECTOR_SIZE;
+	return 1;
+}
+
+/* Returns the XA file the sector belongs to, 0 if none. */
+static XaFile* FindXaFile(int sector)
+{
+	int i;
+
+	for (i = 0; i < s_xaCount; ++i)
+	{
+		if (sector >= s_xaFiles[i].first && sector < s_xaFiles[i].first + s_xaFiles[i].sectors)
+		{
+			return &s_xaFiles[i];
+		}
+	}
+
+	return 0;
+}
+
+/* Reads the data of a sector and its subheader. Sectors past the end of the disc read as zeros. */
+static void ReadSector(int sector, u_char* dest, u_char* subheader)
+{
+	XaFile* xa;
+
+	memset(subheader, 0, 4);
+
+	if (sector >= 0 && sector < s_discSectors)
+	{
+		memcpy(dest, s_disc + (size_t)sector * SECTOR_SIZE, SECTOR_SIZE);
+		return;
+	}
+
+	memset(dest, 0, SECTOR_SIZE);
+	if ((xa = FindXaFile(sector)) != 0)
+	{
+		memcpy(subheader, xa->subheaders + (size_t)(sector - xa->first) * 4, 4);
+
+		/* Only data sectors of form 1 have 2048 bytes which can be read, audio goes to the SPU */
+		if ((subheader[2] & (HOST_XA_AUDIO | HOST_XA_FORM2)) == 0)
+		{
+			fseek(xa->file, (long)(sector - xa->first) * XA_SECTOR_SIZE + XA_SUBHEADER_SIZE, SEEK_SET);
+			if (fread(dest, 1, SECTOR_SIZE, xa->file) != SECTOR_SIZE)
+			{
+				memset(dest, 0, SECTOR_SIZE);
+			}
+		}
+	}
+}
+
+/******************************************************/
+/* Streaming */
+
+/* Reserves room for a frame behind the newest one in the ring, or at its start. Returns the offset, -1 if it's full. */
+static long AllocateRingFrame(long size)
+{
+	RingFrame* first = &s_ringFrames[s_ringFirst];
+	RingFrame* last = &s_ringFrames[(s_ringFirst + s_ringCount - 1) % MAX_RING_FRAMES];
+	long end = last->offset + last->size;
+
+	if (s_ringCount == 0)
+	{
+		return size <= s_ringSize ? 0 : -1;
+	}
+
+	if (s_ringCount == MAX_RING_FRAMES)
+	{
+		return -1;
+	}
+
+	if (end > first->offset)
+	{
+		if (end + size <= s_ringSize)
+		{
+			return end;
+		}
+
+		return size <= first->offset ? 0 : -1;
+	}
+
+	return end + size <= first->offset ? end : -1;
+}
+
+/* Collects a sector of a movie frame in the ring. Frames which find no room are dropped. */
+static void RingSector(u_char* data)
+{
+	RingFrame* frame = s_ringCount > 0 ? &s_ringFrames[(s_ringFirst + s_ringCount - 1) % MAX_RING_FRAMES] : 0;
+	int index = data[4] | (data[5] << 8);
+	int sectors = data[6] | (data[7] << 8);
+	u_long number = data[8] | (data[9] << 8) | (data[10] << 16) | ((u_long)data[11] << 24);
+	long offset;
+
+	if (number < s_streamStart || number > s_streamEnd || index >= sectors)
+	{
+		return;
+	}
+
+	if (index == 0)
+	{
+		/* A frame which missed sectors makes room for the next */
+		if (frame != 0 && frame->state == RING_FILLING)
+		{
+			s_ringCount--;
+			HostCd.droppedFrames++;
+		}
+
+		/* The MDEC reads the bitstream a word ahead */
+		offset = AllocateRingFrame(ST_HEADER_SIZE + (long)sectors * ST_PAYLOAD + 4);
+		if (offset < 0)
+		{
+			HostCd.droppedFrames++;
+			return;
+		}
+
+		frame = &s_ringFrames[(s_ringFirst + s_ringCount++) % MAX_RING_FRAMES];
+		frame->offset = offset;
+		frame->size = ST_HEADER_SIZE + (long)sectors * ST_PAYLOAD + 4;
+		frame->frame = number;
+		frame->sectors = sectors;
+		frame->received = 0;
+		frame->state = RING_FILLING;
+		memcpy(s_ring + offset, data, ST_HEADER_SIZE);
+	}
+	else if (frame == 0 || frame->state != RING_FILLING || frame->frame != number || frame->sectors != sectors)
+	{
+		return;
+	}
+
+	memcpy(s_ring + frame->offset + ST_HEADER_SIZE + (long)index * ST_PAYLOAD, data + ST_HEADER_SIZE, ST_PAYLOAD);
+	if (++frame->received == frame->sectors)
+	{
+		frame->state = RING_READY;
+		HostCd.frames++;
+
+		if (s_frameCallback != 0)
+		{
+			s_frameCallback();
+		}
+	}
+}
+
+/* Sector times an XA-ADPCM sector with the given coding plays, at the current speed. */
+static long AudioTicks(u_char coding)
+{
+	/* 4 bit samples: 18 sound groups of 8 units of 28 samples, 8 bit ones have half as many */
+	long samples = (coding & 0x30) == 0 ? 18 * 8 * 28 : 18 * 4 * 28;
+	long rate = (coding & 0x0c) == 0 ? 37800 : 18900;
+	long speed = (s_mode & CdlModeSpeed) != 0 ? 2 * SECTORS_PER_SECOND : SECTORS_PER_SECOND;
+
+	if ((coding & 0x03) == 1)
+	{
+		samples /= 2;
+	}
+
+	return samples * speed / rate;
+}
+
+/* The drive reaches the next sector of a stream. */
+static void StreamSector()
+{
+	u_char subheader[4];
+	u_char result[8] = { 0 };
+	CdlLOC pos;
+	XaFile* xa;
+	int sector = s_position++;
+
+	if ((xa = FindXaFile(sector)) != 0)
+	{
+		memcpy(subheader, xa->subheaders + (size_t)(sector - xa->first) * 4, 4);
+	}
+	else
+	{
+		memset(subheader, 0, sizeof(subheader));
+	}
+
+	if ((subheader[2] & HOST_XA_AUDIO) != 0 && (s_mode & CdlModeRT) != 0)
+	{
+		if ((s_mode & CdlModeSF) != 0 && (subheader[0] != s_filter.file || subheader[1] != s_filter.chan))
+		{
+			return;
+		}
+
+		if (s_audioTick >= 0 && s_ticks - s_audioTick > AudioTicks(subheader[3]))
+		{
+			HostCd.underruns++;
+		}
+
+		s_audioTick = s_ticks;
+		HostCd.audioSectors++;
+		return;
+	}
+
+	/* Header (position and mode 2), subheader and data */
+	CdIntToPos(sector, &pos);
+	s_sector[0] = pos.minute;
+	s_sector[1] = pos.second;
+	s_sector[2] = pos.sector;
+	s_sector[3] = 2;
+	ReadSector(sector, s_sector + 12, s_sector + 4);
+	memcpy(s_sector + 8, s_sector + 4, 4);
+
+	s_sectorRead = (s_mode & CdlModeSize1) != 0 ? 0 : 12;
+	HostCd.dataSectors++;
+
+	if (s_ringStream && s_ring != 0 && (s_sector[12] | (s_sector[13] << 8)) == ST_SECTOR_ID)
+	{
+		RingSector(s_sector + 12);
+		return;
+	}
+
+	if (s_readyCallback != 0)
+	{
+		s_readyCallback(CdlDataReady, result);
+	}
+}
+
+/* Moves the drive on by the time of a vertical blank. */
+static void DriveVBlank()
+{
+	long speed = (s_mode & CdlModeSpeed) != 0 ? 2 * SECTORS_PER_SECOND : SECTORS_PER_SECOND;
+	long rate = GetVideoMode() == MODE_PAL ? 50 : 60;
+
+	for (s_tickRemainder += speed; s_tickRemainder >= rate; s_tickRemainder -= rate)
+	{
+		s_ticks++;
+		if (s_streaming)
+		{
+			StreamSector();
+		}
+	}
+}
+
+/******************************************************/
+/* libcd */
+
+int CdInit(void)
+{
+	s_position = 0;
+	s_readFailed = 0;
+	s_streaming = 0;
+	s_readyCallback = 0;
+	HostVSyncHook = DriveVBlank;
+	return 1;
+}
+
+int CdSetDebug(int level) { return 0; }
+
+CdlFILE* CdSearchFile(CdlFILE* fp, char* name)
+{
+	char wanted[PCK_NAME_LENGTH];
+	char* version;
+	int i;
+
+	/* "\NAME.EXT;1", only the root directory exists */
+	while (*name == '\\')
+	{
+		name++;
+	}
+
+	snprintf(wanted, sizeof(wanted), "%s", name);
+	if ((version = strchr(wanted, ';')) != 0)
+	{
+		*version = 0;
+	}
+
+	for (i = 0; i < s_fileCount; ++i)
+	{
+		if (strcasecmp(s_files[i].name, wanted) == 0)
+		{
+			CdIntToPos(s_files[i].sector, &fp->pos);
+			fp->size = s_files[i].size;
+			snprintf(fp->name, sizeof(fp->name), "%s;1", s_files[i].name);
+			return fp;
+		}
+	}
+
+	return 0;
+}
+
+int CdControl(u_char com, u_char* param, u_char* result)
+{
+	switch (com)
+	{
+	case CdlSetloc:
+		if (param != 0)
+		{
+			s_position = CdPosToInt((CdlLOC*)param);
+		}
+		break;
+	case CdlSetmode:
+		s_mode = *param;
+		break;
+	case CdlSetfilter:
+		/* Another channel starts where it is, that's no gap */
+		s_filter = *(CdlFILTER*)param;
+		s_audioTick = -1;
+		break;
+	case CdlReadS:
+		if (param != 0)
+		{
+			s_position = CdPosToInt((CdlLOC*)param);
+		}
+		s_streaming = 1;
+		s_ringStream = 0;
+		s_audioTick = -1;
+		HostCd.streams++;
+		break;
+	case CdlPause:
+	case CdlStop:
+		s_streaming = 0;
+		break;
+	}
+
+	return 1;
+}
+
+int CdControlB(u_char com, u_char* param, u_char* result)
+{
+	return CdControl(com, param, result);
+}
+
+int CdControlF(u_char com, u_char* param)
+{
+	return CdControl(com, param, 0);
+}
+
+CdlCB CdReadyCallback(CdlCB func)
+{
+	CdlCB old = s_readyCallback;
+
+	s_readyCallback = func;
+	return old;
+}
+
+int CdGetSector(void* madr, int size)
+{
+	size *= 4;
+	if (s_sectorRead + size > (int)sizeof(s_sector))
+	{
+		size = (int)sizeof(s_sector) - s_sectorRead;
+	}
+
+	memcpy(madr, s_sector + s_sectorRead, size);
+	s_sectorRead += size;
+	return 1;
+}
+
+int CdRead(int sectors, u_long* buf, int mode)
+{
+	u_char* dest = (u_char*)buf;
+	u_char subheader[4];
+
+	/* A read ends a stream, the drive seeks away */
+	s_streaming = 0;
+
+	/* A failed read leaves garbage in the buffer, which CdReadSync reports */
+	s_readFailed = HostCdErrorEvery > 0 && ++s_reads % HostCdErrorEvery == 0;
+	if (s_readFailed)
+	{
+		memset(dest, 0xff, (size_t)sectors * SECTOR_SIZE);
+		s_position += sectors;
+		return 1;
+	}
+
+	for (; sectors > 0; --sectors, ++s_position, dest += SECTOR_SIZE)
+	{
+		ReadSector(s_position, dest, subheader);
+	}
+
+	return 1;
+}
+
+int CdReadSync(int mode, u_char* result)
+{
+	return s_readFailed ? -1 : 0;
+}
+
+int CdRead2(long mode)
+{
+	s_mode = (u_char)mode;
+	s_streaming = 1;
+	s_ringStream = (mode & CdlModeStream) != 0;
+	s_audioTick = -1;
+	HostCd.streams++;
+	StClearRing();
+	return 1;
+}
+
+/******************************************************/
+/* Streaming library */
+
+void StSetRing(u_long* ring_addr, u_long ring_size)
+{
+	s_ring = (u_char*)ring_addr;
+	s_ringSize = (long)ring_size * SECTOR_SIZE;
+	StClearRing();
+}
+
+void StSetStream(u_long mode, u_long start_frame, u_long end_frame, void (*func1)(), void (*func2)())
+{
+	s_streamStart = start_frame;
+	s_streamEnd = end_frame;
+	s_frameCallback = func1;
+}
+
+void StClearRing(void)
+{
+	s_ringFirst = 0;
+	s_ringCount = 0;
+}
+
+void StUnSetRing(void)
+{
+	s_ring = 0;
+	s_ringStream = 0;
+	StClearRing();
+}
+
+u_long StGetNext(u_long** addr, u_long** header)
+{
+	RingFrame* frame;
+	int i;
+
+	/* Frames come out in the order they were read */
+	for (i = 0; i < s_ringCount; ++i)
+	{
+		frame = &s_ringFrames[(s_ringFirst + i) % MAX_RING_FRAMES];
+		if (frame->state == RING_FILLING)
+		{
+			break;
+		}
+
+		if (frame->state == RING_READY)
+		{
+			frame->state = RING_TAKEN;
+			*header = (u_long*)(s_ring + frame->offset);
+			*addr = (u_long*)(s_ring + frame->offset + ST_HEADER_SIZE);
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+u_long StFreeRing(u_long* base)
+{
+	RingFrame* frame;
+	int i;
+
+	for (i = 0; i < s_ringCount; ++i)
+	{
+		frame = &s_ringFrames[(s_ringFirst + i) % MAX_RING_FRAMES];
+		if (frame->state == RING_TAKEN && (u_char*)base == s_ring + frame->offset + ST_HEADER_SIZE)
+		{
+			frame->state = RING_FREE;
+
+			/* The room of the oldest frames can be used again */
+			while (s_ringCount > 0 && s_ringFrames[s_ringFirst].state == RING_FREE)
+			{
+				s_ringFirst = (s_ringFirst + 1) % MAX_RING_FRAMES;
+				s_ringCount--;
+			}
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+static u_char ToBcd(int value)
+{
+	return (u_char)(((value / 10) << 4) | (value % 10));
+}
+
+static int FromBcd(u_char value)
+{
+	return (value >> 4) * 10 + (value & 15);
+}
+
+CdlLOC* CdIntToPos(int i, CdlLOC* p)
+{
+	/* Sector 0 is 00:02:00, after the two second lead-in */
+	i += 150;
+
+	p->minute = ToBcd(i / (75 * 60));
+	p->second = ToBcd((i / 75) % 60);
+	p->sector = ToBcd(i % 75);
+	p->track = 0;
+	return p;
+}
+
+int CdPosToInt(CdlLOC* p)
+{
+	return (FromBcd(p->minute) * 60 + FromBcd(p->second)) * 75 + FromBcd(p->sector) - 150;
+}
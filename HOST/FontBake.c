@@ -0,0 +1,315 @@
+/*
+ * Bakes a font sheet (TIM) and its glyph metrics (AngelCode BMFont text format, as
+ * written by BMFont and most other font tools) into a font file for the engine.
+ *
+ * The texture page, CLUT and u/v of every glyph are computed here for the VRAM position
+ * stored in the TIM, so the game does not do any per glyph math when drawing text.
+ * Several fonts, e.g. sizes of the same face, can share one sheet: only one of them has
+ * to embed it, the others are baked with -n.
+ *
+ * Usage: fontbake [-s spacing] [-n] -o output.fnt sheet.tim metrics.fnt
+ */
+
+#include <sys/types.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "Font.h"
+
+/* Maximum size of a TIM file the tool accepts. */
+#define MAX_TIM_SIZE (1024 * 1024)
+
+/* The parts of a TIM header needed to place glyphs in VRAM. */
+typedef struct
+{
+	int colorMode;
+	int hasClut;
+	int cx, cy;
+	int px, py, pw, ph;
+} TimInfo;
+
+static u_char s_tim[MAX_TIM_SIZE];
+static long s_timSize;
+
+static u_char s_index[256];
+static FontGlyph s_glyphs[256];
+static int s_glyphCount = 0;
+static int s_lineHeight = 0;
+
+static u_long ReadLong(u_char* p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((u_long)p[3] << 24);
+}
+
+static u_short ReadShort(u_char* p)
+{
+	return (u_short)(p[0] | (p[1] << 8));
+}
+
+/* Returns the value of key=value in the given line, or the default if the key is missing. */
+static int GetValue(char* line, char* key, int def)
+{
+	char pattern[32];
+	char* p;
+
+	snprintf(pattern, sizeof(pattern), " %s=", key);
+	p = strstr(line, pattern);
+	if (p == 0)
+	{
+		return def;
+	}
+
+	return atoi(p + strlen(pattern));
+}
+
+static int ReadTim(char* filename, TimInfo* tim)
+{
+	FILE* file;
+	long offset = 8;
+	u_long flags;
+
+	file = fopen(filename, "rb");
+	if (file == 0)
+	{
+		fprintf(stderr, "%s: can't open\n", filename);
+		return 0;
+	}
+
+	s_timSize = (long)fread(s_tim, 1, sizeof(s_tim), file);
+	fclose(file);
+
+	if (s_timSize < 20 || ReadLong(s_tim) != 0x10)
+	{
+		fprintf(stderr, "%s: not a TIM file\n", filename);
+		return 0;
+	}
+
+	flags = ReadLong(s_tim + 4);
+	tim->colorMode = flags & 7;
+	tim->hasClut = (flags >> 3) & 1;
+	tim->cx = tim->cy = 0;
+
+	if (tim->colorMode > 2)
+	{
+		fprintf(stderr, "%s: only 4, 8 and 16 bit sheets are supported\n", filename);
+		return 0;
+	}
+
+	if (tim->hasClut)
+	{
+		tim->cx = ReadShort(s_tim + offset + 4);
+		tim->cy = ReadShort(s_tim + offset + 6);
+		offset += ReadLong(s_tim + offset);
+	}
+
+	if (offset + 12 > s_timSize)
+	{
+		fprintf(stderr, "%s: truncated\n", filename);
+		return 0;
+	}
+
+	tim->px = ReadShort(s_tim + offset + 4);
+	tim->py = ReadShort(s_tim + offset + 6);
+	tim->pw = ReadShort(s_tim + offset + 8);
+	tim->ph = ReadShort(s_tim + offset + 10);
+	return 1;
+}
+
+/* Places a glyph at sheet position (x, y) into the texture page which contains its left edge. */
+static int PlaceGlyph(TimInfo* tim, int id, int x, int y, int w, int h, FontGlyph* glyph)
+{
+	/* Texels per VRAM pixel */
+	int texels = 4 >> tim->colorMode;
+	int column = tim->px * texels + x;
+	int pageX = (column / texels) & ~63;
+	int pageY = (tim->py + y) & ~255;
+	int u = column - pageX * texels;
+	int v = tim->py + y - pageY;
+
+	if (x < 0 || y < 0 || x + w > tim->pw * texels || y + h > tim->ph)
+	{
+		fprintf(stderr, "glyph %d is outside of the sheet\n", id);
+		return 0;
+	}
+
+	if (u + w > 256 || v + h > 256)
+	{
+		fprintf(stderr, "glyph %d crosses a texture page border\n", id);
+		return 0;
+	}
+
+	/* GetTPage(colorMode, 0, pageX, pageY) */
+	glyph->tpage = (u_short)((tim->colorMode << 7) | ((pageY & 0x100) >> 4) | ((pageX & 0x3ff) >> 6));
+	glyph->cx = (u_short)tim->cx;
+	glyph->cy = (u_short)tim->cy;
+	glyph->u = (u_char)u;
+	glyph->v = (u_char)v;
+	glyph->w = (u_char)w;
+	glyph->h = (u_char)h;
+	return 1;
+}
+
+static int ReadMetrics(char* filename, TimInfo* tim, int spacing)
+{
+	FILE* file;
+	char line[512];
+	FontGlyph* glyph;
+	int id, lineNumber = 0;
+
+	file = fopen(filename, "r");
+	if (file == 0)
+	{
+		fprintf(stderr, "%s: can't open\n", filename);
+		return 0;
+	}
+
+	memset(s_index, FONT_NO_GLYPH, sizeof(s_index));
+
+	while (fgets(line, sizeof(line), file) != 0)
+	{
+		lineNumber++;
+
+		if (strncmp(line, "common ", 7) == 0)
+		{
+			s_lineHeight = GetValue(line, "lineHeight", 0);
+			continue;
+		}
+
+		if (strncmp(line, "char ", 5) != 0)
+		{
+			continue;
+		}
+
+		id = GetValue(line, "id", -1);
+		if (id < 0 || id > 255)
+		{
+			/* Only 8 bit characters can be drawn, everything else is left out. */
+			continue;
+		}
+
+		if (s_index[id] != FONT_NO_GLYPH || s_glyphCount >= FONT_NO_GLYPH)
+		{
+			fprintf(stderr, "%s:%d: duplicate character or too many glyphs\n", filename, lineNumber);
+			fclose(file);
+			return 0;
+		}
+
+		glyph = &s_glyphs[s_glyphCount];
+		if (!PlaceGlyph(tim, id, GetValue(line, "x", 0), GetValue(line, "y", 0),
+			GetValue(line, "width", 0), GetValue(line, "height", 0), glyph))
+		{
+			fclose(file);
+			return 0;
+		}
+
+		glyph->xoffset = (char)GetValue(line, "xoffset", 0);
+		glyph->yoffset = (char)GetValue(line, "yoffset", 0);
+		glyph->advance = (u_char)(GetValue(line, "xadvance", 0) + spacing);
+		glyph->reserved = 0;
+
+		s_index[id] = (u_char)s_glyphCount++;
+	}
+
+	fclose(file);
+
+	if (s_glyphCount == 0)
+	{
+		fprintf(stderr, "%s: no glyphs found\n", filename);
+		return 0;
+	}
+
+	return 1;
+}
+
+static int WriteFont(char* filename, TimInfo* tim, int embedSheet)
+{
+	FILE* file;
+	FontHeader header;
+	static const u_char padding[4] = { 0 };
+	long offset;
+
+	offset = sizeof(FontHeader) + sizeof(s_index) + s_glyphCount * sizeof(FontGlyph);
+
+	memset(&header, 0, sizeof(header));
+	header.id = FONT_ID;
+	header.version = FONT_VERSION;
+	header.glyphCount = (u_short)s_glyphCount;
+	header.colorMode = (u_char)tim->colorMode;
+	header.lineHeight = (u_char)s_lineHeight;
+	header.timSize = embedSheet ? (u_long)s_timSize : 0;
+	/* The TIM is read as words */
+	header.timOffset = embedSheet ? (u_long)((offset + 3) & ~3) : 0;
+
+	file = fopen(filename, "wb");
+	if (file == 0)
+	{
+		fprintf(stderr, "%s: can't create\n", filename);
+		return 0;
+	}
+
+	fwrite(&header, sizeof(header), 1, file);
+	fwrite(s_index, sizeof(s_index), 1, file);
+	fwrite(s_glyphs, sizeof(FontGlyph), s_glyphCount, file);
+
+	if (embedSheet)
+	{
+		fwrite(padding, 1, header.timOffset - offset, file);
+		fwrite(s_tim, 1, s_timSize, file);
+	}
+
+	if (fclose(file) != 0)
+	{
+		fprintf(stderr, "%s: write error\n", filename);
+		return 0;
+	}
+
+	return 1;
+}
+
+static void Usage()
+{
+	fprintf(stderr,
+		"usage: fontbake [-s spacing] [-n] -o output.fnt sheet.tim metrics.fnt\n"
+		"  -s  extra pixels added to the advance of every glyph (default 0)\n"
+		"  -n  don't embed the sheet, another font brings it into VRAM\n");
+	exit(2);
+}
+
+int main(int argc, char** argv)
+{
+	TimInfo tim;
+	char* output = 0;
+	int spacing = 0;
+	int embedSheet = 1;
+	int option;
+
+	while ((option = getopt(argc, argv, "s:no:")) != -1)
+	{
+		switch (option)
+		{
+		case 's': spacing = atoi(optarg); break;
+		case 'n': embedSheet = 0; break;
+		case 'o': output = optarg; break;
+		default: Usage();
+		}
+	}
+
+	if (output == 0 || argc - optind != 2)
+	{
+		Usage();
+	}
+
+	if (!ReadTim(argv[optind], &tim) ||
+		!ReadMetrics(argv[optind + 1], &tim, spacing) ||
+		!WriteFont(output, &tim, embedSheet))
+	{
+		return 1;
+	}
+
+	printf("%s: %d glyphs, %d bit sheet at (%d,%d)%s\n", output, s_glyphCount, 4 << tim.colorMode,
+		tim.px, tim.py, embedSheet ? "" : ", sheet not embedded");
+	return 0;
+}
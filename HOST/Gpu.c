@@ -0,0 +1,1002 @@
+/*
+ * Host implementation of libgpu: a software GPU which executes the same order tables and
+ * primitive packets as the console's GPU and draws them into an in-memory VRAM.
+ *
+ * The rasteriser follows the rules of the hardware where they matter for the picture:
+ * 11 bit signed vertex coordinates plus the drawing offset, polygons larger than
+ * 1023x511 are skipped, triangles are filled with the top-left rule (right and bottom
+ * edges are not drawn), colors are converted to 15 bits with the 4x4 dither matrix
+ * when dithering is on, texel 0 is transparent, semi transparency uses the four
+ * blend modes and the mask bit settings are honoured. Attributes are interpolated with
+ * 16.16 fixed point plane equations, which gets within one step of the console's
+ * per-span interpolation but is not guaranteed to match it bit for bit.
+ */
+
+#include <sys/types.h>
+#include <libgpu.h>
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+/* Maximum number of entries DrawOTag walks before it assumes the list loops. */
+#define MAX_OT_ENTRIES	(1024 * 1024)
+
+/* Terminator of a polyline. */
+#define POLYLINE_END	0x50005000
+#define POLYLINE_MASK	0xf000f000
+
+u_short HostVram[HOST_VRAM_HEIGHT][HOST_VRAM_WIDTH];
+HostGpuStats HostGpu;
+DISPENV HostDisplay;
+int HostDisplayEnabled = 0;
+int HostFntFlushCount = 0;
+
+const char* HostPrimNames[HOST_PRIM_TYPES] =
+{
+	"F3", "FT3", "G3", "GT3", "F4", "FT4", "G4", "GT4", "LINE", "TILE", "SPRT", "FILL", "MODE"
+};
+
+/* Drawing state, as set by the E1 - E6 commands. */
+static struct
+{
+	/* Texture page, semi transparency and color mode bits of E1 */
+	u_long texpage;
+	int dither;
+	/* Drawing area, inclusive */
+	int clipX0, clipY0, clipX1, clipY1;
+	int offsetX, offsetY;
+	/* Texture window in 8 texel steps */
+	int windowMaskX, windowMaskY, windowOffsetX, windowOffsetY;
+	u_short setMask;
+	int checkMask;
+} s_gpu;
+
+/* Everything the pixel loops need to know about the primitive being drawn. */
+typedef struct
+{
+	int gouraud;
+	int textured;
+	int semi;
+	int raw;
+	int dither;
+	int abr;
+	/* Texture page origin and color mode, CLUT position */
+	int tx, ty, mode;
+	int cx, cy;
+} PrimState;
+
+typedef struct
+{
+	int x, y;
+	int r, g, b;
+	int u, v;
+} GpuVertex;
+
+static const int s_ditherMatrix[4][4] =
+{
+	{ -4,  0, -3,  1 },
+	{  2, -2,  3, -1 },
+	{ -3,  1, -4,  0 },
+	{  3, -1,  2, -2 }
+};
+
+/* The debug font only collects text, see FntFlush. */
+static char s_fontText[1024];
+static int s_fontLength = 0;
+
+/******************************************************/
+/* Pixels */
+
+static int Clamp(int value, int low, int high)
+{
+	return value < low ? low : (value > high ? high : value);
+}
+
+/* Sign extends an 11 bit vertex coordinate. */
+static int Coordinate(u_long value)
+{
+	return ((int)(value << 21)) >> 21;
+}
+
+static u_short Blend(u_short back, u_short front, int abr)
+{
+	int i, b, f, c;
+	u_short result = 0;
+
+	for (i = 0; i < 15; i += 5)
+	{
+		b = (back >> i) & 31;
+		f = (front >> i) & 31;
+
+		switch (abr)
+		{
+		case 0: c = (b + f) >> 1; break;
+		case 1: c = b + f; break;
+		case 2: c = b - f; break;
+		default: c = b + (f >> 2); break;
+		}
+
+		result |= (u_short)(Clamp(c, 0, 31) << i);
+	}
+
+	return result;
+}
+
+static void WritePixel(int x, int y, u_short color, int semi, int abr)
+{
+	u_short* dest = &HostVram[y][x];
+
+	if (s_gpu.checkMask && (*dest & 0x8000))
+	{
+		return;
+	}
+
+	if (semi)
+	{
+		color = Blend(*dest, color, abr) | (color & 0x8000);
+	}
+
+	*dest = color | s_gpu.setMask;
+	HostGpu.pixels++;
+}
+
+/* Converts an 8 bit per channel color to 15 bits, dithered if requested. */
+static u_short Pack(int r, int g, int b, int x, int y, int dither)
+{
+	int d;
+
+	if (dither)
+	{
+		d = s_ditherMatrix[y & 3][x & 3];
+		r = Clamp(r + d, 0, 255);
+		g = Clamp(g + d, 0, 255);
+		b = Clamp(b + d, 0, 255);
+	}
+
+	return (u_short)((r >> 3) | ((g >> 3) << 5) | ((b >> 3) << 10));
+}
+
+static void SetupTexture(PrimState* state, u_long texpage, u_long clut)
+{
+	state->tx = (texpage & 0xf) * 64;
+	state->ty = ((texpage >> 4) & 1) * 256;
+	state->mode = (texpage >> 7) & 3;
+	state->cx = (clut & 0x3f) * 16;
+	state->cy = (clut >> 6) & 0x1ff;
+}
+
+static u_short FetchTexel(PrimState* state, int u, int v)
+{
+	u_short word;
+	int index;
+
+	u = ((u & ~(s_gpu.windowMaskX * 8)) | ((s_gpu.windowOffsetX & s_gpu.windowMaskX) * 8)) & 0xff;
+	v = ((v & ~(s_gpu.windowMaskY * 8)) | ((s_gpu.windowOffsetY & s_gpu.windowMaskY) * 8)) & 0xff;
+
+	HostGpu.texels++;
+
+	switch (state->mode)
+	{
+	case 0:
+		word = HostVram[(state->ty + v) & 511][(state->tx + (u >> 2)) & 1023];
+		index = (word >> ((u & 3) * 4)) & 0xf;
+		return HostVram[state->cy][(state->cx + index) & 1023];
+
+	case 1:
+		word = HostVram[(state->ty + v) & 511][(state->tx + (u >> 1)) & 1023];
+		index = (word >> ((u & 1) * 8)) & 0xff;
+		return HostVram[state->cy][(state->cx + index) & 1023];
+
+	default:
+		return HostVram[(state->ty + v) & 511][(state->tx + u) & 1023];
+	}
+}
+
+/* Shades and writes one pixel of a polygon, sprite or line with 8 bit color and texture coordinates. */
+static void ShadePixel(PrimState* state, int x, int y, int r, int g, int b, int u, int v)
+{
+	u_short texel, color;
+
+	if (!state->textured)
+	{
+		WritePixel(x, y, Pack(r, g, b, x, y, state->dither), state->semi, state->abr);
+		return;
+	}
+
+	texel = FetchTexel(state, u, v);
+	if (texel == 0)
+	{
+		return;
+	}
+
+	if (state->raw)
+	{
+		color = texel;
+	}
+	else
+	{
+		color = Pack(Clamp(((texel & 31) * r) >> 4, 0, 255), Clamp((((texel >> 5) & 31) * g) >> 4, 0, 255),
+			Clamp((((texel >> 10) & 31) * b) >> 4, 0, 255), x, y, state->dither) | (texel & 0x8000);
+	}
+
+	/* Only texels with the STP bit set are blended. */
+	WritePixel(x, y, color, state->semi && (texel & 0x8000), state->abr);
+}
+
+/******************************************************/
+/* Polygons */
+
+/* Plane equation of a vertex attribute in 16.16 fixed point. */
+typedef struct
+{
+	int64_t base, dx, dy;
+} Gradient;
+
+static void SetupGradient(Gradient* gradient, GpuVertex* a, GpuVertex* b, GpuVertex* c, int va, int vb, int vc, int64_t area)
+{
+	int64_t db = vb - va, dc = vc - va;
+
+	gradient->dx = ((db * (c->y - a->y) - dc * (b->y - a->y)) << 16) / area;
+	gradient->dy = ((dc * (b->x - a->x) - db * (c->x - a->x)) << 16) / area;
+	gradient->base = ((int64_t)va << 16) + 0x8000;
+}
+
+static int Interpolate(Gradient* gradient, int x, int y)
+{
+	return (int)((gradient->base + gradient->dx * x + gradient->dy * y) >> 16);
+}
+
+/* An edge a -> b includes the pixels exactly on it if it is a top or a left edge. */
+static int EdgeBias(GpuVertex* a, GpuVertex* b)
+{
+	int dx = b->x - a->x, dy = b->y - a->y;
+	return (dy < 0 || (dy == 0 && dx > 0)) ? 0 : -1;
+}
+
+static void DrawTriangle(PrimState* state, GpuVertex* a, GpuVertex* b, GpuVertex* c)
+{
+	GpuVertex* t;
+	Gradient gr, gg, gb, gu, gv;
+	int64_t area;
+	int minX, maxX, minY, maxY;
+	int x, y, w0, w1, w2, e0, e1, e2;
+	int r, g, bl, u, v;
+
+	area = (int64_t)(b->x - a->x) * (c->y - a->y) - (int64_t)(b->y - a->y) * (c->x - a->x);
+	if (area == 0)
+	{
+		return;
+	}
+
+	/* The GPU draws both windings */
+	if (area < 0)
+	{
+		t = b; b = c; c = t;
+		area = -area;
+	}
+
+	minX = a->x < b->x ? (a->x < c->x ? a->x : c->x) : (b->x < c->x ? b->x : c->x);
+	maxX = a->x > b->x ? (a->x > c->x ? a->x : c->x) : (b->x > c->x ? b->x : c->x);
+	minY = a->y < b->y ? (a->y < c->y ? a->y : c->y) : (b->y < c->y ? b->y : c->y);
+	maxY = a->y > b->y ? (a->y > c->y ? a->y : c->y) : (b->y > c->y ? b->y : c->y);
+
+	if (maxX - minX >= 1024 || maxY - minY >= 512)
+	{
+		HostGpu.rejected++;
+		return;
+	}
+
+	minX = minX > s_gpu.clipX0 ? minX : s_gpu.clipX0;
+	minY = minY > s_gpu.clipY0 ? minY : s_gpu.clipY0;
+	maxX = maxX < s_gpu.clipX1 ? maxX : s_gpu.clipX1;
+	maxY = maxY < s_gpu.clipY1 ? maxY : s_gpu.clipY1;
+	if (minX > maxX || minY > maxY)
+	{
+		return;
+	}
+
+	SetupGradient(&gr, a, b, c, a->r, b->r, c->r, area);
+	SetupGradient(&gg, a, b, c, a->g, b->g, c->g, area);
+	SetupGradient(&gb, a, b, c, a->b, b->b, c->b, area);
+	SetupGradient(&gu, a, b, c, a->u, b->u, c->u, area);
+	SetupGradient(&gv, a, b, c, a->v, b->v, c->v, area);
+
+	/* Edge functions at the first pixel, positive inside */
+	e0 = (b->x - a->x) * (minY - a->y) - (b->y - a->y) * (minX - a->x) + EdgeBias(a, b);
+	e1 = (c->x - b->x) * (minY - b->y) - (c->y - b->y) * (minX - b->x) + EdgeBias(b, c);
+	e2 = (a->x - c->x) * (minY - c->y) - (a->y - c->y) * (minX - c->x) + EdgeBias(c, a);
+
+	r = a->r; g = a->g; bl = a->b;
+	u = v = 0;
+
+	for (y = minY; y <= maxY; ++y)
+	{
+		w0 = e0; w1 = e1; w2 = e2;
+
+		for (x = minX; x <= maxX; ++x)
+		{
+			if ((w0 | w1 | w2) >= 0)
+			{
+				if (state->gouraud)
+				{
+					r = Clamp(Interpolate(&gr, x - a->x, y - a->y), 0, 255);
+					g = Clamp(Interpolate(&gg, x - a->x, y - a->y), 0, 255);
+					bl = Clamp(Interpolate(&gb, x - a->x, y - a->y), 0, 255);
+				}
+
+				if (state->textured)
+				{
+					u = Interpolate(&gu, x - a->x, y - a->y);
+					v = Interpolate(&gv, x - a->x, y - a->y);
+				}
+
+				ShadePixel(state, x, y, r, g, bl, u, v);
+			}
+
+			w0 -= b->y - a->y;
+			w1 -= c->y - b->y;
+			w2 -= a->y - c->y;
+		}
+
+		e0 += b->x - a->x;
+		e1 += c->x - b->x;
+		e2 += a->x - c->x;
+	}
+}
+
+/* Executes a polygon command, returns the number of words it takes. */
+static int DrawPolygon(u_long* words)
+{
+	static const int kinds[8] =
+	{
+		HOST_PRIM_F3, HOST_PRIM_FT3, HOST_PRIM_F4, HOST_PRIM_FT4,
+		HOST_PRIM_G3, HOST_PRIM_GT3, HOST_PRIM_G4, HOST_PRIM_GT4
+	};
+
+	u_long code = words[0] >> 24;
+	u_long* p = words;
+	u_long word, clut = 0, texpage = s_gpu.texpage;
+	PrimState state;
+	GpuVertex v[4];
+	int i, count;
+
+	state.gouraud = (code & 0x10) != 0;
+	state.textured = (code & 0x04) != 0;
+	state.semi = (code & 0x02) != 0;
+	state.raw = (code & 0x01) != 0;
+	count = (code & 0x08) ? 4 : 3;
+
+	for (i = 0; i < count; ++i)
+	{
+		if (i == 0 || state.gouraud)
+		{
+			word = *p++;
+			v[i].r = word & 0xff;
+			v[i].g = (word >> 8) & 0xff;
+			v[i].b = (word >> 16) & 0xff;
+		}
+		else
+		{
+			v[i].r = v[0].r;
+			v[i].g = v[0].g;
+			v[i].b = v[0].b;
+		}
+
+		word = *p++;
+		v[i].x = Coordinate(word) + s_gpu.offsetX;
+		v[i].y = Coordinate(word >> 16) + s_gpu.offsetY;
+		v[i].u = v[i].v = 0;
+
+		if (state.textured)
+		{
+			word = *p++;
+			v[i].u = word & 0xff;
+			v[i].v = (word >> 8) & 0xff;
+
+			if (i == 0)
+			{
+				clut = word >> 16;
+			}
+			else if (i == 1)
+			{
+				texpage = (word >> 16) & 0x1ff;
+			}
+		}
+	}
+
+	/* The texture page of a polygon stays selected for the following primitives. */
+	if (state.textured)
+	{
+		s_gpu.texpage = (s_gpu.texpage & ~0x1ff) | texpage;
+		SetupTexture(&state, texpage, clut);
+	}
+
+	state.abr = (s_gpu.texpage >> 5) & 3;
+	state.dither = s_gpu.dither && (state.gouraud || (state.textured && !state.raw));
+
+	HostGpu.prims[kinds[(state.gouraud ? 4 : 0) + (count == 4 ? 2 : 0) + (state.textured ? 1 : 0)]]++;
+
+	DrawTriangle(&state, &v[0], &v[1], &v[2]);
+	if (count == 4)
+	{
+		DrawTriangle(&state, &v[1], &v[2], &v[3]);
+	}
+
+	return (int)(p - words);
+}
+
+/******************************************************/
+/* Lines, rectangles and fills */
+
+static void DrawLine(PrimState* state, GpuVertex* a, GpuVertex* b)
+{
+	int dx = b->x - a->x, dy = b->y - a->y;
+	int steps, i, x, y, r, g, bl;
+
+	if (dx >= 1024 || -dx >= 1024 || dy >= 512 || -dy >= 512)
+	{
+		HostGpu.rejected++;
+		return;
+	}
+
+	steps = (dx < 0 ? -dx : dx) > (dy < 0 ? -dy : dy) ? (dx < 0 ? -dx : dx) : (dy < 0 ? -dy : dy);
+
+	for (i = 0; i <= steps; ++i)
+	{
+		/* Bresenham style rounding of the major and minor axis */
+		x = a->x + (steps ? (dx * i * 2 + (dx < 0 ? -steps : steps)) / (2 * steps) : 0);
+		y = a->y + (steps ? (dy * i * 2 + (dy < 0 ? -steps : steps)) / (2 * steps) : 0);
+
+		if (x < s_gpu.clipX0 || x > s_gpu.clipX1 || y < s_gpu.clipY0 || y > s_gpu.clipY1)
+		{
+			continue;
+		}
+
+		r = a->r; g = a->g; bl = a->b;
+		if (state->gouraud && steps)
+		{
+			r = a->r + (b->r - a->r) * i / steps;
+			g = a->g + (b->g - a->g) * i / steps;
+			bl = a->b + (b->b - a->b) * i / steps;
+		}
+
+		ShadePixel(state, x, y, r, g, bl, 0, 0);
+	}
+}
+
+static int DrawLines(u_long* words, int available)
+{
+	u_long code = words[0] >> 24;
+	u_long* p = words;
+	int polyline = (code & 0x08) != 0;
+	PrimState state;
+	GpuVertex v[2];
+	u_long word;
+
+	memset(&state, 0, sizeof(state));
+	state.gouraud = (code & 0x10) != 0;
+	state.semi = (code & 0x02) != 0;
+	state.abr = (s_gpu.texpage >> 5) & 3;
+	state.dither = s_gpu.dither && state.gouraud;
+
+	word = *p++;
+	v[0].r = v[1].r = word & 0xff;
+	v[0].g = v[1].g = (word >> 8) & 0xff;
+	v[0].b = v[1].b = (word >> 16) & 0xff;
+
+	word = *p++;
+	v[0].x = Coordinate(word) + s_gpu.offsetX;
+	v[0].y = Coordinate(word >> 16) + s_gpu.offsetY;
+
+	while (p - words < available)
+	{
+		word = *p++;
+		if (polyline && (word & POLYLINE_MASK) == POLYLINE_END)
+		{
+			break;
+		}
+
+		if (state.gouraud)
+		{
+			v[1].r = word & 0xff;
+			v[1].g = (word >> 8) & 0xff;
+			v[1].b = (word >> 16) & 0xff;
+
+			if (p - words >= available)
+			{
+				break;
+			}
+
+			word = *p++;
+		}
+
+		v[1].x = Coordinate(word) + s_gpu.offsetX;
+		v[1].y = Coordinate(word >> 16) + s_gpu.offsetY;
+
+		HostGpu.prims[HOST_PRIM_LINE]++;
+		DrawLine(&state, &v[0], &v[1]);
+		v[0] = v[1];
+
+		if (!polyline)
+		{
+			break;
+		}
+	}
+
+	return (int)(p - words);
+}
+
+/* Executes a rectangle (tile or sprite) command, returns the number of words it takes. */
+static int DrawRectangle(u_long* words)
+{
+	static const int sizes[4] = { 0, 1, 8, 16 };
+
+	u_long code = words[0] >> 24;
+	u_long* p = words;
+	PrimState state;
+	u_long word;
+	int r, g, b, x0, y0, w, h, u0 = 0, v0 = 0;
+	int x, y, left, right, top, bottom;
+
+	memset(&state, 0, sizeof(state));
+	state.textured = (code & 0x04) != 0;
+	state.semi = (code & 0x02) != 0;
+	state.raw = (code & 0x01) != 0;
+	state.abr = (s_gpu.texpage >> 5) & 3;
+
+	word = *p++;
+	r = word & 0xff;
+	g = (word >> 8) & 0xff;
+	b = (word >> 16) & 0xff;
+
+	word = *p++;
+	x0 = Coordinate(word) + s_gpu.offsetX;
+	y0 = Coordinate(word >> 16) + s_gpu.offsetY;
+
+	if (state.textured)
+	{
+		word = *p++;
+		u0 = word & 0xff;
+		v0 = (word >> 8) & 0xff;
+		SetupTexture(&state, s_gpu.texpage, word >> 16);
+	}
+
+	w = h = sizes[(code >> 3) & 3];
+	if (w == 0)
+	{
+		word = *p++;
+		w = word & 0x3ff;
+		h = (word >> 16) & 0x1ff;
+	}
+
+	HostGpu.prims[state.textured ? HOST_PRIM_SPRT : HOST_PRIM_TILE]++;
+
+	left = x0 > s_gpu.clipX0 ? x0 : s_gpu.clipX0;
+	top = y0 > s_gpu.clipY0 ? y0 : s_gpu.clipY0;
+	right = x0 + w - 1 < s_gpu.clipX1 ? x0 + w - 1 : s_gpu.clipX1;
+	bottom = y0 + h - 1 < s_gpu.clipY1 ? y0 + h - 1 : s_gpu.clipY1;
+
+	/* Sprites are never dithered */
+	for (y = top; y <= bottom; ++y)
+	{
+		for (x = left; x <= right; ++x)
+		{
+			ShadePixel(&state, x, y, r, g, b, u0 + x - x0, v0 + y - y0);
+		}
+	}
+
+	return (int)(p - words);
+}
+
+/* Fills a rectangle, rounded to 16 pixels horizontally, regardless of drawing area, offset and mask. */
+static void Fill(int x, int y, int w, int h, int r, int g, int b)
+{
+	u_short color = (u_short)((r >> 3) | ((g >> 3) << 5) | ((b >> 3) << 10));
+	int i, j;
+
+	x &= 0x3f0;
+	y &= 0x1ff;
+	w = ((w & 0x3ff) + 15) & ~15;
+	h &= 0x1ff;
+
+	for (j = 0; j < h; ++j)
+	{
+		for (i = 0; i < w; ++i)
+		{
+			HostVram[(y + j) & 511][(x + i) & 1023] = color;
+		}
+	}
+
+	HostGpu.pixels += w * h;
+}
+
+static void CopyVram(int sx, int sy, int dx, int dy, int w, int h)
+{
+	static u_short line[HOST_VRAM_WIDTH];
+	int i, j;
+
+	w = ((w - 1) & 0x3ff) + 1;
+	h = ((h - 1) & 0x1ff) + 1;
+
+	for (j = 0; j < h; ++j)
+	{
+		for (i = 0; i < w; ++i)
+		{
+			line[i] = HostVram[(sy + j) & 511][(sx + i) & 1023];
+		}
+
+		for (i = 0; i < w; ++i)
+		{
+			HostVram[(dy + j) & 511][(dx + i) & 1023] = line[i] | s_gpu.setMask;
+		}
+	}
+}
+
+/******************************************************/
+/* Command stream */
+
+static void SetDrawMode(u_long word)
+{
+	s_gpu.texpage = word & 0x1ff;
+	s_gpu.dither = (word >> 9) & 1;
+}
+
+/* Executes the GPU commands of one packet. */
+static void ExecutePacket(u_long* words, int length)
+{
+	u_long code;
+	int used, w, h;
+
+	while (length > 0)
+	{
+		code = words[0] >> 24;
+		used = 1;
+
+		switch (code >> 5)
+		{
+		case 0:
+			if (code == 0x02 && length >= 3)
+			{
+				HostGpu.prims[HOST_PRIM_FILL]++;
+				Fill(words[1] & 0xffff, words[1] >> 16, words[2] & 0xffff, words[2] >> 16,
+					words[0] & 0xff, (words[0] >> 8) & 0xff, (words[0] >> 16) & 0xff);
+				used = 3;
+			}
+			else if (code > 0x02)
+			{
+				HostGpu.unsupported++;
+			}
+			break;
+
+		case 1:
+			used = DrawPolygon(words);
+			break;
+
+		case 2:
+			used = DrawLines(words, length);
+			break;
+
+		case 3:
+			used = DrawRectangle(words);
+			break;
+
+		case 4:
+			used = 4;
+			if (length >= 4)
+			{
+				CopyVram(words[1] & 0x3ff, (words[1] >> 16) & 0x1ff, words[2] & 0x3ff, (words[2] >> 16) & 0x1ff,
+					words[3] & 0xffff, words[3] >> 16);
+			}
+			break;
+
+		case 5:
+			/* Image data sent along with the command */
+			w = ((words[2] & 0xffff) - 1) & 0x3ff;
+			h = ((words[2] >> 16) - 1) & 0x1ff;
+			used = 3 + ((w + 1) * (h + 1) + 1) / 2;
+			if (used <= length)
+			{
+				RECT rect;
+				rect.x = (short)(words[1] & 0x3ff);
+				rect.y = (short)((words[1] >> 16) & 0x1ff);
+				rect.w = (short)(w + 1);
+				rect.h = (short)(h + 1);
+				LoadImage(&rect, words + 3);
+			}
+			break;
+
+		case 6:
+			used = 3;
+			break;
+
+		default:
+			switch (code)
+			{
+			case 0xe1:
+				HostGpu.prims[HOST_PRIM_MODE]++;
+				SetDrawMode(words[0]);
+				break;
+
+			case 0xe2:
+				s_gpu.windowMaskX = words[0] & 0x1f;
+				s_gpu.windowMaskY = (words[0] >> 5) & 0x1f;
+				s_gpu.windowOffsetX = (words[0] >> 10) & 0x1f;
+				s_gpu.windowOffsetY = (words[0] >> 15) & 0x1f;
+				break;
+
+			case 0xe3:
+				s_gpu.clipX0 = words[0] & 0x3ff;
+				s_gpu.clipY0 = (words[0] >> 10) & 0x1ff;
+				break;
+
+			case 0xe4:
+				s_gpu.clipX1 = words[0] & 0x3ff;
+				s_gpu.clipY1 = (words[0] >> 10) & 0x1ff;
+				break;
+
+			case 0xe5:
+				s_gpu.offsetX = Coordinate(words[0]);
+				s_gpu.offsetY = Coordinate(words[0] >> 11);
+				break;
+
+			case 0xe6:
+				s_gpu.setMask = (words[0] & 1) ? 0x8000 : 0;
+				s_gpu.checkMask = (words[0] & 2) != 0;
+				break;
+
+			default:
+				HostGpu.unsupported++;
+				break;
+			}
+			break;
+		}
+
+		words += used;
+		length -= used;
+	}
+}
+
+/******************************************************/
+/* libgpu */
+
+/* Like the console, a reset keeps the contents of VRAM. */
+int ResetGraph(int mode)
+{
+	memset(&s_gpu, 0, sizeof(s_gpu));
+	s_gpu.clipX1 = HOST_VRAM_WIDTH - 1;
+	s_gpu.clipY1 = HOST_VRAM_HEIGHT - 1;
+	HostDisplayEnabled = 0;
+	return 0;
+}
+
+int SetGraphDebug(int level) { return 0; }
+
+void SetDispMask(int mask)
+{
+	HostDisplayEnabled = mask;
+}
+
+/* Drawing is done by the time the functions return. */
+int DrawSync(int mode) { return 0; }
+
+int LoadImage(RECT* rect, u_long* p)
+{
+	u_short* pixels = (u_short*)p;
+	int x, y;
+
+	for (y = 0; y < rect->h; ++y)
+	{
+		for (x = 0; x < rect->w; ++x)
+		{
+			HostVram[(rect->y + y) & 511][(rect->x + x) & 1023] = *pixels++;
+		}
+	}
+
+	return 0;
+}
+
+int StoreImage(RECT* rect, u_long* p)
+{
+	u_short* pixels = (u_short*)p;
+	int x, y;
+
+	for (y = 0; y < rect->h; ++y)
+	{
+		for (x = 0; x < rect->w; ++x)
+		{
+			*pixels++ = HostVram[(rect->y + y) & 511][(rect->x + x) & 1023];
+		}
+	}
+
+	return 0;
+}
+
+int MoveImage(RECT* rect, int x, int y)
+{
+	CopyVram(rect->x, rect->y, x, y, rect->w, rect->h);
+	return 0;
+}
+
+int ClearImage(RECT* rect, u_char r, u_char g, u_char b)
+{
+	Fill(rect->x, rect->y, rect->w, rect->h, r, g, b);
+	return 0;
+}
+
+u_long* ClearOTag(u_long* ot, int n)
+{
+	int i;
+
+	for (i = 0; i < n - 1; ++i)
+	{
+		setaddr(&ot[i], &ot[i + 1]);
+		setlen(&ot[i], 0);
+	}
+
+	termPrim(&ot[n - 1]);
+	setlen(&ot[n - 1], 0);
+	return ot;
+}
+
+u_long* ClearOTagR(u_long* ot, int n)
+{
+	int i;
+
+	for (i = n - 1; i > 0; --i)
+	{
+		setaddr(&ot[i], &ot[i - 1]);
+		setlen(&ot[i], 0);
+	}
+
+	termPrim(&ot[0]);
+	setlen(&ot[0], 0);
+	return ot;
+}
+
+void DrawOTag(u_long* p)
+{
+	u_long tag, next;
+	long entries = 0;
+
+	while (1)
+	{
+		tag = *p;
+		HostGpu.tags++;
+
+		if ((tag >> 24) != 0)
+		{
+			ExecutePacket(p + 1, tag >> 24);
+		}
+
+		next = tag & 0xffffff;
+		if (next == 0xffffff)
+		{
+			break;
+		}
+
+		if (next == 0 || ++entries > MAX_OT_ENTRIES)
+		{
+			fprintf(stderr, "DrawOTag: broken order table at %p\n", (void*)p);
+			break;
+		}
+
+		p = (u_long*)(uintptr_t)next;
+	}
+}
+
+void DrawPrim(void* p)
+{
+	ExecutePacket((u_long*)p + 1, getlen(p));
+}
+
+DRAWENV* SetDefDrawEnv(DRAWENV* env, int x, int y, int w, int h)
+{
+	memset(env, 0, sizeof(DRAWENV));
+	setRECT(&env->clip, x, y, w, h);
+	env->ofs[0] = (short)x;
+	env->ofs[1] = (short)y;
+	env->tpage = GetTPage(0, 0, 640, 0);
+	env->dtd = 1;
+	return env;
+}
+
+DISPENV* SetDefDispEnv(DISPENV* env, int x, int y, int w, int h)
+{
+	memset(env, 0, sizeof(DISPENV));
+	setRECT(&env->disp, x, y, w, h);
+	return env;
+}
+
+void SetDrawArea(DR_AREA* p, RECT* r)
+{
+	setlen(p, 2);
+	p->code[0] = 0xe3000000 | (r->x & 0x3ff) | ((r->y & 0x3ff) << 10);
+	p->code[1] = 0xe4000000 | ((r->x + r->w - 1) & 0x3ff) | (((r->y + r->h - 1) & 0x3ff) << 10);
+}
+
+void SetDrawOffset(DR_OFFSET* p, u_short* ofs)
+{
+	setlen(p, 2);
+	p->code[0] = 0xe5000000 | (ofs[0] & 0x7ff) | ((ofs[1] & 0x7ff) << 11);
+	p->code[1] = 0;
+}
+
+DRAWENV* PutDrawEnv(DRAWENV* env)
+{
+	u_long* code = env->dr_env.code;
+
+	/* Same commands as the console library puts into dr_env */
+	code[0] = _get_mode(env->dfe, env->dtd, env->tpage);
+	code[1] = 0xe2000000 | (_get_tw(&env->tw) & 0xfffff);
+	code[2] = 0xe3000000 | (env->clip.x & 0x3ff) | ((env->clip.y & 0x3ff) << 10);
+	code[3] = 0xe4000000 | ((env->clip.x + env->clip.w - 1) & 0x3ff) | (((env->clip.y + env->clip.h - 1) & 0x3ff) << 10);
+	code[4] = 0xe5000000 | (env->ofs[0] & 0x7ff) | ((env->ofs[1] & 0x7ff) << 11);
+	setlen(&env->dr_env, 5);
+
+	ExecutePacket(code, 5);
+
+	if (env->isbg)
+	{
+		Fill(env->clip.x, env->clip.y, env->clip.w, env->clip.h, env->r0, env->g0, env->b0);
+	}
+
+	return env;
+}
+
+DISPENV* PutDispEnv(DISPENV* env)
+{
+	HostDisplay = *env;
+	return env;
+}
+
+u_short GetTPage(int tp, int abr, int x, int y)
+{
+	return (u_short)getTPage(tp, abr, x, y);
+}
+
+u_short GetClut(int x, int y)
+{
+	return (u_short)getClut(x, y);
+}
+
+/******************************************************/
+/* Debug font */
+
+void FntLoad(int tx, int ty) { }
+int FntOpen(int x, int y, int w, int h, int isbg, int n) { return 0; }
+void SetDumpFnt(int id) { }
+
+int FntPrint(char* format, ...)
+{
+	va_list list;
+	int length;
+
+	va_start(list, format);
+	length = vsnprintf(s_fontText + s_fontLength, sizeof(s_fontText) - s_fontLength, format, list);
+	va_end(list);
+
+	if (length > 0)
+	{
+		s_fontLength += length;
+		if (s_fontLength >= (int)sizeof(s_fontText))
+		{
+			s_fontLength = sizeof(s_fontText) - 1;
+		}
+	}
+
+	return length;
+}
+
+u_long* FntFlush(int id)
+{
+	if (s_fontLength > 0)
+	{
+		fputs(s_fontText, stderr);
+		s_fontLength = 0;
+		HostFntFlushCount++;
+	}
+
+	return 0;
+}
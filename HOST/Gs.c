@@ -0,0 +1,711 @@
+/*
+ * Host implementation of the libgs functions used by the game.
+ *
+ * Order tables, sprites, clears and TMD objects are turned into the same GPU packets
+ * the console library writes into the packet area, so the host GPU (Gpu.c) can draw
+ * them. Double buffering and the drawing offset follow GsInitGraph/GsInit3D.
+ */
+
+#include <sys/types.h>
+#include <libgte.h>
+#include <libgpu.h>
+#include <libgs.h>
+
+#include <stdint.h>
+#include <string.h>
+
+/* Maximum number of vertices GsSortObject4 transforms per face, subdivided faces included. */
+#define MAX_FACE_VERTICES	4
+
+/* Deepest subdivision of GsDIVn. */
+#define MAX_DIVISION		5
+
+DISPENV GsDISPENV;
+DRAWENV GsDRAWENV;
+MATRIX GsWSMATRIX;
+
+void (*HostDrawOtHook)(void) = 0;
+
+/* Flat light directions (one per row, pointing towards the light) and colors (one per column). */
+static MATRIX s_lightDirections;
+static MATRIX s_lightColors;
+
+static PACKET* s_workBase = 0;
+
+/*
+ * Tables linked into another one by GsSortOt end in the destination instead of the
+ * terminator, so the last packet of every linked table is remembered until the table
+ * is cleared again. Tables can be linked again for as long as their packets are kept.
+ */
+#define MAX_SORTED_OTS		8
+
+typedef struct
+{
+	GsOT* ot;
+	u_long* last;
+} SortedOt;
+
+static SortedOt s_sortedOts[MAX_SORTED_OTS];
+static int s_nextSortedOt = 0;
+
+/* Double buffering: the buffer being drawn and the VRAM position of both buffers. */
+static int s_activeBuff = 0;
+static short s_bufferX[2], s_bufferY[2];
+static u_short s_width = 320, s_height = 240;
+static int s_gpuOffset = 0;
+static int s_centered = 0;
+
+/* A polygon of a TMD object, ready to be subdivided and sorted. */
+typedef struct
+{
+	SVECTOR position[4];
+	CVECTOR color[4];
+	u_char u[4], v[4];
+} GsFace;
+
+/* What GsSortObject4 needs to know about the polygon being sorted. */
+typedef struct
+{
+	int quad;
+	int gouraud;
+	int textured;
+	int doubleSided;
+	u_char code;
+	u_short clut, tpage;
+	GsOT* ot;
+	int shift;
+} GsFaceType;
+
+/******************************************************/
+/* Display buffers */
+
+/* Puts the drawing environment of the active buffer and displays the other one. */
+static void UpdateEnvironments()
+{
+	GsDRAWENV.clip.x = s_bufferX[s_activeBuff];
+	GsDRAWENV.clip.y = s_bufferY[s_activeBuff];
+	GsDRAWENV.clip.w = (short)s_width;
+	GsDRAWENV.clip.h = (short)s_height;
+	GsDRAWENV.ofs[0] = GsDRAWENV.clip.x;
+	GsDRAWENV.ofs[1] = GsDRAWENV.clip.y;
+
+	/* With GsOFSGPU, GsInit3D moves the screen origin to the center through the drawing offset. */
+	if (s_gpuOffset && s_centered)
+	{
+		GsDRAWENV.ofs[0] += s_width / 2;
+		GsDRAWENV.ofs[1] += s_height / 2;
+	}
+
+	GsDISPENV.disp.x = s_bufferX[s_activeBuff ^ 1];
+	GsDISPENV.disp.y = s_bufferY[s_activeBuff ^ 1];
+	GsDISPENV.disp.w = (short)s_width;
+	GsDISPENV.disp.h = (short)s_height;
+
+	PutDrawEnv(&GsDRAWENV);
+	PutDispEnv(&GsDISPENV);
+}
+
+void GsInitGraph(u_short x, u_short y, u_short intmode, u_short dith, u_short varmmode)
+{
+	s_width = x;
+	s_height = y;
+	s_gpuOffset = (intmode & GsOFSGPU) != 0;
+	s_centered = 0;
+
+	SetDefDrawEnv(&GsDRAWENV, 0, 0, x, y);
+	GsDRAWENV.dtd = (u_char)dith;
+	GsDISPENV.isinter = (u_char)(intmode & GsINTER);
+
+	SetGeomOffset(0, 0);
+	UpdateEnvironments();
+}
+
+void GsDefDispBuff(u_short x0, u_short y0, u_short x1, u_short y1)
+{
+	s_bufferX[0] = (short)x0;
+	s_bufferY[0] = (short)y0;
+	s_bufferX[1] = (short)x1;
+	s_bufferY[1] = (short)y1;
+	s_activeBuff = 0;
+
+	UpdateEnvironments();
+}
+
+void GsInit3D(void)
+{
+	s_centered = 1;
+
+	if (s_gpuOffset)
+	{
+		SetGeomOffset(0, 0);
+	}
+	else
+	{
+		SetGeomOffset(s_width / 2, s_height / 2);
+	}
+
+	UpdateEnvironments();
+}
+
+void GsSetProjection(long h)
+{
+	SetGeomScreen(h);
+}
+
+int GsGetActiveBuff(void)
+{
+	return s_activeBuff;
+}
+
+void GsSwapDispBuff(void)
+{
+	s_activeBuff ^= 1;
+	UpdateEnvironments();
+}
+
+void GsSetWorkBase(PACKET* base)
+{
+	s_workBase = base;
+}
+
+PACKET* GsGetWorkBase(void)
+{
+	return s_workBase;
+}
+
+/******************************************************/
+/* Order tables */
+
+void GsClearOt(u_short offset, u_short point, GsOT* ot)
+{
+	int i, count = 1 << ot->length;
+
+	/* The farthest entry is drawn first */
+	for (i = count - 1; i > 0; --i)
+	{
+		ot->org[i].p = (u_long)&ot->org[i - 1];
+		ot->org[i].num = 0;
+	}
+
+	ot->org[0].p = 0xffffff;
+	ot->org[0].num = 0;
+
+	ot->offset = offset;
+	ot->point = point;
+	ot->tag = ot->org + count - 1;
+
+	for (i = 0; i < MAX_SORTED_OTS; ++i)
+	{
+		if (s_sortedOts[i].ot == ot)
+		{
+			s_sortedOts[i].ot = 0;
+		}
+	}
+}
+
+void GsDrawOt(GsOT* ot)
+{
+	DrawOTag((u_long*)ot->tag);
+
+	if (HostDrawOtHook != 0)
+	{
+		HostDrawOtHook();
+	}
+}
+
+void GsSortOt(GsOT* src, GsOT* dst)
+{
+	u_long point = src->point;
+	u_long* last = 0;
+	int i;
+
+	if (point >= (u_long)(1 << dst->length))
+	{
+		point = (1 << dst->length) - 1;
+	}
+
+	for (i = 0; i < MAX_SORTED_OTS && last == 0; ++i)
+	{
+		if (s_sortedOts[i].ot == src)
+		{
+			last = s_sortedOts[i].last;
+		}
+	}
+
+	/* The nearest entry heads the last primitives of the table, the terminator follows them. */
+	if (last == 0)
+	{
+		last = (u_long*)src->org;
+		while ((*last & 0xffffff) != 0xffffff)
+		{
+			last = (u_long*)(uintptr_t)(*last & 0xffffff);
+		}
+
+		/* Entries of cleared tables are taken first, tables which are linked every frame stay */
+		for (i = 0; i < MAX_SORTED_OTS; ++i)
+		{
+			if (s_sortedOts[s_nextSortedOt].ot == 0)
+			{
+				break;
+			}
+			s_nextSortedOt = (s_nextSortedOt + 1) % MAX_SORTED_OTS;
+		}
+
+		s_sortedOts[s_nextSortedOt].ot = src;
+		s_sortedOts[s_nextSortedOt].last = last;
+		s_nextSortedOt = (s_nextSortedOt + 1) % MAX_SORTED_OTS;
+	}
+
+	/* The whole source table is drawn where its point falls into the destination. */
+	*last = (*last & 0xff000000) | dst->org[point].p;
+	dst->org[point].p = (u_long)(uintptr_t)src->tag;
+}
+
+void GsSortClear(u_char r, u_char g, u_char b, GsOT* ot)
+{
+	BLK_FILL* fill = (BLK_FILL*)s_workBase;
+
+	setBlockFill(fill);
+	setRGB0(fill, r, g, b);
+	setXYWH(fill, GsDRAWENV.clip.x, GsDRAWENV.clip.y, GsDRAWENV.clip.w, GsDRAWENV.clip.h);
+
+	/* Added last to the farthest entry, so it is drawn before anything else. */
+	addPrim(ot->org + (1 << ot->length) - 1, fill);
+	s_workBase += sizeof(BLK_FILL);
+}
+
+void GsSortFastSprite(GsSPRITE* sp, GsOT* ot, u_short pri)
+{
+	u_long* packet = (u_long*)s_workBase;
+	u_long attribute = sp->attribute;
+	u_long code = 0x64;
+	u_short tpage;
+
+	/* Display off */
+	if (attribute & (1u << 31))
+	{
+		return;
+	}
+
+	/* Color mode and semi transparency rate come from the attribute, not from the sprite's tpage. */
+	tpage = (u_short)((sp->tpage & 0x1f) | (((attribute >> 28) & 3) << 5) | (((attribute >> 24) & 3) << 7));
+
+	if (attribute & (1 << 30))
+	{
+		code |= 0x02;
+	}
+
+	/* Brightness calculation off */
+	if (attribute & (1 << 6))
+	{
+		code |= 0x01;
+	}
+
+	packet[1] = _get_mode(0, GsDRAWENV.dtd, tpage);
+	packet[2] = (code << 24) | (sp->b << 16) | (sp->g << 8) | sp->r;
+	packet[3] = ((u_long)(u_short)sp->y << 16) | (u_short)sp->x;
+	packet[4] = ((u_long)getClut(sp->cx, sp->cy) << 16) | (sp->v << 8) | sp->u;
+	packet[5] = ((u_long)sp->h << 16) | sp->w;
+	setlen(packet, 5);
+
+	if (pri >= (1 << ot->length))
+	{
+		pri = (1 << ot->length) - 1;
+	}
+
+	addPrim(ot->org + pri, packet);
+	s_workBase += 6 * sizeof(u_long);
+}
+
+void GsGetTimInfo(u_long* im, GsIMAGE* tim)
+{
+	u_long* block = im + 1;
+
+	memset(tim, 0, sizeof(GsIMAGE));
+	tim->pmode = im[0];
+
+	/* Blocks: length in bytes (header included), y << 16 | x, h << 16 | w, data */
+	if (tim->pmode & 8)
+	{
+		tim->cx = (short)(block[1] & 0xffff);
+		tim->cy = (short)(block[1] >> 16);
+		tim->cw = (u_short)(block[2] & 0xffff);
+		tim->ch = (u_short)(block[2] >> 16);
+		tim->clut = block + 3;
+		block += block[0] / 4;
+	}
+
+	tim->px = (short)(block[1] & 0xffff);
+	tim->py = (short)(block[1] >> 16);
+	tim->pw = (u_short)(block[2] & 0xffff);
+	tim->ph = (u_short)(block[2] >> 16);
+	tim->pixel = block + 3;
+}
+
+/******************************************************/
+/* Coordinate systems and lighting */
+
+void GsInitCoordinate2(GsCOORDINATE2* super, GsCOORDINATE2* base)
+{
+	memset(base, 0, sizeof(GsCOORDINATE2));
+	base->coord.m[0][0] = base->coord.m[1][1] = base->coord.m[2][2] = ONE;
+	base->super = super;
+}
+
+int GsSetView2(GsVIEW2* pv)
+{
+	GsWSMATRIX = pv->view;
+	return 0;
+}
+
+void GsSetAmbient(long r, long g, long b)
+{
+	SetBackColor(r >> 4, g >> 4, b >> 4);
+}
+
+int GsSetLightMode(int mode) { return 0; }
+
+int GsSetFlatLight(int id, GsF_LIGHT* lt)
+{
+	VECTOR direction;
+	SVECTOR normal;
+
+	if (id < 0 || id > 2)
+	{
+		return -1;
+	}
+
+	setVector(&direction, -lt->vx, -lt->vy, -lt->vz);
+	VectorNormalS(&direction, &normal);
+	s_lightDirections.m[id][0] = normal.vx;
+	s_lightDirections.m[id][1] = normal.vy;
+	s_lightDirections.m[id][2] = normal.vz;
+
+	s_lightColors.m[0][id] = (short)(lt->r * ONE / 255);
+	s_lightColors.m[1][id] = (short)(lt->g * ONE / 255);
+	s_lightColors.m[2][id] = (short)(lt->b * ONE / 255);
+	SetColorMatrix(&s_lightColors);
+	return 0;
+}
+
+void GsGetLws(GsCOORDINATE2* coord, MATRIX* lw, MATRIX* ls)
+{
+	MATRIX local = coord->coord;
+	GsCOORDINATE2* super;
+
+	for (super = coord->super; super != WORLD; super = super->super)
+	{
+		CompMatrixLV(&super->coord, &local, &local);
+	}
+
+	*lw = local;
+	CompMatrixLV(&GsWSMATRIX, &local, ls);
+}
+
+void GsGetLs(GsCOORDINATE2* coord, MATRIX* m)
+{
+	MATRIX lw;
+
+	GsGetLws(coord, &lw, m);
+}
+
+void GsSetLightMatrix(MATRIX* mp)
+{
+	MATRIX light;
+
+	/* Light directions are given in world space, the normals in local space. */
+	CompMatrixLV(&s_lightDirections, mp, &light);
+	SetLightMatrix(&light);
+}
+
+void GsSetLsMatrix(MATRIX* mp)
+{
+	SetRotMatrix(mp);
+	SetTransMatrix(mp);
+}
+
+/******************************************************/
+/* TMD objects */
+
+void GsMapModelingData(u_long* p)
+{
+	u_long* objects = p + 2;
+	u_long* object;
+	u_long i;
+
+	if (p[0] & 1)
+	{
+		return;
+	}
+
+	/* Vertex, normal and primitive offsets are relative to the object table. */
+	for (i = 0; i < p[1]; ++i)
+	{
+		object = objects + i * 7;
+		object[0] += (u_long)objects;
+		object[2] += (u_long)objects;
+		object[4] += (u_long)objects;
+	}
+
+	p[0] |= 1;
+}
+
+void GsLinkObject4(u_long tmd_base, GsDOBJ2* obj, int n)
+{
+	memset(obj, 0, sizeof(GsDOBJ2));
+	obj->tmd = (u_long*)(uintptr_t)tmd_base + n * 7;
+	obj->id = n;
+}
+
+/* Transforms a face and writes its primitive into the order table. */
+static void SortFace(GsFace* face, GsFaceType* type)
+{
+	DVECTOR screen[MAX_FACE_VERTICES];
+	u_short depth[MAX_FACE_VERTICES], interpolation[MAX_FACE_VERTICES], flags[MAX_FACE_VERTICES];
+	u_long* packet = (u_long*)s_workBase;
+	u_long* p;
+	int i, count = type->quad ? 4 : 3;
+	long otz;
+
+	RotTransPersN(face->position, screen, depth, interpolation, flags, count);
+
+	/* Vertices on or behind the near plane end up with a depth of 0. */
+	for (i = 0; i < count; ++i)
+	{
+		if (depth[i] == 0)
+		{
+			return;
+		}
+	}
+
+	if (!type->doubleSided && NormalClip(*(u_long*)&screen[0], *(u_long*)&screen[1], *(u_long*)&screen[2]) <= 0)
+	{
+		return;
+	}
+
+	if (type->quad)
+	{
+		otz = (depth[0] + depth[1] + depth[2] + depth[3]) >> 2;
+	}
+	else
+	{
+		otz = ((depth[0] + depth[1] + depth[2]) * 1365) >> 12;
+	}
+
+	otz >>= type->shift;
+	if (otz >= (1 << type->ot->length))
+	{
+		otz = (1 << type->ot->length) - 1;
+	}
+
+	/* Same layout as the POLY_* structures: color, xy, (uv + clut/tpage), per vertex */
+	p = packet + 1;
+	for (i = 0; i < count; ++i)
+	{
+		if (i == 0)
+		{
+			*p++ = ((u_long)type->code << 24) | (face->color[0].b << 16) | (face->color[0].g << 8) | face->color[0].r;
+		}
+		else if (type->gouraud)
+		{
+			*p++ = (face->color[i].b << 16) | (face->color[i].g << 8) | face->color[i].r;
+		}
+
+		*p++ = ((u_long)(u_short)screen[i].vy << 16) | (u_short)screen[i].vx;
+
+		if (type->textured)
+		{
+			*p++ = (i == 0 ? (u_long)type->clut << 16 : (i == 1 ? (u_long)type->tpage << 16 : 0)) |
+				(face->v[i] << 8) | face->u[i];
+		}
+	}
+
+	setlen(packet, p - packet - 1);
+	addPrim(type->ot->org + otz, packet);
+	s_workBase = (PACKET*)p;
+}
+
+static void Midpoint(GsFace* from, int a, int b, GsFace* to, int index)
+{
+	to->position[index].vx = (short)((from->position[a].vx + from->position[b].vx) / 2);
+	to->position[index].vy = (short)((from->position[a].vy + from->position[b].vy) / 2);
+	to->position[index].vz = (short)((from->position[a].vz + from->position[b].vz) / 2);
+	to->color[index].r = (u_char)((from->color[a].r + from->color[b].r) / 2);
+	to->color[index].g = (u_char)((from->color[a].g + from->color[b].g) / 2);
+	to->color[index].b = (u_char)((from->color[a].b + from->color[b].b) / 2);
+	to->u[index] = (u_char)((from->u[a] + from->u[b]) / 2);
+	to->v[index] = (u_char)((from->v[a] + from->v[b]) / 2);
+}
+
+static void Corner(GsFace* from, int a, GsFace* to, int index)
+{
+	Midpoint(from, a, a, to, index);
+}
+
+/* Splits a face into four in local space (GsDIVn) and sorts the parts. */
+static void DivideFace(GsFace* face, GsFaceType* type, int division)
+{
+	GsFace parts[4];
+	GsFace center;
+	int i;
+
+	if (division == 0)
+	{
+		SortFace(face, type);
+		return;
+	}
+
+	if (type->quad)
+	{
+		/* Vertex order 0 1 / 2 3, the center is the midpoint of the diagonal midpoints */
+		Midpoint(face, 0, 3, &center, 0);
+		Midpoint(face, 1, 2, &center, 1);
+		Midpoint(&center, 0, 1, &center, 2);
+
+		Corner(face, 0, &parts[0], 0); Midpoint(face, 0, 1, &parts[0], 1); Midpoint(face, 0, 2, &parts[0], 2); Corner(&center, 2, &parts[0], 3);
+		Midpoint(face, 0, 1, &parts[1], 0); Corner(face, 1, &parts[1], 1); Corner(&center, 2, &parts[1], 2); Midpoint(face, 1, 3, &parts[1], 3);
+		Midpoint(face, 0, 2, &parts[2], 0); Corner(&center, 2, &parts[2], 1); Corner(face, 2, &parts[2], 2); Midpoint(face, 2, 3, &parts[2], 3);
+		Corner(&center, 2, &parts[3], 0); Midpoint(face, 1, 3, &parts[3], 1); Midpoint(face, 2, 3, &parts[3], 2); Corner(face, 3, &parts[3], 3);
+	}
+	else
+	{
+		Corner(face, 0, &parts[0], 0); Midpoint(face, 0, 1, &parts[0], 1); Midpoint(face, 2, 0, &parts[0], 2);
+		Midpoint(face, 0, 1, &parts[1], 0); Corner(face, 1, &parts[1], 1); Midpoint(face, 1, 2, &parts[1], 2);
+		Midpoint(face, 2, 0, &parts[2], 0); Midpoint(face, 1, 2, &parts[2], 1); Corner(face, 2, &parts[2], 2);
+		Midpoint(face, 0, 1, &parts[3], 0); Midpoint(face, 1, 2, &parts[3], 1); Midpoint(face, 2, 0, &parts[3], 2);
+	}
+
+	for (i = 0; i < 4; ++i)
+	{
+		DivideFace(&parts[i], type, division - 1);
+	}
+}
+
+void GsSortObject4(GsDOBJ2* obj, GsOT* ot, int shift, u_long* scratch)
+{
+	u_long* object = obj->tmd;
+	SVECTOR* vertices = (SVECTOR*)(uintptr_t)object[0];
+	SVECTOR* normals = (SVECTOR*)(uintptr_t)object[2];
+	u_char* primitive = (u_char*)(uintptr_t)object[4];
+	u_long count = object[5];
+	int lighting = !(obj->attribute & GsLOFF);
+	int division = (obj->attribute >> 9) & 7;
+	GsFaceType type;
+	GsFace face;
+	CVECTOR base[4];
+	SVECTOR* normal[4];
+	u_short* indices;
+	u_char* data;
+	u_char mode, flag;
+	u_long i;
+	int j, n, colors, unlit;
+
+	type.ot = ot;
+	type.shift = shift;
+
+	if (division > MAX_DIVISION)
+	{
+		division = MAX_DIVISION;
+	}
+
+	for (i = 0; i < count; ++i, primitive += 4 + primitive[1] * 4)
+	{
+		/* Header: olen, ilen, flag, mode. Only polygons are drawn. */
+		flag = primitive[2];
+		mode = primitive[3];
+		if ((mode & 0xe0) != 0x20)
+		{
+			continue;
+		}
+
+		type.quad = (mode & 0x08) != 0;
+		type.textured = (mode & 0x04) != 0;
+		type.doubleSided = (flag & 0x02) != 0;
+		unlit = (flag & 0x01) != 0;
+		n = type.quad ? 4 : 3;
+		data = primitive + 4;
+
+		/* U V CBA, U V TSB, U V, (U V) */
+		if (type.textured)
+		{
+			for (j = 0; j < n; ++j, data += 4)
+			{
+				face.u[j] = data[0];
+				face.v[j] = data[1];
+			}
+
+			type.clut = *(u_short*)(primitive + 4 + 2);
+			type.tpage = *(u_short*)(primitive + 8 + 2) & 0x1ff;
+		}
+
+		/* Lit textured polygons have no color, lit gouraud polygons only one unless gradated. */
+		if (!unlit)
+		{
+			colors = type.textured ? 0 : ((flag & 0x04) ? n : 1);
+		}
+		else
+		{
+			colors = ((mode & 0x10) || (flag & 0x04)) ? n : 1;
+		}
+
+		for (j = 0; j < n; ++j)
+		{
+			if (j < colors)
+			{
+				base[j].r = data[0];
+				base[j].g = data[1];
+				base[j].b = data[2];
+				data += 4;
+			}
+			else if (colors > 0)
+			{
+				base[j] = base[0];
+			}
+			else
+			{
+				/* Textured polygons are lit from a neutral base color */
+				base[j].r = base[j].g = base[j].b = 128;
+			}
+
+			base[j].cd = mode;
+		}
+
+		/* Lit: Norm0 Vert0 (Norm1 Vert1 ...) for gouraud, Norm0 Vert0 Vert1 ... for flat. Unlit: Vert0 Vert1 ... */
+		indices = (u_short*)data;
+		for (j = 0; j < n; ++j)
+		{
+			if (unlit)
+			{
+				face.position[j] = vertices[indices[j]];
+				normal[j] = 0;
+			}
+			else if (mode & 0x10)
+			{
+				normal[j] = &normals[indices[j * 2]];
+				face.position[j] = vertices[indices[j * 2 + 1]];
+			}
+			else
+			{
+				normal[j] = &normals[indices[0]];
+				face.position[j] = vertices[indices[j + 1]];
+			}
+		}
+
+		for (j = 0; j < n; ++j)
+		{
+			if (!unlit && lighting)
+			{
+				NormalColorCol(normal[j], &base[j], &face.color[j]);
+			}
+			else
+			{
+				face.color[j] = base[j];
+			}
+		}
+
+		type.gouraud = (mode & 0x10) || colors > 1;
+		type.code = (u_char)(0x20 | (type.gouraud ? 0x10 : 0) | (mode & 0x0f));
+
+		DivideFace(&face, &type, division);
+	}
+}
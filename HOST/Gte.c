@@ -0,0 +1,750 @@
+/*
+ * Host implementation of the libgte functions used by the game.
+ *
+ * The GTE is modelled at register level after the nocash PSX specifications: 44 bit
+ * accumulators with their overflow flags, the saturation of IR, SZ and SXY, the FLAG
+ * register and the table based divider of the perspective transformation. The library
+ * functions are built from these commands the way libgte uses them, so results match the
+ * console bit for bit, also where values saturate.
+ *
+ * RotTransPersN and the Host...N functions are the batched versions for many vertices or
+ * matrices at once. They do the multiplications of a whole batch in loops the compiler
+ * can vectorise and give the same results as the single versions.
+ */
+
+#include <sys/types.h>
+#include <libgte.h>
+
+#include <math.h>
+
+u_long HostScratchpad[256];
+
+/* Sine table in the rsin()/rcos() format: 4096 steps per turn, scaled by ONE. */
+static short s_sinTable[4096];
+static int s_sinTableReady = 0;
+
+static void InitSinTable()
+{
+	int i;
+
+	for (i = 0; i < 4096; ++i)
+	{
+		s_sinTable[i] = (short)floor(sin(i * 3.14159265358979323846 * 2.0 / 4096.0) * ONE + 0.5);
+	}
+
+	s_sinTableReady = 1;
+}
+
+static int HostSin(int a)
+{
+	if (!s_sinTableReady)
+	{
+		InitSinTable();
+	}
+
+	return s_sinTable[a & 4095];
+}
+
+static int HostCos(int a)
+{
+	return HostSin(a + 1024);
+}
+
+int rsin(int a)
+{
+	return HostSin(a);
+}
+
+int rcos(int a)
+{
+	return HostCos(a);
+}
+
+MATRIX* RotMatrix(SVECTOR* r, MATRIX* m)
+{
+	int s0 = HostSin(r->vx), c0 = HostCos(r->vx);
+	int s1 = HostSin(r->vy), c1 = HostCos(r->vy);
+	int s2 = HostSin(r->vz), c2 = HostCos(r->vz);
+
+	m->m[0][0] = (short)((c1 * c2) >> 12);
+	m->m[0][1] = (short)(-(c1 * s2) >> 12);
+	m->m[0][2] = (short)s1;
+	m->m[1][0] = (short)((((s0 * s1) >> 12) * c2 + c0 * s2) >> 12);
+	m->m[1][1] = (short)((c0 * c2 - ((s0 * s1) >> 12) * s2) >> 12);
+	m->m[1][2] = (short)(-(s0 * c1) >> 12);
+	m->m[2][0] = (short)((s0 * s2 - ((c0 * s1) >> 12) * c2) >> 12);
+	m->m[2][1] = (short)((s0 * c2 + ((c0 * s1) >> 12) * s2) >> 12);
+	m->m[2][2] = (short)((c0 * c1) >> 12);
+
+	return m;
+}
+
+MATRIX* TransMatrix(MATRIX* m, VECTOR* v)
+{
+	m->t[0] = v->vx;
+	m->t[1] = v->vy;
+	m->t[2] = v->vz;
+
+	return m;
+}
+
+/******************************************************/
+/* GTE registers */
+
+typedef struct
+{
+	MATRIX rotation;		/* RT and TR */
+	MATRIX light;			/* LLM */
+	MATRIX lightColor;		/* LCM */
+	long backColor[3];		/* RBK, GBK, BBK */
+	long offsetX, offsetY;	/* OFX, OFY, 16.16 */
+	u_short screenH;		/* H */
+	short dqa;				/* DQA and DQB, depth cueing */
+	long dqb;
+
+	long mac[4];			/* MAC0 - MAC3 */
+	short ir[4];			/* IR0 - IR3 */
+	u_short sz3;			/* SZ3 */
+	short sx2, sy2;			/* SXY2 */
+	u_long flag;			/* FLAG */
+} GteRegisters;
+
+static GteRegisters s_gte = { {{{ONE, 0, 0}, {0, ONE, 0}, {0, 0, ONE}}, {0, 0, 0}} };
+static int s_gteReady = 0;
+
+/* Reciprocal table of the divider (UNR), 0x101 entries. */
+static u_char s_unrTable[0x101];
+
+static void InitGte()
+{
+	int i, value;
+
+	for (i = 0; i <= 0x100; ++i)
+	{
+		value = (0x40000 / (i + 0x100) + 1) / 2 - 0x101;
+		s_unrTable[i] = (u_char)(value > 0 ? value : 0);
+	}
+
+	s_gte.screenH = 1000;
+	s_gteReady = 1;
+}
+
+void SetRotMatrix(MATRIX* m)
+{
+	int i, j;
+
+	for (i = 0; i < 3; ++i)
+	{
+		for (j = 0; j < 3; ++j)
+		{
+			s_gte.rotation.m[i][j] = m->m[i][j];
+		}
+	}
+}
+
+void SetTransMatrix(MATRIX* m)
+{
+	/* Registers are 32 bits wide, host longs may not be */
+	s_gte.rotation.t[0] = (int)m->t[0];
+	s_gte.rotation.t[1] = (int)m->t[1];
+	s_gte.rotation.t[2] = (int)m->t[2];
+}
+
+void SetLightMatrix(MATRIX* m) { s_gte.light = *m; }
+void SetColorMatrix(MATRIX* m) { s_gte.lightColor = *m; }
+
+void SetBackColor(long rbk, long gbk, long bbk)
+{
+	/* Like libgte, the 0 - 255 colors are stored in the 4.12 format of the light colors */
+	s_gte.backColor[0] = (int)(rbk << 4);
+	s_gte.backColor[1] = (int)(gbk << 4);
+	s_gte.backColor[2] = (int)(bbk << 4);
+}
+
+void SetGeomOffset(long ofx, long ofy)
+{
+	s_gte.offsetX = (int)(ofx << 16);
+	s_gte.offsetY = (int)(ofy << 16);
+}
+
+void SetGeomScreen(long h)
+{
+	if (!s_gteReady)
+	{
+		InitGte();
+	}
+
+	s_gte.screenH = (u_short)h;
+}
+
+/******************************************************/
+/* Arithmetic of the GTE commands, after the nocash PSX specifications */
+
+/* Adds value to the 44 bit accumulator of MAC1 - MAC3 (i), which wraps around after setting its overflow flag. */
+static long long Accumulate(int i, long long sum, long long value)
+{
+	sum += value;
+
+	if (sum > 0x7ffffffffffLL)
+	{
+		s_gte.flag |= HOST_GTE_FLAG_MAC1_POSITIVE >> (i - 1);
+	}
+	else if (sum < -0x80000000000LL)
+	{
+		s_gte.flag |= HOST_GTE_FLAG_MAC1_NEGATIVE >> (i - 1);
+	}
+
+	return (long long)((unsigned long long)sum << 20) >> 20;
+}
+
+/* Saturates MAC1 - MAC3 (i) into IR1 - IR3, to 0 - 0x7fff if lm is set and to -0x8000 - 0x7fff otherwise. */
+static short SaturateIr(int i, long value, int lm)
+{
+	long low = lm ? 0 : -0x8000;
+
+	if (value < low || value > 0x7fff)
+	{
+		s_gte.flag |= HOST_GTE_FLAG_IR1 >> (i - 1);
+		return (short)(value < low ? low : 0x7fff);
+	}
+
+	return (short)value;
+}
+
+/* Checks a MAC0 result for 32 bit overflow. */
+static long long CheckMac0(long long value)
+{
+	if (value > 0x7fffffffLL)
+	{
+		s_gte.flag |= HOST_GTE_FLAG_MAC0_POSITIVE;
+	}
+	else if (value < -0x80000000LL)
+	{
+		s_gte.flag |= HOST_GTE_FLAG_MAC0_NEGATIVE;
+	}
+
+	return value;
+}
+
+/* Bit 31 of FLAG is set when any of the error bits is. */
+static void FinishFlag()
+{
+	if (s_gte.flag & 0x7f87e000)
+	{
+		s_gte.flag |= HOST_GTE_FLAG_ERROR;
+	}
+}
+
+/*
+ * Matrix times vector like MVMVA: MAC = (t << 12 + m * v) >> shift, with t optional, and
+ * IR = MAC saturated.
+ */
+static void Transform(MATRIX* m, long* t, long vx, long vy, long vz, int shift, int lm)
+{
+	long long sum;
+	int i;
+
+	for (i = 0; i < 3; ++i)
+	{
+		sum = t != 0 ? (long long)(int)t[i] << 12 : 0;
+		sum = Accumulate(i + 1, sum, (long long)m->m[i][0] * vx);
+		sum = Accumulate(i + 1, sum, (long long)m->m[i][1] * vy);
+		sum = Accumulate(i + 1, sum, (long long)m->m[i][2] * vz);
+
+		s_gte.mac[i + 1] = (int)(sum >> shift);
+		s_gte.ir[i + 1] = SaturateIr(i + 1, s_gte.mac[i + 1], lm);
+	}
+}
+
+u_long HostGteDivide(u_long h, u_long sz3, u_long* flag)
+{
+	u_long n, d, u;
+	int z = 0;
+
+	if (!s_gteReady)
+	{
+		InitGte();
+	}
+
+	h &= 0xffff;
+	sz3 &= 0xffff;
+
+	/* Results of 2.0 and above don't fit into the 1.16 result */
+	if (h >= sz3 * 2)
+	{
+		*flag |= HOST_GTE_FLAG_DIVIDE | HOST_GTE_FLAG_ERROR;
+		return 0x1ffff;
+	}
+
+	/* Normalize the divisor to 0x8000 - 0xffff, then two Newton-Raphson steps from the table */
+	while (((sz3 << z) & 0x8000) == 0)
+	{
+		++z;
+	}
+
+	n = h << z;
+	d = sz3 << z;
+	u = s_unrTable[(d - 0x7fc0) >> 7] + 0x101;
+	d = (0x2000080 - d * u) >> 8;
+	d = (0x0000080 + d * u) >> 8;
+
+	n = (u_long)(((unsigned long long)n * d + 0x8000) >> 16);
+	return n > 0x1ffff ? 0x1ffff : n;
+}
+
+/* MAC1 - MAC3 of RTPS: the vertex rotated and translated. */
+static void RotateTranslate(SVECTOR* v)
+{
+	long long sum;
+	int i;
+
+	for (i = 0; i < 3; ++i)
+	{
+		sum = (long long)(int)s_gte.rotation.t[i] << 12;
+		sum = Accumulate(i + 1, sum, s_gte.rotation.m[i][0] * v->vx);
+		sum = Accumulate(i + 1, sum, s_gte.rotation.m[i][1] * v->vy);
+		sum = Accumulate(i + 1, sum, s_gte.rotation.m[i][2] * v->vz);
+
+		s_gte.mac[i + 1] = (int)(sum >> 12);
+	}
+}
+
+/* The rest of RTPS once MAC1 - MAC3 are known. */
+static void Project()
+{
+	long long sum, x, y;
+	long sz;
+	u_long h;
+	int i;
+
+	for (i = 0; i < 3; ++i)
+	{
+		s_gte.ir[i + 1] = SaturateIr(i + 1, s_gte.mac[i + 1], 0);
+	}
+
+	sz = s_gte.mac[3];
+	if (sz < 0 || sz > 0xffff)
+	{
+		s_gte.flag |= HOST_GTE_FLAG_SZ;
+		sz = sz < 0 ? 0 : 0xffff;
+	}
+	s_gte.sz3 = (u_short)sz;
+
+	h = HostGteDivide(s_gte.screenH, s_gte.sz3, &s_gte.flag);
+
+	/* The projection uses the saturated IR1 and IR2, not the full coordinates */
+	x = CheckMac0((long long)s_gte.offsetX + (long long)s_gte.ir[1] * h) >> 16;
+	y = CheckMac0((long long)s_gte.offsetY + (long long)s_gte.ir[2] * h) >> 16;
+
+	if (x < -0x400 || x > 0x3ff)
+	{
+		s_gte.flag |= HOST_GTE_FLAG_SX;
+		x = x < -0x400 ? -0x400 : 0x3ff;
+	}
+	if (y < -0x400 || y > 0x3ff)
+	{
+		s_gte.flag |= HOST_GTE_FLAG_SY;
+		y = y < -0x400 ? -0x400 : 0x3ff;
+	}
+
+	s_gte.sx2 = (short)x;
+	s_gte.sy2 = (short)y;
+
+	/* Depth cueing */
+	sum = CheckMac0((long long)s_gte.dqb + (long long)s_gte.dqa * h);
+	s_gte.mac[0] = (int)sum;
+	sum >>= 12;
+	if (sum < 0 || sum > 0x1000)
+	{
+		s_gte.flag |= HOST_GTE_FLAG_IR0;
+		sum = sum < 0 ? 0 : 0x1000;
+	}
+	s_gte.ir[0] = (short)sum;
+
+	FinishFlag();
+}
+
+/* RTPS of one vertex. */
+static void Rtps(SVECTOR* v)
+{
+	if (!s_gteReady)
+	{
+		InitGte();
+	}
+
+	s_gte.flag = 0;
+	RotateTranslate(v);
+	Project();
+}
+
+/******************************************************/
+/* Matrix functions */
+
+/* Splits a 32 bit vector component the way libgte does for MVMVA's 16 bit inputs. */
+#define SPLIT_HIGH(v)	((short)((int)(v) >> 15))
+#define SPLIT_LOW(v)	((int)(v) & 0x7fff)
+
+VECTOR* ApplyMatrixLV(MATRIX* m, VECTOR* v0, VECTOR* v1)
+{
+	long high[3];
+	int i;
+
+	if (!s_gteReady)
+	{
+		InitGte();
+	}
+
+	s_gte.flag = 0;
+
+	/* m * v = (m * high) << 3 + (m * low) >> 12, with the high part unshifted */
+	Transform(m, 0, SPLIT_HIGH(v0->vx), SPLIT_HIGH(v0->vy), SPLIT_HIGH(v0->vz), 0, 0);
+	for (i = 0; i < 3; ++i)
+	{
+		high[i] = s_gte.mac[i + 1];
+	}
+
+	Transform(m, 0, SPLIT_LOW(v0->vx), SPLIT_LOW(v0->vy), SPLIT_LOW(v0->vz), 12, 0);
+	FinishFlag();
+
+	v1->vx = (int)((u_int)high[0] << 3) + (int)s_gte.mac[1];
+	v1->vy = (int)((u_int)high[1] << 3) + (int)s_gte.mac[2];
+	v1->vz = (int)((u_int)high[2] << 3) + (int)s_gte.mac[3];
+	return v1;
+}
+
+MATRIX* CompMatrixLV(MATRIX* m0, MATRIX* m1, MATRIX* m2)
+{
+	MATRIX r;
+	VECTOR t;
+	int i, j;
+
+	if (!s_gteReady)
+	{
+		InitGte();
+	}
+
+	/* Every column of m1 goes through the GTE, so the results saturate to 16 bits */
+	for (j = 0; j < 3; ++j)
+	{
+		s_gte.flag = 0;
+		Transform(m0, 0, m1->m[0][j], m1->m[1][j], m1->m[2][j], 12, 0);
+
+		for (i = 0; i < 3; ++i)
+		{
+			r.m[i][j] = s_gte.ir[i + 1];
+		}
+	}
+
+	t.vx = m1->t[0];
+	t.vy = m1->t[1];
+	t.vz = m1->t[2];
+	ApplyMatrixLV(m0, &t, &t);
+
+	r.t[0] = (int)((u_int)t.vx + (u_int)m0->t[0]);
+	r.t[1] = (int)((u_int)t.vy + (u_int)m0->t[1]);
+	r.t[2] = (int)((u_int)t.vz + (u_int)m0->t[2]);
+
+	*m2 = r;
+	return m2;
+}
+
+/*
+ * Reciprocal square roots for VectorNormal: entry i is ONE * 16 / sqrt(i + 64), for the
+ * square sums normalized to 64 - 255.
+ */
+static u_short s_normalTable[192];
+static int s_normalTableReady = 0;
+
+/* Scales the given vector to a length of ONE like libgte, with a table instead of a square root. */
+static void Normalize(VECTOR* v, long* x, long* y, long* z)
+{
+	unsigned long long sum;
+	int i, shift = 0;
+	long scale;
+
+	if (!s_normalTableReady)
+	{
+		for (i = 0; i < 192; ++i)
+		{
+			s_normalTable[i] = (u_short)floor(ONE * 16.0 / sqrt(i + 64.0) + 0.5);
+		}
+		s_normalTableReady = 1;
+	}
+
+	sum = (unsigned long long)((long long)(int)v->vx * (int)v->vx) +
+		(unsigned long long)((long long)(int)v->vy * (int)v->vy) +
+		(unsigned long long)((long long)(int)v->vz * (int)v->vz);
+
+	if (sum == 0)
+	{
+		*x = *y = *z = 0;
+		return;
+	}
+
+	/* An even shift keeps the square root exact: sum = m << shift, with m in 64 - 255 */
+	while ((sum >> shift) >= 256)
+	{
+		shift += 2;
+	}
+	while (shift <= 0 && (sum << -shift) < 64)
+	{
+		shift -= 2;
+	}
+
+	/* v / sqrt(sum) = v * (16 / sqrt(m)) >> (4 + shift / 2) */
+	scale = s_normalTable[(shift >= 0 ? sum >> shift : sum << -shift) - 64];
+	*x = (long)(((long long)(int)v->vx * scale) >> (4 + shift / 2));
+	*y = (long)(((long long)(int)v->vy * scale) >> (4 + shift / 2));
+	*z = (long)(((long long)(int)v->vz * scale) >> (4 + shift / 2));
+}
+
+void VectorNormal(VECTOR* v0, VECTOR* v1)
+{
+	long x, y, z;
+
+	Normalize(v0, &x, &y, &z);
+	v1->vx = x;
+	v1->vy = y;
+	v1->vz = z;
+}
+
+void VectorNormalS(VECTOR* v0, SVECTOR* v1)
+{
+	long x, y, z;
+
+	Normalize(v0, &x, &y, &z);
+	v1->vx = (short)x;
+	v1->vy = (short)y;
+	v1->vz = (short)z;
+}
+
+long SquareRoot0(long a)
+{
+	u_long value = (u_long)a, root = 0, bit = 1UL << 30;
+
+	/* Integer square root, rounded down like the console library does */
+	while (bit > value)
+	{
+		bit >>= 2;
+	}
+
+	while (bit != 0)
+	{
+		if (value >= root + bit)
+		{
+			value -= root + bit;
+			root = (root >> 1) + bit;
+		}
+		else
+		{
+			root >>= 1;
+		}
+		bit >>= 2;
+	}
+
+	return (long)root;
+}
+
+/******************************************************/
+/* Perspective transformation and lighting */
+
+long RotTransPers(SVECTOR* v0, long* sxy, long* p, long* flag)
+{
+	Rtps(v0);
+
+	*sxy = (long)(((u_long)(u_short)s_gte.sy2 << 16) | (u_short)s_gte.sx2);
+	*p = s_gte.ir[0];
+	*flag = (long)s_gte.flag;
+	return s_gte.sz3 >> 2;
+}
+
+long RotTransPers3(SVECTOR* v0, SVECTOR* v1, SVECTOR* v2, long* sxy0, long* sxy1, long* sxy2, long* p, long* flag)
+{
+	u_long flags;
+
+	/* RTPT is three RTPS in a row which share one FLAG */
+	RotTransPers(v0, sxy0, p, flag);
+	flags = s_gte.flag;
+	RotTransPers(v1, sxy1, p, flag);
+	flags |= s_gte.flag;
+	RotTransPers(v2, sxy2, p, flag);
+	flags |= s_gte.flag;
+
+	*flag = (long)flags;
+	return s_gte.sz3 >> 2;
+}
+
+/* Vertices of one pass of the batched transformations. */
+#define GTE_BATCH 64
+
+/* Largest translation for which the accumulators can't overflow: (t << 12) + 3 * 0x8000 * 0x8000 fits 44 bits. */
+#define SAFE_TRANSLATION (0x7fffffffL - 3 * 0x40000)
+
+static int s_mac[3][GTE_BATCH];
+
+void RotTransPersN(SVECTOR* v0, DVECTOR* v1, u_short* sz, u_short* p, u_short* flag, long n)
+{
+	short (*m)[3] = s_gte.rotation.m;
+	long long t0, t1, t2;
+	long first, count, i;
+	int safe = 1;
+
+	if (!s_gteReady)
+	{
+		InitGte();
+	}
+
+	for (i = 0; i < 3; ++i)
+	{
+		if ((int)s_gte.rotation.t[i] > SAFE_TRANSLATION || (int)s_gte.rotation.t[i] < -SAFE_TRANSLATION)
+		{
+			safe = 0;
+		}
+	}
+
+	t0 = (long long)(int)s_gte.rotation.t[0] << 12;
+	t1 = (long long)(int)s_gte.rotation.t[1] << 12;
+	t2 = (long long)(int)s_gte.rotation.t[2] << 12;
+
+	for (first = 0; first < n; first += GTE_BATCH)
+	{
+		count = n - first < GTE_BATCH ? n - first : GTE_BATCH;
+
+		/* Without overflows, rotation and translation of the whole batch are free of flags and branches and vectorise */
+		if (safe)
+		{
+			for (i = 0; i < count; ++i)
+			{
+				s_mac[0][i] = (int)((t0 + m[0][0] * v0[first + i].vx + m[0][1] * v0[first + i].vy + m[0][2] * v0[first + i].vz) >> 12);
+				s_mac[1][i] = (int)((t1 + m[1][0] * v0[first + i].vx + m[1][1] * v0[first + i].vy + m[1][2] * v0[first + i].vz) >> 12);
+				s_mac[2][i] = (int)((t2 + m[2][0] * v0[first + i].vx + m[2][1] * v0[first + i].vy + m[2][2] * v0[first + i].vz) >> 12);
+			}
+		}
+
+		for (i = 0; i < count; ++i)
+		{
+			s_gte.flag = 0;
+
+			if (safe)
+			{
+				s_gte.mac[1] = s_mac[0][i];
+				s_gte.mac[2] = s_mac[1][i];
+				s_gte.mac[3] = s_mac[2][i];
+			}
+			else
+			{
+				RotateTranslate(&v0[first + i]);
+			}
+
+			Project();
+
+			v1[first + i].vx = s_gte.sx2;
+			v1[first + i].vy = s_gte.sy2;
+			sz[first + i] = s_gte.sz3;
+			p[first + i] = (u_short)s_gte.ir[0];
+			flag[first + i] = (u_short)(s_gte.flag >> 12);
+		}
+	}
+}
+
+void HostApplyMatrixLVN(MATRIX* m, VECTOR* v0, VECTOR* v1, long n)
+{
+	long long high, low;
+	int hx, hy, hz, lx, ly, lz;
+	long i;
+	int j;
+
+	/* Without a translation the accumulators can't overflow, so every vector is the same arithmetic */
+	for (i = 0; i < n; ++i)
+	{
+		hx = SPLIT_HIGH(v0[i].vx);
+		hy = SPLIT_HIGH(v0[i].vy);
+		hz = SPLIT_HIGH(v0[i].vz);
+		lx = SPLIT_LOW(v0[i].vx);
+		ly = SPLIT_LOW(v0[i].vy);
+		lz = SPLIT_LOW(v0[i].vz);
+
+		for (j = 0; j < 3; ++j)
+		{
+			high = (long long)(m->m[j][0] * hx) + m->m[j][1] * hy + m->m[j][2] * hz;
+			low = ((long long)(m->m[j][0] * lx) + m->m[j][1] * ly + m->m[j][2] * lz) >> 12;
+			(&v1[i].vx)[j] = (int)(((u_int)high << 3) + (u_int)low);
+		}
+	}
+}
+
+void HostCompMatrixLVN(MATRIX* m0, MATRIX* m1, MATRIX* m2, long n)
+{
+	MATRIX r;
+	VECTOR t;
+	long long sum;
+	long i;
+	int j, k;
+
+	for (i = 0; i < n; ++i)
+	{
+		for (j = 0; j < 3; ++j)
+		{
+			for (k = 0; k < 3; ++k)
+			{
+				sum = ((long long)(m0->m[j][0] * m1[i].m[0][k]) + m0->m[j][1] * m1[i].m[1][k] + m0->m[j][2] * m1[i].m[2][k]) >> 12;
+				r.m[j][k] = (short)(sum < -0x8000 ? -0x8000 : (sum > 0x7fff ? 0x7fff : sum));
+			}
+		}
+
+		t.vx = m1[i].t[0];
+		t.vy = m1[i].t[1];
+		t.vz = m1[i].t[2];
+		HostApplyMatrixLVN(m0, &t, &t, 1);
+
+		r.t[0] = (int)((u_int)t.vx + (u_int)m0->t[0]);
+		r.t[1] = (int)((u_int)t.vy + (u_int)m0->t[1]);
+		r.t[2] = (int)((u_int)t.vz + (u_int)m0->t[2]);
+		m2[i] = r;
+	}
+}
+
+long NormalClip(long sxy0, long sxy1, long sxy2)
+{
+	/* Screen coordinates are packed as y << 16 | x, only the low 32 bits are registers. */
+	long long x0 = (short)(sxy0 & 0xffff), y0 = (short)((sxy0 >> 16) & 0xffff);
+	long long x1 = (short)(sxy1 & 0xffff), y1 = (short)((sxy1 >> 16) & 0xffff);
+	long long x2 = (short)(sxy2 & 0xffff), y2 = (short)((sxy2 >> 16) & 0xffff);
+
+	s_gte.flag = 0;
+	s_gte.mac[0] = (int)CheckMac0(x0 * y1 + x1 * y2 + x2 * y0 - x0 * y2 - x1 * y0 - x2 * y1);
+	FinishFlag();
+
+	return s_gte.mac[0];
+}
+
+void NormalColorCol(SVECTOR* v0, CVECTOR* v1, CVECTOR* v2)
+{
+	long long sum;
+	long color;
+	int i;
+
+	s_gte.flag = 0;
+
+	/* NCCS: light intensities, then the colors of the lights plus the back color */
+	Transform(&s_gte.light, 0, v0->vx, v0->vy, v0->vz, 12, 1);
+	Transform(&s_gte.lightColor, s_gte.backColor, s_gte.ir[1], s_gte.ir[2], s_gte.ir[3], 12, 1);
+
+	for (i = 0; i < 3; ++i)
+	{
+		sum = Accumulate(i + 1, 0, ((long long)(&v1->r)[i] << 4) * s_gte.ir[i + 1]);
+		s_gte.mac[i + 1] = (int)(sum >> 12);
+		s_gte.ir[i + 1] = SaturateIr(i + 1, s_gte.mac[i + 1], 1);
+
+		color = s_gte.mac[i + 1] >> 4;
+		if (color < 0 || color > 255)
+		{
+			s_gte.flag |= HOST_GTE_FLAG_COLOR_R >> i;
+			color = color < 0 ? 0 : 255;
+		}
+		(&v2->r)[i] = (u_char)color;
+	}
+
+	v2->cd = v1->cd;
+	FinishFlag();
+}
@@ -0,0 +1,646 @@
+/*
+ * GTE tool: checks the host GTE (Gte.c) and measures its batched functions.
+ *
+ * The test mode checks the divider bit for bit against the algorithm of the hardware
+ * documentation (the UNR reciprocal table and two Newton-Raphson steps), written out here
+ * again apart from Gte.c, the saturation of the perspective transformation and the matrix
+ * functions against the results the documentation gives for them, and
+ * that the batched functions give the same results as the single ones, flags included.
+ *
+ * Usage: gtetool test
+ *        gtetool bench
+ */
+
+#include <sys/types.h>
+#include <libgte.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* Random cases of the batch comparisons. */
+#define RANDOM_CASES	200000
+/* Vertices and matrices of one bench round. */
+#define BENCH_COUNT		4096
+
+static u_long s_random = 1;
+
+static long Random(long low, long high)
+{
+	unsigned long long value;
+
+	s_random = s_random * 1103515245 + 12345;
+	value = s_random >> 8;
+	s_random = s_random * 1103515245 + 12345;
+	value = (value << 24) | (s_random >> 8);
+
+	return low + (long)(value % (unsigned long long)(high - low + 1));
+}
+
+static void RandomMatrix(MATRIX* m, long range, long translation)
+{
+	int i, j;
+
+	for (i = 0; i < 3; ++i)
+	{
+		for (j = 0; j < 3; ++j)
+		{
+			m->m[i][j] = (short)Random(-range, range);
+		}
+		m->t[i] = Random(-translation, translation);
+	}
+}
+
+static void IdentityMatrix(MATRIX* m, long x, long y, long z)
+{
+	memset(m, 0, sizeof(MATRIX));
+	m->m[0][0] = m->m[1][1] = m->m[2][2] = ONE;
+	m->t[0] = x;
+	m->t[1] = y;
+	m->t[2] = z;
+}
+
+/* Compares the values only, host matrices have padding. */
+static int SameMatrix(MATRIX* m0, MATRIX* m1)
+{
+	int i, j;
+
+	for (i = 0; i < 3; ++i)
+	{
+		for (j = 0; j < 3; ++j)
+		{
+			if (m0->m[i][j] != m1->m[i][j])
+			{
+				return 0;
+			}
+		}
+
+		if (m0->t[i] != m1->t[i])
+		{
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+/* The first entries of the reciprocal table of the divider as the documentation lists them. */
+static const u_char s_unrStart[16] =
+{
+	0xff, 0xfd, 0xfb, 0xf9, 0xf7, 0xf5, 0xf3, 0xf1, 0xef, 0xee, 0xec, 0xea, 0xe8, 0xe6, 0xe4, 0xe3,
+};
+
+static u_char s_unr[0x101];
+
+/* The division of the hardware documentation: h / sz as 1.16, 0x1ffff if it doesn't fit. */
+static u_long ReferenceDivide(u_long h, u_long sz)
+{
+	unsigned long long n, d, u;
+	int shift;
+
+	if (h >= sz * 2)
+	{
+		return 0x1ffff;
+	}
+
+	/* Leading zeros of the 16 bit divisor */
+	shift = __builtin_clz((unsigned int)sz) - 16;
+	n = (unsigned long long)h << shift;
+	d = (unsigned long long)sz << shift;
+	u = s_unr[(d - 0x7fc0) >> 7] + 0x101;
+	d = (0x2000080 - d * u) >> 8;
+	d = (0x0000080 + d * u) >> 8;
+	n = (n * d + 0x8000) >> 16;
+
+	return n < 0x1ffff ? (u_long)n : 0x1ffff;
+}
+
+static int TestDivider()
+{
+	u_long h, sz, result, expected, flag;
+	long cases = 0;
+	int i, value, failures = 0;
+
+	for (i = 0; i <= 0x100; ++i)
+	{
+		value = (0x40000 / (i + 0x100) + 1) / 2 - 0x101;
+		s_unr[i] = (u_char)(value > 0 ? value : 0);
+
+		if (i < (int)sizeof(s_unrStart) && s_unr[i] != s_unrStart[i])
+		{
+			printf("FAIL divider table %d: %x, %x documented\n", i, s_unr[i], s_unrStart[i]);
+			failures++;
+		}
+	}
+
+	/* Powers of two come out exact, the end of the table a unit short like on the hardware */
+	if (ReferenceDivide(0x8000, 0x8000) != 0x10000 || ReferenceDivide(0x4000, 0x8000) != 0x8000 ||
+		ReferenceDivide(0, 1) != 0 || ReferenceDivide(1, 1) != 0x10000 || ReferenceDivide(0xffff, 0xffff) != 0xffff)
+	{
+		printf("FAIL divider reference\n");
+		failures++;
+	}
+
+	/* Every result and flag the same as the documented algorithm, overflows saturated with the flag */
+	for (h = 0; h < 0x10000; h += (h < 0x100 ? 1 : 0x3f))
+	{
+		for (sz = 1; sz < 0x10000; ++sz, ++cases)
+		{
+			flag = 0;
+			result = HostGteDivide(h, sz, &flag);
+			expected = ReferenceDivide(h, sz);
+
+			if (result != expected || flag != (h >= sz * 2 ? HOST_GTE_FLAG_DIVIDE | HOST_GTE_FLAG_ERROR : 0))
+			{
+				if (failures++ < 4)
+				{
+					printf("FAIL divider %lu / %lu: %lx flag %lx, %lx expected\n", (unsigned long)h, (unsigned long)sz,
+						(unsigned long)result, (unsigned long)flag, (unsigned long)expected);
+				}
+			}
+		}
+	}
+
+	if (failures == 0)
+	{
+		printf("ok   divider: %ld divisions bit exact\n", cases);
+	}
+
+	return failures;
+}
+
+typedef struct
+{
+	char* name;
+	/* Transformation and vertex */
+	long tx, ty, tz;
+	short vx, vy, vz;
+	/* Expected results */
+	short sx, sy;
+	long sz;
+	u_long flag;
+} ProjectionCase;
+
+/* Identity rotation, screen distance 1000 and the geometry offset at 160, 120. */
+static const ProjectionCase s_projectionCases[] =
+{
+	{ "plain", 0, 0, 1000, 100, 50, 0, 260, 170, 1000, 0 },
+	{ "half", 0, 0, 2000, -100, -50, 0, 110, 95, 2000, 0 },
+	{ "sx", 0, 0, 1000, 2000, 0, 0, 1023, 120, 1000, HOST_GTE_FLAG_SX | HOST_GTE_FLAG_ERROR },
+	{ "sy", 0, 0, 1000, 0, -2000, 0, 160, -1024, 1000, HOST_GTE_FLAG_SY | HOST_GTE_FLAG_ERROR },
+	{ "ir1", 40000, 0, 30000, 0, 0, 0, 1023, 120, 30000,
+		HOST_GTE_FLAG_IR1 | HOST_GTE_FLAG_SX | HOST_GTE_FLAG_ERROR },
+	{ "near", 0, 0, 400, 10, 10, 0, 179, 139, 400, HOST_GTE_FLAG_DIVIDE | HOST_GTE_FLAG_ERROR },
+	{ "behind", 0, 0, -100, 0, 0, 0, 160, 120, 0, HOST_GTE_FLAG_SZ | HOST_GTE_FLAG_DIVIDE | HOST_GTE_FLAG_ERROR },
+	{ "far", 0, 0, 70000, 0, 0, 0, 160, 120, 0xffff,
+		(HOST_GTE_FLAG_IR1 >> 2) | HOST_GTE_FLAG_SZ | HOST_GTE_FLAG_ERROR },
+	/* The accumulator wraps around to negative */
+	{ "mac1", 0x7fffffff, 0, 1000, 0x7fff, 0, 0, -1024, 120, 1000,
+		HOST_GTE_FLAG_MAC1_POSITIVE | HOST_GTE_FLAG_IR1 | HOST_GTE_FLAG_SX | HOST_GTE_FLAG_ERROR },
+};
+
+static int TestProjection()
+{
+	const ProjectionCase* c;
+	MATRIX m;
+	SVECTOR v;
+	long sxy, p, flag, otz;
+	u_int i;
+	int failures = 0;
+
+	SetGeomOffset(160, 120);
+	SetGeomScreen(1000);
+
+	for (i = 0; i < sizeof(s_projectionCases) / sizeof(s_projectionCases[0]); ++i)
+	{
+		c = &s_projectionCases[i];
+
+		IdentityMatrix(&m, c->tx, c->ty, c->tz);
+		SetRotMatrix(&m);
+		SetTransMatrix(&m);
+		setVector(&v, c->vx, c->vy, c->vz);
+
+		otz = RotTransPers(&v, &sxy, &p, &flag);
+
+		if ((short)(sxy & 0xffff) != c->sx || (short)(sxy >> 16) != c->sy || otz != c->sz >> 2 || (u_long)flag != c->flag)
+		{
+			printf("FAIL projection %s: %d, %d z %ld flag %lx, %d, %d z %ld flag %lx expected\n", c->name,
+				(short)(sxy & 0xffff), (short)(sxy >> 16), otz * 4, (unsigned long)flag,
+				c->sx, c->sy, c->sz, (unsigned long)c->flag);
+			failures++;
+		}
+	}
+
+	if (failures == 0)
+	{
+		printf("ok   projection: %d cases\n", i);
+	}
+
+	return failures;
+}
+
+static int TestMatrices()
+{
+	MATRIX m0, m1, m2;
+	VECTOR v, r;
+	long long exact;
+	int i, j, failures = 0;
+
+	/* ApplyMatrixLV splits 32 bit vectors for the 16 bit GTE, but the result is the exact product */
+	for (i = 0; i < RANDOM_CASES; ++i)
+	{
+		RandomMatrix(&m0, 0x7fff, 0);
+		setVector(&v, Random(-0x3fffffff, 0x3fffffff), Random(-0x3fffffff, 0x3fffffff), Random(-0x3fffffff, 0x3fffffff));
+		ApplyMatrixLV(&m0, &v, &r);
+
+		for (j = 0; j < 3; ++j)
+		{
+			exact = ((long long)m0.m[j][0] * v.vx + (long long)m0.m[j][1] * v.vy + (long long)m0.m[j][2] * v.vz) >> 12;
+			if (exact < -0x80000000LL || exact > 0x7fffffffLL)
+			{
+				continue;
+			}
+
+			if ((&r.vx)[j] != exact)
+			{
+				if (failures++ < 4)
+				{
+					printf("FAIL ApplyMatrixLV: %ld, %lld expected\n", (long)(&r.vx)[j], exact);
+				}
+			}
+		}
+	}
+
+	/* Products out of the 4.12 range saturate */
+	for (i = 0; i < 3; ++i)
+	{
+		for (j = 0; j < 3; ++j)
+		{
+			m0.m[i][j] = 0x2000;
+			m1.m[i][j] = j == 0 ? 0x2000 : (j == 1 ? -0x2000 : 0x100);
+		}
+		m0.t[i] = 1;
+		m1.t[i] = ONE;
+	}
+	CompMatrixLV(&m0, &m1, &m2);
+
+	for (i = 0; i < 3; ++i)
+	{
+		if (m2.m[i][0] != 0x7fff || m2.m[i][1] != -0x8000 || m2.m[i][2] != 0x600 || m2.t[i] != 0x6001)
+		{
+			printf("FAIL CompMatrixLV: row %d is %d %d %d %ld\n", i, m2.m[i][0], m2.m[i][1], m2.m[i][2], (long)m2.t[i]);
+			failures++;
+		}
+	}
+
+	if (failures == 0)
+	{
+		printf("ok   matrices: %d cases\n", RANDOM_CASES);
+	}
+
+	return failures;
+}
+
+static int TestNormal()
+{
+	VECTOR v, r;
+	SVECTOR s;
+	long long length;
+	int i, failures = 0;
+
+	setVector(&v, 0, 0, 0);
+	VectorNormal(&v, &r);
+	if (r.vx != 0 || r.vy != 0 || r.vz != 0)
+	{
+		printf("FAIL VectorNormal: zero vector\n");
+		failures++;
+	}
+
+	setVector(&v, 0, -0x10000, 0);
+	VectorNormalS(&v, &s);
+	if (s.vx != 0 || s.vy != -ONE || s.vz != 0)
+	{
+		printf("FAIL VectorNormalS: %d %d %d\n", s.vx, s.vy, s.vz);
+		failures++;
+	}
+
+	/* The table has 8 bits, so lengths are within 1% */
+	for (i = 0; i < RANDOM_CASES; ++i)
+	{
+		setVector(&v, Random(-0x7fff, 0x7fff), Random(-0x7fff, 0x7fff), Random(-0x7fff, 0x7fff));
+		if (v.vx == 0 && v.vy == 0 && v.vz == 0)
+		{
+			continue;
+		}
+
+		VectorNormal(&v, &r);
+		length = (long long)r.vx * r.vx + (long long)r.vy * r.vy + (long long)r.vz * r.vz;
+		if (length < (long long)ONE * ONE * 98 / 100 || length > (long long)ONE * ONE * 102 / 100)
+		{
+			if (failures++ < 4)
+			{
+				printf("FAIL VectorNormal: %ld %ld %ld gives %ld %ld %ld\n", (long)v.vx, (long)v.vy, (long)v.vz,
+					(long)r.vx, (long)r.vy, (long)r.vz);
+			}
+		}
+	}
+
+	if (failures == 0)
+	{
+		printf("ok   normal\n");
+	}
+
+	return failures;
+}
+
+static int TestLighting()
+{
+	MATRIX light, color;
+	SVECTOR normal;
+	CVECTOR in, out;
+	int failures = 0;
+
+	/* One white light straight along the normal and a dark back color: the material color scaled by 1.25 */
+	memset(&light, 0, sizeof(light));
+	memset(&color, 0, sizeof(color));
+	light.m[0][2] = ONE;
+	color.m[0][0] = color.m[1][0] = color.m[2][0] = ONE;
+	SetLightMatrix(&light);
+	SetColorMatrix(&color);
+	SetBackColor(64, 64, 64);
+
+	setVector(&normal, 0, 0, ONE);
+	in.r = 100;
+	in.g = 128;
+	in.b = 250;
+	in.cd = 0x30;
+	NormalColorCol(&normal, &in, &out);
+
+	if (out.r != 125 || out.g != 160 || out.b != 255 || out.cd != 0x30)
+	{
+		printf("FAIL lighting: %d %d %d %x\n", out.r, out.g, out.b, out.cd);
+		failures++;
+	}
+
+	/* Facing away, the back color is left */
+	setVector(&normal, 0, 0, -ONE);
+	NormalColorCol(&normal, &in, &out);
+
+	if (out.r != 25 || out.g != 32 || out.b != 62)
+	{
+		printf("FAIL lighting: back color gives %d %d %d\n", out.r, out.g, out.b);
+		failures++;
+	}
+
+	if (failures == 0)
+	{
+		printf("ok   lighting\n");
+	}
+
+	return failures;
+}
+
+static int TestBatches()
+{
+	static SVECTOR vertices[RANDOM_CASES];
+	static DVECTOR screen[RANDOM_CASES];
+	static u_short depth[RANDOM_CASES];
+	static u_short interpolation[RANDOM_CASES];
+	static u_short flags[RANDOM_CASES];
+	static VECTOR vectors[256], results[256];
+	static MATRIX matrices[256], products[256];
+	MATRIX m, product;
+	VECTOR r;
+	long sxy, sxy1, sxy2, p, flag, otz;
+	int i, j, failures = 0;
+
+	/* Big translations and far vertices, so the cases include every kind of saturation */
+	RandomMatrix(&m, ONE, 2000);
+	m.t[2] = 1500;
+	SetRotMatrix(&m);
+	SetTransMatrix(&m);
+	SetGeomOffset(160, 120);
+	SetGeomScreen(320);
+
+	for (i = 0; i < RANDOM_CASES; ++i)
+	{
+		setVector(&vertices[i], Random(-0x8000, 0x7fff) >> (i & 7), Random(-0x8000, 0x7fff) >> (i & 7), Random(-0x8000, 0x7fff) >> (i & 7));
+	}
+
+	/* The second pass has a translation close enough to overflow the accumulators */
+	for (j = 0; j < 2; ++j)
+	{
+		m.t[0] = j == 0 ? m.t[0] : 0x7fff0000;
+		SetTransMatrix(&m);
+
+		RotTransPersN(vertices, screen, depth, interpolation, flags, RANDOM_CASES);
+
+		for (i = 0; i < RANDOM_CASES; ++i)
+		{
+			otz = RotTransPers(&vertices[i], &sxy, &p, &flag);
+
+			if (screen[i].vx != (short)(sxy & 0xffff) || screen[i].vy != (short)(sxy >> 16) || depth[i] >> 2 != otz ||
+				interpolation[i] != p || flags[i] != (u_short)((u_long)flag >> 12))
+			{
+				if (failures++ < 4)
+				{
+					printf("FAIL RotTransPersN: vertex %d differs\n", i);
+				}
+			}
+		}
+	}
+
+	/* RTPT gives the last vertex and the flags of all three */
+	for (i = 0; i + 2 < 3000; i += 3)
+	{
+		otz = RotTransPers3(&vertices[i], &vertices[i + 1], &vertices[i + 2], &sxy, &sxy1, &sxy2, &p, &flag);
+
+		if (otz != depth[i + 2] >> 2 || (short)(sxy2 & 0xffff) != screen[i + 2].vx ||
+			(u_short)((u_long)flag >> 12) != (flags[i] | flags[i + 1] | flags[i + 2]))
+		{
+			if (failures++ < 4)
+			{
+				printf("FAIL RotTransPers3: vertex %d differs\n", i);
+			}
+		}
+	}
+
+	for (i = 0; i < RANDOM_CASES / 256; ++i)
+	{
+		RandomMatrix(&m, 0x7fff, 0x7fffffff);
+
+		for (j = 0; j < 256; ++j)
+		{
+			setVector(&vectors[j], Random(-0x3fffffff, 0x3fffffff), Random(-0x3fffffff, 0x3fffffff), Random(-0x3fffffff, 0x3fffffff));
+			RandomMatrix(&matrices[j], 0x7fff, 0x7fffffff);
+		}
+
+		HostApplyMatrixLVN(&m, vectors, results, 256);
+		HostCompMatrixLVN(&m, matrices, products, 256);
+
+		for (j = 0; j < 256; ++j)
+		{
+			ApplyMatrixLV(&m, &vectors[j], &r);
+			if (r.vx != results[j].vx || r.vy != results[j].vy || r.vz != results[j].vz)
+			{
+				if (failures++ < 4)
+				{
+					printf("FAIL HostApplyMatrixLVN: vector %d differs\n", j);
+				}
+			}
+
+			CompMatrixLV(&m, &matrices[j], &product);
+			if (!SameMatrix(&product, &products[j]))
+			{
+				if (failures++ < 4)
+				{
+					printf("FAIL HostCompMatrixLVN: matrix %d differs\n", j);
+				}
+			}
+		}
+	}
+
+	if (failures == 0)
+	{
+		printf("ok   batches: %d vertices\n", RANDOM_CASES);
+	}
+
+	return failures;
+}
+
+static int Test()
+{
+	int failures = TestDivider() + TestProjection() + TestMatrices() + TestNormal() + TestLighting() + TestBatches();
+
+	printf("%s: %d failures\n", failures == 0 ? "PASS" : "FAIL", failures);
+	return failures == 0;
+}
+
+static double Seconds()
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static int Bench()
+{
+	static SVECTOR vertices[BENCH_COUNT];
+	static DVECTOR screen[BENCH_COUNT];
+	static u_short depth[BENCH_COUNT];
+	static u_short interpolation[BENCH_COUNT];
+	static u_short flags[BENCH_COUNT];
+	static VECTOR vectors[BENCH_COUNT];
+	static MATRIX matrices[BENCH_COUNT];
+	MATRIX m;
+	long sxy, p, flag;
+	double start, single, batched;
+	int i, round, rounds = 200;
+
+	RandomMatrix(&m, ONE, 200);
+	m.t[2] = 2000;
+	SetRotMatrix(&m);
+	SetTransMatrix(&m);
+	SetGeomOffset(160, 120);
+	SetGeomScreen(320);
+
+	for (i = 0; i < BENCH_COUNT; ++i)
+	{
+		setVector(&vertices[i], Random(-500, 500), Random(-500, 500), Random(-500, 500));
+		setVector(&vectors[i], Random(-0x100000, 0x100000), Random(-0x100000, 0x100000), Random(-0x100000, 0x100000));
+		RandomMatrix(&matrices[i], ONE, 0x10000);
+	}
+
+	start = Seconds();
+	for (round = 0; round < rounds; ++round)
+	{
+		for (i = 0; i < BENCH_COUNT; ++i)
+		{
+			RotTransPers(&vertices[i], &sxy, &p, &flag);
+		}
+	}
+	single = Seconds() - start;
+
+	start = Seconds();
+	for (round = 0; round < rounds; ++round)
+	{
+		RotTransPersN(vertices, screen, depth, interpolation, flags, BENCH_COUNT);
+	}
+	batched = Seconds() - start;
+
+	printf("RotTransPers: %.1f Mvertices/s, RotTransPersN %.1f Mvertices/s\n",
+		rounds * BENCH_COUNT / single / 1e6, rounds * BENCH_COUNT / batched / 1e6);
+
+	start = Seconds();
+	for (round = 0; round < rounds; ++round)
+	{
+		for (i = 0; i < BENCH_COUNT; ++i)
+		{
+			ApplyMatrixLV(&m, &vectors[i], &vectors[i]);
+		}
+	}
+	single = Seconds() - start;
+
+	start = Seconds();
+	for (round = 0; round < rounds; ++round)
+	{
+		HostApplyMatrixLVN(&m, vectors, vectors, BENCH_COUNT);
+	}
+	batched = Seconds() - start;
+
+	printf("ApplyMatrixLV: %.1f Mvectors/s, HostApplyMatrixLVN %.1f Mvectors/s\n",
+		rounds * BENCH_COUNT / single / 1e6, rounds * BENCH_COUNT / batched / 1e6);
+
+	start = Seconds();
+	for (round = 0; round < rounds; ++round)
+	{
+		for (i = 0; i < BENCH_COUNT; ++i)
+		{
+			CompMatrixLV(&m, &matrices[i], &matrices[i]);
+		}
+	}
+	single = Seconds() - start;
+
+	start = Seconds();
+	for (round = 0; round < rounds; ++round)
+	{
+		HostCompMatrixLVN(&m, matrices, matrices, BENCH_COUNT);
+	}
+	batched = Seconds() - start;
+
+	printf("CompMatrixLV: %.1f Mmatrices/s, HostCompMatrixLVN %.1f Mmatrices/s\n",
+		rounds * BENCH_COUNT / single / 1e6, rounds * BENCH_COUNT / batched / 1e6);
+
+	return 1;
+}
+
+static void Usage()
+{
+	fprintf(stderr,
+		"usage: gtetool test\n"
+		"       gtetool bench\n");
+	exit(2);
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 2)
+	{
+		Usage();
+	}
+
+	if (strcmp(argv[1], "test") == 0)
+	{
+		return Test() ? 0 : 1;
+	}
+
+	if (strcmp(argv[1], "bench") == 0)
+	{
+		return Bench() ? 0 : 1;
+	}
+
+	Usage();
+	return 2;
+}
@@ -0,0 +1,269 @@
+/*
+ * Replacement for the C library allocator, serving all allocations of a program
+ * from a static arena.
+ *
+ * Order tables and primitives link to each other through 24 bit addresses, like on
+ * the console, so every packet the GPU follows must live in the lowest 16 MB of the
+ * address space. Programs which draw (render) are linked without PIE, which puts their
+ * data right above 4 MB, and with this file, which keeps the heap there as well.
+ * The allocator is a plain first fit list with coalescing, the programs are single
+ * threaded.
+ */
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/* Size of the arena, data and arena have to fit below 16 MB together. */
+#define HEAP_SIZE		(6 * 1024 * 1024)
+#define HEAP_ALIGN		16
+
+/* Marks a block header placed in front of an over-aligned pointer, see memalign. */
+#define BLOCK_FREE		0
+#define BLOCK_USED		1
+#define BLOCK_ALIAS		2
+
+typedef struct
+{
+	/* Payload size of this block and of the block before it, in bytes */
+	size_t size;
+	size_t previous;
+	size_t state;
+	size_t reserved;
+} Block;
+
+static unsigned char s_heap[HEAP_SIZE] __attribute__((aligned(HEAP_ALIGN)));
+static int s_heapReady = 0;
+
+static Block* NextBlock(Block* block)
+{
+	return (Block*)((unsigned char*)(block + 1) + block->size);
+}
+
+static Block* PreviousBlock(Block* block)
+{
+	return (Block*)((unsigned char*)block - block->previous) - 1;
+}
+
+static int IsLastBlock(Block* block)
+{
+	return (unsigned char*)NextBlock(block) >= s_heap + HEAP_SIZE;
+}
+
+static void InitHeap()
+{
+	Block* block = (Block*)s_heap;
+
+	block->size = HEAP_SIZE - sizeof(Block);
+	block->previous = 0;
+	block->state = BLOCK_FREE;
+	s_heapReady = 1;
+}
+
+/* Merges a free block with the free block after it. */
+static void Merge(Block* block)
+{
+	Block* next = NextBlock(block);
+
+	block->size += sizeof(Block) + next->size;
+	if (!IsLastBlock(block))
+	{
+		NextBlock(block)->previous = block->size;
+	}
+}
+
+void* malloc(size_t size)
+{
+	Block* block;
+	Block* rest;
+
+	if (!s_heapReady)
+	{
+		InitHeap();
+	}
+
+	size = (size + HEAP_ALIGN - 1) & ~(size_t)(HEAP_ALIGN - 1);
+	if (size == 0)
+	{
+		size = HEAP_ALIGN;
+	}
+
+	for (block = (Block*)s_heap; ; block = NextBlock(block))
+	{
+		if (block->state == BLOCK_FREE && block->size >= size)
+		{
+			/* Split off the rest if it can hold a block of its own */
+			if (block->size >= size + sizeof(Block) + HEAP_ALIGN)
+			{
+				rest = (Block*)((unsigned char*)(block + 1) + size);
+				rest->size = block->size - size - sizeof(Block);
+				rest->previous = size;
+				rest->state = BLOCK_FREE;
+				block->size = size;
+
+				if (!IsLastBlock(rest))
+				{
+					NextBlock(rest)->previous = rest->size;
+				}
+			}
+
+			block->state = BLOCK_USED;
+			return block + 1;
+		}
+
+		if (IsLastBlock(block))
+		{
+			break;
+		}
+	}
+
+	errno = ENOMEM;
+	return 0;
+}
+
+/* Returns the header of the block which holds the given pointer. */
+static Block* FindBlock(void* p)
+{
+	Block* block = (Block*)p - 1;
+
+	if (block->state == BLOCK_ALIAS)
+	{
+		block = (Block*)((unsigned char*)p - block->previous) - 1;
+	}
+
+	return block;
+}
+
+void free(void* p)
+{
+	Block* block;
+
+	if (p == 0)
+	{
+		return;
+	}
+
+	block = FindBlock(p);
+	block->state = BLOCK_FREE;
+
+	if (!IsLastBlock(block) && NextBlock(block)->state == BLOCK_FREE)
+	{
+		Merge(block);
+	}
+
+	if ((unsigned char*)block > s_heap && PreviousBlock(block)->state == BLOCK_FREE)
+	{
+		Merge(PreviousBlock(block));
+	}
+}
+
+void* calloc(size_t count, size_t size)
+{
+	void* p;
+
+	if (size != 0 && count > (size_t)-1 / size)
+	{
+		errno = ENOMEM;
+		return 0;
+	}
+
+	p = malloc(count * size);
+	if (p != 0)
+	{
+		memset(p, 0, count * size);
+	}
+
+	return p;
+}
+
+size_t malloc_usable_size(void* p)
+{
+	Block* block;
+
+	if (p == 0)
+	{
+		return 0;
+	}
+
+	block = FindBlock(p);
+	return block->size - ((unsigned char*)p - (unsigned char*)(block + 1));
+}
+
+void* realloc(void* p, size_t size)
+{
+	void* moved;
+	size_t available;
+
+	if (p == 0)
+	{
+		return malloc(size);
+	}
+
+	if (size == 0)
+	{
+		free(p);
+		return 0;
+	}
+
+	available = malloc_usable_size(p);
+	if (size <= available)
+	{
+		return p;
+	}
+
+	moved = malloc(size);
+	if (moved != 0)
+	{
+		memcpy(moved, p, available);
+		free(p);
+	}
+
+	return moved;
+}
+
+void* memalign(size_t alignment, size_t size)
+{
+	unsigned char* p;
+	unsigned char* aligned;
+	Block* alias;
+
+	if (alignment <= HEAP_ALIGN)
+	{
+		return malloc(size);
+	}
+
+	/* Room for an alias header in front of the aligned pointer */
+	p = (unsigned char*)malloc(size + alignment + sizeof(Block));
+	if (p == 0)
+	{
+		return 0;
+	}
+
+	aligned = (unsigned char*)(((uintptr_t)p + sizeof(Block) + alignment - 1) & ~(uintptr_t)(alignment - 1));
+	alias = (Block*)aligned - 1;
+	alias->state = BLOCK_ALIAS;
+	alias->previous = aligned - p;
+	return aligned;
+}
+
+int posix_memalign(void** p, size_t alignment, size_t size)
+{
+	*p = memalign(alignment, size);
+	return *p != 0 ? 0 : ENOMEM;
+}
+
+void* aligned_alloc(size_t alignment, size_t size)
+{
+	return memalign(alignment, size);
+}
+
+void* valloc(size_t size)
+{
+	return memalign(4096, size);
+}
+
+void* pvalloc(size_t size)
+{
+	return memalign(4096, (size + 4095) & ~(size_t)4095);
+}
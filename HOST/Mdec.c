@@ -0,0 +1,657 @@
+/*
+ * MDEC encoder and decoder, see Mdec.h.
+ *
+ * The transform is done in floating point as two products with the 8x8 cosine matrix, the
+ * inner loops run over a row of 8 numbers, which the compiler vectorises; MdecIdctReference
+ * is the plain sum over all 64 coefficients for every pixel, to check it against. The MDEC
+ * itself works with 12 bit coefficients and a fixed point transform, so the pixels of the
+ * console can be off by one now and then.
+ */
+
+#include "Mdec.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Escape code: 6 bits run and 10 bits level follow. End of block. */
+#define CODE_ESCAPE		"000001"
+#define CODE_EOB		"10"
+#define ESCAPE_RUN		0xfe
+#define EOB_RUN			0xff
+
+/* Longest code without the sign bit. */
+#define MAX_CODE_LENGTH	16
+
+/* Run/level codes of MPEG-1 (table B.14) as the MDEC bitstream uses them, a sign bit follows each one. */
+typedef struct
+{
+	u_char run, level;
+	const char* bits;
+} Code;
+
+static const Code s_codes[] =
+{
+	{ EOB_RUN, 0, CODE_EOB }, { ESCAPE_RUN, 0, CODE_ESCAPE },
+	{ 0, 1, "11" }, { 1, 1, "011" }, { 0, 2, "0100" }, { 2, 1, "0101" },
+	{ 0, 3, "00101" }, { 3, 1, "00111" }, { 4, 1, "00110" },
+	{ 1, 2, "000110" }, { 5, 1, "000111" }, { 6, 1, "000101" }, { 7, 1, "000100" },
+	{ 0, 4, "0000110" }, { 2, 2, "0000100" }, { 8, 1, "0000111" }, { 9, 1, "0000101" },
+	{ 0, 5, "00100110" }, { 0, 6, "00100001" }, { 1, 3, "00100101" }, { 3, 2, "00100100" },
+	{ 10, 1, "00100111" }, { 11, 1, "00100011" }, { 12, 1, "00100010" }, { 13, 1, "00100000" },
+	{ 0, 7, "0000001010" }, { 1, 4, "0000001100" }, { 2, 3, "0000001011" }, { 4, 2, "0000001111" },
+	{ 5, 2, "0000001001" }, { 14, 1, "0000001110" }, { 15, 1, "0000001101" }, { 16, 1, "0000001000" },
+	{ 0, 8, "000000011101" }, { 0, 9, "000000011000" }, { 0, 10, "000000010011" }, { 0, 11, "000000010000" },
+	{ 1, 5, "000000011011" }, { 2, 4, "000000010100" }, { 3, 3, "000000011100" }, { 4, 3, "000000010010" },
+	{ 6, 2, "000000011110" }, { 7, 2, "000000010101" }, { 8, 2, "000000010001" }, { 17, 1, "000000011111" },
+	{ 18, 1, "000000011010" }, { 19, 1, "000000011001" }, { 20, 1, "000000010111" }, { 21, 1, "000000010110" },
+	{ 0, 12, "0000000011010" }, { 0, 13, "0000000011001" }, { 0, 14, "0000000011000" }, { 0, 15, "0000000010111" },
+	{ 1, 6, "0000000010110" }, { 1, 7, "0000000010101" }, { 2, 5, "0000000010100" }, { 3, 4, "0000000010011" },
+	{ 5, 3, "0000000010010" }, { 9, 2, "0000000010001" }, { 10, 2, "0000000010000" }, { 22, 1, "0000000011111" },
+	{ 23, 1, "0000000011110" }, { 24, 1, "0000000011101" }, { 25, 1, "0000000011100" }, { 26, 1, "0000000011011" },
+	{ 0, 16, "00000000011111" }, { 0, 17, "00000000011110" }, { 0, 18, "00000000011101" }, { 0, 19, "00000000011100" },
+	{ 0, 20, "00000000011011" }, { 0, 21, "00000000011010" }, { 0, 22, "00000000011001" }, { 0, 23, "00000000011000" },
+	{ 0, 24, "00000000010111" }, { 0, 25, "00000000010110" }, { 0, 26, "00000000010101" }, { 0, 27, "00000000010100" },
+	{ 0, 28, "00000000010011" }, { 0, 29, "00000000010010" }, { 0, 30, "00000000010001" }, { 0, 31, "00000000010000" },
+	{ 0, 32, "000000000011000" }, { 0, 33, "000000000010111" }, { 0, 34, "000000000010110" }, { 0, 35, "000000000010101" },
+	{ 0, 36, "000000000010100" }, { 0, 37, "000000000010011" }, { 0, 38, "000000000010010" }, { 0, 39, "000000000010001" },
+	{ 0, 40, "000000000010000" }, { 1, 8, "000000000011111" }, { 1, 9, "000000000011110" }, { 1, 10, "000000000011101" },
+	{ 1, 11, "000000000011100" }, { 1, 12, "000000000011011" }, { 1, 13, "000000000011010" }, { 1, 14, "000000000011001" },
+	{ 1, 15, "0000000000010011" }, { 1, 16, "0000000000010010" }, { 1, 17, "0000000000010001" }, { 1, 18, "0000000000010000" },
+	{ 6, 3, "0000000000010100" }, { 11, 2, "0000000000011010" }, { 12, 2, "0000000000011001" }, { 13, 2, "0000000000011000" },
+	{ 14, 2, "0000000000010111" }, { 15, 2, "0000000000010110" }, { 16, 2, "0000000000010101" }, { 27, 1, "0000000000011111" },
+	{ 28, 1, "0000000000011110" }, { 29, 1, "0000000000011101" }, { 30, 1, "0000000000011100" }, { 31, 1, "0000000000011011" },
+};
+
+#define CODE_COUNT		(int)(sizeof(s_codes) / sizeof(s_codes[0]))
+#define MAX_RUN			32
+#define MAX_LEVEL		41
+
+/* Order of the coefficients in a block. */
+static const u_char s_zigzag[64] =
+{
+	0, 1, 8, 16, 9, 2, 3, 10, 17, 24, 32, 25, 18, 11, 4, 5,
+	12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13, 6, 7, 14, 21, 28,
+	35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+	58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63,
+};
+
+/* Quantisation table DecDCTReset loads, by position in the block. The DC coefficient is only multiplied by the first entry. */
+static const u_char s_quant[64] =
+{
+	2, 16, 19, 22, 26, 27, 29, 34,
+	16, 16, 22, 24, 27, 29, 34, 37,
+	19, 22, 26, 27, 29, 34, 34, 38,
+	22, 22, 26, 27, 29, 34, 37, 40,
+	22, 26, 27, 29, 32, 35, 40, 48,
+	26, 27, 29, 32, 35, 40, 48, 58,
+	26, 27, 29, 34, 38, 46, 56, 69,
+	27, 29, 35, 38, 46, 56, 69, 83,
+};
+
+/* Code and length of every run/level pair which has one, by run and level. */
+static u_short s_encodeBits[MAX_RUN][MAX_LEVEL];
+static u_char s_encodeLength[MAX_RUN][MAX_LEVEL];
+
+/* Entry of every 16 bit start of the bitstream: length << 8 | code index + 1, 0 for no code. */
+static u_short s_decode[1 << MAX_CODE_LENGTH];
+
+/* s_basis[u * 8 + x]: weight of coefficient u for pixel x in one dimension. */
+static float s_basis[64];
+
+static int s_ready = 0;
+static int s_clashes = 0;
+
+static void BuildTables()
+{
+	const char* bits;
+	int i, length, value, first, count, j;
+
+	if (s_ready)
+	{
+		return;
+	}
+
+	for (i = 0; i < CODE_COUNT; ++i)
+	{
+		bits = s_codes[i].bits;
+		length = (int)strlen(bits);
+		for (value = 0, j = 0; j < length; ++j)
+		{
+			value = value * 2 + (bits[j] - '0');
+		}
+
+		if (s_codes[i].run < MAX_RUN)
+		{
+			s_encodeBits[s_codes[i].run][s_codes[i].level] = (u_short)value;
+			s_encodeLength[s_codes[i].run][s_codes[i].level] = (u_char)length;
+		}
+
+		/* Every 16 bit word which starts with the code, a word can only start with one */
+		first = value << (MAX_CODE_LENGTH - length);
+		count = 1 << (MAX_CODE_LENGTH - length);
+		for (j = first; j < first + count; ++j)
+		{
+			if (s_decode[j] != 0)
+			{
+				s_clashes++;
+			}
+			s_decode[j] = (u_short)((length << 8) | (i + 1));
+		}
+	}
+
+	for (i = 0; i < 8; ++i)
+	{
+		for (j = 0; j < 8; ++j)
+		{
+			s_basis[i * 8 + j] = (float)((i == 0 ? sqrt(0.125) : 0.5) * cos((2 * j + 1) * i * M_PI / 16.0));
+		}
+	}
+
+	s_ready = 1;
+}
+
+int MdecCheckCodes()
+{
+	BuildTables();
+	return s_clashes;
+}
+
+/******************************************************/
+/* Transform */
+
+void MdecIdct(const float* in, float* out)
+{
+	float rows[64];
+	int y, u, x;
+
+	BuildTables();
+
+	/* Rows first: rows[y][x] = sum over u of in[y][u] * basis[u][x] */
+	memset(rows, 0, sizeof(rows));
+	for (y = 0; y < 8; ++y)
+	{
+		for (u = 0; u < 8; ++u)
+		{
+			for (x = 0; x < 8; ++x)
+			{
+				rows[y * 8 + x] += in[y * 8 + u] * s_basis[u * 8 + x];
+			}
+		}
+	}
+
+	/* Then columns: out[y][x] = sum over v of basis[v][y] * rows[v][x] */
+	memset(out, 0, 64 * sizeof(float));
+	for (y = 0; y < 8; ++y)
+	{
+		for (u = 0; u < 8; ++u)
+		{
+			for (x = 0; x < 8; ++x)
+			{
+				out[y * 8 + x] += s_basis[u * 8 + y] * rows[u * 8 + x];
+			}
+		}
+	}
+}
+
+void MdecIdctReference(const float* in, float* out)
+{
+	double sum;
+	int x, y, u, v;
+
+	BuildTables();
+
+	for (y = 0; y < 8; ++y)
+	{
+		for (x = 0; x < 8; ++x)
+		{
+			sum = 0.0;
+			for (v = 0; v < 8; ++v)
+			{
+				for (u = 0; u < 8; ++u)
+				{
+					sum += (double)in[v * 8 + u] * s_basis[v * 8 + y] * s_basis[u * 8 + x];
+				}
+			}
+			out[y * 8 + x] = (float)sum;
+		}
+	}
+}
+
+/* The forward transform of the encoder, the IDCT with the matrix transposed. */
+static void Fdct(const float* in, float* out)
+{
+	float rows[64];
+	int y, u, x;
+
+	memset(rows, 0, sizeof(rows));
+	for (y = 0; y < 8; ++y)
+	{
+		for (x = 0; x < 8; ++x)
+		{
+			for (u = 0; u < 8; ++u)
+			{
+				rows[y * 8 + u] += in[y * 8 + x] * s_basis[u * 8 + x];
+			}
+		}
+	}
+
+	memset(out, 0, 64 * sizeof(float));
+	for (u = 0; u < 8; ++u)
+	{
+		for (y = 0; y < 8; ++y)
+		{
+			for (x = 0; x < 8; ++x)
+			{
+				out[u * 8 + x] += s_basis[u * 8 + y] * rows[y * 8 + x];
+			}
+		}
+	}
+}
+
+/******************************************************/
+/* Bitstream */
+
+typedef struct
+{
+	u_char* out;
+	long size;
+	long maxSize;
+	u_long bits;
+	int count;
+} BitWriter;
+
+static void PutBits(BitWriter* writer, u_long value, int length)
+{
+	writer->bits = (writer->bits << length) | (value & ((1u << length) - 1));
+	writer->count += length;
+
+	while (writer->count >= 16)
+	{
+		writer->count -= 16;
+		if (writer->size + 2 <= writer->maxSize)
+		{
+			writer->out[writer->size] = (u_char)(writer->bits >> writer->count);
+			writer->out[writer->size + 1] = (u_char)(writer->bits >> (writer->count + 8));
+		}
+		writer->size += 2;
+	}
+}
+
+typedef struct
+{
+	const u_char* in;
+	const u_char* end;
+	u_long bits;
+	int count;
+	int overrun;
+} BitReader;
+
+static void Refill(BitReader* reader)
+{
+	u_long word = 0;
+
+	while (reader->count <= 16)
+	{
+		if (reader->in + 2 <= reader->end)
+		{
+			word = reader->in[0] | (reader->in[1] << 8);
+			reader->in += 2;
+		}
+		else
+		{
+			word = 0;
+			reader->overrun++;
+		}
+
+		reader->bits |= word << (16 - reader->count);
+		reader->count += 16;
+	}
+}
+
+static u_long PeekBits(BitReader* reader, int length)
+{
+	return (reader->bits & 0xffffffffu) >> (32 - length);
+}
+
+static void SkipBits(BitReader* reader, int length)
+{
+	reader->bits = (reader->bits << length) & 0xffffffffu;
+	reader->count -= length;
+	Refill(reader);
+}
+
+static u_long GetBits(BitReader* reader, int length)
+{
+	u_long value = PeekBits(reader, length);
+
+	SkipBits(reader, length);
+	return value;
+}
+
+/******************************************************/
+/* Encoder */
+
+static int Clamp(int value, int low, int high)
+{
+	return value < low ? low : (value > high ? high : value);
+}
+
+/* Quantises and writes a block. Returns the run/level codes it decodes to. */
+static long EncodeBlock(BitWriter* writer, const float* pixels, int scale)
+{
+	float coefficients[64];
+	int k, run = 0, level, magnitude, divisor, position;
+	long codes = 2;
+
+	Fdct(pixels, coefficients);
+
+	level = Clamp((int)floorf(coefficients[0] / s_quant[0] + 0.5f), -512, 511);
+	PutBits(writer, (u_long)level, 10);
+
+	for (k = 1; k < 64; ++k)
+	{
+		position = s_zigzag[k];
+		divisor = s_quant[position] * scale;
+		level = (int)floorf(fabsf(coefficients[position]) * 8.0f / divisor + 0.5f);
+		if (level == 0)
+		{
+			run++;
+			continue;
+		}
+
+		magnitude = level > 511 ? 511 : level;
+		level = coefficients[position] < 0.0f ? -magnitude : magnitude;
+
+		if (run < MAX_RUN && magnitude < MAX_LEVEL && s_encodeLength[run][magnitude] != 0)
+		{
+			PutBits(writer, s_encodeBits[run][magnitude], s_encodeLength[run][magnitude]);
+			PutBits(writer, level < 0 ? 1 : 0, 1);
+		}
+		else
+		{
+			PutBits(writer, 1, 6);
+			PutBits(writer, (u_long)run, 6);
+			PutBits(writer, (u_long)level, 10);
+		}
+
+		run = 0;
+		codes++;
+	}
+
+	PutBits(writer, 2, 2);
+	return codes;
+}
+
+long MdecEncodeFrame(const u_char* rgb, int width, int height, int scale, u_char* out, long maxSize)
+{
+	float y[4][64], cb[64], cr[64];
+	BitWriter writer;
+	const u_char* p;
+	float r, g, b;
+	long codes = 0, words;
+	int mx, my, px, py, block, i;
+
+	BuildTables();
+
+	writer.out = out;
+	writer.size = MDEC_HEADER_SIZE;
+	writer.maxSize = maxSize;
+	writer.bits = 0;
+	writer.count = 0;
+
+	for (mx = 0; mx < width; mx += MDEC_MB_SIZE)
+	{
+		for (my = 0; my < height; my += MDEC_MB_SIZE)
+		{
+			memset(cb, 0, sizeof(cb));
+			memset(cr, 0, sizeof(cr));
+
+			for (py = 0; py < MDEC_MB_SIZE; ++py)
+			{
+				for (px = 0; px < MDEC_MB_SIZE; ++px)
+				{
+					p = rgb + ((my + py) * width + mx + px) * 3;
+					r = p[0];
+					g = p[1];
+					b = p[2];
+
+					block = (py / 8) * 2 + px / 8;
+					y[block][(py & 7) * 8 + (px & 7)] = 0.299f * r + 0.587f * g + 0.114f * b - 128.0f;
+
+					/* Chroma is the mean over 2x2 pixels */
+					i = (py / 2) * 8 + px / 2;
+					cb[i] += (-0.168736f * r - 0.331264f * g + 0.5f * b) * 0.25f;
+					cr[i] += (0.5f * r - 0.418688f * g - 0.081312f * b) * 0.25f;
+				}
+			}
+
+			codes += EncodeBlock(&writer, cr, scale);
+			codes += EncodeBlock(&writer, cb, scale);
+			for (block = 0; block < 4; ++block)
+			{
+				codes += EncodeBlock(&writer, y[block], scale);
+			}
+		}
+	}
+
+	/* The last word is filled up, the frame is a whole number of 32 bit words */
+	if (writer.count > 0)
+	{
+		PutBits(&writer, 0, 16 - writer.count);
+	}
+	if (writer.size & 2)
+	{
+		PutBits(&writer, 0, 16);
+	}
+
+	words = (codes + 1) / 2;
+	if (writer.size > maxSize || words > 0xffff)
+	{
+		return -1;
+	}
+
+	out[0] = (u_char)words;
+	out[1] = (u_char)(words >> 8);
+	out[2] = (u_char)MDEC_MAGIC;
+	out[3] = (u_char)(MDEC_MAGIC >> 8);
+	out[4] = (u_char)scale;
+	out[5] = 0;
+	out[6] = MDEC_VERSION;
+	out[7] = 0;
+	return writer.size;
+}
+
+/******************************************************/
+/* Decoder */
+
+long MdecDecodeVlc(const u_char* frame, long size, u_short* codes, long maxWords)
+{
+	BitReader reader;
+	long words, total, n = 0;
+	int scale, k, entry, length, run, level;
+	const Code* code;
+
+	BuildTables();
+
+	if (size < MDEC_HEADER_SIZE || (frame[2] | (frame[3] << 8)) != MDEC_MAGIC || (frame[6] | (frame[7] << 8)) != MDEC_VERSION)
+	{
+		return -1;
+	}
+
+	words = frame[0] | (frame[1] << 8);
+	scale = frame[4] & MDEC_MAX_SCALE;
+	total = words * 2;
+	if (words > maxWords)
+	{
+		return -1;
+	}
+
+	codes[0] = (u_short)words;
+	codes[1] = MDEC_MAGIC;
+	codes += 2;
+
+	reader.in = frame + MDEC_HEADER_SIZE;
+	reader.end = frame + size;
+	reader.bits = 0;
+	reader.count = 0;
+	reader.overrun = 0;
+	Refill(&reader);
+
+	while (n < total)
+	{
+		/* An odd number of codes is filled up with an end of block */
+		if (total - n == 1)
+		{
+			codes[n++] = MDEC_EOB;
+			break;
+		}
+
+		codes[n++] = (u_short)((scale << 10) | GetBits(&reader, 10));
+
+		for (k = 0; ; )
+		{
+			entry = s_decode[PeekBits(&reader, MAX_CODE_LENGTH)];
+			if (entry == 0 || reader.overrun > 1 || n == total)
+			{
+				return -1;
+			}
+
+			length = entry >> 8;
+			code = &s_codes[(entry & 0xff) - 1];
+			SkipBits(&reader, length);
+
+			if (code->run == EOB_RUN)
+			{
+				codes[n++] = MDEC_EOB;
+				break;
+			}
+
+			if (code->run == ESCAPE_RUN)
+			{
+				run = (int)GetBits(&reader, 6);
+				level = (int)GetBits(&reader, 10);
+			}
+			else
+			{
+				run = code->run;
+				level = GetBits(&reader, 1) ? -code->level : code->level;
+			}
+
+			k += run + 1;
+			if (k > 63)
+			{
+				return -1;
+			}
+
+			codes[n++] = (u_short)((run << 10) | (level & 0x3ff));
+		}
+	}
+
+	return words;
+}
+
+/* Sign extends the 10 bit level of a code. */
+#define CODE_LEVEL(code)	((int)((short)((code) << 6)) >> 6)
+
+const u_short* MdecDecodeMacroblock(const u_short* codes, const u_short* end, u_char* rgb)
+{
+	float coefficients[64], blocks[6][64];
+	float yy, cb, cr;
+	int block, k, scale, value, px, py, i;
+	u_char* p;
+
+	for (block = 0; block < 6; ++block)
+	{
+		if (codes >= end)
+		{
+			return 0;
+		}
+
+		memset(coefficients, 0, sizeof(coefficients));
+		scale = *codes >> 10;
+		coefficients[0] = (float)(CODE_LEVEL(*codes) * s_quant[0]);
+		codes++;
+
+		for (k = 0; codes < end && *codes != MDEC_EOB; ++codes)
+		{
+			k += (*codes >> 10) + 1;
+			if (k > 63)
+			{
+				return 0;
+			}
+
+			/* Rounded away from zero, and 12 bits like the MDEC keeps them */
+			value = CODE_LEVEL(*codes) * s_quant[s_zigzag[k]] * scale;
+			value = (value + (value < 0 ? -4 : 4)) / 8;
+			coefficients[s_zigzag[k]] = (float)Clamp(value, -2048, 2047);
+		}
+
+		if (codes >= end)
+		{
+			return 0;
+		}
+		codes++;
+
+		MdecIdct(coefficients, blocks[block]);
+	}
+
+	for (py = 0; py < MDEC_MB_SIZE; ++py)
+	{
+		for (px = 0; px < MDEC_MB_SIZE; ++px)
+		{
+			i = (py / 2) * 8 + px / 2;
+			cr = blocks[0][i];
+			cb = blocks[1][i];
+			yy = blocks[2 + (py / 8) * 2 + px / 8][(py & 7) * 8 + (px & 7)] + 128.0f;
+
+			p = rgb + (py * MDEC_MB_SIZE + px) * 3;
+			p[0] = (u_char)Clamp((int)floorf(yy + 1.402f * cr + 0.5f), 0, 255);
+			p[1] = (u_char)Clamp((int)floorf(yy - 0.344136f * cb - 0.714136f * cr + 0.5f), 0, 255);
+			p[2] = (u_char)Clamp((int)floorf(yy + 1.772f * cb + 0.5f), 0, 255);
+		}
+	}
+
+	return codes;
+}
+
+int MdecDecodeFrame(const u_char* frame, long size, int width, int height, u_char* rgb)
+{
+	u_char macroblock[MDEC_MB_SIZE * MDEC_MB_SIZE * 3];
+	u_short* codes;
+	const u_short* next;
+	const u_short* end;
+	long words;
+	int mx, my, row;
+
+	words = (long)(width / MDEC_MB_SIZE) * (height / MDEC_MB_SIZE) * MDEC_MB_CODES / 2 + 1;
+	codes = (u_short*)malloc((words + 1) * 2 * sizeof(u_short));
+	if (codes == 0)
+	{
+		return 0;
+	}
+
+	words = MdecDecodeVlc(frame, size, codes, words);
+	if (words < 0)
+	{
+		free(codes);
+		return 0;
+	}
+
+	next = codes + 2;
+	end = next + words * 2;
+	for (mx = 0; mx < width && next != 0; mx += MDEC_MB_SIZE)
+	{
+		for (my = 0; my < height && next != 0; my += MDEC_MB_SIZE)
+		{
+			next = MdecDecodeMacroblock(next, end, macroblock);
+			for (row = 0; next != 0 && row < MDEC_MB_SIZE; ++row)
+			{
+				memcpy(rgb + ((my + row) * width + mx) * 3, macroblock + row * MDEC_MB_SIZE * 3, MDEC_MB_SIZE * 3);
+			}
+		}
+	}
+
+	free(codes);
+	return next != 0;
+}
@@ -0,0 +1,63 @@
+/*
+ * MDEC codec of the host tools, the format of STR movies (version 2 frames).
+ *
+ * A frame is a bitstream of 16 bit little endian words, read from the top bit down, after
+ * an 8 byte header: the number of 32 bit words the frame decodes to, 0x3800, the quantiser
+ * scale and the version. The picture is cut into macroblocks of 16x16 pixels, column by
+ * column from the left, each one Cr, Cb (8x8, for the whole macroblock) and the four 8x8
+ * luma blocks. Every block is its DC coefficient as a plain 10 bit number followed by the
+ * AC coefficients in zigzag order, as MPEG-1 run/level codes, and the end of block code.
+ *
+ * The bitstream decodes (DecDCTvlc) to the run/level codes the MDEC takes: the quantiser
+ * scale and the DC coefficient, then a code with the zeros to skip and the next coefficient
+ * for every AC coefficient, then MDEC_EOB. The MDEC multiplies them with the quantisation
+ * table, transforms them back (IDCT) and converts YCbCr to RGB.
+ */
+
+#ifndef _MDEC_H_
+#define _MDEC_H_
+
+#include <sys/types.h>
+
+#define MDEC_HEADER_SIZE	8
+#define MDEC_MAGIC			0x3800
+#define MDEC_VERSION		2
+#define MDEC_EOB			0xfe00
+#define MDEC_MAX_SCALE		63
+
+#define MDEC_BLOCK_SIZE		8
+#define MDEC_MB_SIZE		16
+/* Run/level codes of a macroblock at most, six blocks of 64 coefficients and the end. */
+#define MDEC_MB_CODES		(6 * 65)
+
+/*
+ * Encodes an RGB picture (3 bytes per pixel, width and height multiples of 16) with the given
+ * quantiser scale. Returns the size of the frame in bytes, a multiple of 4, or -1 if it is
+ * larger than maxSize.
+ */
+long MdecEncodeFrame(const u_char* rgb, int width, int height, int scale, u_char* out, long maxSize);
+
+/*
+ * Decodes the bitstream of a frame to run/level codes, like DecDCTvlc: codes[0] and codes[1]
+ * get the MDEC command (MDEC_MAGIC << 16 | words), the codes follow. Returns the number of 32
+ * bit words written after the command, -1 if the frame is damaged or doesn't fit.
+ */
+long MdecDecodeVlc(const u_char* frame, long size, u_short* codes, long maxWords);
+
+/*
+ * Decodes the run/level codes of one macroblock to RGB (16x16 pixels, 3 bytes each) like the
+ * MDEC does. Returns the codes following the macroblock, 0 if they ran out.
+ */
+const u_short* MdecDecodeMacroblock(const u_short* codes, const u_short* end, u_char* rgb);
+
+/* Decodes a whole frame to RGB. Returns 0 if it is damaged. */
+int MdecDecodeFrame(const u_char* frame, long size, int width, int height, u_char* rgb);
+
+/* The transform of the MDEC, and the same as a plain sum for checking it. in and out are 8x8, row by row. */
+void MdecIdct(const float* in, float* out);
+void MdecIdctReference(const float* in, float* out);
+
+/* Checks that the code table of the bitstream has no code which is the start of another one. Returns the codes found clashing. */
+int MdecCheckCodes();
+
+#endif
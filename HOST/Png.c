@@ -0,0 +1,733 @@
+/*
+ * Minimal PNG writer and reader. The image data is written in uncompressed deflate blocks,
+ * so no zlib is needed; the files are larger but every viewer and image diff tool reads
+ * them. The reader has a small inflate of its own for the files of paint programs.
+ */
+
+#include <sys/types.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Png.h"
+
+/* Largest payload of a stored deflate block. */
+#define MAX_STORED_BLOCK 65535
+
+static u_long s_crcTable[256];
+static int s_crcTableReady = 0;
+
+u_long Crc32(u_long crc, u_char* data, long size)
+{
+	u_long c;
+	int i, k;
+
+	if (!s_crcTableReady)
+	{
+		for (i = 0; i < 256; ++i)
+		{
+			c = (u_long)i;
+			for (k = 0; k < 8; ++k)
+			{
+				c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+			}
+			s_crcTable[i] = c;
+		}
+
+		s_crcTableReady = 1;
+	}
+
+	crc ^= 0xffffffffu;
+	while (size-- > 0)
+	{
+		crc = s_crcTable[(crc ^ *data++) & 0xff] ^ (crc >> 8);
+	}
+
+	return crc ^ 0xffffffffu;
+}
+
+static void PutLong(u_char* p, u_long value)
+{
+	p[0] = (u_char)(value >> 24);
+	p[1] = (u_char)(value >> 16);
+	p[2] = (u_char)(value >> 8);
+	p[3] = (u_char)value;
+}
+
+static void WriteChunk(FILE* file, char* type, u_char* data, u_long size)
+{
+	u_char header[8];
+	u_char trailer[4];
+	u_long crc;
+
+	PutLong(header, size);
+	memcpy(header + 4, type, 4);
+	crc = Crc32(0, header + 4, 4);
+	crc = Crc32(crc, data, size);
+	PutLong(trailer, crc);
+
+	fwrite(header, 1, 8, file);
+	fwrite(data, 1, size, file);
+	fwrite(trailer, 1, 4, file);
+}
+
+int WritePng(char* filename, int width, int height, u_char* rgb)
+{
+	static const u_char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+	u_char header[13];
+	u_char* raw;
+	u_char* data;
+	u_char* p;
+	u_long rawSize, dataSize, a = 1, b = 0, offset, block;
+	long stride = (long)width * 3;
+	FILE* file;
+	int y;
+
+	/* Every row starts with filter type 0 */
+	rawSize = (u_long)((stride + 1) * height);
+	raw = (u_char*)malloc(rawSize);
+	dataSize = 2 + rawSize + 5 * ((rawSize + MAX_STORED_BLOCK - 1) / MAX_STORED_BLOCK) + 4;
+	data = (u_char*)malloc(dataSize);
+	if (raw == 0 || data == 0)
+	{
+		free(raw);
+		free(data);
+		return 0;
+	}
+
+	for (y = 0; y < height; ++y)
+	{
+		raw[y * (stride + 1)] = 0;
+		memcpy(raw + y * (stride + 1) + 1, rgb + y * stride, stride);
+	}
+
+	/* zlib stream: header, stored blocks, Adler-32 */
+	p = data;
+	*p++ = 0x78;
+	*p++ = 0x01;
+
+	for (offset = 0; offset < rawSize; offset += block)
+	{
+		block = rawSize - offset > MAX_STORED_BLOCK ? MAX_STORED_BLOCK : rawSize - offset;
+		*p++ = offset + block == rawSize ? 1 : 0;
+		*p++ = (u_char)block;
+		*p++ = (u_char)(block >> 8);
+		*p++ = (u_char)~block;
+		*p++ = (u_char)(~block >> 8);
+		memcpy(p, raw + offset, block);
+		p += block;
+	}
+
+	for (offset = 0; offset < rawSize; ++offset)
+	{
+		a = (a + raw[offset]) % 65521;
+		b = (b + a) % 65521;
+	}
+
+	PutLong(p, (b << 16) | a);
+	p += 4;
+
+	PutLong(header, (u_long)width);
+	PutLong(header + 4, (u_long)height);
+	header[8] = 8;		/* bit depth */
+	header[9] = 2;		/* RGB */
+	header[10] = 0;		/* deflate */
+	header[11] = 0;		/* adaptive filtering */
+	header[12] = 0;		/* no interlace */
+
+	file = fopen(filename, "wb");
+	if (file == 0)
+	{
+		free(raw);
+		free(data);
+		return 0;
+	}
+
+	fwrite(signature, 1, sizeof(signature), file);
+	WriteChunk(file, "IHDR", header, sizeof(header));
+	WriteChunk(file, "IDAT", data, (u_long)(p - data));
+	WriteChunk(file, "IEND", 0, 0);
+
+	free(raw);
+	free(data);
+	return fclose(file) == 0;
+}
+
+/******************************************************/
+/* Reading */
+
+/* Largest PNG file the reader accepts. */
+#define MAX_PNG_SIZE (64 * 1024 * 1024)
+
+/* Longest deflate code, and the number of literal/length and distance codes. */
+#define MAX_CODE_BITS	15
+#define MAX_LITERALS	288
+#define MAX_DISTANCES	30
+
+typedef struct
+{
+	u_char* in;
+	u_long inSize, inPos;
+	u_long bits;
+	int bitCount;
+	u_char* out;
+	u_long outSize, outPos;
+} Inflate;
+
+/* Canonical Huffman code: the number of codes of every length and the symbols by code. */
+typedef struct
+{
+	short counts[MAX_CODE_BITS + 1];
+	short symbols[MAX_LITERALS];
+} Huffman;
+
+static u_long GetLong(u_char* p)
+{
+	return ((u_long)p[0] << 24) | ((u_long)p[1] << 16) | ((u_long)p[2] << 8) | p[3];
+}
+
+/* Returns the next count bits of the stream, or -1 past its end. */
+static long GetBits(Inflate* inflate, int count)
+{
+	long value;
+
+	while (inflate->bitCount < count)
+	{
+		if (inflate->inPos >= inflate->inSize)
+		{
+			return -1;
+		}
+
+		inflate->bits |= (u_long)inflate->in[inflate->inPos++] << inflate->bitCount;
+		inflate->bitCount += 8;
+	}
+
+	value = (long)(inflate->bits & ((1UL << count) - 1));
+	inflate->bits >>= count;
+	inflate->bitCount -= count;
+	return value;
+}
+
+/* Builds a code from the code length of every symbol. Returns 0 if the lengths are no code. */
+static int BuildHuffman(Huffman* huffman, u_char* lengths, int count)
+{
+	short offsets[MAX_CODE_BITS + 1];
+	int i, left = 1;
+
+	memset(huffman->counts, 0, sizeof(huffman->counts));
+	for (i = 0; i < count; ++i)
+	{
+		huffman->counts[lengths[i]]++;
+	}
+
+	for (i = 1; i <= MAX_CODE_BITS; ++i)
+	{
+		left = left * 2 - huffman->counts[i];
+		if (left < 0)
+		{
+			return 0;
+		}
+	}
+
+	offsets[1] = 0;
+	for (i = 1; i < MAX_CODE_BITS; ++i)
+	{
+		offsets[i + 1] = (short)(offsets[i] + huffman->counts[i]);
+	}
+
+	for (i = 0; i < count; ++i)
+	{
+		if (lengths[i] != 0)
+		{
+			huffman->symbols[offsets[lengths[i]]++] = (short)i;
+		}
+	}
+
+	return 1;
+}
+
+/* Decodes one symbol, one bit at a time. Returns -1 on a broken stream. */
+static int DecodeSymbol(Inflate* inflate, Huffman* huffman)
+{
+	long code = 0, first = 0, index = 0, bit;
+	int length;
+
+	for (length = 1; length <= MAX_CODE_BITS; ++length)
+	{
+		bit = GetBits(inflate, 1);
+		if (bit < 0)
+		{
+			return -1;
+		}
+
+		code |= bit;
+		if (code - first < huffman->counts[length])
+		{
+			return huffman->symbols[index + code - first];
+		}
+
+		index += huffman->counts[length];
+		first = (first + huffman->counts[length]) << 1;
+		code <<= 1;
+	}
+
+	return -1;
+}
+
+/* Inflates one block of Huffman coded data. Returns 0 on a broken stream. */
+static int InflateCodes(Inflate* inflate, Huffman* literals, Huffman* distances)
+{
+	static const short lengthBase[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+		35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+	static const short lengthExtra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+		3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+	static const u_short distanceBase[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+		257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+	static const short distanceExtra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+		7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+	int symbol;
+	long length, distance, extra;
+
+	while (1)
+	{
+		symbol = DecodeSymbol(inflate, literals);
+		if (symbol < 0)
+		{
+			return 0;
+		}
+
+		if (symbol == 256)
+		{
+			return 1;
+		}
+
+		if (symbol < 256)
+		{
+			if (inflate->outPos >= inflate->outSize)
+			{
+				return 0;
+			}
+			inflate->out[inflate->outPos++] = (u_char)symbol;
+			continue;
+		}
+
+		/* A copy of earlier output */
+		symbol -= 257;
+		if (symbol >= 29 || (extra = GetBits(inflate, lengthExtra[symbol])) < 0)
+		{
+			return 0;
+		}
+		length = lengthBase[symbol] + extra;
+
+		symbol = DecodeSymbol(inflate, distances);
+		if (symbol < 0 || symbol >= MAX_DISTANCES || (extra = GetBits(inflate, distanceExtra[symbol])) < 0)
+		{
+			return 0;
+		}
+		distance = distanceBase[symbol] + extra;
+
+		if ((u_long)distance > inflate->outPos || inflate->outPos + length > inflate->outSize)
+		{
+			return 0;
+		}
+
+		while (length-- > 0)
+		{
+			inflate->out[inflate->outPos] = inflate->out[inflate->outPos - distance];
+			inflate->outPos++;
+		}
+	}
+}
+
+/* Reads the code lengths of a block with its own codes and builds them. */
+static int ReadDynamicCodes(Inflate* inflate, Huffman* literals, Huffman* distances)
+{
+	static const u_char order[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+	u_char lengths[MAX_LITERALS + MAX_DISTANCES];
+	Huffman lengthCode;
+	long literalCount, distanceCount, codeCount, repeat;
+	int i, symbol;
+	u_char previous;
+
+	literalCount = GetBits(inflate, 5) + 257;
+	distanceCount = GetBits(inflate, 5) + 1;
+	codeCount = GetBits(inflate, 4) + 4;
+	if (codeCount < 4 || literalCount > MAX_LITERALS || distanceCount > MAX_DISTANCES)
+	{
+		return 0;
+	}
+
+	memset(lengths, 0, sizeof(lengths));
+	for (i = 0; i < codeCount; ++i)
+	{
+		lengths[order[i]] = (u_char)GetBits(inflate, 3);
+	}
+
+	if (!BuildHuffman(&lengthCode, lengths, 19))
+	{
+		return 0;
+	}
+
+	for (i = 0; i < literalCount + distanceCount; )
+	{
+		symbol = DecodeSymbol(inflate, &lengthCode);
+		if (symbol < 0)
+		{
+			return 0;
+		}
+
+		if (symbol < 16)
+		{
+			lengths[i++] = (u_char)symbol;
+			continue;
+		}
+
+		/* Runs of the previous length or of zeros */
+		previous = 0;
+		if (symbol == 16)
+		{
+			if (i == 0)
+			{
+				return 0;
+			}
+			previous = lengths[i - 1];
+			repeat = 3 + GetBits(inflate, 2);
+		}
+		else if (symbol == 17)
+		{
+			repeat = 3 + GetBits(inflate, 3);
+		}
+		else
+		{
+			repeat = 11 + GetBits(inflate, 7);
+		}
+
+		if (repeat < 3 || i + repeat > literalCount + distanceCount)
+		{
+			return 0;
+		}
+
+		while (repeat-- > 0)
+		{
+			lengths[i++] = previous;
+		}
+	}
+
+	return BuildHuffman(literals, lengths, (int)literalCount) &&
+		BuildHuffman(distances, lengths + literalCount, (int)distanceCount);
+}
+
+/* Inflates a zlib stream into out. Returns the number of bytes written, or -1 on a broken stream. */
+static long InflateZlib(u_char* in, u_long inSize, u_char* out, u_long outSize)
+{
+	static Huffman fixedLiterals, fixedDistances;
+	static int fixedReady = 0;
+	Huffman literals, distances;
+	u_char lengths[MAX_LITERALS];
+	Inflate inflate;
+	long last, type, size;
+	int i;
+
+	if (!fixedReady)
+	{
+		for (i = 0; i < MAX_LITERALS; ++i)
+		{
+			lengths[i] = (u_char)(i < 144 ? 8 : i < 256 ? 9 : i < 280 ? 7 : 8);
+		}
+		BuildHuffman(&fixedLiterals, lengths, MAX_LITERALS);
+
+		for (i = 0; i < MAX_DISTANCES; ++i)
+		{
+			lengths[i] = 5;
+		}
+		BuildHuffman(&fixedDistances, lengths, MAX_DISTANCES);
+
+		fixedReady = 1;
+	}
+
+	/* Deflate only, no preset dictionary */
+	if (inSize < 2 || (in[0] & 0x0f) != 8 || ((in[0] << 8) | in[1]) % 31 != 0 || (in[1] & 0x20))
+	{
+		return -1;
+	}
+
+	memset(&inflate, 0, sizeof(inflate));
+	inflate.in = in;
+	inflate.inSize = inSize;
+	inflate.inPos = 2;
+	inflate.out = out;
+	inflate.outSize = outSize;
+
+	do
+	{
+		last = GetBits(&inflate, 1);
+		type = GetBits(&inflate, 2);
+
+		if (type == 0)
+		{
+			/* Stored block, starts at the next byte */
+			inflate.bits = 0;
+			inflate.bitCount = 0;
+			if (inflate.inPos + 4 > inSize)
+			{
+				return -1;
+			}
+
+			size = in[inflate.inPos] | (in[inflate.inPos + 1] << 8);
+			inflate.inPos += 4;
+			if (inflate.inPos + size > inSize || inflate.outPos + size > outSize)
+			{
+				return -1;
+			}
+
+			memcpy(out + inflate.outPos, in + inflate.inPos, size);
+			inflate.inPos += size;
+			inflate.outPos += size;
+		}
+		else if (type == 1)
+		{
+			if (!InflateCodes(&inflate, &fixedLiterals, &fixedDistances))
+			{
+				return -1;
+			}
+		}
+		else if (type == 2)
+		{
+			if (!ReadDynamicCodes(&inflate, &literals, &distances) || !InflateCodes(&inflate, &literals, &distances))
+			{
+				return -1;
+			}
+		}
+		else
+		{
+			return -1;
+		}
+	}
+	while (last == 0);
+
+	return (long)inflate.outPos;
+}
+
+/* Paeth predictor of the PNG filters. */
+static int Paeth(int a, int b, int c)
+{
+	int p = a + b - c;
+	int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+
+	if (pa <= pb && pa <= pc)
+	{
+		return a;
+	}
+
+	return pb <= pc ? b : c;
+}
+
+/* The parts of a PNG file the reader needs. */
+typedef struct
+{
+	int width, height;
+	int depth;
+	int colorType;
+	u_char palette[256 * 4];
+	/* The contents of all IDAT chunks. */
+	u_char* data;
+	u_long dataSize;
+} PngInfo;
+
+/* Collects header, palette and image data of a PNG file. Returns 0 if it is no PNG file the reader supports. */
+static int ReadChunks(u_char* file, u_long fileSize, PngInfo* info)
+{
+	static const u_char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+	u_char* p;
+	u_long chunkSize;
+	int i;
+
+	if (fileSize < 8 || memcmp(file, signature, 8) != 0)
+	{
+		return 0;
+	}
+
+	for (p = file + 8; p + 12 <= file + fileSize; p += 12 + chunkSize)
+	{
+		chunkSize = GetLong(p);
+		if (chunkSize > (u_long)(file + fileSize - p) - 12)
+		{
+			return 0;
+		}
+
+		if (memcmp(p + 4, "IHDR", 4) == 0 && chunkSize >= 13)
+		{
+			info->width = (int)GetLong(p + 8);
+			info->height = (int)GetLong(p + 12);
+			info->depth = p[16];
+			info->colorType = p[17];
+
+			/* Compression 0, filter method 0 and no interlace */
+			if (p[18] != 0 || p[19] != 0 || p[20] != 0)
+			{
+				return 0;
+			}
+		}
+		else if (memcmp(p + 4, "PLTE", 4) == 0)
+		{
+			for (i = 0; i < 256 && i * 3 + 2 < (int)chunkSize; ++i)
+			{
+				memcpy(info->palette + i * 4, p + 8 + i * 3, 3);
+			}
+		}
+		else if (memcmp(p + 4, "tRNS", 4) == 0 && info->colorType == 3)
+		{
+			for (i = 0; i < 256 && i < (int)chunkSize; ++i)
+			{
+				info->palette[i * 4 + 3] = p[8 + i];
+			}
+		}
+		else if (memcmp(p + 4, "IDAT", 4) == 0)
+		{
+			memcpy(info->data + info->dataSize, p + 8, chunkSize);
+			info->dataSize += chunkSize;
+		}
+		else if (memcmp(p + 4, "IEND", 4) == 0)
+		{
+			break;
+		}
+	}
+
+	/* 8 bits per channel, palettes may have fewer bits per pixel */
+	return info->width > 0 && info->height > 0 && info->width <= 16384 && info->height <= 16384 &&
+		(info->colorType == 0 || info->colorType == 2 || info->colorType == 3 || info->colorType == 4 || info->colorType == 6) &&
+		(info->depth == 8 || (info->colorType == 3 && (info->depth == 1 || info->depth == 2 || info->depth == 4)));
+}
+
+/*
+ * Undoes the filters of the inflated rows in place, each against the already unfiltered row
+ * above it. Returns 0 on an unknown filter.
+ */
+static int Unfilter(u_char* raw, u_long stride, int height, int bytesPerPixel)
+{
+	u_char *row, *previous;
+	int x, y, a, b, c;
+
+	for (y = 0; y < height; ++y)
+	{
+		row = raw + y * (stride + 1) + 1;
+		previous = y > 0 ? row - (stride + 1) : 0;
+
+		if (row[-1] > 4)
+		{
+			return 0;
+		}
+
+		for (x = 0; x < (int)stride; ++x)
+		{
+			a = x >= bytesPerPixel ? row[x - bytesPerPixel] : 0;
+			b = previous != 0 ? previous[x] : 0;
+			c = previous != 0 && x >= bytesPerPixel ? previous[x - bytesPerPixel] : 0;
+
+			switch (row[-1])
+			{
+			case 1: row[x] = (u_char)(row[x] + a); break;
+			case 2: row[x] = (u_char)(row[x] + b); break;
+			case 3: row[x] = (u_char)(row[x] + (a + b) / 2); break;
+			case 4: row[x] = (u_char)(row[x] + Paeth(a, b, c)); break;
+			}
+		}
+	}
+
+	return 1;
+}
+
+/* Converts the unfiltered rows to RGBA. */
+static void ConvertRows(PngInfo* info, u_char* raw, u_long stride, u_char* rgba)
+{
+	u_char *row, *p;
+	int x, y, value;
+
+	for (y = 0; y < info->height; ++y)
+	{
+		row = raw + y * (stride + 1) + 1;
+
+		for (x = 0; x < info->width; ++x)
+		{
+			p = rgba + ((u_long)y * info->width + x) * 4;
+
+			switch (info->colorType)
+			{
+			case 0:
+				p[0] = p[1] = p[2] = row[x];
+				p[3] = 255;
+				break;
+			case 2:
+				memcpy(p, row + x * 3, 3);
+				p[3] = 255;
+				break;
+			case 3:
+				value = (row[x * info->depth / 8] >> (8 - info->depth - (x * info->depth) % 8)) & ((1 << info->depth) - 1);
+				memcpy(p, info->palette + value * 4, 4);
+				break;
+			case 4:
+				p[0] = p[1] = p[2] = row[x * 2];
+				p[3] = row[x * 2 + 1];
+				break;
+			case 6:
+				memcpy(p, row + x * 4, 4);
+				break;
+			}
+		}
+	}
+}
+
+u_char* ReadPng(char* filename, int* width, int* height)
+{
+	static const int channels[7] = { 1, 0, 3, 1, 2, 0, 4 };
+	PngInfo info;
+	u_char* file;
+	u_char* raw = 0;
+	u_char* rgba = 0;
+	u_long fileSize, stride, rawSize;
+	int bytesPerPixel;
+	FILE* in;
+
+	in = fopen(filename, "rb");
+	if (in == 0)
+	{
+		return 0;
+	}
+
+	file = (u_char*)malloc(MAX_PNG_SIZE);
+	fileSize = file != 0 ? (u_long)fread(file, 1, MAX_PNG_SIZE, in) : 0;
+	fclose(in);
+
+	/* All palette entries are opaque unless tRNS says otherwise */
+	memset(&info, 0, sizeof(info));
+	memset(info.palette, 0xff, sizeof(info.palette));
+	info.data = (u_char*)malloc(fileSize + 1);
+
+	if (info.data != 0 && ReadChunks(file, fileSize, &info))
+	{
+		bytesPerPixel = info.depth == 8 ? channels[info.colorType] : 1;
+		stride = ((u_long)info.width * channels[info.colorType] * info.depth + 7) / 8;
+		rawSize = (stride + 1) * (u_long)info.height;
+		raw = (u_char*)malloc(rawSize);
+		rgba = (u_char*)malloc((u_long)info.width * info.height * 4);
+
+		if (raw != 0 && rgba != 0 && InflateZlib(info.data, info.dataSize, raw, rawSize) == (long)rawSize &&
+			Unfilter(raw, stride, info.height, bytesPerPixel))
+		{
+			ConvertRows(&info, raw, stride, rgba);
+			*width = info.width;
+			*height = info.height;
+		}
+		else
+		{
+			free(rgba);
+			rgba = 0;
+		}
+	}
+
+	free(file);
+	free(info.data);
+	free(raw);
+	return rgba;
+}
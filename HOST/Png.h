@@ -0,0 +1,20 @@
+
+#ifndef _PNG_H_
+#define _PNG_H_
+
+#include <sys/types.h>
+
+/* Writes an 8 bit RGB image (3 bytes per pixel, rows top to bottom) as an uncompressed PNG file. Returns 0 on failure. */
+int WritePng(char* filename, int width, int height, u_char* rgb);
+
+/*
+ * Reads a PNG file of 8 bits per channel (gray, RGB, with or without alpha) or with a palette,
+ * not interlaced. Returns the pixels as RGBA (4 bytes per pixel, rows top to bottom), to be
+ * given back with free(), or 0 on failure.
+ */
+u_char* ReadPng(char* filename, int* width, int* height);
+
+/* CRC-32 as used by PNG and zip, start with crc = 0. */
+u_long Crc32(u_long crc, u_char* data, long size);
+
+#endif
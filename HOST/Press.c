@@ -0,0 +1,107 @@
+/*
+ * Host implementation of the libpress functions used by the game, over the codec of the
+ * host tools (see Mdec.c).
+ */
+
+#include <sys/types.h>
+#include <libpress.h>
+
+#include <string.h>
+
+#include "Mdec.h"
+
+/* Modes of DecDCTin: 16 bit pixels with the mask bit set, or 24 bit ones. */
+#define DCT_MODE_16		2
+#define DCT_MODE_24		3
+
+/* Words of pixels of a macroblock, 16x16 pixels of 2 or 3 bytes. */
+#define MB_WORDS_16		(MDEC_MB_SIZE * MDEC_MB_SIZE / 2)
+#define MB_WORDS_24		(MDEC_MB_SIZE * MDEC_MB_SIZE * 3 / 4)
+
+/* Longest a run/level code is in the bitstream: the escape code, run and level. */
+#define MAX_CODE_BITS	22
+
+HostMdecStats HostMdec;
+
+/* Run/level codes given to DecDCTin which are left, and the output mode. */
+static const u_short* s_codes = 0;
+static const u_short* s_end = 0;
+static int s_mode = DCT_MODE_16;
+
+void DecDCTReset(int mode)
+{
+	s_codes = 0;
+	s_end = 0;
+}
+
+int DecDCTvlc(u_long* bs, u_long* buf)
+{
+	const u_char* frame = (const u_char*)bs;
+	long words = frame[0] | (frame[1] << 8);
+	long size;
+
+	/* The bitstream has no size of its own, it can't be longer than its codes at their longest */
+	size = MDEC_HEADER_SIZE + (words * 2 * MAX_CODE_BITS + 31) / 32 * 4;
+
+	HostMdec.frames++;
+	if (MdecDecodeVlc(frame, size, (u_short*)buf, 0xffff) < 0)
+	{
+		HostMdec.errors++;
+		return -1;
+	}
+
+	return 0;
+}
+
+void DecDCTin(u_long* buf, int mode)
+{
+	const u_short* codes = (const u_short*)buf;
+
+	s_codes = codes + 2;
+	s_end = s_codes + codes[0] * 2;
+	s_mode = mode;
+}
+
+void DecDCTout(u_long* buf, int size)
+{
+	u_char rgb[MDEC_MB_SIZE * MDEC_MB_SIZE * 3];
+	u_short* pixels16 = (u_short*)buf;
+	u_char* pixels24 = (u_char*)buf;
+	const u_short* next;
+	int macroblocks, i;
+	u_char* p;
+
+	macroblocks = size / (s_mode == DCT_MODE_24 ? MB_WORDS_24 : MB_WORDS_16);
+
+	for (; macroblocks > 0; --macroblocks)
+	{
+		/* A damaged macroblock comes out black, and everything after it */
+		next = s_codes != 0 ? MdecDecodeMacroblock(s_codes, s_end, rgb) : 0;
+		if (next == 0)
+		{
+			memset(rgb, 0, sizeof(rgb));
+			if (s_codes != 0)
+			{
+				HostMdec.errors++;
+			}
+		}
+		s_codes = next;
+		HostMdec.macroblocks++;
+
+		if (s_mode == DCT_MODE_24)
+		{
+			memcpy(pixels24, rgb, sizeof(rgb));
+			pixels24 += sizeof(rgb);
+			continue;
+		}
+
+		for (i = 0, p = rgb; i < MDEC_MB_SIZE * MDEC_MB_SIZE; ++i, p += 3)
+		{
+			*pixels16++ = (u_short)(0x8000 | (p[0] >> 3) | ((p[1] >> 3) << 5) | ((p[2] >> 3) << 10));
+		}
+	}
+}
+
+int DecDCTinSync(int mode) { return 0; }
+
+int DecDCToutSync(int mode) { return 0; }
@@ -0,0 +1,545 @@
+/*
+ * Runs the game against the host software GPU and reports what every frame draws.
+ *
+ * The whole Engine is used as on the console: order tables, GsSortObject4, sprites and
+ * fonts go through the host libgs and are rasterised into a 1024x512 VRAM by Gpu.c.
+ * The data comes from a virtual disc built from the pack script, the controller is
+ * driven by an input script. For every frame one line with the primitive counts, the
+ * fill rate and a CRC of the drawn image is printed; frames can be written as PNGs and
+ * the CRCs compared against an earlier run, so rendering changes can be checked for
+ * pixel equality and cost without a console.
+ *
+ * Input scripts hold one "frame buttons" line per change of the pressed buttons, e.g.
+ * "40 cross left", "60 none". Buttons: up down left right cross circle square triangle
+ * start select l1 l2 r1 r2 none.
+ *
+ * With -b the benchmark state (Bench.c) is started instead of the title and the tool
+ * exits once all its scenarios are done; frames are neither captured nor printed then,
+ * so the host time of a frame is mostly the game and the software GPU. The run fails
+ * (exit code 1) if a scenario went over the primitive or packet budget of a frame, which
+ * -l prims:bytes sets instead of the defaults of Bench.h. Frame times are the processor time
+ * of the process, and every scenario is run -r times (HOST_BENCH_RUNS by default) with each
+ * frame keeping its fastest time; the p50 of the single runs is printed as well, so a
+ * change between two builds can be told from the noise.
+ *
+ * The virtual console is a European (PAL) one, -n makes it an American one, which
+ * runs the game in NTSC at 60 Hz. With -e every n-th read of the virtual drive fails,
+ * to check that PckLib retries it.
+ *
+ * Host frame times say nothing about the console, so the governor (Governor.c) is kept at
+ * the default quality level. -g picks another level, "-g auto" lets the governor run.
+ *
+ * -m puts an XA file (see XaTool.c) on the disc as MUSIC.XA, so the music streams and the
+ * pack is read through the stream, in real time against the vertical blanks. The summary
+ * then tells how the reads went and whether the audio had gaps.
+ *
+ * -v puts a movie (see StrTool.c) on the disc as INTRO.STR, which the game plays before the
+ * title, decoded by the host MDEC (Press.c). The default input skips it with its first Start.
+ *
+ * Usage: render [-f frames] [-o dir] [-p every] [-i input] [-c golden] [-d root] [-q] [-b] [-l prims:bytes] [-r runs] [-n] [-e every] [-g level|auto] [-m music.xa] [-v intro.str]
+ */
+
+#include "../SRC/GAME.C"
+
+/* The game itself, main() is started by the tool. */
+#define main BreakoutMain
+#include "../SRC/BREAKOUT.C"
+#undef main
+
+#include <libcd.h>
+#include <libpress.h>
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../SRC/Music.h"
+#include "Png.h"
+
+/* Frames rendered if not set with -f. */
+#define DEFAULT_FRAMES		300
+#define MAX_INPUT_STEPS		256
+#define MAX_GOLDEN_FRAMES	65536
+
+/* Runs of every benchmark scenario if not set with -r. */
+#define HOST_BENCH_RUNS		5
+
+typedef struct
+{
+	u_long frame;
+	PadData buttons;
+} InputStep;
+
+static const struct
+{
+	const char* name;
+	PadData button;
+} s_buttonNames[] =
+{
+	{ "up", PAD_Up }, { "down", PAD_Down }, { "left", PAD_Left }, { "right", PAD_Right },
+	{ "cross", PAD_Cross }, { "circle", PAD_Circle }, { "square", PAD_Square }, { "triangle", PAD_Triangle },
+	{ "start", PAD_Start }, { "select", PAD_Select },
+	{ "l1", PAD_L1 }, { "l2", PAD_L2 }, { "r1", PAD_R1 }, { "r2", PAD_R2 },
+};
+
+/* Default session: open the title menu, start the game, launch the ball and move around. */
+static const InputStep s_defaultInput[] =
+{
+	{ 20, PAD_Start }, { 22, 0 },
+	{ 40, PAD_Cross }, { 42, 0 },
+	{ 80, PAD_Cross }, { 82, 0 },
+	{ 100, PAD_Left }, { 140, 0 },
+	{ 160, PAD_Right }, { 230, 0 },
+	{ 250, PAD_Cross | PAD_Left }, { 270, 0 },
+};
+
+static InputStep s_steps[MAX_INPUT_STEPS];
+static int s_stepCount = 0;
+static int s_nextStep = 0;
+
+static u_long s_frame = 0;
+static u_long s_frames = DEFAULT_FRAMES;
+static char* s_outputDir = 0;
+static u_long s_pngEvery = 1;
+static int s_quiet = 0;
+
+/* XA files mounted as MUSIC.XA and INTRO.STR, 0 for none. */
+static char* s_music = 0;
+static char* s_intro = 0;
+static int s_bench = 0;
+
+static u_long s_golden[MAX_GOLDEN_FRAMES];
+static u_long s_goldenCount = 0;
+static u_long s_mismatches = 0;
+
+/* Totals over all frames for the summary. */
+static u_long s_totalPrims = 0;
+static u_long s_maxPrims = 0;
+static unsigned long long s_totalPixels = 0;
+static u_long s_maxPixels = 0;
+
+static u_char s_image[HOST_VRAM_WIDTH * HOST_VRAM_HEIGHT * 3];
+
+/******************************************************/
+/* Input */
+
+static int ParseButtons(char* text, PadData* buttons)
+{
+	char* word;
+	int i;
+
+	*buttons = 0;
+	for (word = strtok(text, " \t\r\n"); word != 0; word = strtok(0, " \t\r\n"))
+	{
+		if (strcasecmp(word, "none") == 0)
+		{
+			continue;
+		}
+
+		for (i = 0; i < (int)(sizeof(s_buttonNames) / sizeof(s_buttonNames[0])); ++i)
+		{
+			if (strcasecmp(word, s_buttonNames[i].name) == 0)
+			{
+				*buttons |= s_buttonNames[i].button;
+				break;
+			}
+		}
+
+		if (i == (int)(sizeof(s_buttonNames) / sizeof(s_buttonNames[0])))
+		{
+			fprintf(stderr, "unknown button '%s'\n", word);
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+static int LoadInput(char* filename)
+{
+	char line[256];
+	char* p;
+	FILE* file = fopen(filename, "r");
+	int lineNumber = 0;
+	long frame;
+
+	if (file == 0)
+	{
+		fprintf(stderr, "%s: can't open\n", filename);
+		return 0;
+	}
+
+	while (fgets(line, sizeof(line), file) != 0)
+	{
+		lineNumber++;
+		if ((p = strchr(line, '#')) != 0)
+		{
+			*p = 0;
+		}
+
+		frame = strtol(line, &p, 10);
+		if (p == line)
+		{
+			continue;
+		}
+
+		if (s_stepCount == MAX_INPUT_STEPS || frame < 0 || !ParseButtons(p, &s_steps[s_stepCount].buttons))
+		{
+			fprintf(stderr, "%s:%d: bad input step\n", filename, lineNumber);
+			fclose(file);
+			return 0;
+		}
+
+		s_steps[s_stepCount++].frame = (u_long)frame;
+	}
+
+	fclose(file);
+	return 1;
+}
+
+/* Sets the controller packet which the next vertical blank latches. */
+static void SetPad(PadData buttons)
+{
+	ControllerPacket* packet = GetControllerPacket(0);
+
+	packet->status = PAD_STATUS_OK;
+	packet->data_format = (CONTROLLER_TYPE_PAD << 4) | 1;
+	packet->data.pad = (PadData)~buttons;
+}
+
+/******************************************************/
+/* Frame capture */
+
+/* Converts the drawing area of the frame to RGB, returns its CRC. */
+static u_long CaptureFrame(RECT* area)
+{
+	u_char* out = s_image;
+	u_short pixel;
+	int x, y;
+
+	for (y = 0; y < area->h; ++y)
+	{
+		for (x = 0; x < area->w; ++x)
+		{
+			pixel = HostVram[(area->y + y) & (HOST_VRAM_HEIGHT - 1)][(area->x + x) & (HOST_VRAM_WIDTH - 1)];
+			*out++ = (u_char)((pixel & 31) << 3 | (pixel & 31) >> 2);
+			*out++ = (u_char)(((pixel >> 5) & 31) << 3 | ((pixel >> 5) & 31) >> 2);
+			*out++ = (u_char)(((pixel >> 10) & 31) << 3 | ((pixel >> 10) & 31) >> 2);
+		}
+	}
+
+	return Crc32(0, s_image, (long)(out - s_image));
+}
+
+static int LoadGolden(char* filename)
+{
+	char line[512];
+	FILE* file = fopen(filename, "r");
+	unsigned long frame, crc;
+
+	if (file == 0)
+	{
+		fprintf(stderr, "%s: can't open\n", filename);
+		return 0;
+	}
+
+	/* The frame lines of an earlier run, everything else is ignored */
+	while (fgets(line, sizeof(line), file) != 0)
+	{
+		if (sscanf(line, "frame %lu crc %lx", &frame, &crc) == 2 && frame < MAX_GOLDEN_FRAMES)
+		{
+			s_golden[frame] = (u_long)crc;
+			if (frame + 1 > s_goldenCount)
+			{
+				s_goldenCount = (u_long)frame + 1;
+			}
+		}
+	}
+
+	fclose(file);
+	return 1;
+}
+
+static void PrintSummary()
+{
+	printf("frames %lu prims avg %lu max %lu pixels avg %llu max %lu",
+		(unsigned long)s_frame, (unsigned long)(s_frame ? s_totalPrims / s_frame : 0), (unsigned long)s_maxPrims,
+		s_frame ? s_totalPixels / s_frame : 0, (unsigned long)s_maxPixels);
+
+	if (s_goldenCount > 0)
+	{
+		printf(" mismatches %lu", (unsigned long)s_mismatches);
+	}
+
+	printf("\nassets file hits %lu misses %lu vram hits %lu uploads %lu evictions %lu resident %lu idle %lu\n",
+		(unsigned long)GetAssetStats()->fileHits, (unsigned long)GetAssetStats()->fileMisses,
+		(unsigned long)GetAssetStats()->vramHits, (unsigned long)GetAssetStats()->vramUploads,
+		(unsigned long)(GetAssetStats()->evictions + GetAssetStats()->vramEvictions),
+		(unsigned long)GetAssetStats()->residentBytes, (unsigned long)GetAssetStats()->idleBytes);
+
+	printf("cd sector hits %lu misses %lu read ahead %lu retries %lu failures %lu\n",
+		(unsigned long)PckGetStats()->Hits, (unsigned long)PckGetStats()->Misses,
+		(unsigned long)PckGetStats()->ReadAhead, (unsigned long)PckGetStats()->Retries,
+		(unsigned long)PckGetStats()->Failures);
+
+	if (s_music != 0)
+	{
+		printf("music streamed %lu direct %lu pauses %lu loops %lu wait %lu longest %lu audio %lu underruns %lu\n",
+			(unsigned long)GetMusicStats()->streamedSectors, (unsigned long)GetMusicStats()->directReads,
+			(unsigned long)GetMusicStats()->pauses, (unsigned long)GetMusicStats()->loops,
+			(unsigned long)GetMusicStats()->waitVBlanks, (unsigned long)GetMusicStats()->longestWait,
+			(unsigned long)HostCd.audioSectors, (unsigned long)HostCd.underruns);
+	}
+
+	if (s_intro != 0)
+	{
+		printf("intro frames %lu dropped %lu decoded %lu macroblocks %lu errors %lu\n",
+			(unsigned long)HostCd.frames, (unsigned long)HostCd.droppedFrames, (unsigned long)HostMdec.frames,
+			(unsigned long)HostMdec.macroblocks, (unsigned long)HostMdec.errors);
+	}
+}
+
+/* Runs after every drawn order table, that is once per frame. */
+static void FrameDrawn()
+{
+	RECT area = GsDRAWENV.clip;
+	char filename[1024];
+	BenchResult* results;
+	u_long crc, prims = 0;
+	int i;
+
+	/* ErrorMessage prints with the debug font and never returns */
+	if (HostFntFlushCount > 0)
+	{
+		fprintf(stderr, "frame %lu: the game stopped with an error message\n", (unsigned long)s_frame);
+		exit(1);
+	}
+
+	if (s_bench)
+	{
+		memset(&HostGpu, 0, sizeof(HostGpu));
+		results = GetBenchResults(&i);
+		if (i == BENCH_SCENARIOS)
+		{
+			for (i = 0; i < BENCH_SCENARIOS; ++i)
+			{
+				if (results[i].overBudget)
+				{
+					fprintf(stderr, "bench %s went over the budget\n", results[i].name);
+					exit(1);
+				}
+			}
+			exit(0);
+		}
+		return;
+	}
+
+	crc = CaptureFrame(&area);
+
+	for (i = 0; i < HOST_PRIM_TYPES; ++i)
+	{
+		if (i != HOST_PRIM_MODE)
+		{
+			prims += HostGpu.prims[i];
+		}
+	}
+
+	s_totalPrims += prims;
+	s_totalPixels += HostGpu.pixels;
+	if (prims > s_maxPrims)
+	{
+		s_maxPrims = prims;
+	}
+	if (HostGpu.pixels > s_maxPixels)
+	{
+		s_maxPixels = HostGpu.pixels;
+	}
+
+	if (!s_quiet)
+	{
+		printf("frame %lu crc %08lx", (unsigned long)s_frame, (unsigned long)crc);
+		for (i = 0; i < HOST_PRIM_TYPES; ++i)
+		{
+			if (HostGpu.prims[i] != 0)
+			{
+				printf(" %s %lu", HostPrimNames[i], (unsigned long)HostGpu.prims[i]);
+			}
+		}
+		printf(" pixels %lu texels %lu", (unsigned long)HostGpu.pixels, (unsigned long)HostGpu.texels);
+		if (HostGpu.rejected != 0 || HostGpu.unsupported != 0)
+		{
+			printf(" rejected %lu unsupported %lu", (unsigned long)HostGpu.rejected, (unsigned long)HostGpu.unsupported);
+		}
+		printf("\n");
+	}
+
+	if (s_frame < s_goldenCount && s_golden[s_frame] != crc)
+	{
+		fprintf(stderr, "frame %lu: crc %08lx, expected %08lx\n", (unsigned long)s_frame, (unsigned long)crc, (unsigned long)s_golden[s_frame]);
+		s_mismatches++;
+	}
+
+	if (s_outputDir != 0 && s_frame % s_pngEvery == 0)
+	{
+		snprintf(filename, sizeof(filename), "%s/frame%05lu.png", s_outputDir, (unsigned long)s_frame);
+		if (!WritePng(filename, area.w, area.h, s_image))
+		{
+			fprintf(stderr, "%s: can't write\n", filename);
+			exit(1);
+		}
+	}
+
+	memset(&HostGpu, 0, sizeof(HostGpu));
+
+	if (++s_frame >= s_frames)
+	{
+		PrintSummary();
+		exit(s_mismatches != 0 ? 1 : 0);
+	}
+
+	/* Input of the next frame, latched in its vertical blank */
+	while (s_nextStep < s_stepCount && s_steps[s_nextStep].frame <= s_frame)
+	{
+		SetPad(s_steps[s_nextStep++].buttons);
+	}
+}
+
+static void Usage()
+{
+	fprintf(stderr, "usage: render [-f frames] [-o dir] [-p every] [-i input] [-c golden] [-d root] [-q] [-b] [-l prims:bytes] [-r runs] [-n] [-e every] [-g level|auto] [-m music.xa] [-v intro.str]\n");
+	exit(2);
+}
+
+int main(int argc, char** argv)
+{
+	char script[1024];
+	unsigned long budgetPrims, budgetBytes;
+	int quality = QUALITY_DEFAULT;
+	char* root = "..";
+	int i;
+
+	SetBenchRuns(HOST_BENCH_RUNS);
+
+	for (i = 1; i < argc; ++i)
+	{
+		if (i + 1 < argc && strcmp(argv[i], "-f") == 0)
+		{
+			s_frames = (u_long)strtoul(argv[++i], 0, 10);
+		}
+		else if (i + 1 < argc && strcmp(argv[i], "-o") == 0)
+		{
+			s_outputDir = argv[++i];
+		}
+		else if (i + 1 < argc && strcmp(argv[i], "-p") == 0)
+		{
+			s_pngEvery = (u_long)strtoul(argv[++i], 0, 10);
+		}
+		else if (i + 1 < argc && strcmp(argv[i], "-i") == 0)
+		{
+			if (!LoadInput(argv[++i]))
+			{
+				return 2;
+			}
+		}
+		else if (i + 1 < argc && strcmp(argv[i], "-c") == 0)
+		{
+			if (!LoadGolden(argv[++i]))
+			{
+				return 2;
+			}
+		}
+		else if (i + 1 < argc && strcmp(argv[i], "-d") == 0)
+		{
+			root = argv[++i];
+		}
+		else if (strcmp(argv[i], "-q") == 0)
+		{
+			s_quiet = 1;
+		}
+		else if (strcmp(argv[i], "-b") == 0)
+		{
+			s_bench = 1;
+		}
+		else if (i + 1 < argc && strcmp(argv[i], "-l") == 0)
+		{
+			if (sscanf(argv[++i], "%lu:%lu", &budgetPrims, &budgetBytes) != 2)
+			{
+				Usage();
+			}
+			SetBenchBudget((u_long)budgetPrims, (u_long)budgetBytes);
+		}
+		else if (i + 1 < argc && strcmp(argv[i], "-r") == 0)
+		{
+			SetBenchRuns(atoi(argv[++i]));
+		}
+		else if (strcmp(argv[i], "-n") == 0)
+		{
+			HostBiosRegion = 'A';
+		}
+		else if (i + 1 < argc && strcmp(argv[i], "-e") == 0)
+		{
+			HostCdErrorEvery = atoi(argv[++i]);
+		}
+		else if (i + 1 < argc && strcmp(argv[i], "-g") == 0)
+		{
+			++i;
+			quality = strcmp(argv[i], "auto") == 0 ? -1 : atoi(argv[i]);
+		}
+		else if (i + 1 < argc && strcmp(argv[i], "-m") == 0)
+		{
+			s_music = argv[++i];
+		}
+		else if (i + 1 < argc && strcmp(argv[i], "-v") == 0)
+		{
+			s_intro = argv[++i];
+		}
+		else
+		{
+			Usage();
+		}
+	}
+
+	if (s_frames == 0 || s_pngEvery == 0)
+	{
+		Usage();
+	}
+
+	/* Primitives link through 24 bit addresses, see Heap.c */
+	if ((unsigned long)(size_t)s_image >= 0x1000000 || (unsigned long)(size_t)malloc(16) >= 0x1000000)
+	{
+		fprintf(stderr, "render must be linked without PIE, data and heap have to be below 16 MB\n");
+		return 2;
+	}
+
+	if (s_stepCount == 0)
+	{
+		memcpy(s_steps, s_defaultInput, sizeof(s_defaultInput));
+		s_stepCount = sizeof(s_defaultInput) / sizeof(s_defaultInput[0]);
+	}
+
+	snprintf(script, sizeof(script), "%s/DATA/BREAKOUT.TXT", root);
+	if (!HostCdMount(script, root) || (s_music != 0 && !HostCdAddXaFile("MUSIC.XA", s_music)) ||
+		(s_intro != 0 && !HostCdAddXaFile("INTRO.STR", s_intro)))
+	{
+		return 2;
+	}
+
+	/* A pad has to be connected before the game starts */
+	SetPad(0);
+	while (s_nextStep < s_stepCount && s_steps[s_nextStep].frame == 0)
+	{
+		SetPad(s_steps[s_nextStep++].buttons);
+	}
+
+	if (s_bench)
+	{
+		currentGameState = GS_BENCH;
+	}
+
+	LockQuality(quality);
+
+	HostDrawOtHook = FrameDrawn;
+	BreakoutMain();
+	return 0;
+}
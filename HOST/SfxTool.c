@@ -0,0 +1,902 @@
+/*
+ * Sound effect tool: converts between WAV and VAG files and builds the sound effect
+ * banks (*.SFX) the game uploads to SPU RAM.
+ *
+ * A bank is built from a list file, one effect per line:
+ *
+ *   # name     file           priority  volume
+ *   PADDLE     PADDLE.WAV     2         100
+ *
+ * File names are relative to the list file, sources are 16 bit PCM WAV files (stereo is
+ * mixed down) or VAG files. Effects of higher priority take over voices of lower ones
+ * when all voices are busy, volume is 0 - 127.
+ *
+ * The test mode checks the codec round trip on synthetic signals, the SPU RAM allocator
+ * and the voice scheduler of the game; bench measures the codec throughput.
+ *
+ * Usage: sfxtool encode in.wav out.vag
+ *        sfxtool decode in.vag out.wav
+ *        sfxtool bank -o out.sfx list.txt
+ *        sfxtool test
+ *        sfxtool bench
+ */
+
+#include <sys/types.h>
+#include <libetc.h>
+#include <libspu.h>
+
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "Adpcm.h"
+#include "Engine.h"
+#include "Sound.h"
+
+/* Longest sound the tool accepts, in samples. */
+#define MAX_SAMPLES (1024 * 1024)
+
+/* Size of a VAG file header. */
+#define VAG_HEADER_SIZE 48
+
+/* SPU pitch of 44100 Hz */
+#define SPU_PITCH_44100 4096
+
+typedef struct
+{
+	short* samples;
+	long count;
+	long rate;
+} Sound;
+
+static u_long ReadLong(u_char* p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((u_long)p[3] << 24);
+}
+
+static u_short ReadShort(u_char* p)
+{
+	return (u_short)(p[0] | (p[1] << 8));
+}
+
+/* VAG headers are big endian */
+static u_long ReadLongBE(u_char* p)
+{
+	return ((u_long)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+static void WriteLongBE(u_char* p, u_long value)
+{
+	p[0] = (u_char)(value >> 24);
+	p[1] = (u_char)(value >> 16);
+	p[2] = (u_char)(value >> 8);
+	p[3] = (u_char)value;
+}
+
+static void WriteLong(u_char* p, u_long value)
+{
+	p[0] = (u_char)value;
+	p[1] = (u_char)(value >> 8);
+	p[2] = (u_char)(value >> 16);
+	p[3] = (u_char)(value >> 24);
+}
+
+static void WriteShort(u_char* p, u_short value)
+{
+	p[0] = (u_char)value;
+	p[1] = (u_char)(value >> 8);
+}
+
+/* Reads a whole file into memory. Returns 0 on failure. */
+static u_char* ReadFile(char* filename, long* size)
+{
+	FILE* file;
+	u_char* data;
+
+	file = fopen(filename, "rb");
+	if (file == 0)
+	{
+		fprintf(stderr, "%s: can't open\n", filename);
+		return 0;
+	}
+
+	fseek(file, 0, SEEK_END);
+	*size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+
+	data = (u_char*)malloc(*size > 0 ? *size : 1);
+	if (data == 0 || (long)fread(data, 1, *size, file) != *size)
+	{
+		fprintf(stderr, "%s: read error\n", filename);
+		free(data);
+		fclose(file);
+		return 0;
+	}
+
+	fclose(file);
+	return data;
+}
+
+static int WriteFile(char* filename, u_char* data, long size)
+{
+	FILE* file;
+
+	file = fopen(filename, "wb");
+	if (file == 0)
+	{
+		fprintf(stderr, "%s: can't create\n", filename);
+		return 0;
+	}
+
+	fwrite(data, 1, size, file);
+	if (fclose(file) != 0)
+	{
+		fprintf(stderr, "%s: write error\n", filename);
+		return 0;
+	}
+
+	return 1;
+}
+
+/******************************************************/
+/* WAV and VAG files */
+
+static int ReadWav(char* filename, u_char* data, long size, Sound* sound)
+{
+	u_char* chunk;
+	u_char* format = 0;
+	u_char* samples = 0;
+	long samplesSize = 0;
+	long chunkSize, i;
+	int channels, bits;
+
+	if (size < 12 || memcmp(data, "RIFF", 4) != 0 || memcmp(data + 8, "WAVE", 4) != 0)
+	{
+		fprintf(stderr, "%s: not a WAV file\n", filename);
+		return 0;
+	}
+
+	for (chunk = data + 12; chunk + 8 <= data + size; chunk += 8 + ((chunkSize + 1) & ~1))
+	{
+		chunkSize = (long)ReadLong(chunk + 4);
+		if (chunkSize > data + size - chunk - 8)
+		{
+			chunkSize = data + size - chunk - 8;
+		}
+
+		if (memcmp(chunk, "fmt ", 4) == 0 && chunkSize >= 16)
+		{
+			format = chunk + 8;
+		}
+		else if (memcmp(chunk, "data", 4) == 0)
+		{
+			samples = chunk + 8;
+			samplesSize = chunkSize;
+		}
+	}
+
+	if (format == 0 || samples == 0)
+	{
+		fprintf(stderr, "%s: no format or data chunk\n", filename);
+		return 0;
+	}
+
+	channels = ReadShort(format + 2);
+	bits = ReadShort(format + 14);
+	if (ReadShort(format) != 1 || bits != 16 || channels < 1 || channels > 2)
+	{
+		fprintf(stderr, "%s: only 16 bit PCM with one or two channels is supported\n", filename);
+		return 0;
+	}
+
+	sound->rate = (long)ReadLong(format + 4);
+	sound->count = samplesSize / (2 * channels);
+	if (sound->count > MAX_SAMPLES)
+	{
+		fprintf(stderr, "%s: too long\n", filename);
+		return 0;
+	}
+
+	sound->samples = (short*)malloc((sound->count + 1) * sizeof(short));
+	for (i = 0; i < sound->count; ++i)
+	{
+		if (channels == 1)
+		{
+			sound->samples[i] = (short)ReadShort(samples + i * 2);
+		}
+		else
+		{
+			sound->samples[i] = (short)(((short)ReadShort(samples + i * 4) + (short)ReadShort(samples + i * 4 + 2)) / 2);
+		}
+	}
+
+	return 1;
+}
+
+static int WriteWav(char* filename, Sound* sound)
+{
+	long size = 44 + sound->count * 2;
+	u_char* data = (u_char*)malloc(size);
+	long i;
+	int result;
+
+	memcpy(data, "RIFF", 4);
+	WriteLong(data + 4, size - 8);
+	memcpy(data + 8, "WAVEfmt ", 8);
+	WriteLong(data + 16, 16);
+	WriteShort(data + 20, 1);
+	WriteShort(data + 22, 1);
+	WriteLong(data + 24, sound->rate);
+	WriteLong(data + 28, sound->rate * 2);
+	WriteShort(data + 32, 2);
+	WriteShort(data + 34, 16);
+	memcpy(data + 36, "data", 4);
+	WriteLong(data + 40, sound->count * 2);
+
+	for (i = 0; i < sound->count; ++i)
+	{
+		WriteShort(data + 44 + i * 2, (u_short)sound->samples[i]);
+	}
+
+	result = WriteFile(filename, data, size);
+	free(data);
+	return result;
+}
+
+static int ReadVag(char* filename, u_char* data, long size, Sound* sound)
+{
+	long dataSize;
+
+	if (size < VAG_HEADER_SIZE || memcmp(data, "VAGp", 4) != 0)
+	{
+		fprintf(stderr, "%s: not a VAG file\n", filename);
+		return 0;
+	}
+
+	dataSize = (long)ReadLongBE(data + 12);
+	if (dataSize > size - VAG_HEADER_SIZE)
+	{
+		dataSize = size - VAG_HEADER_SIZE;
+	}
+
+	sound->rate = (long)ReadLongBE(data + 16);
+	sound->samples = (short*)malloc((dataSize / ADPCM_BLOCK_SIZE + 1) * ADPCM_BLOCK_SAMPLES * sizeof(short));
+	sound->count = AdpcmDecode(data + VAG_HEADER_SIZE, dataSize, sound->samples);
+	return 1;
+}
+
+static int WriteVag(char* filename, Sound* sound)
+{
+	long dataSize = AdpcmSize(sound->count);
+	u_char* data = (u_char*)calloc(1, VAG_HEADER_SIZE + dataSize);
+	char* name;
+	int result;
+
+	memcpy(data, "VAGp", 4);
+	WriteLongBE(data + 4, 0x20);
+	WriteLongBE(data + 12, dataSize);
+	WriteLongBE(data + 16, sound->rate);
+
+	name = strrchr(filename, '/');
+	strncpy((char*)data + 32, name != 0 ? name + 1 : filename, 16);
+
+	AdpcmEncode(sound->samples, sound->count, data + VAG_HEADER_SIZE);
+
+	result = WriteFile(filename, data, VAG_HEADER_SIZE + dataSize);
+	free(data);
+	return result;
+}
+
+/* Loads a WAV or VAG file, told apart by their magic. */
+static int ReadSound(char* filename, Sound* sound)
+{
+	u_char* data;
+	long size;
+	int result;
+
+	data = ReadFile(filename, &size);
+	if (data == 0)
+	{
+		return 0;
+	}
+
+	if (size >= 4 && memcmp(data, "VAGp", 4) == 0)
+	{
+		result = ReadVag(filename, data, size, sound);
+	}
+	else
+	{
+		result = ReadWav(filename, data, size, sound);
+	}
+
+	free(data);
+
+	if (result && (sound->rate <= 0 || sound->rate > 65535))
+	{
+		fprintf(stderr, "%s: unsupported sample rate %ld\n", filename, sound->rate);
+		return 0;
+	}
+
+	return result;
+}
+
+/******************************************************/
+/* Banks */
+
+/*
+ * Builds a bank in memory from the given sounds. Returns the size of the bank, the caller
+ * frees *bank.
+ */
+static long BuildBank(Sound* sounds, char (*names)[SFX_NAME_LENGTH + 1], int* priorities, int* volumes,
+	int count, u_char** bank)
+{
+	SfxBankHeader* header;
+	SfxEntry* entries;
+	long dataOffset, dataSize = 0, size;
+	u_char* data;
+	int i;
+
+	for (i = 0; i < count; ++i)
+	{
+		dataSize += AdpcmSize(sounds[i].count);
+	}
+
+	/* ADPCM data starts on a block boundary, which also keeps the DMA source word aligned */
+	dataOffset = (sizeof(SfxBankHeader) + count * sizeof(SfxEntry) + ADPCM_BLOCK_SIZE - 1) & ~(ADPCM_BLOCK_SIZE - 1);
+	size = dataOffset + dataSize;
+
+	*bank = (u_char*)calloc(1, size);
+	header = (SfxBankHeader*)*bank;
+	entries = (SfxEntry*)(header + 1);
+	data = *bank + dataOffset;
+
+	header->id = SFX_BANK_ID;
+	header->version = SFX_BANK_VERSION;
+	header->count = (u_short)count;
+	header->dataSize = dataSize;
+	header->dataOffset = dataOffset;
+
+	dataSize = 0;
+	for (i = 0; i < count; ++i)
+	{
+		strncpy(entries[i].name, names[i], SFX_NAME_LENGTH);
+		entries[i].offset = dataSize;
+		entries[i].size = AdpcmEncode(sounds[i].samples, sounds[i].count, data + dataSize);
+		entries[i].rate = (u_short)sounds[i].rate;
+		entries[i].pitch = (u_short)((sounds[i].rate * SPU_PITCH_44100 + 22050) / 44100);
+		entries[i].priority = (u_char)priorities[i];
+		entries[i].volume = (u_char)volumes[i];
+		dataSize += entries[i].size;
+	}
+
+	return size;
+}
+
+static int MakeBank(char* output, char* listFile)
+{
+	FILE* file;
+	char line[512], path[512], directory[512];
+	char fileName[256];
+	static char names[MAX_SFX][SFX_NAME_LENGTH + 1];
+	static Sound sounds[MAX_SFX];
+	int priorities[MAX_SFX], volumes[MAX_SFX];
+	int count = 0, lineNumber = 0, result, i;
+	char* slash;
+	u_char* bank;
+	long size;
+
+	file = fopen(listFile, "r");
+	if (file == 0)
+	{
+		fprintf(stderr, "%s: can't open\n", listFile);
+		return 0;
+	}
+
+	strncpy(directory, listFile, sizeof(directory) - 1);
+	directory[sizeof(directory) - 1] = 0;
+	slash = strrchr(directory, '/');
+	if (slash != 0)
+	{
+		slash[1] = 0;
+	}
+	else
+	{
+		directory[0] = 0;
+	}
+
+	while (fgets(line, sizeof(line), file) != 0)
+	{
+		lineNumber++;
+		if (line[0] == '#' || line[strspn(line, " \t\r\n")] == 0)
+		{
+			continue;
+		}
+
+		if (count >= MAX_SFX)
+		{
+			fprintf(stderr, "%s:%d: more than %d effects\n", listFile, lineNumber, MAX_SFX);
+			fclose(file);
+			return 0;
+		}
+
+		if (sscanf(line, "%8s %255s %d %d", names[count], fileName, &priorities[count], &volumes[count]) != 4 ||
+			priorities[count] < 0 || priorities[count] > 255 || volumes[count] < 0 || volumes[count] > 127)
+		{
+			fprintf(stderr, "%s:%d: expected name, file, priority (0 - 255) and volume (0 - 127)\n", listFile, lineNumber);
+			fclose(file);
+			return 0;
+		}
+
+		snprintf(path, sizeof(path), "%s%s", directory, fileName);
+		if (!ReadSound(path, &sounds[count]))
+		{
+			fclose(file);
+			return 0;
+		}
+
+		count++;
+	}
+
+	fclose(file);
+
+	size = BuildBank(sounds, names, priorities, volumes, count, &bank);
+	result = WriteFile(output, bank, size);
+	if (result)
+	{
+		printf("%s: %d effects, %lu bytes of SPU RAM\n", output, count, (unsigned long)((SfxBankHeader*)bank)->dataSize);
+	}
+
+	free(bank);
+	for (i = 0; i < count; ++i)
+	{
+		free(sounds[i].samples);
+	}
+
+	return result;
+}
+
+/******************************************************/
+/* Engine functions used by Sound.c */
+
+/* Bank the test loads through LoadSfxBank. */
+static u_char* s_testBank = 0;
+static long s_testBankSize = 0;
+
+u_long* LoadFile(char* filename, int* size)
+{
+	u_long* data;
+
+	if (s_testBank == 0)
+	{
+		return 0;
+	}
+
+	data = (u_long*)malloc(s_testBankSize);
+	memcpy(data, s_testBank, s_testBankSize);
+	if (size != 0)
+	{
+		*size = (int)s_testBankSize;
+	}
+
+	return data;
+}
+
+void ErrorMessage(char* format, ...)
+{
+	va_list list;
+
+	va_start(list, format);
+	vfprintf(stderr, format, list);
+	va_end(list);
+	fprintf(stderr, "\n");
+	exit(1);
+}
+
+/******************************************************/
+/* Tests */
+
+/* Synthetic test signals */
+enum
+{
+	SIGNAL_SILENCE,
+	SIGNAL_SINE,
+	SIGNAL_SWEEP,
+	SIGNAL_SQUARE,
+	SIGNAL_NOISE,
+	SIGNAL_DECAY,
+	SIGNAL_COUNT
+};
+
+static const char* s_signalNames[SIGNAL_COUNT] = { "silence", "sine", "sweep", "square", "noise", "decay" };
+
+/* Lowest acceptable signal to noise ratio of the round trip in dB, noise can't be predicted. */
+static const double s_minimumSnr[SIGNAL_COUNT] = { 0.0, 45.0, 20.0, 40.0, 12.0, 35.0 };
+
+static void MakeSignal(int signal, Sound* sound, long count)
+{
+	u_long random = 12345;
+	double phase = 0.0;
+	long i;
+
+	sound->rate = 22050;
+	sound->count = count;
+	sound->samples = (short*)malloc(count * sizeof(short));
+
+	for (i = 0; i < count; ++i)
+	{
+		double t = (double)i / sound->rate;
+		double value = 0.0;
+
+		switch (signal)
+		{
+		case SIGNAL_SINE: value = 0.8 * sin(2.0 * M_PI * 440.0 * t); break;
+		case SIGNAL_SWEEP:
+			phase += 2.0 * M_PI * (100.0 + 8000.0 * i / count) / sound->rate;
+			value = 0.7 * sin(phase);
+			break;
+		case SIGNAL_SQUARE: value = ((long)(t * 220.0 * 2.0) & 1) ? 0.5 : -0.5; break;
+		case SIGNAL_NOISE:
+			random = random * 1103515245u + 12345u;
+			value = ((double)((random >> 16) & 0x7fff) / 16384.0 - 1.0) * 0.5;
+			break;
+		case SIGNAL_DECAY: value = 0.9 * exp(-t * 8.0) * sin(2.0 * M_PI * 880.0 * t); break;
+		}
+
+		sound->samples[i] = (short)(value * 32767.0);
+	}
+}
+
+/* Returns the signal to noise ratio in dB, or 999 for an exact match. */
+static double Snr(short* reference, short* decoded, long count)
+{
+	double signal = 0.0, noise = 0.0, difference;
+	long i;
+
+	for (i = 0; i < count; ++i)
+	{
+		difference = (double)reference[i] - decoded[i];
+		signal += (double)reference[i] * reference[i];
+		noise += difference * difference;
+	}
+
+	if (noise == 0.0)
+	{
+		return 999.0;
+	}
+
+	return 10.0 * log10(signal / noise);
+}
+
+static int TestCodec()
+{
+	Sound sound;
+	u_char* encoded;
+	short* decoded;
+	long size, count;
+	double snr;
+	int signal, failures = 0;
+
+	for (signal = 0; signal < SIGNAL_COUNT; ++signal)
+	{
+		/* Not a multiple of 28, so the padding of the last block is covered */
+		MakeSignal(signal, &sound, 22050 + 5);
+
+		encoded = (u_char*)malloc(AdpcmSize(sound.count));
+		decoded = (short*)malloc((sound.count + ADPCM_BLOCK_SAMPLES) * sizeof(short));
+
+		size = AdpcmEncode(sound.samples, sound.count, encoded);
+		count = AdpcmDecode(encoded, size, decoded);
+		snr = Snr(sound.samples, decoded, sound.count);
+
+		if (size != AdpcmSize(sound.count) || count < sound.count || !(encoded[size - 15] & ADPCM_FLAG_LOOP_END))
+		{
+			printf("FAIL codec %s: %ld bytes, %ld samples\n", s_signalNames[signal], size, count);
+			failures++;
+		}
+		else if (signal == SIGNAL_SILENCE ? snr != 999.0 : snr < s_minimumSnr[signal])
+		{
+			printf("FAIL codec %s: %.1f dB\n", s_signalNames[signal], snr);
+			failures++;
+		}
+		else
+		{
+			printf("ok   codec %s: %.1f dB\n", s_signalNames[signal], snr);
+		}
+
+		free(encoded);
+		free(decoded);
+		free(sound.samples);
+	}
+
+	return failures;
+}
+
+static int TestAllocator()
+{
+	u_long a, b, c, largest, total;
+	int failures = 0;
+
+	InitSfx();
+	total = SpuRamAvailable(&largest);
+
+	a = SpuRamAlloc(100);
+	b = SpuRamAlloc(1000);
+	c = SpuRamAlloc(16);
+
+	if (a == 0 || b == 0 || c == 0 || (a & 15) || (b & 15) || b < a + 112 || c < b + 1008)
+	{
+		printf("FAIL allocator: blocks at %lx %lx %lx\n", (unsigned long)a, (unsigned long)b, (unsigned long)c);
+		failures++;
+	}
+
+	/* The freed middle block is reused first fit, the rest merges back */
+	SpuRamFree(b);
+	if (SpuRamAlloc(500) != b)
+	{
+		printf("FAIL allocator: freed block not reused\n");
+		failures++;
+	}
+
+	SpuRamFree(b);
+	SpuRamFree(a);
+	SpuRamFree(c);
+	if (SpuRamAvailable(&largest) != total || largest != total)
+	{
+		printf("FAIL allocator: %lu of %lu bytes free after freeing everything\n", (unsigned long)largest, (unsigned long)total);
+		failures++;
+	}
+
+	if (SpuRamAlloc(total + 16) != 0)
+	{
+		printf("FAIL allocator: more than the SPU RAM handed out\n");
+		failures++;
+	}
+
+	if (failures == 0)
+	{
+		printf("ok   allocator: %lu bytes\n", (unsigned long)total);
+	}
+
+	return failures;
+}
+
+static int TestScheduler()
+{
+	static char names[4][SFX_NAME_LENGTH + 1] = { "LOW", "HIGH", "LONG", "QUIET" };
+	int priorities[4] = { 1, 5, 1, 0 };
+	int volumes[4] = { 127, 127, 127, 64 };
+	Sound sounds[4];
+	SfxBankHeader* header;
+	SfxEntry* entries;
+	int low, high, playing, i, failures = 0;
+	u_long keyOns = 0;
+
+	MakeSignal(SIGNAL_DECAY, &sounds[0], 2205);
+	MakeSignal(SIGNAL_SINE, &sounds[1], 2205);
+	MakeSignal(SIGNAL_SINE, &sounds[2], 22050);
+	MakeSignal(SIGNAL_SQUARE, &sounds[3], 2205);
+	s_testBankSize = BuildBank(sounds, names, priorities, volumes, 4, &s_testBank);
+	header = (SfxBankHeader*)s_testBank;
+	entries = (SfxEntry*)(header + 1);
+
+	InitSfx();
+	if (!LoadSfxBank("TEST.SFX"))
+	{
+		printf("FAIL scheduler: bank not loaded\n");
+		return 1;
+	}
+
+	/* The upload lands at the start of the SPU RAM */
+	if (memcmp(HostSpuRam + 0x1010, s_testBank + header->dataOffset, header->dataSize) != 0)
+	{
+		printf("FAIL scheduler: bank not in SPU RAM\n");
+		failures++;
+	}
+
+	low = GetSfx("LONG");
+	high = GetSfx("HIGH");
+	if (low != 2 || high != 1 || GetSfx("MISSING") != -1)
+	{
+		printf("FAIL scheduler: effect lookup\n");
+		failures++;
+	}
+
+	/* Repeated triggers in a frame play once */
+	PlaySfx(low, SFX_VOLUME_DEFAULT, 0);
+	PlaySfx(low, SFX_VOLUME_DEFAULT, 0);
+	UpdateSfx();
+	VSync(0);
+
+	/* Fill every voice with long, unimportant effects over several frames */
+	for (i = 1; i < SFX_VOICE_COUNT; ++i)
+	{
+		PlaySfx(low, SFX_VOLUME_DEFAULT, i * 8 - 64);
+		UpdateSfx();
+		VSync(0);
+	}
+
+	for (i = 0, playing = 0; i < SFX_VOICE_COUNT; ++i)
+	{
+		playing += HostSpuVoices[i].playing;
+		keyOns += HostSpuVoices[i].keyOns;
+	}
+
+	if (playing != SFX_VOICE_COUNT || keyOns != SFX_VOICE_COUNT || HostSpuVoices[SFX_VOICE_COUNT].keyOns != 0)
+	{
+		printf("FAIL scheduler: %d voices playing after %lu key ons\n", playing, (unsigned long)keyOns);
+		failures++;
+	}
+
+	/* An important effect takes over the oldest voice */
+	PlaySfx(high, SFX_VOLUME_DEFAULT, 0);
+	UpdateSfx();
+	if (HostSpuVoices[0].keyOns != 2 || HostSpuVoices[0].address != 0x1010 + entries[1].offset ||
+		HostSpuVoices[0].pitch != entries[1].pitch)
+	{
+		printf("FAIL scheduler: voice 0 not taken over\n");
+		failures++;
+	}
+
+	/* An effect of the same priority takes over the oldest voice of that priority, a less important one is dropped */
+	for (i = 0; i < SFX_VOICE_COUNT; ++i)
+	{
+		HostSpuVoices[i].keyOns = 0;
+	}
+
+	VSync(0);
+	PlaySfx(GetSfx("LOW"), SFX_VOLUME_DEFAULT, 0);
+	PlaySfx(GetSfx("QUIET"), SFX_VOLUME_DEFAULT, 0);
+	UpdateSfx();
+
+	for (i = 0, keyOns = 0; i < SFX_VOICE_COUNT; ++i)
+	{
+		keyOns += HostSpuVoices[i].keyOns;
+	}
+
+	if (keyOns != 1 || HostSpuVoices[1].keyOns != 1 || HostSpuVoices[1].address != 0x1010 + entries[0].offset)
+	{
+		printf("FAIL scheduler: wrong voice taken over\n");
+		failures++;
+	}
+
+	/* Once the effects are over, the first voice is free again */
+	for (i = 0; i < 120; ++i)
+	{
+		VSync(0);
+	}
+
+	PlaySfx(GetSfx("QUIET"), SFX_VOLUME_DEFAULT, 0);
+	UpdateSfx();
+	if (HostSpuVoices[0].keyOns != 1)
+	{
+		printf("FAIL scheduler: voices not free after their effects ended\n");
+		failures++;
+	}
+
+	FreeSfxBank();
+	if (SpuRamAvailable(0) != HOST_SPU_RAM_SIZE - 0x1010)
+	{
+		printf("FAIL scheduler: bank not freed\n");
+		failures++;
+	}
+
+	if (failures == 0)
+	{
+		printf("ok   scheduler\n");
+	}
+
+	free(s_testBank);
+	s_testBank = 0;
+	for (i = 0; i < 4; ++i)
+	{
+		free(sounds[i].samples);
+	}
+
+	return failures;
+}
+
+static int Test()
+{
+	int failures = TestCodec() + TestAllocator() + TestScheduler();
+
+	printf("%s: %d failures\n", failures == 0 ? "PASS" : "FAIL", failures);
+	return failures == 0;
+}
+
+static double Seconds()
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static int Bench()
+{
+	Sound sound;
+	u_char* encoded;
+	short* decoded;
+	long size = 0;
+	double start, encodeTime, decodeTime;
+	int i, rounds = 4;
+
+	MakeSignal(SIGNAL_SWEEP, &sound, 44100 * 10);
+	encoded = (u_char*)malloc(AdpcmSize(sound.count));
+	decoded = (short*)malloc((sound.count + ADPCM_BLOCK_SAMPLES) * sizeof(short));
+
+	start = Seconds();
+	for (i = 0; i < rounds; ++i)
+	{
+		size = AdpcmEncode(sound.samples, sound.count, encoded);
+	}
+	encodeTime = Seconds() - start;
+
+	start = Seconds();
+	for (i = 0; i < rounds * 10; ++i)
+	{
+		AdpcmDecode(encoded, size, decoded);
+	}
+	decodeTime = Seconds() - start;
+
+	printf("encode: %.1f Msamples/s (%.0fx real time at 44100 Hz)\n",
+		rounds * sound.count / encodeTime / 1e6, rounds * sound.count / encodeTime / 44100.0);
+	printf("decode: %.1f Msamples/s (%.0fx real time at 44100 Hz)\n",
+		rounds * 10 * sound.count / decodeTime / 1e6, rounds * 10 * sound.count / decodeTime / 44100.0);
+
+	free(encoded);
+	free(decoded);
+	free(sound.samples);
+	return 1;
+}
+
+static void Usage()
+{
+	fprintf(stderr,
+		"usage: sfxtool encode in.wav out.vag\n"
+		"       sfxtool decode in.vag out.wav\n"
+		"       sfxtool bank -o out.sfx list.txt\n"
+		"       sfxtool test\n"
+		"       sfxtool bench\n");
+	exit(2);
+}
+
+int main(int argc, char** argv)
+{
+	Sound sound;
+
+	if (argc < 2)
+	{
+		Usage();
+	}
+
+	if (strcmp(argv[1], "encode") == 0 && argc == 4)
+	{
+		return ReadSound(argv[2], &sound) && WriteVag(argv[3], &sound) ? 0 : 1;
+	}
+
+	if (strcmp(argv[1], "decode") == 0 && argc == 4)
+	{
+		return ReadSound(argv[2], &sound) && WriteWav(argv[3], &sound) ? 0 : 1;
+	}
+
+	if (strcmp(argv[1], "bank") == 0 && argc == 5 && strcmp(argv[2], "-o") == 0)
+	{
+		return MakeBank(argv[3], argv[4]) ? 0 : 1;
+	}
+
+	if (strcmp(argv[1], "test") == 0)
+	{
+		return Test() ? 0 : 1;
+	}
+
+	if (strcmp(argv[1], "bench") == 0)
+	{
+		return Bench() ? 0 : 1;
+	}
+
+	Usage();
+	return 2;
+}
@@ -0,0 +1,852 @@
+/*
+ * Randomized soak harness for the gameplay simulation in GAME.C.
+ *
+ * Every session is fully determined by its seed: the seed picks the start level, the
+ * controller type, the paddle input and the fire timing. After each simulated frame
+ * the harness checks a set of invariants and reports the seed and frame of the first
+ * violation, so every failure can be replayed with -r.
+ *
+ * GAME.C keeps its state in file-scope variables, so sessions are spread over worker
+ * processes (one per core by default) instead of threads.
+ *
+ * With -a the autopilot of the attract mode plays every session instead of the random
+ * player, and the levels it cleared and the balls it lost are reported, which shows how
+ * well it plays.
+ *
+ * With -w every frame is also recorded into the rewind buffer (see Rewind.h) and now and then
+ * the session goes back to a random recorded frame, players included. Snapshots have to come
+ * back from a load and from the buffer unchanged, and the frames played again have to be
+ * the same as the first time. The size and time of the recording are reported.
+ *
+ * The simulation steps one PAL frame per frame, with -t it steps like a 60 Hz console does
+ * (see GetFrameStep). The invariants have to hold at both rates.
+ *
+ * With -2 every session is a versus game, each paddle played by a player of its own, and the
+ * tries, scores and paddles of both players are checked.
+ *
+ * Usage: soak [-n sessions] [-f frames] [-j jobs] [-s firstSeed] [-r seed] [-a] [-w] [-t] [-2]
+ */
+
+#include "../SRC/GAME.C"
+
+/* The input layer of the game, main() is replaced by the harness. */
+#define main BreakoutMain
+#include "../SRC/BREAKOUT.C"
+#undef main
+
+#include <setjmp.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+/* Maximum number of failures a single worker reports in detail. */
+#define MAX_REPORTED_FAILURES 16
+
+/* Highest power a block can have (see CreateBlockRow). */
+#define MAX_BLOCK_POWER 4
+
+/* On average every REWIND_CHANCE frames a -w session goes back. */
+#define REWIND_CHANCE 300
+
+static jmp_buf s_errorJump;
+static char s_errorText[256];
+
+/* Sessions are played by the autopilot (-a). */
+static int s_useAutopilot = 0;
+
+/* Levels cleared and balls lost in the sessions of this process. */
+static long s_levelsCleared = 0;
+static long s_ballsLost = 0;
+
+/* Sessions record and restore snapshots (-w). */
+static int s_checkRewind = 0;
+
+/* Frames recorded and restores in the sessions of this process, with the bytes, keyframes and time they took. */
+static long s_rewindFrames = 0;
+static long s_rewindBytes = 0;
+static long s_rewindKeyframes = 0;
+static long s_rewindNanoseconds = 0;
+static long s_rewindRestores = 0;
+/* Frames the buffer held at the end of the sessions. */
+static long s_rewindKept = 0;
+
+/* Step of the simulation per frame, one PAL frame or a 60 Hz frame (-t). */
+static long s_frameStep = ONE;
+
+/* Players of every session, 2 for a versus game (-2). */
+static int s_soakPlayers = 1;
+
+/******************************************************/
+/* Engine replacements. The harness never renders anything. */
+
+void SetDisplayMode(long mode) { }
+void EngineInit(char* dataImage) { }
+void SwapTo3D() { }
+void SwapTo2D() { }
+void SetClearColor(u_char red, u_char green, u_char blue) { }
+void BeginFrame() { }
+void Clear() { }
+void EndFrame() { }
+void InitGraphics() { }
+int HandleGsTitle() { return GS_GAME; }
+int HandleGsBench() { return GS_TITLE; }
+int HandleGsIntro() { return GS_TITLE; }
+void PlayMusic(int track) { }
+GsOT* GetActiveOT() { return 0; }
+u_long GetFrameCount() { return 0; }
+long GetFrameStep() { return s_frameStep; }
+u_long GetDisplayedFrame(long* vsync) { if (vsync != 0) *vsync = 0; return 0; }
+void SetScreenWidth(int width) { }
+int GetScreenWidth() { return SCREEN_WIDTH; }
+int GetScreenHeight() { return PAL_SCREEN_HEIGHT; }
+u_long GetFrameTime() { return 0; }
+u_long GetFrameLines() { return 0; }
+
+/* The vertical blank hook (the input latch) is run by the harness before every frame. */
+static void (*s_vsyncHook)() = 0;
+void SetVSyncHook(void (*hook)()) { s_vsyncHook = hook; }
+int CreateStaticGeometry(StaticGeometry* geometry, u_long packetSize) { return 1; }
+void FreeStaticGeometry(StaticGeometry* geometry) { }
+void InvalidateStaticGeometry(StaticGeometry* geometry) { }
+GsOT* BeginStaticGeometry(StaticGeometry* geometry, MATRIX* view) { return 0; }
+void EndStaticGeometry(StaticGeometry* geometry) { }
+void DrawStaticGeometry(StaticGeometry* geometry) { }
+void InitView(View* view) { }
+void BeginView(View* view, RECT* area) { }
+void EndView(View* view) { }
+void DrawSprite(GsSPRITE* sprite) { }
+void SortObject(GsDOBJ2* object, GsOT* ot, int shift, u_long* scratch) { }
+
+TextPosition DrawTextColored(char* text, short x, short y, u_char r, u_char g, u_char b)
+{
+	TextPosition position;
+	position.x = x;
+	position.y = y;
+	return position;
+}
+
+TextPosition DrawText(char* text, short x, short y)
+{
+	return DrawTextColored(text, x, y, 128, 128, 128);
+}
+
+u_long* LoadFile(char* filename, int* size) { return 0; }
+int LoadTIMFile(char* filename, GsIMAGE* image) { return 0; }
+u_long* AcquireFile(char* filename, int* size) { return 0; }
+void ReleaseFile(u_long* data) { }
+int AcquireTIM(char* filename, GsIMAGE* image) { return 0; }
+void ReleaseTIM(char* filename) { }
+
+/* Errors halt the console, so for the harness they end the session as a failure. */
+void ErrorMessage(char* format, ...)
+{
+	va_list list;
+
+	va_start(list, format);
+	vsnprintf(s_errorText, sizeof(s_errorText), format, list);
+	va_end(list);
+
+	longjmp(s_errorJump, 1);
+}
+
+/* Every GAME.C global, g_level, g_score, g_tries, is reached through the unity build. */
+volatile int fps = 0;
+
+
+/******************************************************/
+/* Deterministic input generation */
+
+typedef struct
+{
+	u_long state;
+} Random;
+
+static void SeedRandom(Random* random, u_long seed)
+{
+	/* Spread nearby seeds apart, xorshift must never be seeded with 0. */
+	random->state = seed * 2654435761u + 0x9e3779b9u;
+	if (random->state == 0)
+	{
+		random->state = 1;
+	}
+}
+
+static u_long NextRandom(Random* random)
+{
+	u_long x = random->state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	random->state = x;
+	return x;
+}
+
+/* Returns a random number in the range [0, count). */
+static int RandomRange(Random* random, int count)
+{
+	return (int)(NextRandom(random) % (u_long)count);
+}
+
+/* Random player who holds an input for a while, then picks another one. */
+typedef struct
+{
+	Random random;
+	int index;
+	int controllerType;
+	PadData buttons;
+	u_char axis;
+	int holdFrames;
+	int fireChance;
+	int tracking;
+	Fixed slack;
+	Autopilot pilot;
+} Player;
+
+/* Returns the direction button that moves the paddle of the given player below the lowest free ball. */
+static PadData TrackBall(int index, Fixed slack)
+{
+	Paddle* paddle = &s_paddles[index];
+	int i;
+	int target = -1;
+
+	for (i = 0; i < MAX_BALLS; ++i)
+	{
+		if (s_balls[i].enabled && !s_balls[i].grabbed &&
+			(target < 0 || FixedCompare(s_balls[i].pos.vz, s_balls[target].pos.vz) < 0))
+		{
+			target = i;
+		}
+	}
+
+	if (target < 0)
+	{
+		return 0;
+	}
+
+	if (FixedCompare(s_balls[target].pos.vx, FixedSub(paddle->pos.vx, slack)) < 0)
+	{
+		return PAD_Left;
+	}
+
+	if (FixedCompare(s_balls[target].pos.vx, FixedAdd(paddle->pos.vx, slack)) > 0)
+	{
+		return PAD_Right;
+	}
+
+	return 0;
+}
+
+/* Sets up the player of the given paddle. Player 0 plays the same for a seed in both modes. */
+static void InitPlayer(Player* player, u_long seed, int index)
+{
+	static const int types[] = { CONTROLLER_TYPE_PAD, CONTROLLER_TYPE_ANALOG, CONTROLLER_TYPE_DUALSHOCK };
+
+	seed += (u_long)index * 0x9e3779b9u;
+	SeedRandom(&player->random, seed);
+	player->index = index;
+	player->controllerType = types[RandomRange(&player->random, 3)];
+	player->buttons = 0;
+	player->axis = 128;
+	player->holdFrames = 0;
+	player->tracking = 0;
+	player->slack = FIXED(0);
+	player->fireChance = 1 + RandomRange(&player->random, 64);
+
+	if (s_useAutopilot)
+	{
+		player->controllerType = CONTROLLER_TYPE_DUALSHOCK;
+		InitAutopilot(&player->pilot, seed);
+		player->pilot.player = (u_char)index;
+	}
+}
+
+/* Produces the controller packet for the next frame and tells whether the player fires. */
+static int NextInput(Player* player, ControllerPacket* packet)
+{
+	int fire;
+
+	if (s_useAutopilot)
+	{
+		UpdateAutopilot(&player->pilot, s_balls, &s_paddles[player->index].pos, packet);
+		return IsPadButtonPressed(packet, PAD_Cross);
+	}
+
+	if (player->holdFrames-- <= 0)
+	{
+		player->holdFrames = RandomRange(&player->random, 90);
+		player->axis = 128;
+
+		player->tracking = 0;
+
+		switch (RandomRange(&player->random, 8))
+		{
+		case 0: player->buttons = 0; break;
+		case 1: player->buttons = PAD_Left; break;
+		case 2: player->buttons = PAD_Right; break;
+		case 3:
+			player->buttons = 0;
+			player->axis = (u_char)RandomRange(&player->random, 256);
+			break;
+		default:
+			/* Follow the lowest ball with some slack, so levels actually get cleared. */
+			player->tracking = 1;
+			player->slack = FIXED(4 + RandomRange(&player->random, 28));
+			break;
+		}
+	}
+
+	if (player->tracking)
+	{
+		player->buttons = TrackBall(player->index, player->slack);
+	}
+
+	fire = RandomRange(&player->random, player->fireChance) == 0;
+
+	memset(packet, 0xff, sizeof(ControllerPacket));
+
+	/* Now and then the pad drops out for a frame, like a loose cable. */
+	if (RandomRange(&player->random, 2000) == 0)
+	{
+		packet->status = PAD_STATUS_ERROR;
+		return 0;
+	}
+
+	packet->status = PAD_STATUS_OK;
+	if (player->controllerType == CONTROLLER_TYPE_PAD)
+	{
+		packet->data_format = (CONTROLLER_TYPE_PAD << 4) | 1;
+		packet->data.pad = (PadData)~(player->buttons | (fire ? PAD_Cross : 0));
+	}
+	else
+	{
+		packet->data_format = (u_char)((player->controllerType << 4) | 3);
+		packet->data.analog.digital_buttons = (u_short)~(player->buttons | (fire ? PAD_Cross : 0));
+		packet->data.analog.left_x = player->axis;
+		packet->data.analog.left_y = 128;
+		packet->data.analog.right_x = 128;
+		packet->data.analog.right_y = 128;
+	}
+
+	return fire;
+}
+
+/******************************************************/
+/* Invariants */
+
+static int CountAliveBlocks()
+{
+	int i, count = 0;
+
+	for (i = 0; i < MAX_BLOCKS; ++i)
+	{
+		if (s_blocks[i].type != 0)
+		{
+			count++;
+		}
+	}
+
+	return count;
+}
+
+/* Checks the game state after a frame. Returns 0 if fine, otherwise writes a description of the violation. */
+static int CheckInvariants(int levelBefore, u_char* powerBefore, long* scoreBefore, char* message, int messageSize)
+{
+	int i;
+
+	for (i = 0; i < MAX_BALLS; ++i)
+	{
+		if (!s_balls[i].enabled || s_balls[i].grabbed)
+		{
+			continue;
+		}
+
+		if (FixedCompare(s_balls[i].pos.vx, FIXED(-300)) < 0 || FixedCompare(s_balls[i].pos.vx, FIXED(300)) > 0 ||
+			FixedCompare(s_balls[i].pos.vz, FIXED(150)) > 0)
+		{
+			snprintf(message, messageSize, "ball %d left the field at (%ld, %ld)",
+				i, FixedToInt(s_balls[i].pos.vx), FixedToInt(s_balls[i].pos.vz));
+			return 1;
+		}
+	}
+
+	for (i = 0; i < MAX_BLOCKS; ++i)
+	{
+		if (s_blocks[i].type == 0)
+		{
+			continue;
+		}
+
+		if (s_blocks[i].power == 0 || s_blocks[i].power > MAX_BLOCK_POWER || s_blocks[i].power > powerBefore[i])
+		{
+			snprintf(message, messageSize, "block %d power wrapped from %d to %d",
+				i, powerBefore[i], s_blocks[i].power);
+			return 1;
+		}
+	}
+
+	for (i = 0; i < MAX_PLAYERS; ++i)
+	{
+		if (g_tries[i] < 0 || (i >= s_playerCount && g_tries[i] != 0))
+		{
+			snprintf(message, messageSize, "tries of player %d out of range (%d)", i, g_tries[i]);
+			return 1;
+		}
+
+		if (g_score[i] < scoreBefore[i] || (i >= s_playerCount && g_score[i] != 0))
+		{
+			snprintf(message, messageSize, "score of player %d went from %ld to %ld", i, scoreBefore[i], (long)g_score[i]);
+			return 1;
+		}
+
+		if (i < s_playerCount && (FixedCompare(FixedAbs(s_paddles[i].pos.vx), FIXED(268)) > 0 ||
+			FixedCompare(s_paddles[i].pos.vy, FIXED(0)) != 0 || FixedCompare(s_paddles[i].pos.vz, FIXED(-250)) != 0))
+		{
+			snprintf(message, messageSize, "paddle %d left its line at (%ld, %ld)",
+				i, FixedToInt(s_paddles[i].pos.vx), FixedToInt(s_paddles[i].pos.vz));
+			return 1;
+		}
+	}
+
+	if (g_level < 1 || g_level > NUM_LEVEL)
+	{
+		snprintf(message, messageSize, "level counter out of range (%d)", g_level);
+		return 1;
+	}
+
+	if (g_level != levelBefore && CountAliveBlocks() != 0)
+	{
+		snprintf(message, messageSize, "level %d completed with %d blocks left", levelBefore, CountAliveBlocks());
+		return 1;
+	}
+
+	return 0;
+}
+
+/******************************************************/
+/* Rewind (-w) */
+
+/* A recorded frame and the players who go on from there. */
+typedef struct
+{
+	GameSnapshot snapshot;
+	Player players[MAX_PLAYERS];
+} RecordedFrame;
+
+/* The frames of the rewind buffer, by the number of the frame. */
+static RecordedFrame s_recordedFrames[REWIND_MAX_FRAMES];
+/* Frames recorded in this session, and up to which frame they were recorded before going back. */
+static long s_recorded;
+static long s_replayUntil;
+/* Decides when to go back, the player's random numbers must not change. */
+static Random s_rewindRandom;
+
+static void BeginRewindSession(u_long seed)
+{
+	ResetRewind();
+	SeedRandom(&s_rewindRandom, ~seed);
+	s_recorded = 0;
+	s_replayUntil = 0;
+}
+
+static long GetNanoseconds()
+{
+	struct timespec time;
+
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return (long)time.tv_sec * 1000000000L + time.tv_nsec;
+}
+
+/*
+ * Records the frame just played, checks the snapshots and sometimes goes back. Returns 0 if
+ * fine, otherwise writes a description of the violation.
+ */
+static int CheckRewind(Player* players, char* message, int messageSize)
+{
+	static GameSnapshot snapshot, check;
+	RecordedFrame* recorded = &s_recordedFrames[s_recorded % REWIND_MAX_FRAMES];
+	long start;
+	int back;
+
+	start = GetNanoseconds();
+	SaveGameSnapshot(&snapshot);
+	RecordRewind(&snapshot);
+	s_rewindNanoseconds += GetNanoseconds() - start;
+	s_rewindFrames++;
+	s_rewindBytes += (long)GetRewindStats()->lastSize;
+	s_rewindKeyframes += GetRewindStats()->lastSize == sizeof(GameSnapshot);
+
+	if (s_recorded < s_replayUntil && memcmp(&recorded->snapshot, &snapshot, sizeof(GameSnapshot)) != 0)
+	{
+		snprintf(message, messageSize, "frame %ld played differently after going back", s_recorded);
+		return 1;
+	}
+
+	recorded->snapshot = snapshot;
+	memcpy(recorded->players, players, sizeof(recorded->players));
+	s_recorded++;
+
+	LoadGameSnapshot(&snapshot);
+	SaveGameSnapshot(&check);
+	if (memcmp(&snapshot, &check, sizeof(GameSnapshot)) != 0)
+	{
+		snprintf(message, messageSize, "snapshot changed by loading it");
+		return 1;
+	}
+
+	if (!GetRewindSnapshot(0, &check) || memcmp(&snapshot, &check, sizeof(GameSnapshot)) != 0)
+	{
+		snprintf(message, messageSize, "newest frame of the rewind buffer differs");
+		return 1;
+	}
+
+	/* Frames played again are compared first */
+	if (s_recorded < s_replayUntil || RandomRange(&s_rewindRandom, REWIND_CHANCE) != 0)
+	{
+		return 0;
+	}
+
+	back = RandomRange(&s_rewindRandom, (int)GetRewindStats()->frames);
+	recorded = &s_recordedFrames[(s_recorded - 1 - back) % REWIND_MAX_FRAMES];
+
+	if (!GetRewindSnapshot(back, &check) || memcmp(&recorded->snapshot, &check, sizeof(GameSnapshot)) != 0)
+	{
+		snprintf(message, messageSize, "frame %ld differs in the rewind buffer", s_recorded - 1 - back);
+		return 1;
+	}
+
+	LoadGameSnapshot(&check);
+	memcpy(players, recorded->players, sizeof(recorded->players));
+	TruncateRewind(back);
+
+	s_replayUntil = s_recorded;
+	s_recorded -= back;
+	s_rewindRestores++;
+	return 0;
+}
+
+/******************************************************/
+/* Sessions */
+
+static void PrintFrame(int frame, ControllerPacket* packet, int fire)
+{
+	int i;
+
+	printf("%5d pad=%04x axis=%3d fire=%d level=%d blocks=%d", frame, packet->data.pad, packet->data.analog.left_x,
+		fire, g_level, CountAliveBlocks());
+
+	for (i = 0; i < s_playerCount; ++i)
+	{
+		printf(" p%d paddle=%4ld tries=%d score=%ld", i, FixedToInt(s_paddles[i].pos.vx), g_tries[i], (long)g_score[i]);
+	}
+
+	for (i = 0; i < MAX_BALLS; ++i)
+	{
+		if (s_balls[i].enabled)
+		{
+			printf(" b%d=(%ld,%ld)%s", i, FixedToInt(s_balls[i].pos.vx), FixedToInt(s_balls[i].pos.vz),
+				s_balls[i].grabbed ? "g" : "");
+		}
+	}
+
+	printf("\n");
+}
+
+/* Runs the session for the given seed. Returns the failing frame, or -1 if all invariants held. */
+static int RunSession(u_long seed, int frames, int trace, char* message, int messageSize)
+{
+	Player players[MAX_PLAYERS];
+	int fire[MAX_PLAYERS];
+	InputState* inputs[MAX_PLAYERS];
+	u_char powerBefore[MAX_BLOCKS];
+	long scoreBefore[MAX_PLAYERS];
+	volatile int frame = 0;
+	int levelBefore;
+	int triesBefore;
+	int i;
+
+	s_playerCount = s_soakPlayers;
+	for (i = 0; i < s_playerCount; ++i)
+	{
+		InitPlayer(&players[i], seed, i);
+	}
+
+	if (setjmp(s_errorJump))
+	{
+		snprintf(message, messageSize, "ErrorMessage: %s", s_errorText);
+		return frame;
+	}
+
+	/* Sessions must not see the buttons held at the end of the previous one. */
+	memset((void*)s_latchedInput, 0, sizeof(s_latchedInput));
+	memset(s_input, 0, sizeof(s_input));
+	InitInput();
+
+	InitGameState();
+	g_level = (u_char)(1 + RandomRange(&players[0].random, NUM_LEVEL));
+
+	if (s_checkRewind)
+	{
+		BeginRewindSession(seed);
+	}
+
+	for (frame = 0; frame < frames; ++frame)
+	{
+		/* After a game over the players start a new game on another level, like HandleGsGame's SELECT. */
+		if (IsGameOver())
+		{
+			InitGameState();
+			g_level = (u_char)(1 + RandomRange(&players[0].random, NUM_LEVEL));
+		}
+
+		/* Blocks only carry over when UpdateGame does not set up a new level first. */
+		levelBefore = g_level;
+		for (i = 0; i < MAX_BLOCKS; ++i)
+		{
+			powerBefore[i] = (s_loadedLevel == g_level && s_blocks[i].type != 0) ? s_blocks[i].power : MAX_BLOCK_POWER;
+		}
+
+		triesBefore = 0;
+		for (i = 0; i < MAX_PLAYERS; ++i)
+		{
+			scoreBefore[i] = g_score[i];
+			triesBefore += g_tries[i];
+		}
+
+		/* The controllers deliver a packet each, the vertical blank latches them. */
+		for (i = 0; i < s_playerCount; ++i)
+		{
+			fire[i] = NextInput(&players[i], GetControllerPacket(i));
+		}
+		VSync(0);
+		if (s_vsyncHook != 0)
+		{
+			s_vsyncHook();
+		}
+
+		/* Same order as HandleGsGame: take the input, simulate, then react to the fire button. */
+		UpdateInput();
+		for (i = 0; i < s_playerCount; ++i)
+		{
+			inputs[i] = GetInput(i);
+		}
+		UpdateGame(inputs);
+
+		s_levelsCleared += g_level != levelBefore;
+		for (i = 0; i < MAX_PLAYERS; ++i)
+		{
+			triesBefore -= g_tries[i];
+		}
+		s_ballsLost += triesBefore > 0 ? triesBefore : 0;
+
+		for (i = 0; i < s_playerCount; ++i)
+		{
+			if (IsInputHeld(inputs[i], PAD_Cross) && g_tries[i] > 0)
+			{
+				FireBall(i);
+			}
+		}
+
+		if (trace)
+		{
+			PrintFrame(frame, GetControllerPacket(0), fire[0]);
+		}
+
+		/* The level is set up lazily, so there is nothing to compare before the first frame. */
+		if (frame > 0 && CheckInvariants(levelBefore, powerBefore, scoreBefore, message, messageSize))
+		{
+			return frame;
+		}
+
+		if (s_checkRewind && CheckRewind(players, message, messageSize))
+		{
+			return frame;
+		}
+	}
+
+	if (s_checkRewind)
+	{
+		s_rewindKept += (long)GetRewindStats()->frames;
+	}
+
+	return -1;
+}
+
+/* Runs every jobs-th session starting at firstSeed + worker and prints failures to the given stream. */
+static int RunWorker(int worker, int jobs, u_long firstSeed, long sessions, int frames, FILE* out)
+{
+	char message[256];
+	long i;
+	int frame;
+	int failures = 0;
+
+	for (i = worker; i < sessions; i += jobs)
+	{
+		frame = RunSession(firstSeed + (u_long)i, frames, 0, message, sizeof(message));
+		if (frame < 0)
+		{
+			continue;
+		}
+
+		if (failures < MAX_REPORTED_FAILURES)
+		{
+			fprintf(out, "FAIL seed %lu frame %d: %s\n", (unsigned long)(firstSeed + i), frame, message);
+		}
+		failures++;
+	}
+
+	fprintf(out, "PLAYED %ld %ld\n", s_levelsCleared, s_ballsLost);
+	fprintf(out, "REWIND %ld %ld %ld %ld %ld %ld\n", s_rewindFrames, s_rewindBytes, s_rewindKeyframes,
+		s_rewindNanoseconds, s_rewindRestores, s_rewindKept);
+	fprintf(out, "DONE %d\n", failures);
+	fflush(out);
+	return failures;
+}
+
+static void Usage()
+{
+	printf("usage: soak [-n sessions] [-f frames] [-j jobs] [-s firstSeed] [-r seed] [-a] [-w] [-t] [-2]\n");
+	printf("  -n  number of sessions to run (default 1000000)\n");
+	printf("  -f  frames per session (default 3000, one minute of PAL gameplay)\n");
+	printf("  -j  number of worker processes (default: one per core)\n");
+	printf("  -s  seed of the first session (default 1)\n");
+	printf("  -r  replay a single seed and print every frame\n");
+	printf("  -a  let the autopilot play instead of the random player\n");
+	printf("  -w  record every frame for rewind and go back to random frames\n");
+	printf("  -t  step the simulation like a 60 Hz console instead of a PAL one\n");
+	printf("  -2  play versus games of two players\n");
+}
+
+int main(int argc, char** argv)
+{
+	long sessions = 1000000;
+	int frames = 3000;
+	int jobs = (int)sysconf(_SC_NPROCESSORS_ONLN);
+	u_long firstSeed = 1;
+	u_long replaySeed = 0;
+	int replay = 0;
+	int failures = 0;
+	long levels = 0, lost = 0, workerLevels, workerLost;
+	long rewind[6] = { 0 }, workerRewind[6];
+	int i, frame, count;
+	int* pipes;
+	pid_t* workers;
+	char line[512];
+	char message[256];
+	FILE* in;
+
+	for (i = 1; i < argc; ++i)
+	{
+		if (i + 1 < argc && strcmp(argv[i], "-n") == 0) sessions = atol(argv[++i]);
+		else if (i + 1 < argc && strcmp(argv[i], "-f") == 0) frames = atoi(argv[++i]);
+		else if (i + 1 < argc && strcmp(argv[i], "-j") == 0) jobs = atoi(argv[++i]);
+		else if (i + 1 < argc && strcmp(argv[i], "-s") == 0) firstSeed = (u_long)strtoul(argv[++i], 0, 0);
+		else if (i + 1 < argc && strcmp(argv[i], "-r") == 0) { replaySeed = (u_long)strtoul(argv[++i], 0, 0); replay = 1; }
+		else if (strcmp(argv[i], "-a") == 0) s_useAutopilot = 1;
+		else if (strcmp(argv[i], "-w") == 0) s_checkRewind = 1;
+		else if (strcmp(argv[i], "-t") == 0) s_frameStep = ONE * 50 / 60;
+		else if (strcmp(argv[i], "-2") == 0) s_soakPlayers = 2;
+		else { Usage(); return 2; }
+	}
+
+	if (replay)
+	{
+		frame = RunSession(replaySeed, frames, 1, message, sizeof(message));
+		if (frame < 0)
+		{
+			printf("seed %lu: no invariant violated in %d frames\n", (unsigned long)replaySeed, frames);
+			return 0;
+		}
+
+		printf("FAIL seed %lu frame %d: %s\n", (unsigned long)replaySeed, frame, message);
+		return 1;
+	}
+
+	if (jobs < 1)
+	{
+		jobs = 1;
+	}
+
+	printf("Running %ld sessions of %d frames of %d players at %d Hz on %d workers...\n", sessions, frames,
+		s_soakPlayers, s_frameStep == ONE ? 50 : 60, jobs);
+	fflush(stdout);
+
+	pipes = (int*)malloc(sizeof(int) * jobs);
+	workers = (pid_t*)malloc(sizeof(pid_t) * jobs);
+
+	for (i = 0; i < jobs; ++i)
+	{
+		int fds[2];
+
+		if (pipe(fds) != 0)
+		{
+			perror("pipe");
+			return 2;
+		}
+
+		workers[i] = fork();
+		if (workers[i] < 0)
+		{
+			perror("fork");
+			return 2;
+		}
+
+		if (workers[i] == 0)
+		{
+			close(fds[0]);
+			RunWorker(i, jobs, firstSeed, sessions, frames, fdopen(fds[1], "w"));
+			_exit(0);
+		}
+
+		close(fds[1]);
+		pipes[i] = fds[0];
+	}
+
+	for (i = 0; i < jobs; ++i)
+	{
+		in = fdopen(pipes[i], "r");
+		while (fgets(line, sizeof(line), in) != 0)
+		{
+			if (sscanf(line, "DONE %d", &count) == 1)
+			{
+				failures += count;
+			}
+			else if (sscanf(line, "PLAYED %ld %ld", &workerLevels, &workerLost) == 2)
+			{
+				levels += workerLevels;
+				lost += workerLost;
+			}
+			else if (sscanf(line, "REWIND %ld %ld %ld %ld %ld %ld", &workerRewind[0], &workerRewind[1], &workerRewind[2],
+				&workerRewind[3], &workerRewind[4], &workerRewind[5]) == 6)
+			{
+				for (count = 0; count < 6; ++count)
+				{
+					rewind[count] += workerRewind[count];
+				}
+			}
+			else
+			{
+				fputs(line, stdout);
+			}
+		}
+
+		fclose(in);
+		waitpid(workers[i], 0, 0);
+	}
+
+	if (s_useAutopilot)
+	{
+		printf("autopilot cleared %ld levels and lost %ld balls in %ld frames\n", levels, lost, sessions * frames);
+	}
+
+	if (s_checkRewind && rewind[0] > 0)
+	{
+		printf("rewind recorded %ld frames, %ld bytes and %ld ns per frame, %ld%% keyframes, %ld frames kept, %ld restores\n",
+			rewind[0], rewind[1] / rewind[0], rewind[3] / rewind[0], rewind[2] * 100 / rewind[0], rewind[5] / sessions, rewind[4]);
+		printf("rewind buffer %d bytes, snapshot %d bytes\n", REWIND_BUFFER_SIZE, (int)sizeof(GameSnapshot));
+	}
+
+	printf("%ld sessions, %d failed\n", sessions, failures);
+	return failures != 0 ? 1 : 0;
+}
@@ -0,0 +1,93 @@
+/*
+ * Host implementation of the libspu functions used by the game. Transfers land in a copy
+ * of the sound RAM and voice attributes are kept, nothing is mixed or played.
+ */
+
+#include <sys/types.h>
+#include <libetc.h>
+#include <libspu.h>
+
+#include <string.h>
+
+u_char HostSpuRam[HOST_SPU_RAM_SIZE];
+HostSpuVoice HostSpuVoices[HOST_SPU_VOICES];
+
+static u_long s_transferAddress = 0;
+
+void SpuInit(void)
+{
+	memset(HostSpuRam, 0, sizeof(HostSpuRam));
+	memset(HostSpuVoices, 0, sizeof(HostSpuVoices));
+	s_transferAddress = 0;
+}
+
+void SpuQuit(void) { }
+
+void SpuSetCommonAttr(SpuCommonAttr* attr) { }
+
+long SpuSetTransferMode(long mode) { return mode; }
+
+u_long SpuSetTransferStartAddr(u_long addr)
+{
+	/* The SPU addresses its RAM in 8 byte units. */
+	if (addr >= HOST_SPU_RAM_SIZE)
+	{
+		return 0;
+	}
+
+	s_transferAddress = addr & ~7;
+	return s_transferAddress;
+}
+
+u_long SpuWrite(u_char* addr, u_long size)
+{
+	if (size > HOST_SPU_RAM_SIZE - s_transferAddress)
+	{
+		size = HOST_SPU_RAM_SIZE - s_transferAddress;
+	}
+
+	memcpy(HostSpuRam + s_transferAddress, addr, size);
+	return size;
+}
+
+long SpuIsTransferCompleted(long flag) { return 1; }
+
+void SpuSetVoiceAttr(SpuVoiceAttr* attr)
+{
+	HostSpuVoice* voice;
+	int i;
+
+	for (i = 0; i < HOST_SPU_VOICES; ++i)
+	{
+		if (!(attr->voice & SPU_VOICECH(i)))
+		{
+			continue;
+		}
+
+		voice = &HostSpuVoices[i];
+		if (attr->mask & SPU_VOICE_VOLL) voice->volumeLeft = attr->volume.left;
+		if (attr->mask & SPU_VOICE_VOLR) voice->volumeRight = attr->volume.right;
+		if (attr->mask & SPU_VOICE_PITCH) voice->pitch = attr->pitch;
+		if (attr->mask & SPU_VOICE_WDSA) voice->address = attr->addr;
+	}
+}
+
+void SpuSetKey(long on_off, u_long voice_bit)
+{
+	int i;
+
+	for (i = 0; i < HOST_SPU_VOICES; ++i)
+	{
+		if (!(voice_bit & SPU_VOICECH(i)))
+		{
+			continue;
+		}
+
+		HostSpuVoices[i].playing = (u_char)on_off;
+		if (on_off == SpuOn)
+		{
+			HostSpuVoices[i].keyOns++;
+			HostSpuVoices[i].keyOnVSync = VSync(-1);
+		}
+	}
+}
@@ -0,0 +1,661 @@
+/*
+ * STR movie tool: encodes PNG frames into INTRO.STR, the intro movie of the game (see
+ * SRC/Intro.h), and decodes movies again.
+ *
+ * Every frame gets the same number of sectors (-s, 10 by default, 15 frames a second at
+ * double speed). Without -q each frame is encoded with the finest quantiser scale whose
+ * frame still fits into them, so the quality follows what the frame costs; -q fixes the
+ * scale, frames which don't fit then fail. The output has raw XA sectors of 2336 bytes
+ * (subheader and data, no EDC/ECC), like xatool writes them.
+ *
+ * Decoding checks every frame of a movie and reports its size and scale, with -o the frames
+ * are written as PNGs, with -c the PSNR against the source frames is printed as well. test
+ * checks the code table, the transform and the round trip, bench the decoder throughput.
+ *
+ * Usage: strtool encode -o INTRO.STR [-s sectors] [-q scale] frame.png...
+ *        strtool decode [-o dir] [-c frame.png...] INTRO.STR
+ *        strtool test
+ *        strtool bench
+ */
+
+#include <sys/types.h>
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "Intro.h"
+#include "Mdec.h"
+#include "Png.h"
+
+#define XA_SECTOR_SIZE		2336
+#define XA_SUBHEADER_SIZE	8
+#define XA_DATA_SIZE		2048
+
+/* Submode of the sectors: real time data, the last one ends the file. */
+#define XA_SUBMODE_EOR		0x01
+#define XA_SUBMODE_DATA		0x08
+#define XA_SUBMODE_RT		0x40
+#define XA_SUBMODE_EOF		0x80
+#define STR_XA_FILE			1
+
+/* Most sectors a frame can take. */
+#define MAX_FRAME_SECTORS	32
+
+static void WriteShort(u_char* p, u_long value)
+{
+	p[0] = (u_char)value;
+	p[1] = (u_char)(value >> 8);
+}
+
+static void WriteLong(u_char* p, u_long value)
+{
+	p[0] = (u_char)value;
+	p[1] = (u_char)(value >> 8);
+	p[2] = (u_char)(value >> 16);
+	p[3] = (u_char)(value >> 24);
+}
+
+static u_long ReadShort(const u_char* p)
+{
+	return p[0] | (p[1] << 8);
+}
+
+static u_long ReadLong(const u_char* p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((u_long)p[3] << 24);
+}
+
+/* Reads a PNG as RGB. Returns 0 on failure. */
+static u_char* LoadFrame(char* filename, int* width, int* height)
+{
+	u_char* rgba;
+	u_char* rgb;
+	long i;
+
+	rgba = ReadPng(filename, width, height);
+	if (rgba == 0)
+	{
+		return 0;
+	}
+
+	rgb = (u_char*)malloc((size_t)*width * *height * 3);
+	for (i = 0; i < (long)*width * *height; ++i)
+	{
+		memcpy(rgb + i * 3, rgba + i * 4, 3);
+	}
+
+	free(rgba);
+	return rgb;
+}
+
+static double Psnr(const u_char* a, const u_char* b, long count)
+{
+	double error = 0.0;
+	long i;
+
+	for (i = 0; i < count; ++i)
+	{
+		error += (double)(a[i] - b[i]) * (a[i] - b[i]);
+	}
+
+	return error == 0.0 ? 99.0 : 10.0 * log10(255.0 * 255.0 * count / error);
+}
+
+/******************************************************/
+/* Movies */
+
+/* Writes the sectors of a frame: the header and the next part of the frame in each one. */
+static void WriteFrameSectors(u_char* out, const u_char* frame, long size, int number, int sectors, int width, int height, int last)
+{
+	u_char* sector;
+	u_char* header;
+	long offset, part;
+	int i;
+
+	for (i = 0; i < sectors; ++i)
+	{
+		sector = out + (size_t)i * XA_SECTOR_SIZE;
+		memset(sector, 0, XA_SECTOR_SIZE);
+
+		sector[0] = STR_XA_FILE;
+		sector[2] = XA_SUBMODE_DATA | XA_SUBMODE_RT | (last && i == sectors - 1 ? XA_SUBMODE_EOF | XA_SUBMODE_EOR : 0);
+		memcpy(sector + 4, sector, 4);
+
+		header = sector + XA_SUBHEADER_SIZE;
+		WriteShort(header, STR_ID);
+		WriteShort(header + 2, STR_TYPE);
+		WriteShort(header + 4, i);
+		WriteShort(header + 6, sectors);
+		WriteLong(header + 8, number);
+		WriteLong(header + 12, size);
+		WriteShort(header + 16, width);
+		WriteShort(header + 18, height);
+		memcpy(header + 20, frame, MDEC_HEADER_SIZE);
+
+		offset = (long)i * STR_PAYLOAD;
+		part = size - offset < STR_PAYLOAD ? size - offset : STR_PAYLOAD;
+		if (part > 0)
+		{
+			memcpy(header + STR_HEADER_SIZE, frame + offset, part);
+		}
+	}
+}
+
+/* Encodes a frame with the given scale, or the finest one which fits if scale is 0. Returns the size, -1 if it doesn't fit. */
+static long EncodeFrame(const u_char* rgb, int width, int height, int* scale, u_char* out, long maxSize)
+{
+	long size;
+	int low = 1, high = MDEC_MAX_SCALE, middle;
+
+	if (*scale != 0)
+	{
+		return MdecEncodeFrame(rgb, width, height, *scale, out, maxSize);
+	}
+
+	/* Coarser scales make smaller frames, the first one which fits is searched */
+	if (MdecEncodeFrame(rgb, width, height, high, out, maxSize) < 0)
+	{
+		return -1;
+	}
+
+	while (low < high)
+	{
+		middle = (low + high) / 2;
+		if (MdecEncodeFrame(rgb, width, height, middle, out, maxSize) >= 0)
+		{
+			high = middle;
+		}
+		else
+		{
+			low = middle + 1;
+		}
+	}
+
+	*scale = low;
+	size = MdecEncodeFrame(rgb, width, height, low, out, maxSize);
+	return size;
+}
+
+static int Encode(char* output, int sectors, int fixedScale, char** files, int count)
+{
+	u_char frame[MAX_FRAME_SECTORS * STR_PAYLOAD];
+	u_char* rgb;
+	u_char* decoded;
+	u_char* movie;
+	FILE* file;
+	long size, totalSize = 0;
+	int width = 0, height = 0, w, h, i, scale, totalScale = 0, maxScale = 0;
+	double psnr, totalPsnr = 0.0, minPsnr = 99.0;
+
+	movie = (u_char*)malloc((size_t)sectors * XA_SECTOR_SIZE);
+	decoded = 0;
+
+	file = fopen(output, "wb");
+	if (file == 0)
+	{
+		fprintf(stderr, "%s: can't create\n", output);
+		free(movie);
+		return 0;
+	}
+
+	for (i = 0; i < count; ++i)
+	{
+		rgb = LoadFrame(files[i], &w, &h);
+		if (rgb == 0)
+		{
+			break;
+		}
+
+		if (i == 0)
+		{
+			width = w;
+			height = h;
+			decoded = (u_char*)malloc((size_t)width * height * 3);
+		}
+
+		if (w != width || h != height || w % MDEC_MB_SIZE != 0 || h % MDEC_MB_SIZE != 0 ||
+			w > INTRO_MAX_WIDTH || h > INTRO_MAX_HEIGHT)
+		{
+			fprintf(stderr, "%s: frames have to be the same size, a multiple of 16 and at most %dx%d\n",
+				files[i], INTRO_MAX_WIDTH, INTRO_MAX_HEIGHT);
+			free(rgb);
+			break;
+		}
+
+		scale = fixedScale;
+		size = EncodeFrame(rgb, width, height, &scale, frame, (long)sectors * STR_PAYLOAD);
+		if (size < 0)
+		{
+			fprintf(stderr, "%s: doesn't fit into %d sectors\n", files[i], sectors);
+			free(rgb);
+			break;
+		}
+
+		MdecDecodeFrame(frame, size, width, height, decoded);
+		psnr = Psnr(rgb, decoded, (long)width * height * 3);
+		free(rgb);
+
+		totalPsnr += psnr;
+		minPsnr = psnr < minPsnr ? psnr : minPsnr;
+		totalScale += scale;
+		maxScale = scale > maxScale ? scale : maxScale;
+		totalSize += size;
+
+		WriteFrameSectors(movie, frame, size, i + 1, sectors, width, height, i == count - 1);
+		fwrite(movie, XA_SECTOR_SIZE, sectors, file);
+	}
+
+	free(movie);
+	free(decoded);
+	if (fclose(file) != 0 || i < count)
+	{
+		if (i == count)
+		{
+			fprintf(stderr, "%s: write error\n", output);
+		}
+		remove(output);
+		return 0;
+	}
+
+	printf("%s: %d frames of %dx%d, %d sectors each, %.0f%% of them used, scale avg %.1f max %d, PSNR avg %.1f dB min %.1f dB\n",
+		output, count, width, height, sectors, 100.0 * totalSize / ((double)count * sectors * STR_PAYLOAD),
+		(double)totalScale / count, maxScale, totalPsnr / count, minPsnr);
+	return 1;
+}
+
+/*
+ * Collects the next frame of a movie from its sectors. Returns the size of the frame, 0 at
+ * the end of the movie, -1 if the sectors are damaged.
+ */
+static long NextFrame(const u_char** sector, const u_char* end, u_char* frame, int* number, int* width, int* height)
+{
+	const u_char* header;
+	long size = 0;
+	int sectors, i;
+
+	if (*sector + XA_SECTOR_SIZE > end)
+	{
+		return 0;
+	}
+
+	header = *sector + XA_SUBHEADER_SIZE;
+	sectors = (int)ReadShort(header + 6);
+	*number = (int)ReadLong(header + 8);
+	size = (long)ReadLong(header + 12);
+	*width = (int)ReadShort(header + 16);
+	*height = (int)ReadShort(header + 18);
+
+	if (sectors == 0 || sectors > MAX_FRAME_SECTORS || size > (long)sectors * STR_PAYLOAD)
+	{
+		return -1;
+	}
+
+	for (i = 0; i < sectors; ++i, *sector += XA_SECTOR_SIZE)
+	{
+		header = *sector + XA_SUBHEADER_SIZE;
+		if (*sector + XA_SECTOR_SIZE > end || ReadShort(header) != STR_ID || ReadShort(header + 2) != STR_TYPE ||
+			(int)ReadShort(header + 4) != i || (int)ReadLong(header + 8) != *number)
+		{
+			return -1;
+		}
+
+		memcpy(frame + (long)i * STR_PAYLOAD, header + STR_HEADER_SIZE, STR_PAYLOAD);
+	}
+
+	return size;
+}
+
+static int Decode(char* input, char* outputDir, char** references, int referenceCount)
+{
+	u_char frame[MAX_FRAME_SECTORS * STR_PAYLOAD];
+	char filename[1024];
+	u_char* movie;
+	u_char* rgb = 0;
+	u_char* reference;
+	const u_char* sector;
+	FILE* file;
+	long size, movieSize;
+	int number, width, height, w, h, frames = 0, failures = 0;
+
+	file = fopen(input, "rb");
+	if (file == 0)
+	{
+		fprintf(stderr, "%s: can't open\n", input);
+		return 0;
+	}
+
+	fseek(file, 0, SEEK_END);
+	movieSize = ftell(file);
+	fseek(file, 0, SEEK_SET);
+	movie = (u_char*)malloc(movieSize > 0 ? movieSize : 1);
+	if ((long)fread(movie, 1, movieSize, file) != movieSize || movieSize % XA_SECTOR_SIZE != 0)
+	{
+		fprintf(stderr, "%s: not a whole number of XA sectors\n", input);
+		fclose(file);
+		free(movie);
+		return 0;
+	}
+	fclose(file);
+
+	for (sector = movie; (size = NextFrame(&sector, movie + movieSize, frame, &number, &width, &height)) != 0; ++frames)
+	{
+		rgb = (u_char*)realloc(rgb, (size_t)width * height * 3 + 1);
+		if (size < 0 || width % MDEC_MB_SIZE != 0 || height % MDEC_MB_SIZE != 0 ||
+			!MdecDecodeFrame(frame, size, width, height, rgb))
+		{
+			printf("frame %d: damaged\n", frames + 1);
+			failures++;
+			break;
+		}
+
+		printf("frame %d: %dx%d %ld bytes scale %d", number, width, height, size, frame[4]);
+
+		if (frames < referenceCount && (reference = LoadFrame(references[frames], &w, &h)) != 0)
+		{
+			if (w == width && h == height)
+			{
+				printf(" PSNR %.1f dB", Psnr(reference, rgb, (long)width * height * 3));
+			}
+			free(reference);
+		}
+		printf("\n");
+
+		if (outputDir != 0)
+		{
+			snprintf(filename, sizeof(filename), "%s/frame%04d.png", outputDir, number);
+			if (!WritePng(filename, width, height, rgb))
+			{
+				failures++;
+				break;
+			}
+		}
+	}
+
+	printf("%s: %d frames, %d failures\n", input, frames, failures);
+	free(rgb);
+	free(movie);
+	return failures == 0 && frames > 0;
+}
+
+/******************************************************/
+/* Test and bench */
+
+/* A test picture: gradients, hard edges and a moving disc. */
+static void MakePicture(u_char* rgb, int width, int height, int time)
+{
+	int x, y, dx, dy;
+	u_char* p;
+
+	for (y = 0; y < height; ++y)
+	{
+		for (x = 0; x < width; ++x)
+		{
+			p = rgb + (y * width + x) * 3;
+			p[0] = (u_char)(x * 255 / width);
+			p[1] = (u_char)(y * 255 / height);
+			p[2] = (u_char)(((x / 32 + y / 32) & 1) ? 200 : 40);
+
+			dx = x - (width / 4 + time * 8);
+			dy = y - height / 2;
+			if (dx * dx + dy * dy < 40 * 40)
+			{
+				p[0] = 250;
+				p[1] = 220;
+				p[2] = 30;
+			}
+		}
+	}
+}
+
+static int Test()
+{
+	float in[64], fast[64], reference[64], error, maxError = 0.0f;
+	u_char frame[MAX_FRAME_SECTORS * STR_PAYLOAD];
+	u_char movie[3 * 2 * XA_SECTOR_SIZE];
+	u_char back[MAX_FRAME_SECTORS * STR_PAYLOAD];
+	u_char* rgb;
+	u_char* decoded;
+	const u_char* sector;
+	long size, lastSize = 0x7fffffff, sizes[3];
+	int width = 64, height = 48, i, k, scale, failures = 0, number, w, h;
+	double psnr, lastPsnr = 99.0;
+
+	/* Every code decodes as itself only */
+	if (MdecCheckCodes() != 0)
+	{
+		printf("code table: %d codes clash\n", MdecCheckCodes());
+		failures++;
+	}
+
+	/* The fast transform against the plain sum */
+	srand(1);
+	for (i = 0; i < 100; ++i)
+	{
+		for (k = 0; k < 64; ++k)
+		{
+			in[k] = (float)(rand() % 4096 - 2048) / (k + 1);
+		}
+
+		MdecIdct(in, fast);
+		MdecIdctReference(in, reference);
+		for (k = 0; k < 64; ++k)
+		{
+			error = fabsf(fast[k] - reference[k]);
+			maxError = error > maxError ? error : maxError;
+		}
+	}
+
+	printf("idct: largest difference %.5f\n", maxError);
+	if (maxError > 0.01f)
+	{
+		failures++;
+	}
+
+	/* Round trip: finer scales are larger and better, as far as the halved chroma of the disc lets them */
+	rgb = (u_char*)malloc(width * height * 3);
+	decoded = (u_char*)malloc(width * height * 3);
+	MakePicture(rgb, width, height, 0);
+
+	for (scale = 1; scale <= 16; scale *= 4)
+	{
+		size = MdecEncodeFrame(rgb, width, height, scale, frame, sizeof(frame));
+		if (size < 0 || !MdecDecodeFrame(frame, size, width, height, decoded))
+		{
+			printf("scale %d: round trip failed\n", scale);
+			failures++;
+			continue;
+		}
+
+		psnr = Psnr(rgb, decoded, width * height * 3);
+		printf("scale %d: %ld bytes, PSNR %.1f dB\n", scale, size, psnr);
+		if (size >= lastSize || psnr < (scale == 1 ? 30.0 : 25.0) || psnr > lastPsnr)
+		{
+			failures++;
+		}
+		lastSize = size;
+		lastPsnr = psnr;
+	}
+
+	/* A damaged frame is refused, whatever the damage */
+	size = MdecEncodeFrame(rgb, width, height, 2, frame, sizeof(frame));
+	if (MdecDecodeFrame(frame, size / 2, width, height, decoded))
+	{
+		printf("a cut off frame decoded\n");
+		failures++;
+	}
+	for (i = 0; i < 200; ++i)
+	{
+		memcpy(back, frame, size);
+		back[MDEC_HEADER_SIZE + rand() % (size - MDEC_HEADER_SIZE)] ^= (u_char)(1 << (rand() % 8));
+		MdecDecodeFrame(back, size, width, height, decoded);
+	}
+
+	/* The sectors of a movie give the frames back */
+	for (i = 0; i < 3; ++i)
+	{
+		MakePicture(rgb, width, height, i);
+		sizes[i] = MdecEncodeFrame(rgb, width, height, 4, frame, 2 * STR_PAYLOAD);
+		WriteFrameSectors(movie + (size_t)i * 2 * XA_SECTOR_SIZE, frame, sizes[i], i + 1, 2, width, height, i == 2);
+	}
+
+	sector = movie;
+	for (i = 0; i < 3; ++i)
+	{
+		MakePicture(rgb, width, height, i);
+		MdecEncodeFrame(rgb, width, height, 4, frame, 2 * STR_PAYLOAD);
+		size = NextFrame(&sector, movie + sizeof(movie), back, &number, &w, &h);
+		if (size != sizes[i] || number != i + 1 || w != width || h != height || memcmp(frame, back, size) != 0)
+		{
+			printf("movie: frame %d differs\n", i + 1);
+			failures++;
+		}
+	}
+
+	if (NextFrame(&sector, movie + sizeof(movie), back, &number, &w, &h) != 0 || (movie[sizeof(movie) - XA_SECTOR_SIZE + 2] & XA_SUBMODE_EOF) == 0)
+	{
+		printf("movie: doesn't end after the last frame\n");
+		failures++;
+	}
+
+	free(rgb);
+	free(decoded);
+
+	printf("%s: %d failures\n", failures == 0 ? "PASS" : "FAIL", failures);
+	return failures == 0;
+}
+
+static double Seconds()
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static int Bench()
+{
+	u_char frame[INTRO_FRAME_SECTORS * STR_PAYLOAD];
+	u_short* codes;
+	u_char* rgb;
+	float in[64], out[64];
+	long size, words;
+	double start, vlcTime, decodeTime, fastTime, referenceTime;
+	int width = 320, height = 240, scale = 0, i, rounds = 200;
+
+	rgb = (u_char*)malloc(width * height * 3);
+	codes = (u_short*)malloc(0x20000 * sizeof(u_short));
+	MakePicture(rgb, width, height, 3);
+	size = EncodeFrame(rgb, width, height, &scale, frame, sizeof(frame));
+
+	start = Seconds();
+	for (i = 0; i < rounds; ++i)
+	{
+		words = MdecDecodeVlc(frame, size, codes, 0xffff);
+	}
+	vlcTime = Seconds() - start;
+
+	start = Seconds();
+	for (i = 0; i < rounds; ++i)
+	{
+		MdecDecodeFrame(frame, size, width, height, rgb);
+	}
+	decodeTime = Seconds() - start;
+
+	for (i = 0; i < 64; ++i)
+	{
+		in[i] = (float)(i * 37 % 200 - 100);
+	}
+
+	start = Seconds();
+	for (i = 0; i < rounds * 1000; ++i)
+	{
+		in[0] = (float)i;
+		MdecIdct(in, out);
+	}
+	fastTime = Seconds() - start;
+
+	start = Seconds();
+	for (i = 0; i < rounds * 100; ++i)
+	{
+		in[0] = (float)i;
+		MdecIdctReference(in, out);
+	}
+	referenceTime = (Seconds() - start) * 10;
+
+	printf("frame: %dx%d, %ld bytes, scale %d, %ld words of codes\n", width, height, size, scale, words);
+	printf("vlc: %.0f frames/s\n", rounds / vlcTime);
+	printf("decode: %.0f frames/s (%.0fx real time at 15 frames/s)\n", rounds / decodeTime, rounds / decodeTime / 15.0);
+	printf("idct: %.1f Mblocks/s, %.1fx the plain sum\n", rounds * 1000 / fastTime / 1e6, referenceTime / fastTime);
+
+	free(codes);
+	free(rgb);
+	return 1;
+}
+
+static void Usage()
+{
+	fprintf(stderr,
+		"usage: strtool encode -o INTRO.STR [-s sectors] [-q scale] frame.png...\n"
+		"       strtool decode [-o dir] [-c frame.png...] INTRO.STR\n"
+		"       strtool test\n"
+		"       strtool bench\n");
+	exit(2);
+}
+
+int main(int argc, char** argv)
+{
+	char* output = 0;
+	int sectors = INTRO_FRAME_SECTORS, scale = 0, i, first;
+
+	if (argc < 2)
+	{
+		Usage();
+	}
+
+	if (strcmp(argv[1], "test") == 0)
+	{
+		return Test() ? 0 : 1;
+	}
+
+	if (strcmp(argv[1], "bench") == 0)
+	{
+		return Bench() ? 0 : 1;
+	}
+
+	if (strcmp(argv[1], "encode") == 0)
+	{
+		for (i = 2; i < argc && argv[i][0] == '-'; ++i)
+		{
+			if (i + 1 < argc && strcmp(argv[i], "-o") == 0) output = argv[++i];
+			else if (i + 1 < argc && strcmp(argv[i], "-s") == 0) sectors = atoi(argv[++i]);
+			else if (i + 1 < argc && strcmp(argv[i], "-q") == 0) scale = atoi(argv[++i]);
+			else Usage();
+		}
+
+		if (output == 0 || i == argc || sectors < 1 || sectors > MAX_FRAME_SECTORS || scale < 0 || scale > MDEC_MAX_SCALE)
+		{
+			Usage();
+		}
+
+		return Encode(output, sectors, scale, argv + i, argc - i) ? 0 : 1;
+	}
+
+	if (strcmp(argv[1], "decode") == 0 && argc >= 3)
+	{
+		/* The reference frames after -c run up to the movie */
+		for (i = 2, first = argc - 1; i < argc - 1 && first == argc - 1; ++i)
+		{
+			if (i + 1 < argc - 1 && strcmp(argv[i], "-o") == 0) output = argv[++i];
+			else if (strcmp(argv[i], "-c") == 0) first = i + 1;
+			else Usage();
+		}
+
+		return Decode(argv[argc - 1], output, argv + first, argc - 1 - first) ? 0 : 1;
+	}
+
+	Usage();
+	return 2;
+}
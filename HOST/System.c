@@ -0,0 +1,86 @@
+/*
+ * Host implementation of the libetc and libapi functions used by the game.
+ */
+
+#include <sys/types.h>
+#include <libapi.h>
+#include <libetc.h>
+
+#include <time.h>
+
+char HostBiosRegion = 'E';
+void (*HostVSyncHook)(void) = 0;
+
+static long s_videoMode = MODE_NTSC;
+static int s_vsyncCount = 0;
+static void (*s_vsyncCallback)() = 0;
+
+/* Processor time of the last VSync(0), VSync(1) measures from there. */
+static struct timespec s_vsyncTime;
+
+int ResetCallback(void) { s_vsyncCallback = 0; return 0; }
+int StopCallback(void) { s_vsyncCallback = 0; return 0; }
+
+int VSync(int mode)
+{
+	struct timespec now;
+	long microseconds;
+
+	if (mode < 0)
+	{
+		return s_vsyncCount;
+	}
+
+	/*
+	 * Horizontal blanks since the last vertical blank. The host doesn't wait for vertical
+	 * blanks, so this is the processor time the process spent since the last VSync(0), in
+	 * scanlines of the video mode (64 us on PAL, 63.6 us on NTSC), for frame timing on the
+	 * host. Unlike the real time it doesn't count the time other processes had the core.
+	 */
+	if (mode == 1)
+	{
+		clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &now);
+		microseconds = (long)(now.tv_sec - s_vsyncTime.tv_sec) * 1000000 + (now.tv_nsec - s_vsyncTime.tv_nsec) / 1000;
+		return s_videoMode == MODE_PAL ? (int)(microseconds / 64) : (int)(microseconds * 10 / 636);
+	}
+
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &s_vsyncTime);
+	s_vsyncCount++;
+	if (HostVSyncHook != 0)
+	{
+		HostVSyncHook();
+	}
+	if (s_vsyncCallback != 0)
+	{
+		s_vsyncCallback();
+	}
+
+	return 0;
+}
+
+int VSyncCallback(void (*f)())
+{
+	s_vsyncCallback = f;
+	return 0;
+}
+
+long SetVideoMode(long mode)
+{
+	long previous = s_videoMode;
+	s_videoMode = mode;
+	return previous;
+}
+
+long GetVideoMode(void)
+{
+	return s_videoMode;
+}
+
+/* The controller buffers stay as the caller filled them, host tools write packets directly. */
+int InitTAP(void* bufA, long lenA, void* bufB, long lenB) { return 1; }
+int StartTAP(void) { return 1; }
+int StopTAP(void) { return 1; }
+
+/* There are no interrupts on the host, callbacks only run from VSync. */
+int EnterCriticalSection(void) { return 1; }
+void ExitCriticalSection(void) { }
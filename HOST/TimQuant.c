@@ -0,0 +1,1317 @@
+/*
+ * Texture quantiser: converts TIM and PNG images into TIMs with a 4 or 8 bit CLUT.
+ *
+ * Colors are reduced to the 15 bit colors of the GPU first. If the image has no more
+ * colors than the CLUT takes it is converted without loss, otherwise the palette comes
+ * from a median cut of the color histogram, refined by a few rounds of k-means. With -d
+ * the pixels are Floyd-Steinberg dithered against the palette. Transparent pixels (color
+ * 0 in a TIM, alpha below 128 in a PNG) get CLUT entry 0, which stays 0; other colors
+ * which would come out as 0 are written as 0x8000 so they stay opaque, like the STP bit of
+ * the source. The quality is reported as the PSNR of the opaque pixels against the source.
+ *
+ * Without -b the depth is chosen: 4 bits if that is lossless or reaches the PSNR given
+ * with -q, 8 bits otherwise. TIM sources keep their VRAM positions unless -p (image) or -c
+ * (CLUT) are given, PNG sources need both.
+ *
+ * The nearest palette entry is only searched once per 15 bit color and kept in a table of
+ * all 32768 colors, the search itself runs over the palette as arrays of channels, in
+ * blocks the compiler vectorises.
+ *
+ * Usage: timquant [-b 4|8] [-q dB] [-d] [-p x,y] [-c x,y] -o out.tim in.tim|in.png
+ *        timquant report file...
+ *        timquant test
+ *        timquant bench
+ */
+
+#include <sys/types.h>
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+
+#include "Png.h"
+
+/* Maximum size of a TIM file the tool accepts. */
+#define MAX_TIM_SIZE (1024 * 1024)
+
+/* Colors of the GPU, 5 bits per channel. */
+#define COLOR_COUNT 32768
+
+/* Rounds of k-means after the median cut. */
+#define REFINE_ROUNDS 8
+
+/* PSNR in dB at which 4 bits are good enough when the depth is chosen. */
+#define DEFAULT_QUALITY 40.0
+
+/* Kinds of source pixels. */
+#define PIXEL_TRANSPARENT	0
+#define PIXEL_OPAQUE		1
+/* Opaque with the STP bit set. */
+#define PIXEL_STP			2
+
+/*
+ * The palette is searched in blocks of this many entries, a loop of fixed length the
+ * compiler vectorises. Entries past the end of the palette are far away from every color.
+ */
+#define SEARCH_BLOCK	16
+#define FAR_CHANNEL		1024
+
+/* Marks a color of s_nearest whose palette entry was not searched yet. */
+#define NOT_SEARCHED 0xffff
+
+typedef struct
+{
+	int width, height;
+	/* 8 bits per channel, 3 bytes per pixel. */
+	u_char* rgb;
+	/* PIXEL_* of every pixel. */
+	u_char* kind;
+	/* VRAM position of the image and CLUT, -1 if the source has none. */
+	int px, py;
+	int cx, cy;
+	/* Bits per pixel and size of the source file. */
+	int bits;
+	long fileSize;
+} Image;
+
+typedef struct
+{
+	int bits;
+	/* CLUT entries in use, transparency included. */
+	int colors;
+	u_short clut[256];
+	/* CLUT index of every pixel. */
+	u_char* indices;
+	/* Squared error summed over the channels of the opaque pixels, and their number. */
+	double error;
+	long samples;
+} Quantized;
+
+/* A color of the histogram and the number of pixels which have it. */
+typedef struct
+{
+	u_short color;
+	u_long count;
+} HistogramColor;
+
+/* Colors of the histogram from start on which become one palette entry. */
+typedef struct
+{
+	int start, count;
+	/* Squared error of the box against its mean and the channel it is widest in. */
+	double error;
+	int axis;
+} Box;
+
+static u_char s_tim[MAX_TIM_SIZE];
+
+static u_long s_counts[COLOR_COUNT];
+static u_long s_stpCounts[COLOR_COUNT];
+static HistogramColor s_histogram[COLOR_COUNT];
+static int s_histogramSize;
+
+/* Palette as arrays of 5 bit channels, without the transparent entry. */
+static int s_paletteR[256];
+static int s_paletteG[256];
+static int s_paletteB[256];
+static int s_paletteSize;
+
+/* Palette entry nearest to every 15 bit color, NOT_SEARCHED until needed. */
+static u_short s_nearest[COLOR_COUNT];
+
+/* Channel the colors are sorted by, for qsort. */
+static int s_sortAxis;
+
+static u_long ReadLong(u_char* p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((u_long)p[3] << 24);
+}
+
+static u_short ReadShort(u_char* p)
+{
+	return (u_short)(p[0] | (p[1] << 8));
+}
+
+static void WriteLong(u_char* p, u_long value)
+{
+	p[0] = (u_char)value;
+	p[1] = (u_char)(value >> 8);
+	p[2] = (u_char)(value >> 16);
+	p[3] = (u_char)(value >> 24);
+}
+
+static void WriteShort(u_char* p, u_short value)
+{
+	p[0] = (u_char)value;
+	p[1] = (u_char)(value >> 8);
+}
+
+static double Seconds()
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/* 8 bit channel to 5 bits, rounded. */
+static int ToFive(int value)
+{
+	return (value * 31 + 127) / 255;
+}
+
+/* 5 bit channel to 8 bits, like the GPU expands it for display. */
+static int ToEight(int value)
+{
+	return (value << 3) | (value >> 2);
+}
+
+static int GetR(int color) { return color & 31; }
+static int GetG(int color) { return (color >> 5) & 31; }
+static int GetB(int color) { return (color >> 10) & 31; }
+
+static int GetChannel(int color, int axis)
+{
+	return (color >> (axis * 5)) & 31;
+}
+
+static int MakeColor(int r, int g, int b)
+{
+	return r | (g << 5) | (b << 10);
+}
+
+static int AllocImage(Image* image, int width, int height)
+{
+	image->width = width;
+	image->height = height;
+	image->rgb = (u_char*)malloc((long)width * height * 3);
+	image->kind = (u_char*)malloc((long)width * height);
+	image->px = image->py = image->cx = image->cy = -1;
+	return image->rgb != 0 && image->kind != 0;
+}
+
+static void FreeImage(Image* image)
+{
+	free(image->rgb);
+	free(image->kind);
+	image->rgb = 0;
+	image->kind = 0;
+}
+
+/* Sets a pixel from a 16 bit GPU color. */
+static void SetPixel16(Image* image, long pixel, u_short color)
+{
+	image->rgb[pixel * 3 + 0] = (u_char)ToEight(GetR(color));
+	image->rgb[pixel * 3 + 1] = (u_char)ToEight(GetG(color));
+	image->rgb[pixel * 3 + 2] = (u_char)ToEight(GetB(color));
+	image->kind[pixel] = color == 0 ? PIXEL_TRANSPARENT : (color & 0x8000) ? PIXEL_STP : PIXEL_OPAQUE;
+}
+
+/******************************************************/
+/* Reading and writing */
+
+static int ReadTim(char* filename, Image* image)
+{
+	FILE* file;
+	long size, offset = 8, pixel, count;
+	u_long flags;
+	u_short clut[256];
+	int mode, clutSize = 0, width, height, x, y, index, cx = -1, cy = -1;
+	u_char* data;
+
+	file = fopen(filename, "rb");
+	if (file == 0)
+	{
+		fprintf(stderr, "%s: can't open\n", filename);
+		return 0;
+	}
+
+	size = (long)fread(s_tim, 1, sizeof(s_tim), file);
+	fclose(file);
+
+	if (size < 20 || ReadLong(s_tim) != 0x10)
+	{
+		fprintf(stderr, "%s: not a TIM file\n", filename);
+		return 0;
+	}
+
+	flags = ReadLong(s_tim + 4);
+	mode = flags & 7;
+	if (mode > 3)
+	{
+		fprintf(stderr, "%s: mixed TIMs are not supported\n", filename);
+		return 0;
+	}
+
+	memset(clut, 0, sizeof(clut));
+
+	/* Only the first CLUT of the TIM is used */
+	if ((flags >> 3) & 1)
+	{
+		clutSize = ReadShort(s_tim + offset + 8);
+		clutSize = clutSize > 256 ? 256 : clutSize;
+		if (offset + 12 + clutSize * 2 > size)
+		{
+			fprintf(stderr, "%s: truncated\n", filename);
+			return 0;
+		}
+
+		for (x = 0; x < clutSize; ++x)
+		{
+			clut[x] = ReadShort(s_tim + offset + 12 + x * 2);
+		}
+
+		cx = ReadShort(s_tim + offset + 4);
+		cy = ReadShort(s_tim + offset + 6);
+		offset += ReadLong(s_tim + offset);
+	}
+
+	if (offset + 12 > size)
+	{
+		fprintf(stderr, "%s: truncated\n", filename);
+		return 0;
+	}
+
+	/* The width is stored in 16 bit words */
+	width = ReadShort(s_tim + offset + 8);
+	height = ReadShort(s_tim + offset + 10);
+	count = (long)width * 2 * height;
+	data = s_tim + offset + 12;
+	if (offset + 12 + count > size)
+	{
+		fprintf(stderr, "%s: truncated\n", filename);
+		return 0;
+	}
+
+	switch (mode)
+	{
+	case 0: width *= 4; break;
+	case 1: width *= 2; break;
+	case 3: width = width * 2 / 3; break;
+	}
+
+	if (!AllocImage(image, width, height))
+	{
+		fprintf(stderr, "%s: out of memory\n", filename);
+		return 0;
+	}
+
+	image->px = ReadShort(s_tim + offset + 4);
+	image->py = ReadShort(s_tim + offset + 6);
+	image->cx = cx;
+	image->cy = cy;
+	image->bits = mode == 0 ? 4 : mode == 1 ? 8 : mode == 2 ? 16 : 24;
+	image->fileSize = size;
+
+	for (y = 0; y < height; ++y)
+	{
+		for (x = 0; x < width; ++x)
+		{
+			pixel = (long)y * width + x;
+
+			switch (mode)
+			{
+			case 0:
+				index = (data[y * (count / height) + x / 2] >> ((x & 1) * 4)) & 15;
+				SetPixel16(image, pixel, clut[index]);
+				break;
+			case 1:
+				SetPixel16(image, pixel, clut[data[y * (count / height) + x]]);
+				break;
+			case 2:
+				SetPixel16(image, pixel, ReadShort(data + y * (count / height) + x * 2));
+				break;
+			case 3:
+				memcpy(image->rgb + pixel * 3, data + y * (count / height) + x * 3, 3);
+				image->kind[pixel] = PIXEL_OPAQUE;
+				break;
+			}
+		}
+	}
+
+	return 1;
+}
+
+static int ReadImage(char* filename, Image* image)
+{
+	u_char* rgba;
+	long pixel;
+	int width, height;
+	FILE* file;
+	char* extension = strrchr(filename, '.');
+
+	if (extension == 0 || strcasecmp(extension, ".png") != 0)
+	{
+		return ReadTim(filename, image);
+	}
+
+	rgba = ReadPng(filename, &width, &height);
+	if (rgba == 0)
+	{
+		fprintf(stderr, "%s: not a PNG file the tool can read\n", filename);
+		return 0;
+	}
+
+	if (!AllocImage(image, width, height))
+	{
+		fprintf(stderr, "%s: out of memory\n", filename);
+		free(rgba);
+		return 0;
+	}
+
+	for (pixel = 0; pixel < (long)width * height; ++pixel)
+	{
+		memcpy(image->rgb + pixel * 3, rgba + pixel * 4, 3);
+		image->kind[pixel] = rgba[pixel * 4 + 3] < 128 ? PIXEL_TRANSPARENT : PIXEL_OPAQUE;
+	}
+
+	image->bits = 32;
+	file = fopen(filename, "rb");
+	fseek(file, 0, SEEK_END);
+	image->fileSize = ftell(file);
+	fclose(file);
+
+	free(rgba);
+	return 1;
+}
+
+/* Returns the size of the TIM WriteTim writes. */
+static long GetTimSize(Image* image, Quantized* quantized)
+{
+	int perWord = quantized->bits == 4 ? 4 : 2;
+	long words = (image->width + perWord - 1) / perWord;
+
+	return 8 + 12 + (1L << quantized->bits) * 2 + 12 + words * 2 * image->height;
+}
+
+/*
+ * Writes the quantized image as a TIM at the VRAM positions of image. Rows are padded to
+ * whole 16 bit words with CLUT entry 0.
+ */
+static int WriteTim(char* filename, Image* image, Quantized* quantized)
+{
+	int perWord = quantized->bits == 4 ? 4 : 2;
+	int entries = 1 << quantized->bits;
+	long words = (image->width + perWord - 1) / perWord;
+	long size = GetTimSize(image, quantized);
+	long rowBytes = words * 2;
+	u_char* tim;
+	u_char* p;
+	int x, y, i, index;
+	FILE* file;
+
+	tim = (u_char*)calloc(1, size);
+	if (tim == 0)
+	{
+		return 0;
+	}
+
+	WriteLong(tim, 0x10);
+	WriteLong(tim + 4, (quantized->bits == 4 ? 0 : 1) | 8);
+
+	p = tim + 8;
+	WriteLong(p, 12 + entries * 2);
+	WriteShort(p + 4, (u_short)image->cx);
+	WriteShort(p + 6, (u_short)image->cy);
+	WriteShort(p + 8, (u_short)entries);
+	WriteShort(p + 10, 1);
+	for (i = 0; i < entries; ++i)
+	{
+		WriteShort(p + 12 + i * 2, i < quantized->colors ? quantized->clut[i] : 0);
+	}
+
+	p += 12 + entries * 2;
+	WriteLong(p, 12 + rowBytes * image->height);
+	WriteShort(p + 4, (u_short)image->px);
+	WriteShort(p + 6, (u_short)image->py);
+	WriteShort(p + 8, (u_short)words);
+	WriteShort(p + 10, (u_short)image->height);
+	p += 12;
+
+	/* The first pixel is in the lowest bits */
+	for (y = 0; y < image->height; ++y)
+	{
+		for (x = 0; x < image->width; ++x)
+		{
+			index = quantized->indices[(long)y * image->width + x];
+
+			if (quantized->bits == 4)
+			{
+				p[y * rowBytes + x / 2] |= (u_char)(index << ((x & 1) * 4));
+			}
+			else
+			{
+				p[y * rowBytes + x] = (u_char)index;
+			}
+		}
+	}
+
+	file = fopen(filename, "wb");
+	if (file == 0)
+	{
+		free(tim);
+		return 0;
+	}
+
+	fwrite(tim, 1, size, file);
+	free(tim);
+	return fclose(file) == 0;
+}
+
+/******************************************************/
+/* Quantisation */
+
+/* Returns the GPU color of a pixel without its STP bit. */
+static int GetPixelColor(Image* image, long pixel)
+{
+	u_char* rgb = image->rgb + pixel * 3;
+
+	return MakeColor(ToFive(rgb[0]), ToFive(rgb[1]), ToFive(rgb[2]));
+}
+
+/* Counts the colors of the opaque pixels. Returns 1 if the image has transparent pixels. */
+static int BuildHistogram(Image* image)
+{
+	long pixel, pixels = (long)image->width * image->height;
+	int color, transparent = 0;
+
+	memset(s_counts, 0, sizeof(s_counts));
+	memset(s_stpCounts, 0, sizeof(s_stpCounts));
+
+	for (pixel = 0; pixel < pixels; ++pixel)
+	{
+		if (image->kind[pixel] == PIXEL_TRANSPARENT)
+		{
+			transparent = 1;
+			continue;
+		}
+
+		color = GetPixelColor(image, pixel);
+		s_counts[color]++;
+		s_stpCounts[color] += image->kind[pixel] == PIXEL_STP;
+	}
+
+	s_histogramSize = 0;
+	for (color = 0; color < COLOR_COUNT; ++color)
+	{
+		if (s_counts[color] != 0)
+		{
+			s_histogram[s_histogramSize].color = (u_short)color;
+			s_histogram[s_histogramSize].count = s_counts[color];
+			s_histogramSize++;
+		}
+	}
+
+	return transparent;
+}
+
+/* Computes the error of a box and the channel to split it along. */
+static void MeasureBox(Box* box)
+{
+	double sum[3] = { 0, 0, 0 }, squares[3] = { 0, 0, 0 }, weight = 0, variance, widest = -1;
+	int i, axis, value;
+
+	for (i = box->start; i < box->start + box->count; ++i)
+	{
+		for (axis = 0; axis < 3; ++axis)
+		{
+			value = GetChannel(s_histogram[i].color, axis);
+			sum[axis] += (double)value * s_histogram[i].count;
+			squares[axis] += (double)value * value * s_histogram[i].count;
+		}
+		weight += s_histogram[i].count;
+	}
+
+	box->error = 0;
+	box->axis = 0;
+	for (axis = 0; axis < 3; ++axis)
+	{
+		variance = squares[axis] - sum[axis] * sum[axis] / weight;
+		box->error += variance;
+		if (variance > widest)
+		{
+			widest = variance;
+			box->axis = axis;
+		}
+	}
+}
+
+static int CompareChannel(const void* a, const void* b)
+{
+	return GetChannel(((const HistogramColor*)a)->color, s_sortAxis) - GetChannel(((const HistogramColor*)b)->color, s_sortAxis);
+}
+
+/* Splits the histogram into up to count boxes, always the one with the largest error at its weighted median. */
+static int MedianCut(Box* boxes, int count)
+{
+	u_long weight, half;
+	int boxCount = 1, i, worst, split;
+	Box* box;
+
+	boxes[0].start = 0;
+	boxes[0].count = s_histogramSize;
+	MeasureBox(&boxes[0]);
+
+	while (boxCount < count)
+	{
+		worst = -1;
+		for (i = 0; i < boxCount; ++i)
+		{
+			if (boxes[i].count > 1 && boxes[i].error > 0 && (worst < 0 || boxes[i].error > boxes[worst].error))
+			{
+				worst = i;
+			}
+		}
+
+		if (worst < 0)
+		{
+			break;
+		}
+
+		box = &boxes[worst];
+		s_sortAxis = box->axis;
+		qsort(&s_histogram[box->start], box->count, sizeof(HistogramColor), CompareChannel);
+
+		for (i = box->start, weight = 0; i < box->start + box->count; ++i)
+		{
+			weight += s_histogram[i].count;
+		}
+
+		/* The second half starts after the weighted median, both keep at least one color */
+		half = weight / 2;
+		weight = s_histogram[box->start].count;
+		for (split = box->start + 1; split < box->start + box->count - 1 && weight < half; ++split)
+		{
+			weight += s_histogram[split].count;
+		}
+
+		boxes[boxCount].start = split;
+		boxes[boxCount].count = box->start + box->count - split;
+		box->count = split - box->start;
+		MeasureBox(box);
+		MeasureBox(&boxes[boxCount]);
+		boxCount++;
+	}
+
+	return boxCount;
+}
+
+/* Returns the palette entry nearest to a 15 bit color, searched once per color. */
+static int FindNearest(int color)
+{
+	int distances[256];
+	int r = GetR(color), g = GetG(color), b = GetB(color);
+	int i, block, best, dr, dg, db;
+
+	if (s_nearest[color] != NOT_SEARCHED)
+	{
+		return s_nearest[color];
+	}
+
+	for (block = 0; block < s_paletteSize; block += SEARCH_BLOCK)
+	{
+		for (i = block; i < block + SEARCH_BLOCK; ++i)
+		{
+			dr = s_paletteR[i] - r;
+			dg = s_paletteG[i] - g;
+			db = s_paletteB[i] - b;
+			distances[i] = dr * dr + dg * dg + db * db;
+		}
+	}
+
+	for (i = 1, best = 0; i < s_paletteSize; ++i)
+	{
+		if (distances[i] < distances[best])
+		{
+			best = i;
+		}
+	}
+
+	s_nearest[color] = (u_short)best;
+	return best;
+}
+
+/* Forgets the searched entries, after the palette changed. */
+static void ClearNearest()
+{
+	int i;
+
+	for (i = s_paletteSize; i % SEARCH_BLOCK != 0; ++i)
+	{
+		s_paletteR[i] = s_paletteG[i] = s_paletteB[i] = FAR_CHANNEL;
+	}
+
+	memset(s_nearest, 0xff, sizeof(s_nearest));
+}
+
+/* Moves every palette entry to the mean of the colors nearest to it until nothing changes. */
+static void Refine()
+{
+	double sum[256][3], weight[256];
+	int round, i, index, changed, r, g, b;
+
+	for (round = 0; round < REFINE_ROUNDS; ++round)
+	{
+		memset(sum, 0, sizeof(sum));
+		memset(weight, 0, sizeof(weight));
+		ClearNearest();
+
+		for (i = 0; i < s_histogramSize; ++i)
+		{
+			index = FindNearest(s_histogram[i].color);
+			sum[index][0] += (double)GetR(s_histogram[i].color) * s_histogram[i].count;
+			sum[index][1] += (double)GetG(s_histogram[i].color) * s_histogram[i].count;
+			sum[index][2] += (double)GetB(s_histogram[i].color) * s_histogram[i].count;
+			weight[index] += s_histogram[i].count;
+		}
+
+		changed = 0;
+		for (i = 0; i < s_paletteSize; ++i)
+		{
+			if (weight[i] == 0)
+			{
+				continue;
+			}
+
+			r = (int)(sum[i][0] / weight[i] + 0.5);
+			g = (int)(sum[i][1] / weight[i] + 0.5);
+			b = (int)(sum[i][2] / weight[i] + 0.5);
+			changed |= r != s_paletteR[i] || g != s_paletteG[i] || b != s_paletteB[i];
+			s_paletteR[i] = r;
+			s_paletteG[i] = g;
+			s_paletteB[i] = b;
+		}
+
+		if (!changed)
+		{
+			break;
+		}
+	}
+
+	ClearNearest();
+}
+
+/* Chooses the palette for the histogram, at most count entries. */
+static void BuildPalette(int count)
+{
+	static Box boxes[256];
+	double sum[3], weight;
+	int boxCount, i, j;
+
+	if (s_histogramSize <= count)
+	{
+		for (i = 0; i < s_histogramSize; ++i)
+		{
+			s_paletteR[i] = GetR(s_histogram[i].color);
+			s_paletteG[i] = GetG(s_histogram[i].color);
+			s_paletteB[i] = GetB(s_histogram[i].color);
+		}
+
+		s_paletteSize = s_histogramSize;
+		ClearNearest();
+		return;
+	}
+
+	boxCount = MedianCut(boxes, count);
+	for (i = 0; i < boxCount; ++i)
+	{
+		sum[0] = sum[1] = sum[2] = weight = 0;
+		for (j = boxes[i].start; j < boxes[i].start + boxes[i].count; ++j)
+		{
+			sum[0] += (double)GetR(s_histogram[j].color) * s_histogram[j].count;
+			sum[1] += (double)GetG(s_histogram[j].color) * s_histogram[j].count;
+			sum[2] += (double)GetB(s_histogram[j].color) * s_histogram[j].count;
+			weight += s_histogram[j].count;
+		}
+
+		s_paletteR[i] = (int)(sum[0] / weight + 0.5);
+		s_paletteG[i] = (int)(sum[1] / weight + 0.5);
+		s_paletteB[i] = (int)(sum[2] / weight + 0.5);
+	}
+
+	s_paletteSize = boxCount;
+	Refine();
+}
+
+/* Maps every pixel to its nearest palette entry, spreading the error over the neighbours if dither is set. */
+static void MapPixels(Image* image, Quantized* quantized, int first, int dither)
+{
+	/* Errors of the current and the next row, 16 times the 8 bit channel */
+	int* errors = (int*)calloc((image->width + 2) * 6, sizeof(int));
+	int* current;
+	int* next;
+	int* swap;
+	int x, y, i, step, channel, value[3], error, entry, color;
+	long pixel;
+
+	current = errors;
+	next = errors + (image->width + 2) * 3;
+
+	for (y = 0; y < image->height; ++y)
+	{
+		memset(next, 0, (image->width + 2) * 3 * sizeof(int));
+
+		/* Every other row goes right to left, so the error does not drift to one side */
+		step = (y & 1) ? -1 : 1;
+
+		for (i = 0; i < image->width; ++i)
+		{
+			x = step > 0 ? i : image->width - 1 - i;
+			pixel = (long)y * image->width + x;
+
+			if (image->kind[pixel] == PIXEL_TRANSPARENT)
+			{
+				quantized->indices[pixel] = 0;
+				continue;
+			}
+
+			if (!dither)
+			{
+				quantized->indices[pixel] = (u_char)(first + FindNearest(GetPixelColor(image, pixel)));
+				continue;
+			}
+
+			for (channel = 0; channel < 3; ++channel)
+			{
+				value[channel] = image->rgb[pixel * 3 + channel] * 16 + current[(x + 1) * 3 + channel];
+				value[channel] = value[channel] < 0 ? 0 : value[channel] > 255 * 16 ? 255 * 16 : value[channel];
+			}
+
+			color = MakeColor(ToFive((value[0] + 8) / 16), ToFive((value[1] + 8) / 16), ToFive((value[2] + 8) / 16));
+			entry = FindNearest(color);
+			quantized->indices[pixel] = (u_char)(first + entry);
+
+			/* Floyd-Steinberg weights: 7 ahead, 3 behind below, 5 below, 1 ahead below */
+			for (channel = 0; channel < 3; ++channel)
+			{
+				error = value[channel] - 16 * ToEight(channel == 0 ? s_paletteR[entry] : channel == 1 ? s_paletteG[entry] : s_paletteB[entry]);
+				current[(x + 1 + step) * 3 + channel] += error * 7 / 16;
+				next[(x + 1 - step) * 3 + channel] += error * 3 / 16;
+				next[(x + 1) * 3 + channel] += error * 5 / 16;
+				next[(x + 1 + step) * 3 + channel] += error / 16;
+			}
+		}
+
+		swap = current;
+		current = next;
+		next = swap;
+	}
+
+	free(errors);
+}
+
+/* Sums the squared error of the opaque pixels against the source. */
+static void MeasureError(Image* image, Quantized* quantized)
+{
+	long pixel, pixels = (long)image->width * image->height;
+	u_short color;
+	int channel, difference;
+
+	quantized->error = 0;
+	quantized->samples = 0;
+
+	for (pixel = 0; pixel < pixels; ++pixel)
+	{
+		if (image->kind[pixel] == PIXEL_TRANSPARENT)
+		{
+			continue;
+		}
+
+		color = quantized->clut[quantized->indices[pixel]];
+		for (channel = 0; channel < 3; ++channel)
+		{
+			difference = image->rgb[pixel * 3 + channel] - ToEight(GetChannel(color, channel));
+			quantized->error += difference * difference;
+		}
+		quantized->samples += 3;
+	}
+}
+
+/* Returns the PSNR in dB, or a negative value if there is no error at all. */
+static double GetPsnr(Quantized* quantized)
+{
+	if (quantized->error == 0 || quantized->samples == 0)
+	{
+		return -1;
+	}
+
+	return 10.0 * log10(255.0 * 255.0 * quantized->samples / quantized->error);
+}
+
+static void PrintPsnr(char* buffer, int size, Quantized* quantized)
+{
+	if (GetPsnr(quantized) < 0)
+	{
+		snprintf(buffer, size, "lossless");
+	}
+	else
+	{
+		snprintf(buffer, size, "PSNR %.1f dB", GetPsnr(quantized));
+	}
+}
+
+/* Quantizes the image to a CLUT of the given depth. Returns 0 if out of memory. */
+static int Quantize(Image* image, int bits, int dither, Quantized* quantized)
+{
+	long pixel, pixels = (long)image->width * image->height;
+	u_long stp[256], total[256];
+	int transparent, first, i, index;
+
+	quantized->bits = bits;
+	quantized->indices = (u_char*)malloc(pixels);
+	if (quantized->indices == 0)
+	{
+		return 0;
+	}
+
+	/* Transparency takes CLUT entry 0 */
+	transparent = BuildHistogram(image);
+	first = transparent ? 1 : 0;
+	BuildPalette((1 << bits) - first);
+
+	MapPixels(image, quantized, first, dither);
+
+	/* An entry gets the STP bit if most of its pixels had it */
+	memset(stp, 0, sizeof(stp));
+	memset(total, 0, sizeof(total));
+	for (pixel = 0; pixel < pixels; ++pixel)
+	{
+		index = quantized->indices[pixel];
+		stp[index] += image->kind[pixel] == PIXEL_STP;
+		total[index] += image->kind[pixel] != PIXEL_TRANSPARENT;
+	}
+
+	quantized->colors = first + s_paletteSize;
+	quantized->clut[0] = 0;
+	for (i = 0; i < s_paletteSize; ++i)
+	{
+		index = first + i;
+		quantized->clut[index] = (u_short)MakeColor(s_paletteR[i], s_paletteG[i], s_paletteB[i]);
+		if (stp[index] * 2 > total[index] || quantized->clut[index] == 0)
+		{
+			quantized->clut[index] |= 0x8000;
+		}
+	}
+
+	MeasureError(image, quantized);
+	return 1;
+}
+
+/******************************************************/
+/* Commands */
+
+/* Parses "x,y". */
+static int ParsePosition(char* text, int* x, int* y)
+{
+	return sscanf(text, "%d,%d", x, y) == 2 && *x >= 0 && *x < 1024 && *y >= 0 && *y < 512;
+}
+
+static int Convert(char* input, char* output, int bits, double quality, int dither, int px, int py, int cx, int cy)
+{
+	Image image;
+	Quantized quantized;
+	char psnr[32];
+	double start = Seconds();
+	int ok;
+
+	if (!ReadImage(input, &image))
+	{
+		return 0;
+	}
+
+	if (px >= 0)
+	{
+		image.px = px;
+		image.py = py;
+	}
+	if (cx >= 0)
+	{
+		image.cx = cx;
+		image.cy = cy;
+	}
+
+	if (image.px < 0 || image.cx < 0)
+	{
+		fprintf(stderr, "%s: no VRAM position for the image or CLUT, give it with -p and -c\n", input);
+		FreeImage(&image);
+		return 0;
+	}
+
+	/* 4 bits if they are good enough */
+	quantized.indices = 0;
+	if (bits == 0)
+	{
+		if (!Quantize(&image, 4, dither, &quantized))
+		{
+			FreeImage(&image);
+			return 0;
+		}
+
+		if (GetPsnr(&quantized) >= 0 && GetPsnr(&quantized) < quality)
+		{
+			free(quantized.indices);
+			quantized.indices = 0;
+		}
+		bits = 8;
+	}
+
+	if (quantized.indices == 0 && !Quantize(&image, bits, dither, &quantized))
+	{
+		FreeImage(&image);
+		return 0;
+	}
+
+	if (image.width % (quantized.bits == 4 ? 4 : 2) != 0)
+	{
+		fprintf(stderr, "%s: width %d padded to whole 16 bit words\n", input, image.width);
+	}
+
+	ok = WriteTim(output, &image, &quantized);
+	if (!ok)
+	{
+		fprintf(stderr, "%s: can't write\n", output);
+	}
+	else
+	{
+		PrintPsnr(psnr, sizeof(psnr), &quantized);
+		printf("%s: %dx%d %d bit -> %d bit, %d colors, %s, %ld -> %ld bytes, %.0f ms\n", input, image.width, image.height,
+			image.bits, quantized.bits, quantized.colors, psnr, image.fileSize, GetTimSize(&image, &quantized), (Seconds() - start) * 1000);
+	}
+
+	free(quantized.indices);
+	FreeImage(&image);
+	return ok;
+}
+
+/* Prints what every depth, with and without dither, would give for the files. */
+static int Report(int count, char** files)
+{
+	Image image;
+	Quantized plain, dithered;
+	char psnr[2][32];
+	double start;
+	int i, bits, ok = 1;
+
+	for (i = 0; i < count; ++i)
+	{
+		start = Seconds();
+		if (!ReadImage(files[i], &image))
+		{
+			ok = 0;
+			continue;
+		}
+
+		BuildHistogram(&image);
+		printf("%s: %dx%d %d bit, %d colors, %ld bytes\n", files[i], image.width, image.height, image.bits,
+			s_histogramSize, image.fileSize);
+
+		for (bits = 4; bits <= 8; bits += 4)
+		{
+			if (!Quantize(&image, bits, 0, &plain) || !Quantize(&image, bits, 1, &dithered))
+			{
+				FreeImage(&image);
+				return 0;
+			}
+
+			PrintPsnr(psnr[0], sizeof(psnr[0]), &plain);
+			PrintPsnr(psnr[1], sizeof(psnr[1]), &dithered);
+			printf("  %d bit  %6ld bytes  %-16s dithered %s\n", bits, GetTimSize(&image, &plain), psnr[0], psnr[1]);
+
+			free(plain.indices);
+			free(dithered.indices);
+		}
+
+		printf("  %.0f ms\n", (Seconds() - start) * 1000);
+		FreeImage(&image);
+	}
+
+	return ok;
+}
+
+/******************************************************/
+/* Test and bench */
+
+/* Fills an image with smooth gradients and a little noise, the hard case for a small palette. */
+static void MakeGradient(Image* image, int width, int height)
+{
+	long pixel;
+	int x, y;
+
+	AllocImage(image, width, height);
+	srand(1);
+
+	for (y = 0; y < height; ++y)
+	{
+		for (x = 0; x < width; ++x)
+		{
+			pixel = (long)y * width + x;
+			image->rgb[pixel * 3 + 0] = (u_char)(x * 255 / (width - 1));
+			image->rgb[pixel * 3 + 1] = (u_char)(y * 255 / (height - 1));
+			image->rgb[pixel * 3 + 2] = (u_char)((x + y) * 127 / (width + height) + rand() % 8);
+			image->kind[pixel] = PIXEL_OPAQUE;
+		}
+	}
+
+	image->px = 320;
+	image->py = 0;
+	image->cx = 0;
+	image->cy = 480;
+	image->bits = 24;
+	image->fileSize = 0;
+}
+
+static int TestFewColors()
+{
+	static const u_short colors[12] = { 0x8000, 0x001f, 0x03e0, 0x7c00, 0x7fff, 0x1234, 0x4321, 0x0421,
+		0x2108, 0x5294, 0x8842, 0x7bde };
+	char* filename = "/tmp/timquant_test.tim";
+	Image image, reread;
+	Quantized quantized;
+	long pixel;
+	int failures = 0;
+
+	/* Transparent border around a pattern of 12 colors, opaque black among them */
+	AllocImage(&image, 30, 20);
+	for (pixel = 0; pixel < 30 * 20; ++pixel)
+	{
+		SetPixel16(&image, pixel, (pixel % 30 == 0 || pixel < 30) ? 0 : colors[pixel % 12]);
+	}
+	image.px = 320;
+	image.py = 0;
+	image.cx = 0;
+	image.cy = 480;
+
+	if (!Quantize(&image, 4, 0, &quantized) || GetPsnr(&quantized) >= 0 || quantized.colors != 13 || quantized.clut[0] != 0)
+	{
+		printf("FAIL few colors: not converted without loss\n");
+		failures++;
+	}
+
+	/* Width 30 is padded to 32 pixels */
+	if (!WriteTim(filename, &image, &quantized) || !ReadTim(filename, &reread) || reread.width != 32 ||
+		reread.px != 320 || reread.cy != 480)
+	{
+		printf("FAIL few colors: TIM not written\n");
+		failures++;
+	}
+	else
+	{
+		for (pixel = 0; pixel < 30 * 20; ++pixel)
+		{
+			if (reread.kind[pixel % 30 + pixel / 30 * 32] != image.kind[pixel] ||
+				memcmp(reread.rgb + (pixel % 30 + pixel / 30 * 32) * 3, image.rgb + pixel * 3, 3) != 0)
+			{
+				printf("FAIL few colors: pixel %ld changed\n", pixel);
+				failures++;
+				break;
+			}
+		}
+		FreeImage(&reread);
+	}
+
+	free(quantized.indices);
+	FreeImage(&image);
+	remove(filename);
+
+	if (failures == 0)
+	{
+		printf("ok   few colors\n");
+	}
+
+	return failures;
+}
+
+static int TestGradient()
+{
+	Image image;
+	Quantized four, eight, dithered;
+	double sourceMean = 0, plainMean = 0, ditheredMean = 0, plainDrift = 0, ditheredDrift = 0;
+	long pixel;
+	int failures = 0, x, y;
+
+	MakeGradient(&image, 128, 64);
+
+	if (!Quantize(&image, 4, 0, &four) || !Quantize(&image, 8, 0, &eight) || !Quantize(&image, 4, 1, &dithered))
+	{
+		printf("FAIL gradient: out of memory\n");
+		return 1;
+	}
+
+	if (GetPsnr(&four) < 22 || GetPsnr(&eight) < 32 || GetPsnr(&eight) <= GetPsnr(&four))
+	{
+		printf("FAIL gradient: PSNR %.1f dB at 4 bits, %.1f dB at 8 bits\n", GetPsnr(&four), GetPsnr(&eight));
+		failures++;
+	}
+
+	/* Dithering keeps the average color of every column closer to the source */
+	for (x = 0; x < image.width; ++x)
+	{
+		sourceMean = plainMean = ditheredMean = 0;
+		for (y = 0; y < image.height; ++y)
+		{
+			pixel = (long)y * image.width + x;
+			sourceMean += image.rgb[pixel * 3];
+			plainMean += ToEight(GetR(four.clut[four.indices[pixel]]));
+			ditheredMean += ToEight(GetR(dithered.clut[dithered.indices[pixel]]));
+		}
+
+		plainDrift += fabs(plainMean - sourceMean) / image.height;
+		ditheredDrift += fabs(ditheredMean - sourceMean) / image.height;
+	}
+
+	if (ditheredDrift >= plainDrift)
+	{
+		printf("FAIL gradient: dithered columns are %.2f off on average, without dither %.2f\n",
+			ditheredDrift / image.width, plainDrift / image.width);
+		failures++;
+	}
+
+	free(four.indices);
+	free(eight.indices);
+	free(dithered.indices);
+	FreeImage(&image);
+
+	if (failures == 0)
+	{
+		printf("ok   gradient\n");
+	}
+
+	return failures;
+}
+
+static int TestPng()
+{
+	char* filename = "/tmp/timquant_test.png";
+	Image image, reread;
+	int failures = 0;
+
+	MakeGradient(&image, 61, 33);
+
+	if (!WritePng(filename, image.width, image.height, image.rgb) || !ReadImage(filename, &reread))
+	{
+		printf("FAIL png: not read back\n");
+		failures++;
+	}
+	else
+	{
+		if (reread.width != image.width || reread.height != image.height ||
+			memcmp(reread.rgb, image.rgb, (long)image.width * image.height * 3) != 0)
+		{
+			printf("FAIL png: pixels changed\n");
+			failures++;
+		}
+		FreeImage(&reread);
+	}
+
+	FreeImage(&image);
+	remove(filename);
+
+	if (failures == 0)
+	{
+		printf("ok   png\n");
+	}
+
+	return failures;
+}
+
+static int Test()
+{
+	int failures = TestFewColors() + TestGradient() + TestPng();
+
+	printf("%s: %d failures\n", failures == 0 ? "PASS" : "FAIL", failures);
+	return failures == 0;
+}
+
+static int Bench()
+{
+	Image image;
+	Quantized quantized;
+	double start, seconds;
+	int bits, dither, i, rounds = 4;
+
+	MakeGradient(&image, 256, 256);
+
+	for (bits = 4; bits <= 8; bits += 4)
+	{
+		for (dither = 0; dither <= 1; ++dither)
+		{
+			start = Seconds();
+			for (i = 0; i < rounds; ++i)
+			{
+				Quantize(&image, bits, dither, &quantized);
+				free(quantized.indices);
+			}
+			seconds = (Seconds() - start) / rounds;
+
+			printf("%d bit%s: %.1f ms per 256x256 image, %.1f Mpixels/s\n", bits, dither ? " dithered" : "",
+				seconds * 1000, 256.0 * 256.0 / seconds / 1e6);
+		}
+	}
+
+	FreeImage(&image);
+	return 1;
+}
+
+static void Usage()
+{
+	fprintf(stderr,
+		"usage: timquant [-b 4|8] [-q dB] [-d] [-p x,y] [-c x,y] -o out.tim in.tim|in.png\n"
+		"       timquant report file...\n"
+		"       timquant test\n"
+		"       timquant bench\n"
+		"  -b  bits per pixel, without it 4 if they reach the quality of -q, otherwise 8\n"
+		"  -q  PSNR in dB 4 bits have to reach (default %.0f)\n"
+		"  -d  dither\n"
+		"  -p  VRAM position of the image, in 16 bit words\n"
+		"  -c  VRAM position of the CLUT\n", DEFAULT_QUALITY);
+	exit(2);
+}
+
+int main(int argc, char** argv)
+{
+	char* output = 0;
+	double quality = DEFAULT_QUALITY;
+	int bits = 0, dither = 0, px = -1, py = -1, cx = -1, cy = -1;
+	int i;
+
+	if (argc < 2)
+	{
+		Usage();
+	}
+
+	if (strcmp(argv[1], "report") == 0 && argc >= 3)
+	{
+		return Report(argc - 2, argv + 2) ? 0 : 1;
+	}
+
+	if (strcmp(argv[1], "test") == 0)
+	{
+		return Test() ? 0 : 1;
+	}
+
+	if (strcmp(argv[1], "bench") == 0)
+	{
+		return Bench() ? 0 : 1;
+	}
+
+	for (i = 1; i < argc - 1; ++i)
+	{
+		if (i + 1 < argc - 1 && strcmp(argv[i], "-b") == 0) bits = atoi(argv[++i]);
+		else if (i + 1 < argc - 1 && strcmp(argv[i], "-q") == 0) quality = atof(argv[++i]);
+		else if (strcmp(argv[i], "-d") == 0) dither = 1;
+		else if (i + 1 < argc - 1 && strcmp(argv[i], "-p") == 0 && ParsePosition(argv[i + 1], &px, &py)) ++i;
+		else if (i + 1 < argc - 1 && strcmp(argv[i], "-c") == 0 && ParsePosition(argv[i + 1], &cx, &cy)) ++i;
+		else if (i + 1 < argc - 1 && strcmp(argv[i], "-o") == 0) output = argv[++i];
+		else Usage();
+	}
+
+	if (output == 0 || (bits != 0 && bits != 4 && bits != 8))
+	{
+		Usage();
+	}
+
+	return Convert(argv[argc - 1], output, bits, quality, dither, px, py, cx, cy) ? 0 : 1;
+}
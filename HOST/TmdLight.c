@@ -0,0 +1,562 @@
+/*
+ * Bakes the light of a scene into a TMD model. Every lit polygon is replaced by an unlit
+ * one whose colors are the result of the light calculation, so the game draws the models
+ * without any light source setup and the GTE skips the lighting of every vertex.
+ *
+ * The light calculation is the one of the GTE (NormalColorCol of the host libgte), so
+ * a face gets exactly the color it got when the game lit it at runtime. Vertex normals
+ * are smoothed over faces whose normals are closer than the crease angle; faces with
+ * different colors at their corners become gouraud shaded, the others stay flat.
+ *
+ * The light description is a text file, one setting per line:
+ *
+ *   # Ambient light like GsSetAmbient, 0 - 4096 per channel
+ *   ambient 1024 2048 1365
+ *   # Up to three directional lights like GsF_LIGHT: direction, then 0 - 255 per channel
+ *   light   0 1 3   255 255 255
+ *   # Normals of neighbouring faces are averaged below this angle, in degrees
+ *   crease  35
+ *
+ * Usage: tmdlight -l light.txt -o output.tmd input.tmd
+ */
+
+#include <sys/types.h>
+#include <libgte.h>
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Maximum size of a TMD file the tool accepts. */
+#define MAX_TMD_SIZE (1024 * 1024)
+/* Maximum number of objects, vertices and polygons of a model. */
+#define MAX_OBJECTS		16
+#define MAX_VERTICES	4096
+#define MAX_FACES		4096
+
+/* TMD header ID, primitive flags and mode bits */
+#define TMD_ID			0x41
+#define TMD_FLAG_UNLIT	0x01
+#define TMD_FLAG_GRADE	0x04
+#define TMD_MODE_POLY	0x20
+#define TMD_MODE_GOURAUD 0x10
+#define TMD_MODE_QUAD	0x08
+#define TMD_MODE_TEXTURE 0x04
+#define TMD_MODE_RAW	0x01
+
+typedef struct
+{
+	/* Primitive header of the source, kept for the flags and modes which aren't changed. */
+	u_char flag, mode;
+	u_char quad, textured;
+	/* U V CBA, U V TSB, U V, (U V) words of textured polygons */
+	u_long uv[4];
+	/* Material color and normal of every corner, the normal already smoothed */
+	CVECTOR color[4];
+	SVECTOR normal[4];
+	u_short vertex[4];
+	/* Source primitive words, for polygons which are copied unchanged */
+	u_long* source;
+	int lit;
+} Face;
+
+typedef struct
+{
+	SVECTOR* vertices;
+	int vertexCount;
+	long scale;
+	Face* faces;
+	int faceCount;
+} Object;
+
+static u_char s_input[MAX_TMD_SIZE];
+static u_long s_output[MAX_TMD_SIZE / 4];
+
+static Object s_objects[MAX_OBJECTS];
+static int s_objectCount = 0;
+
+/* Light description */
+static long s_ambient[3] = { ONE / 4, ONE / 2, ONE / 3 };
+static long s_lights[3][6];
+static int s_lightCount = 0;
+static double s_crease = 35.0;
+
+static u_long ReadLong(u_char* p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((u_long)p[3] << 24);
+}
+
+static int ReadLight(char* filename)
+{
+	FILE* file;
+	char line[256];
+	long* l;
+	int number = 0;
+
+	file = fopen(filename, "r");
+	if (file == 0)
+	{
+		fprintf(stderr, "%s: can't open\n", filename);
+		return 0;
+	}
+
+	while (fgets(line, sizeof(line), file) != 0)
+	{
+		number++;
+
+		if (line[strspn(line, " \t\r\n")] == '#' || line[strspn(line, " \t\r\n")] == 0)
+		{
+			continue;
+		}
+
+		if (sscanf(line, " ambient %ld %ld %ld", &s_ambient[0], &s_ambient[1], &s_ambient[2]) == 3)
+		{
+			continue;
+		}
+
+		if (sscanf(line, " crease %lf", &s_crease) == 1)
+		{
+			continue;
+		}
+
+		if (s_lightCount < 3)
+		{
+			l = s_lights[s_lightCount];
+			if (sscanf(line, " light %ld %ld %ld %ld %ld %ld", &l[0], &l[1], &l[2], &l[3], &l[4], &l[5]) == 6)
+			{
+				s_lightCount++;
+				continue;
+			}
+		}
+
+		fprintf(stderr, "%s:%d: can't read \"%s\"\n", filename, number, strtok(line, "\r\n"));
+		fclose(file);
+		return 0;
+	}
+
+	fclose(file);
+	return 1;
+}
+
+/* Sets up the GTE like GsSetAmbient and GsSetFlatLight with an unrotated object. */
+static void SetupLight()
+{
+	MATRIX directions, colors;
+	VECTOR direction;
+	SVECTOR normal;
+	int i;
+
+	memset(&directions, 0, sizeof(directions));
+	memset(&colors, 0, sizeof(colors));
+
+	for (i = 0; i < s_lightCount; ++i)
+	{
+		setVector(&direction, -s_lights[i][0], -s_lights[i][1], -s_lights[i][2]);
+		VectorNormalS(&direction, &normal);
+		directions.m[i][0] = normal.vx;
+		directions.m[i][1] = normal.vy;
+		directions.m[i][2] = normal.vz;
+
+		colors.m[0][i] = (short)(s_lights[i][3] * ONE / 255);
+		colors.m[1][i] = (short)(s_lights[i][4] * ONE / 255);
+		colors.m[2][i] = (short)(s_lights[i][5] * ONE / 255);
+	}
+
+	SetLightMatrix(&directions);
+	SetColorMatrix(&colors);
+	SetBackColor(s_ambient[0] >> 4, s_ambient[1] >> 4, s_ambient[2] >> 4);
+}
+
+/* Reads the polygons of one object. Lines and sprites are not supported. */
+static int ReadObject(char* filename, u_char* table, u_char* object, Object* o)
+{
+	SVECTOR* normals;
+	u_char* primitive;
+	u_char* data;
+	u_short* indices;
+	Face* face;
+	long primitiveCount, normalCount;
+	int i, j, n, colors;
+
+	o->vertices = (SVECTOR*)(table + ReadLong(object));
+	o->vertexCount = (int)ReadLong(object + 4);
+	normals = (SVECTOR*)(table + ReadLong(object + 8));
+	normalCount = (long)ReadLong(object + 12);
+	primitive = table + ReadLong(object + 16);
+	primitiveCount = (long)ReadLong(object + 20);
+	o->scale = (long)ReadLong(object + 24);
+
+	if (o->vertexCount > MAX_VERTICES || primitiveCount > MAX_FACES)
+	{
+		fprintf(stderr, "%s: object too large\n", filename);
+		return 0;
+	}
+
+	o->faces = (Face*)calloc(primitiveCount, sizeof(Face));
+	o->faceCount = 0;
+
+	for (i = 0; i < primitiveCount; ++i, primitive += 4 + primitive[1] * 4)
+	{
+		face = &o->faces[o->faceCount++];
+		face->flag = primitive[2];
+		face->mode = primitive[3];
+		face->source = (u_long*)primitive;
+
+		if ((face->mode & 0xe0) != TMD_MODE_POLY)
+		{
+			fprintf(stderr, "%s: primitive %d isn't a polygon\n", filename, i);
+			return 0;
+		}
+
+		face->quad = (face->mode & TMD_MODE_QUAD) != 0;
+		face->textured = (face->mode & TMD_MODE_TEXTURE) != 0;
+		face->lit = (face->flag & TMD_FLAG_UNLIT) == 0;
+		if (!face->lit)
+		{
+			continue;
+		}
+
+		n = face->quad ? 4 : 3;
+		data = primitive + 4;
+
+		if (face->textured)
+		{
+			for (j = 0; j < n; ++j, data += 4)
+			{
+				face->uv[j] = ReadLong(data);
+			}
+		}
+
+		/* Lit textured polygons have no color, lit polygons only one unless gradated */
+		colors = face->textured ? 0 : ((face->flag & TMD_FLAG_GRADE) ? n : 1);
+		for (j = 0; j < n; ++j)
+		{
+			if (j < colors)
+			{
+				face->color[j].r = data[0];
+				face->color[j].g = data[1];
+				face->color[j].b = data[2];
+				data += 4;
+			}
+			else if (colors > 0)
+			{
+				face->color[j] = face->color[0];
+			}
+			else
+			{
+				/* Like GsSortObject4, textured polygons are lit from a neutral base color */
+				face->color[j].r = face->color[j].g = face->color[j].b = 128;
+			}
+		}
+
+		/* Norm0 Vert0 Norm1 Vert1 ... for gouraud, Norm0 Vert0 Vert1 ... for flat */
+		indices = (u_short*)data;
+		for (j = 0; j < n; ++j)
+		{
+			if (face->mode & TMD_MODE_GOURAUD)
+			{
+				face->normal[j] = normals[indices[j * 2] < normalCount ? indices[j * 2] : 0];
+				face->vertex[j] = indices[j * 2 + 1];
+			}
+			else
+			{
+				face->normal[j] = normals[indices[0] < normalCount ? indices[0] : 0];
+				face->vertex[j] = indices[j + 1];
+			}
+
+			if (face->vertex[j] >= o->vertexCount)
+			{
+				fprintf(stderr, "%s: primitive %d uses vertex %d of %d\n", filename, i, face->vertex[j], o->vertexCount);
+				return 0;
+			}
+		}
+	}
+
+	return 1;
+}
+
+static int ReadTmd(char* filename)
+{
+	FILE* file;
+	long size;
+	int i;
+
+	file = fopen(filename, "rb");
+	if (file == 0)
+	{
+		fprintf(stderr, "%s: can't open\n", filename);
+		return 0;
+	}
+
+	size = (long)fread(s_input, 1, sizeof(s_input), file);
+	fclose(file);
+
+	if (size < 12 || ReadLong(s_input) != TMD_ID || (ReadLong(s_input + 4) & 1))
+	{
+		fprintf(stderr, "%s: not a TMD file with relative addresses\n", filename);
+		return 0;
+	}
+
+	s_objectCount = (int)ReadLong(s_input + 8);
+	if (s_objectCount > MAX_OBJECTS || 12 + s_objectCount * 28 > size)
+	{
+		fprintf(stderr, "%s: too many objects\n", filename);
+		return 0;
+	}
+
+	for (i = 0; i < s_objectCount; ++i)
+	{
+		if (!ReadObject(filename, s_input + 12, s_input + 12 + i * 28, &s_objects[i]))
+		{
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+/*
+ * Replaces the normals of flat polygons with vertex normals, averaged over the faces
+ * around the same position whose normal is within the crease angle.
+ */
+static void SmoothNormals(Object* o)
+{
+	double limit = cos(s_crease * 3.14159265358979323846 / 180.0) * ONE * ONE;
+	SVECTOR* faceNormals;
+	SVECTOR* p;
+	SVECTOR* q;
+	VECTOR sum;
+	Face* face;
+	Face* other;
+	int i, j, k, l, bent;
+
+	/* The smoothed normals must not see each other, so the face normals are kept apart */
+	faceNormals = (SVECTOR*)malloc(o->faceCount * sizeof(SVECTOR));
+	for (i = 0; i < o->faceCount; ++i)
+	{
+		faceNormals[i] = o->faces[i].normal[0];
+	}
+
+	for (i = 0; i < o->faceCount; ++i)
+	{
+		face = &o->faces[i];
+		if (!face->lit || (face->mode & TMD_MODE_GOURAUD))
+		{
+			continue;
+		}
+
+		for (j = 0; j < (face->quad ? 4 : 3); ++j)
+		{
+			p = &o->vertices[face->vertex[j]];
+			setVector(&sum, 0, 0, 0);
+			bent = 0;
+
+			for (k = 0; k < o->faceCount; ++k)
+			{
+				other = &o->faces[k];
+				if (!other->lit || (other->mode & TMD_MODE_GOURAUD) ||
+					(double)faceNormals[i].vx * faceNormals[k].vx + (double)faceNormals[i].vy * faceNormals[k].vy +
+					(double)faceNormals[i].vz * faceNormals[k].vz < limit)
+				{
+					continue;
+				}
+
+				/* Models may repeat vertices, so corners are found by position */
+				for (l = 0; l < (other->quad ? 4 : 3); ++l)
+				{
+					q = &o->vertices[other->vertex[l]];
+					if (q->vx == p->vx && q->vy == p->vy && q->vz == p->vz)
+					{
+						addVector(&sum, &faceNormals[k]);
+						bent |= faceNormals[k].vx != faceNormals[i].vx || faceNormals[k].vy != faceNormals[i].vy ||
+							faceNormals[k].vz != faceNormals[i].vz;
+						break;
+					}
+				}
+			}
+
+			/* Corners in a flat area keep the face normal as it is, so they get the runtime light exactly */
+			if (bent)
+			{
+				VectorNormalS(&sum, &face->normal[j]);
+			}
+		}
+	}
+
+	free(faceNormals);
+}
+
+/* Appends color words (R G B code/pad) to the output. */
+static u_long* WriteColor(u_long* p, CVECTOR* color, u_char code)
+{
+	*p++ = ((u_long)code << 24) | (color->b << 16) | (color->g << 8) | color->r;
+	return p;
+}
+
+/* Writes one unlit polygon, returns the position after it. */
+static u_long* WriteFace(u_long* p, Face* face, int* gouraudCount)
+{
+	CVECTOR lit[4];
+	u_long* header = p++;
+	u_char mode;
+	int i, n = face->quad ? 4 : 3;
+	int gouraud = 0;
+
+	for (i = 0; i < n; ++i)
+	{
+		NormalColorCol(&face->normal[i], &face->color[i], &lit[i]);
+		if (lit[i].r != lit[0].r || lit[i].g != lit[0].g || lit[i].b != lit[0].b)
+		{
+			gouraud = 1;
+		}
+	}
+
+	*gouraudCount += gouraud;
+
+	/* Textured polygons keep the texture modulated by the color, so the baked light shows */
+	mode = (u_char)(TMD_MODE_POLY | (gouraud ? TMD_MODE_GOURAUD : 0) | (face->mode & (TMD_MODE_QUAD | TMD_MODE_TEXTURE | 0x02)));
+	if (!face->textured)
+	{
+		mode |= TMD_MODE_RAW;
+	}
+
+	if (face->textured)
+	{
+		for (i = 0; i < n; ++i)
+		{
+			*p++ = face->uv[i];
+		}
+	}
+
+	/* Untextured polygons have the mode in their first color, textured ones padding */
+	for (i = 0; i < (gouraud ? n : 1); ++i)
+	{
+		p = WriteColor(p, &lit[i], (u_char)(i == 0 && !face->textured ? mode : 0));
+	}
+
+	/* Vert0 Vert1, Vert2 (Vert3 or pad) */
+	*p++ = ((u_long)face->vertex[1] << 16) | face->vertex[0];
+	*p++ = ((u_long)(face->quad ? face->vertex[3] : 0) << 16) | face->vertex[2];
+
+	/* olen is the size of the GPU packet: color, xy (and uv) per vertex, colors of gouraud polygons */
+	*header = ((u_long)mode << 24) | ((u_long)((face->flag & ~TMD_FLAG_GRADE) | TMD_FLAG_UNLIT) << 16) |
+		((u_long)(p - header - 1) << 8) | (u_long)(1 + n * (face->textured ? 2 : 1) + (gouraud ? n - 1 : 0));
+
+	return p;
+}
+
+static int WriteTmd(char* filename, char* input)
+{
+	FILE* file;
+	u_long* table = s_output + 3;
+	u_long* p;
+	u_long* object;
+	Face* face;
+	long inputSize;
+	int i, j, faces = 0, gouraud = 0;
+
+	s_output[0] = TMD_ID;
+	s_output[1] = 0;
+	s_output[2] = (u_long)s_objectCount;
+
+	/* Object table, then primitives and vertices of every object. Unlit polygons need no normals. */
+	p = table + s_objectCount * 7;
+
+	for (i = 0; i < s_objectCount; ++i)
+	{
+		object = table + i * 7;
+
+		object[4] = (u_long)((p - table) * 4);
+		object[5] = (u_long)s_objects[i].faceCount;
+
+		for (j = 0; j < s_objects[i].faceCount; ++j)
+		{
+			face = &s_objects[i].faces[j];
+			if (face->lit)
+			{
+				p = WriteFace(p, face, &gouraud);
+			}
+			else
+			{
+				memcpy(p, face->source, 4 + ((u_char*)face->source)[1] * 4);
+				p += 1 + ((u_char*)face->source)[1];
+			}
+		}
+
+		faces += s_objects[i].faceCount;
+
+		object[0] = (u_long)((p - table) * 4);
+		object[1] = (u_long)s_objects[i].vertexCount;
+		object[2] = object[0];
+		object[3] = 0;
+		object[6] = (u_long)s_objects[i].scale;
+
+		memcpy(p, s_objects[i].vertices, s_objects[i].vertexCount * sizeof(SVECTOR));
+		p += s_objects[i].vertexCount * 2;
+	}
+
+	file = fopen(filename, "wb");
+	if (file == 0 || fwrite(s_output, 4, p - s_output, file) != (size_t)(p - s_output))
+	{
+		fprintf(stderr, "%s: can't write\n", filename);
+		if (file != 0)
+		{
+			fclose(file);
+		}
+		return 0;
+	}
+
+	fclose(file);
+
+	file = fopen(input, "rb");
+	fseek(file, 0, SEEK_END);
+	inputSize = ftell(file);
+	fclose(file);
+
+	printf("%s: %d polygons, %d gouraud, %ld -> %ld bytes\n", filename, faces, gouraud, inputSize, (long)((p - s_output) * 4));
+	return 1;
+}
+
+static void Usage()
+{
+	fprintf(stderr, "usage: tmdlight -l light.txt -o output.tmd input.tmd\n");
+	exit(2);
+}
+
+int main(int argc, char** argv)
+{
+	char* light = 0;
+	char* output = 0;
+	int option, i;
+
+	while ((option = getopt(argc, argv, "l:o:")) != -1)
+	{
+		switch (option)
+		{
+		case 'l': light = optarg; break;
+		case 'o': output = optarg; break;
+		default: Usage();
+		}
+	}
+
+	if (light == 0 || output == 0 || argc - optind != 1)
+	{
+		Usage();
+	}
+
+	if (!ReadLight(light) || !ReadTmd(argv[optind]))
+	{
+		return 1;
+	}
+
+	SetupLight();
+
+	for (i = 0; i < s_objectCount; ++i)
+	{
+		SmoothNormals(&s_objects[i]);
+	}
+
+	return WriteTmd(output, argv[optind]) ? 0 : 1;
+}
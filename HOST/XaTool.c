@@ -0,0 +1,973 @@
+/*
+ * XA music tool: builds MUSIC.XA, the streamed background music of the game (see
+ * SRC/Music.h), and decodes it again.
+ *
+ * Each track is a 16 bit PCM WAV file, resampled to 37.8 kHz stereo and encoded to 4 bit
+ * XA-ADPCM, one XA channel per track. Shorter tracks loop until the longest one ends, and
+ * the music is made long enough to carry the whole pack at least once. The data sectors
+ * between the audio sectors get the sectors of the pack, laid out like Music.h says. The
+ * pack is either a built pack file (-p) or a pack script (-s), which is packed in memory
+ * like the host renderer does, with file names relative to the root given with -d.
+ *
+ * The output has raw XA sectors of 2336 bytes (subheader and data, no EDC/ECC), the form
+ * BUILDCD takes as XASource.
+ *
+ * Every unit of 28 samples is encoded with the four XA filters and the two ranges around
+ * the one the input needs, the best after decoding wins, like the SPU ADPCM encoder does.
+ *
+ * Usage: xatool build -o MUSIC.XA -p pack.pck|-s pack.txt [-d root] title.wav game.wav
+ *        xatool decode -c channel -o out.wav MUSIC.XA
+ *        xatool test
+ *        xatool bench
+ */
+
+#include <sys/types.h>
+#include <libcd.h>
+
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+
+#include "Music.h"
+#include "PckLib.h"
+
+/* Sample rate and size of an XA sector. */
+#define XA_RATE				37800
+#define XA_SECTOR_SIZE		2336
+#define XA_SUBHEADER_SIZE	8
+#define XA_DATA_SIZE		2048
+
+/* 18 sound groups of 128 bytes: 16 parameter bytes and 28 rows of 4 bytes, 8 units of 28 samples. */
+#define XA_GROUPS			18
+#define XA_GROUP_SIZE		128
+#define XA_UNITS			8
+#define XA_UNIT_SAMPLES		28
+/* Stereo samples of a sector, even units are left, odd ones right. */
+#define XA_SECTOR_SAMPLES	(XA_GROUPS * XA_UNITS / 2 * XA_UNIT_SAMPLES)
+
+/* Submode bits of the subheader. */
+#define XA_SUBMODE_EOR		0x01
+#define XA_SUBMODE_AUDIO	0x04
+#define XA_SUBMODE_DATA		0x08
+#define XA_SUBMODE_FORM2	0x20
+#define XA_SUBMODE_RT		0x40
+#define XA_SUBMODE_EOF		0x80
+
+/* Coding of the audio sectors: stereo, 37.8 kHz, 4 bits. */
+#define XA_CODING_STEREO	0x01
+
+#define XA_FILTERS			4
+#define XA_MAX_RANGE		12
+
+/* Longest track, in seconds. */
+#define MAX_SECONDS			600
+
+/* Largest pack, in sectors. */
+#define MAX_PACK_SECTORS	8192
+
+static const int s_filter0[XA_FILTERS] = { 0, 60, 115, 98 };
+static const int s_filter1[XA_FILTERS] = { 0, 0, -52, -55 };
+
+/* Decoder state of a channel, carried from unit to unit. */
+typedef struct
+{
+	int s1, s2;
+} XaState;
+
+/* A track at 37.8 kHz, interleaved stereo. */
+typedef struct
+{
+	short* samples;
+	long count;
+} Track;
+
+static u_long ReadLong(u_char* p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((u_long)p[3] << 24);
+}
+
+static u_short ReadShort(u_char* p)
+{
+	return (u_short)(p[0] | (p[1] << 8));
+}
+
+static void WriteLong(u_char* p, u_long value)
+{
+	p[0] = (u_char)value;
+	p[1] = (u_char)(value >> 8);
+	p[2] = (u_char)(value >> 16);
+	p[3] = (u_char)(value >> 24);
+}
+
+static void WriteShort(u_char* p, u_short value)
+{
+	p[0] = (u_char)value;
+	p[1] = (u_char)(value >> 8);
+}
+
+static int Clamp16(int value)
+{
+	return value < -32768 ? -32768 : (value > 32767 ? 32767 : value);
+}
+
+/* Reads a whole file into memory. Returns 0 on failure. */
+static u_char* ReadFile(char* filename, long* size)
+{
+	FILE* file;
+	u_char* data;
+
+	file = fopen(filename, "rb");
+	if (file == 0)
+	{
+		fprintf(stderr, "%s: can't open\n", filename);
+		return 0;
+	}
+
+	fseek(file, 0, SEEK_END);
+	*size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+
+	data = (u_char*)malloc(*size > 0 ? *size : 1);
+	if (data == 0 || (long)fread(data, 1, *size, file) != *size)
+	{
+		fprintf(stderr, "%s: read error\n", filename);
+		free(data);
+		fclose(file);
+		return 0;
+	}
+
+	fclose(file);
+	return data;
+}
+
+static int WriteFile(char* filename, u_char* data, long size)
+{
+	FILE* file;
+
+	file = fopen(filename, "wb");
+	if (file == 0)
+	{
+		fprintf(stderr, "%s: can't create\n", filename);
+		return 0;
+	}
+
+	fwrite(data, 1, size, file);
+	if (fclose(file) != 0)
+	{
+		fprintf(stderr, "%s: write error\n", filename);
+		return 0;
+	}
+
+	return 1;
+}
+
+void ErrorMessage(char* format, ...)
+{
+	va_list list;
+
+	va_start(list, format);
+	vfprintf(stderr, format, list);
+	va_end(list);
+	fprintf(stderr, "\n");
+	exit(1);
+}
+
+/******************************************************/
+/* WAV files */
+
+/* Reads a 16 bit PCM WAV file, mono or stereo at any rate, into a 37.8 kHz stereo track. */
+static int ReadWav(char* filename, Track* track)
+{
+	u_char* data;
+	u_char* chunk;
+	u_char* format = 0;
+	u_char* samples = 0;
+	long size, samplesSize = 0, chunkSize, count, rate, i;
+	int channels, c;
+	double position, fraction;
+
+	data = ReadFile(filename, &size);
+	if (data == 0)
+	{
+		return 0;
+	}
+
+	if (size < 12 || memcmp(data, "RIFF", 4) != 0 || memcmp(data + 8, "WAVE", 4) != 0)
+	{
+		fprintf(stderr, "%s: not a WAV file\n", filename);
+		free(data);
+		return 0;
+	}
+
+	for (chunk = data + 12; chunk + 8 <= data + size; chunk += 8 + ((chunkSize + 1) & ~1))
+	{
+		chunkSize = (long)ReadLong(chunk + 4);
+		if (chunkSize > data + size - chunk - 8)
+		{
+			chunkSize = data + size - chunk - 8;
+		}
+
+		if (memcmp(chunk, "fmt ", 4) == 0 && chunkSize >= 16)
+		{
+			format = chunk + 8;
+		}
+		else if (memcmp(chunk, "data", 4) == 0)
+		{
+			samples = chunk + 8;
+			samplesSize = chunkSize;
+		}
+	}
+
+	if (format == 0 || samples == 0)
+	{
+		fprintf(stderr, "%s: no format or data chunk\n", filename);
+		free(data);
+		return 0;
+	}
+
+	channels = ReadShort(format + 2);
+	rate = (long)ReadLong(format + 4);
+	if (ReadShort(format) != 1 || ReadShort(format + 14) != 16 || channels < 1 || channels > 2 || rate <= 0)
+	{
+		fprintf(stderr, "%s: only 16 bit PCM with one or two channels is supported\n", filename);
+		free(data);
+		return 0;
+	}
+
+	count = samplesSize / (2 * channels);
+	track->count = (long)((double)count * XA_RATE / rate);
+	if (count == 0 || track->count > (long)MAX_SECONDS * XA_RATE)
+	{
+		fprintf(stderr, "%s: %s\n", filename, count == 0 ? "no samples" : "too long");
+		free(data);
+		return 0;
+	}
+
+	/* Linear interpolation to 37.8 kHz, mono goes to both sides */
+	track->samples = (short*)malloc(track->count * 2 * sizeof(short));
+	for (i = 0; i < track->count; ++i)
+	{
+		position = (double)i * rate / XA_RATE;
+		fraction = position - floor(position);
+
+		for (c = 0; c < 2; ++c)
+		{
+			long first = (long)position, second = first + 1 < count ? first + 1 : first;
+			int source = channels == 2 ? c : 0;
+			double a = (short)ReadShort(samples + (first * channels + source) * 2);
+			double b = (short)ReadShort(samples + (second * channels + source) * 2);
+
+			track->samples[i * 2 + c] = (short)Clamp16((int)floor(a + (b - a) * fraction + 0.5));
+		}
+	}
+
+	free(data);
+	return 1;
+}
+
+static int WriteWav(char* filename, Track* track)
+{
+	long size = 44 + track->count * 4;
+	u_char* data = (u_char*)malloc(size);
+	long i;
+	int result;
+
+	memcpy(data, "RIFF", 4);
+	WriteLong(data + 4, size - 8);
+	memcpy(data + 8, "WAVEfmt ", 8);
+	WriteLong(data + 16, 16);
+	WriteShort(data + 20, 1);
+	WriteShort(data + 22, 2);
+	WriteLong(data + 24, XA_RATE);
+	WriteLong(data + 28, XA_RATE * 4);
+	WriteShort(data + 32, 4);
+	WriteShort(data + 34, 16);
+	memcpy(data + 36, "data", 4);
+	WriteLong(data + 40, track->count * 4);
+
+	for (i = 0; i < track->count * 2; ++i)
+	{
+		WriteShort(data + 44 + i * 2, (u_short)track->samples[i]);
+	}
+
+	result = WriteFile(filename, data, size);
+	free(data);
+	return result;
+}
+
+/******************************************************/
+/* XA-ADPCM */
+
+/* Decodes a unit of 28 samples, every 4th byte of the sound group from the given nibble on. */
+static void DecodeUnit(const u_char* group, int unit, XaState* state, short* out, int stride)
+{
+	int param = group[4 + unit];
+	int range = param & 0x0f;
+	int filter = (param >> 4) & 0x03;
+	int nibble, sample, i;
+
+	/* The hardware treats invalid ranges like this */
+	if (range > XA_MAX_RANGE)
+	{
+		range = 9;
+	}
+
+	for (i = 0; i < XA_UNIT_SAMPLES; ++i)
+	{
+		nibble = (group[16 + i * 4 + unit / 2] >> ((unit & 1) * 4)) & 0x0f;
+		sample = (int)((short)(nibble << 12)) >> range;
+		sample = Clamp16(sample + ((state->s1 * s_filter0[filter] + state->s2 * s_filter1[filter] + 32) >> 6));
+
+		state->s2 = state->s1;
+		state->s1 = sample;
+		out[i * stride] = (short)sample;
+	}
+}
+
+/* Encodes a unit with the given filter and range into nibbles. Returns the squared error. */
+static double EncodeNibbles(const short* samples, int stride, int filter, int range, XaState* state, u_char* nibbles)
+{
+	int f0 = s_filter0[filter];
+	int f1 = s_filter1[filter];
+	int s1 = state->s1, s2 = state->s2;
+	int predicted, residual, nibble, decoded, sample, i;
+	double error = 0.0;
+
+	for (i = 0; i < XA_UNIT_SAMPLES; ++i)
+	{
+		sample = samples[i * stride];
+		predicted = (s1 * f0 + s2 * f1 + 32) >> 6;
+		residual = sample - predicted;
+
+		/* Quantize to the nearest step, steps are 4096 >> range */
+		nibble = (residual * (1 << range) + (residual >= 0 ? 2048 : -2048)) / 4096;
+		if (nibble > 7) nibble = 7;
+		if (nibble < -8) nibble = -8;
+
+		decoded = Clamp16(((nibble << 12) >> range) + predicted);
+		error += (double)(sample - decoded) * (sample - decoded);
+
+		nibbles[i] = (u_char)(nibble & 0x0f);
+		s2 = s1;
+		s1 = decoded;
+	}
+
+	return error;
+}
+
+/* Returns the largest range whose steps can still reach the largest residual of the filter. */
+static int FindRange(const short* samples, int stride, int filter, XaState* state)
+{
+	int s1 = state->s1, s2 = state->s2;
+	int residual, max = 0, range, i;
+
+	/* Open loop, predicting from the input instead of the decoded samples */
+	for (i = 0; i < XA_UNIT_SAMPLES; ++i)
+	{
+		residual = samples[i * stride] - ((s1 * s_filter0[filter] + s2 * s_filter1[filter] + 32) >> 6);
+		if (residual < 0) residual = -residual;
+		if (residual > max) max = residual;
+
+		s2 = s1;
+		s1 = samples[i * stride];
+	}
+
+	for (range = XA_MAX_RANGE; range > 0; --range)
+	{
+		if (max <= (7 << 12) >> range)
+		{
+			break;
+		}
+	}
+
+	return range;
+}
+
+/* Encodes a unit into the sound group, every stride-th sample from samples on. */
+static void EncodeUnit(const short* samples, int stride, XaState* state, u_char* group, int unit)
+{
+	u_char nibbles[XA_UNIT_SAMPLES], best[XA_UNIT_SAMPLES];
+	short decoded[XA_UNIT_SAMPLES];
+	int filter, range, first, bestFilter = 0, bestRange = 0, i;
+	double error, bestError = -1.0;
+
+	for (filter = 0; filter < XA_FILTERS; ++filter)
+	{
+		/* The range found open loop, and one coarser step in case decoded samples drift off */
+		first = FindRange(samples, stride, filter, state);
+		for (range = first; range >= 0 && range >= first - 1; --range)
+		{
+			error = EncodeNibbles(samples, stride, filter, range, state, nibbles);
+			if (bestError < 0.0 || error < bestError)
+			{
+				bestError = error;
+				bestFilter = filter;
+				bestRange = range;
+				memcpy(best, nibbles, sizeof(best));
+			}
+		}
+	}
+
+	group[4 + unit] = (u_char)((bestFilter << 4) | bestRange);
+	for (i = 0; i < XA_UNIT_SAMPLES; ++i)
+	{
+		group[16 + i * 4 + unit / 2] |= (u_char)(best[i] << ((unit & 1) * 4));
+	}
+
+	/* Advance the state exactly like the decoder does */
+	DecodeUnit(group, unit, state, decoded, 1);
+}
+
+/* Encodes XA_SECTOR_SAMPLES interleaved stereo samples into the data of an audio sector. */
+static void EncodeSector(const short* samples, XaState* states, u_char* data)
+{
+	u_char* group;
+	int g, unit;
+
+	memset(data, 0, XA_GROUPS * XA_GROUP_SIZE);
+
+	for (g = 0; g < XA_GROUPS; ++g, samples += XA_UNITS / 2 * XA_UNIT_SAMPLES * 2)
+	{
+		group = data + g * XA_GROUP_SIZE;
+		for (unit = 0; unit < XA_UNITS; ++unit)
+		{
+			EncodeUnit(samples + unit / 2 * XA_UNIT_SAMPLES * 2 + (unit & 1), 2, &states[unit & 1], group, unit);
+		}
+
+		/* The parameters are there twice, bytes 0 - 3 and 12 - 15 repeat 4 - 11 */
+		memcpy(group, group + 4, 4);
+		memcpy(group + 12, group + 8, 4);
+	}
+}
+
+static void DecodeSector(const u_char* data, XaState* states, short* out)
+{
+	int g, unit;
+
+	for (g = 0; g < XA_GROUPS; ++g, out += XA_UNITS / 2 * XA_UNIT_SAMPLES * 2)
+	{
+		for (unit = 0; unit < XA_UNITS; ++unit)
+		{
+			DecodeUnit(data + g * XA_GROUP_SIZE, unit, &states[unit & 1], out + unit / 2 * XA_UNIT_SAMPLES * 2 + (unit & 1), 2);
+		}
+	}
+}
+
+/******************************************************/
+/* MUSIC.XA */
+
+static void WriteSubheader(u_char* sector, int channel, int submode, int coding)
+{
+	sector[0] = MUSIC_XA_FILE;
+	sector[1] = (u_char)channel;
+	sector[2] = (u_char)submode;
+	sector[3] = (u_char)coding;
+	memcpy(sector + 4, sector, 4);
+}
+
+/* Sectors of the pack by its TOC, the way Music.c counts them. */
+static int PackSectors(u_char* pack, long size)
+{
+	PckTOC* toc = (PckTOC*)pack;
+	int i, end, sectors = 1;
+
+	if (size < (long)sizeof(PckTOC) || memcmp(toc->ID, "PCK", 3) != 0)
+	{
+		return 0;
+	}
+
+	for (i = 0; i < toc->NumFiles; ++i)
+	{
+		end = toc->File[i].Pos + (toc->File[i].Size + XA_DATA_SIZE - 1) / XA_DATA_SIZE;
+		if (end > sectors)
+		{
+			sectors = end;
+		}
+	}
+
+	return (long)sectors * XA_DATA_SIZE <= size ? sectors : 0;
+}
+
+/*
+ * Lays out MUSIC.XA: the audio of the tracks and the pack, see Music.h. The music is made
+ * long enough that every sector of the pack is in it. Returns the image, 0 on failure.
+ */
+static u_char* BuildXa(Track* tracks, u_char* pack, int packSectors, int* sectorCount)
+{
+	XaState states[MUSIC_TRACKS][2];
+	short block[XA_SECTOR_SAMPLES * 2];
+	long longest = 0, first, i;
+	int groups, sectors, sector, track, submode;
+	u_char* xa;
+	u_char* out;
+
+	for (track = 0; track < MUSIC_TRACKS; ++track)
+	{
+		if (tracks[track].count > longest)
+		{
+			longest = tracks[track].count;
+		}
+	}
+
+	groups = (int)((longest + XA_SECTOR_SAMPLES - 1) / XA_SECTOR_SAMPLES);
+	if (groups < (packSectors + MUSIC_DATA_SLOTS - 1) / MUSIC_DATA_SLOTS)
+	{
+		groups = (packSectors + MUSIC_DATA_SLOTS - 1) / MUSIC_DATA_SLOTS;
+	}
+
+	sectors = groups * MUSIC_INTERLEAVE;
+	xa = (u_char*)calloc(sectors, XA_SECTOR_SIZE);
+	if (xa == 0)
+	{
+		fprintf(stderr, "out of memory\n");
+		return 0;
+	}
+
+	memset(states, 0, sizeof(states));
+
+	for (sector = 0; sector < sectors; ++sector)
+	{
+		out = xa + (size_t)sector * XA_SECTOR_SIZE;
+		submode = sector == sectors - 1 ? XA_SUBMODE_EOF | XA_SUBMODE_EOR : 0;
+
+		if (MUSIC_IS_AUDIO(sector))
+		{
+			/* Shorter tracks start over */
+			track = MUSIC_AUDIO_TRACK(sector);
+			first = (long)(sector / MUSIC_INTERLEAVE) * XA_SECTOR_SAMPLES;
+			for (i = 0; i < XA_SECTOR_SAMPLES; ++i)
+			{
+				long index = (first + i) % tracks[track].count;
+
+				block[i * 2] = tracks[track].samples[index * 2];
+				block[i * 2 + 1] = tracks[track].samples[index * 2 + 1];
+			}
+
+			WriteSubheader(out, track, submode | XA_SUBMODE_AUDIO | XA_SUBMODE_FORM2 | XA_SUBMODE_RT, XA_CODING_STEREO);
+			EncodeSector(block, states[track], out + XA_SUBHEADER_SIZE);
+		}
+		else
+		{
+			WriteSubheader(out, 0, submode | XA_SUBMODE_DATA, 0);
+			memcpy(out + XA_SUBHEADER_SIZE, pack + (size_t)(MUSIC_DATA_INDEX(sector) % packSectors) * XA_DATA_SIZE, XA_DATA_SIZE);
+		}
+	}
+
+	*sectorCount = sectors;
+	return xa;
+}
+
+/* Reads the pack from a pack file, or packs it from a pack script. */
+static u_char* LoadPack(char* packFile, char* script, char* root, long* size)
+{
+	char line[512];
+	char name[64];
+	CdlFILE file;
+	FILE* in;
+	u_char* pack;
+	char* p;
+
+	if (packFile != 0)
+	{
+		return ReadFile(packFile, size);
+	}
+
+	/* The name of the pack comes from the build line of the script */
+	in = fopen(script, "r");
+	if (in == 0)
+	{
+		fprintf(stderr, "%s: can't open\n", script);
+		return 0;
+	}
+
+	name[0] = 0;
+	while (fgets(line, sizeof(line), in) != 0)
+	{
+		if ((p = strstr(line, "build,pck,\"")) != 0 && sscanf(p + 11, "%63[^\"]", name) == 1)
+		{
+			break;
+		}
+	}
+	fclose(in);
+
+	if (name[0] == 0 || !HostCdMount(script, root) || CdSearchFile(&file, name) == 0)
+	{
+		fprintf(stderr, "%s: no pack\n", script);
+		return 0;
+	}
+
+	*size = file.size;
+	pack = (u_char*)malloc(file.size);
+	if (pack == 0 || CdControl(CdlSetloc, (u_char*)&file.pos, 0) == 0 ||
+		CdRead(file.size / XA_DATA_SIZE, (u_long*)pack, CdlModeSpeed) == 0 || CdReadSync(0, 0) != 0)
+	{
+		fprintf(stderr, "%s: can't read %s\n", script, name);
+		free(pack);
+		return 0;
+	}
+
+	return pack;
+}
+
+static int Build(char* output, char* packFile, char* script, char* root, char** wavs)
+{
+	Track tracks[MUSIC_TRACKS];
+	u_char* pack;
+	u_char* xa = 0;
+	long packSize;
+	int packSectors, sectors = 0, track, result = 0;
+
+	memset(tracks, 0, sizeof(tracks));
+
+	pack = LoadPack(packFile, script, root, &packSize);
+	if (pack == 0)
+	{
+		return 0;
+	}
+
+	packSectors = PackSectors(pack, packSize);
+	if (packSectors == 0 || packSectors > MAX_PACK_SECTORS)
+	{
+		fprintf(stderr, "%s: not a pack\n", packFile != 0 ? packFile : script);
+		free(pack);
+		return 0;
+	}
+
+	for (track = 0; track < MUSIC_TRACKS; ++track)
+	{
+		if (!ReadWav(wavs[track], &tracks[track]))
+		{
+			break;
+		}
+	}
+
+	if (track == MUSIC_TRACKS && (xa = BuildXa(tracks, pack, packSectors, &sectors)) != 0)
+	{
+		result = WriteFile(output, xa, (long)sectors * XA_SECTOR_SIZE);
+		printf("%s: %d sectors, %.1f s of music, pack of %d sectors passes every %.1f s\n", output, sectors,
+			(double)sectors / MUSIC_INTERLEAVE * XA_SECTOR_SAMPLES / XA_RATE, packSectors,
+			(double)packSectors * MUSIC_INTERLEAVE / MUSIC_DATA_SLOTS / 150.0);
+	}
+
+	for (track = 0; track < MUSIC_TRACKS; ++track)
+	{
+		free(tracks[track].samples);
+	}
+	free(xa);
+	free(pack);
+	return result;
+}
+
+/* Decodes the audio sectors of a channel, in the order they are on the disc. */
+static int DecodeChannel(u_char* xa, long size, int channel, Track* track)
+{
+	XaState states[2] = { { 0, 0 }, { 0, 0 } };
+	u_char* sector;
+	long sectors = size / XA_SECTOR_SIZE, i;
+
+	track->samples = (short*)malloc((sectors * XA_SECTOR_SAMPLES + 1) * 2 * sizeof(short));
+	track->count = 0;
+
+	for (i = 0; i < sectors; ++i)
+	{
+		sector = xa + i * XA_SECTOR_SIZE;
+		if ((sector[2] & XA_SUBMODE_AUDIO) != 0 && sector[0] == MUSIC_XA_FILE && sector[1] == channel)
+		{
+			DecodeSector(sector + XA_SUBHEADER_SIZE, states, track->samples + track->count * 2);
+			track->count += XA_SECTOR_SAMPLES;
+		}
+	}
+
+	return track->count > 0;
+}
+
+static int Decode(char* input, int channel, char* output)
+{
+	Track track;
+	u_char* xa;
+	long size;
+	int result;
+
+	xa = ReadFile(input, &size);
+	if (xa == 0)
+	{
+		return 0;
+	}
+
+	if (size % XA_SECTOR_SIZE != 0 || !DecodeChannel(xa, size, channel, &track))
+	{
+		fprintf(stderr, "%s: no audio of channel %d\n", input, channel);
+		free(xa);
+		return 0;
+	}
+
+	result = WriteWav(output, &track);
+	free(track.samples);
+	free(xa);
+	return result;
+}
+
+/******************************************************/
+/* Test and bench */
+
+/* A chord on the left, a sweep on the right, both a little below full scale. */
+static void MakeTrack(Track* track, long count, double base)
+{
+	long i;
+	double t;
+
+	track->count = count;
+	track->samples = (short*)malloc(count * 2 * sizeof(short));
+	for (i = 0; i < count; ++i)
+	{
+		t = (double)i / XA_RATE;
+		track->samples[i * 2] = (short)(8000.0 * (sin(2.0 * M_PI * base * t) + sin(2.0 * M_PI * base * 1.25 * t) +
+			sin(2.0 * M_PI * base * 1.5 * t)));
+		track->samples[i * 2 + 1] = (short)(20000.0 * sin(2.0 * M_PI * (base + 2000.0 * t / 4.0) * t));
+	}
+}
+
+static double Snr(short* reference, short* decoded, long count)
+{
+	double signal = 0.0, noise = 0.0;
+	long i;
+
+	for (i = 0; i < count; ++i)
+	{
+		signal += (double)reference[i] * reference[i];
+		noise += (double)(reference[i] - decoded[i]) * (reference[i] - decoded[i]);
+	}
+
+	return noise == 0.0 ? 99.0 : 10.0 * log10(signal / noise);
+}
+
+static int Test()
+{
+	Track tracks[MUSIC_TRACKS], decoded;
+	u_char* pack;
+	u_char* xa;
+	u_char* sector;
+	PckTOC* toc;
+	int packSectors = 100, sectors, track, s, failures = 0, seen;
+	long i, count;
+	double snr;
+
+	/* A pack of 100 sectors, each one filled with its number */
+	pack = (u_char*)calloc(packSectors, XA_DATA_SIZE);
+	for (s = 1; s < packSectors; ++s)
+	{
+		memset(pack + s * XA_DATA_SIZE, s, XA_DATA_SIZE);
+	}
+	toc = (PckTOC*)pack;
+	memcpy(toc->ID, "PCK", 3);
+	toc->NumFiles = 1;
+	toc->File[0].Pos = 1;
+	toc->File[0].Size = (packSectors - 1) * XA_DATA_SIZE;
+
+	if (PackSectors(pack, (long)packSectors * XA_DATA_SIZE) != packSectors)
+	{
+		printf("pack sectors: %d instead of %d\n", PackSectors(pack, (long)packSectors * XA_DATA_SIZE), packSectors);
+		failures++;
+	}
+
+	/* 4 seconds of title music, a shorter game track which loops */
+	MakeTrack(&tracks[0], XA_RATE * 4, 220.0);
+	MakeTrack(&tracks[1], XA_RATE * 3, 330.0);
+
+	xa = BuildXa(tracks, pack, packSectors, &sectors);
+
+	/* Audio where Music.h says it is, every pack sector in the first trip */
+	seen = 0;
+	for (s = 0; s < sectors; ++s)
+	{
+		sector = xa + (size_t)s * XA_SECTOR_SIZE;
+		if (MUSIC_IS_AUDIO(s) != ((sector[2] & XA_SUBMODE_AUDIO) != 0) ||
+			(MUSIC_IS_AUDIO(s) && sector[1] != MUSIC_AUDIO_TRACK(s)))
+		{
+			printf("sector %d: wrong kind or channel\n", s);
+			failures++;
+			break;
+		}
+
+		if (!MUSIC_IS_AUDIO(s))
+		{
+			if (memcmp(sector + XA_SUBHEADER_SIZE, pack + (size_t)(MUSIC_DATA_INDEX(s) % packSectors) * XA_DATA_SIZE, XA_DATA_SIZE) != 0)
+			{
+				printf("sector %d: not pack sector %d\n", s, MUSIC_DATA_INDEX(s) % packSectors);
+				failures++;
+				break;
+			}
+
+			if (MUSIC_DATA_INDEX(s) < packSectors)
+			{
+				seen++;
+			}
+		}
+	}
+
+	if (seen != packSectors || memcmp(xa + XA_SECTOR_SIZE + XA_SUBHEADER_SIZE, toc, XA_DATA_SIZE) != 0)
+	{
+		printf("layout: %d of %d pack sectors, TOC %s\n", seen, packSectors,
+			memcmp(xa + XA_SECTOR_SIZE + XA_SUBHEADER_SIZE, toc, XA_DATA_SIZE) == 0 ? "in sector 1" : "missing");
+		failures++;
+	}
+
+	/* The round trip of both tracks, the looping one compared over its own length */
+	for (track = 0; track < MUSIC_TRACKS; ++track)
+	{
+		DecodeChannel(xa, (long)sectors * XA_SECTOR_SIZE, track, &decoded);
+		count = tracks[track].count < decoded.count ? tracks[track].count : decoded.count;
+		snr = Snr(tracks[track].samples, decoded.samples, count * 2);
+
+		/* The loop continues the track without a new start of the decoder */
+		for (i = tracks[track].count; i < decoded.count && i < tracks[track].count + 1000; ++i)
+		{
+			if (abs(decoded.samples[i * 2] - tracks[track].samples[(i - tracks[track].count) * 2]) > 4096)
+			{
+				break;
+			}
+		}
+
+		printf("track %d: %ld samples, SNR %.1f dB\n", track, count, snr);
+		if (snr < 25.0 || decoded.count < tracks[track].count ||
+			(i < decoded.count && i < tracks[track].count + 1000))
+		{
+			printf("track %d: round trip failed\n", track);
+			failures++;
+		}
+
+		free(decoded.samples);
+	}
+
+	for (track = 0; track < MUSIC_TRACKS; ++track)
+	{
+		free(tracks[track].samples);
+	}
+	free(xa);
+	free(pack);
+
+	printf("%s: %d failures\n", failures == 0 ? "PASS" : "FAIL", failures);
+	return failures == 0;
+}
+
+static double Seconds()
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static int Bench()
+{
+	Track track;
+	XaState states[2] = { { 0, 0 }, { 0, 0 } };
+	u_char data[XA_GROUPS * XA_GROUP_SIZE];
+	short out[XA_SECTOR_SAMPLES * 2];
+	long sectors, i;
+	double start, encodeTime, decodeTime;
+	int rounds = 10;
+
+	MakeTrack(&track, XA_RATE * 10, 220.0);
+	sectors = track.count / XA_SECTOR_SAMPLES;
+
+	start = Seconds();
+	for (i = 0; i < sectors; ++i)
+	{
+		EncodeSector(track.samples + i * XA_SECTOR_SAMPLES * 2, states, data);
+	}
+	encodeTime = Seconds() - start;
+
+	start = Seconds();
+	for (i = 0; i < sectors * rounds; ++i)
+	{
+		DecodeSector(data, states, out);
+	}
+	decodeTime = Seconds() - start;
+
+	printf("encode: %.1f Msamples/s (%.0fx real time at 37800 Hz stereo)\n",
+		sectors * XA_SECTOR_SAMPLES / encodeTime / 1e6, sectors * XA_SECTOR_SAMPLES / encodeTime / XA_RATE);
+	printf("decode: %.1f Msamples/s (%.0fx real time at 37800 Hz stereo)\n",
+		rounds * sectors * XA_SECTOR_SAMPLES / decodeTime / 1e6, rounds * sectors * XA_SECTOR_SAMPLES / decodeTime / XA_RATE);
+
+	free(track.samples);
+	return 1;
+}
+
+static void Usage()
+{
+	fprintf(stderr,
+		"usage: xatool build -o MUSIC.XA -p pack.pck|-s pack.txt [-d root] title.wav game.wav\n"
+		"       xatool decode -c channel -o out.wav MUSIC.XA\n"
+		"       xatool test\n"
+		"       xatool bench\n");
+	exit(2);
+}
+
+int main(int argc, char** argv)
+{
+	char* output = 0;
+	char* packFile = 0;
+	char* script = 0;
+	char* root = ".";
+	int channel = -1;
+	int i;
+
+	if (argc < 2)
+	{
+		Usage();
+	}
+
+	if (strcmp(argv[1], "test") == 0)
+	{
+		return Test() ? 0 : 1;
+	}
+
+	if (strcmp(argv[1], "bench") == 0)
+	{
+		return Bench() ? 0 : 1;
+	}
+
+	if (strcmp(argv[1], "build") == 0)
+	{
+		for (i = 2; i < argc - MUSIC_TRACKS; ++i)
+		{
+			if (i + 1 < argc - MUSIC_TRACKS && strcmp(argv[i], "-o") == 0) output = argv[++i];
+			else if (i + 1 < argc - MUSIC_TRACKS && strcmp(argv[i], "-p") == 0) packFile = argv[++i];
+			else if (i + 1 < argc - MUSIC_TRACKS && strcmp(argv[i], "-s") == 0) script = argv[++i];
+			else if (i + 1 < argc - MUSIC_TRACKS && strcmp(argv[i], "-d") == 0) root = argv[++i];
+			else Usage();
+		}
+
+		if (output == 0 || (packFile == 0) == (script == 0) || argc < 2 + MUSIC_TRACKS)
+		{
+			Usage();
+		}
+
+		return Build(output, packFile, script, root, argv + argc - MUSIC_TRACKS) ? 0 : 1;
+	}
+
+	if (strcmp(argv[1], "decode") == 0)
+	{
+		for (i = 2; i < argc - 1; ++i)
+		{
+			if (i + 1 < argc - 1 && strcmp(argv[i], "-c") == 0) channel = atoi(argv[++i]);
+			else if (i + 1 < argc - 1 && strcmp(argv[i], "-o") == 0) output = argv[++i];
+			else Usage();
+		}
+
+		if (output == 0 || channel < 0 || channel >= MUSIC_TRACKS || argc < 3)
+		{
+			Usage();
+		}
+
+		return Decode(argv[argc - 1], channel, output) ? 0 : 1;
+	}
+
+	Usage();
+	return 2;
+}
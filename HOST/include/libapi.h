@@ -0,0 +1,19 @@
+/*
+ * Host replacement for the PSY-Q <libapi.h>.
+ *
+ * Only the part of the library used by the game is declared here.
+ */
+
+#ifndef _HOST_LIBAPI_H_
+#define _HOST_LIBAPI_H_
+
+#include <sys/types.h>
+
+int InitTAP(void* bufA, long lenA, void* bufB, long lenB);
+int StartTAP(void);
+int StopTAP(void);
+
+int EnterCriticalSection(void);
+void ExitCriticalSection(void);
+
+#endif
@@ -0,0 +1,126 @@
+/*
+ * Host replacement for the PSY-Q <libcd.h>.
+ *
+ * Only the part of the library used by the game is declared here. The host drive
+ * reads from a virtual disc which holds the data pack built from a pack script,
+ * see HostCdMount.
+ */
+
+#ifndef _HOST_LIBCD_H_
+#define _HOST_LIBCD_H_
+
+#include <sys/types.h>
+
+/* Commands */
+#define CdlNop			0x01
+#define CdlSetloc		0x02
+#define CdlStop			0x08
+#define CdlPause		0x09
+#define CdlSetfilter	0x0d
+#define CdlSetmode		0x0e
+#define CdlReadS		0x1b
+
+/* Modes */
+#define CdlModeStream	0x100	/* CdRead2 collects STR movie frames in the ring buffer of StSetRing */
+#define CdlModeSpeed	0x80	/* Double speed */
+#define CdlModeRT		0x40	/* XA-ADPCM sectors are played, not delivered */
+#define CdlModeSize1	0x20	/* Sectors are delivered with header and subheader */
+#define CdlModeSF		0x08	/* Only XA-ADPCM sectors of the CdlSetfilter file and channel are played */
+
+/* Interrupts passed to the ready callback */
+#define CdlDataReady	0x01
+#define CdlDiskError	0x05
+
+/* Submode bits of the XA subheader of a sector */
+#define HOST_XA_AUDIO	0x04
+#define HOST_XA_DATA	0x08
+#define HOST_XA_FORM2	0x20
+
+typedef struct
+{
+	u_char minute;
+	u_char second;
+	u_char sector;
+	u_char track;
+} CdlLOC;
+
+typedef struct
+{
+	u_char file;
+	u_char chan;
+	u_short pad;
+} CdlFILTER;
+
+typedef void (*CdlCB)(u_char, u_char*);
+
+typedef struct
+{
+	CdlLOC pos;
+	u_long size;
+	char name[16];
+} CdlFILE;
+
+int CdInit(void);
+int CdSetDebug(int level);
+CdlFILE* CdSearchFile(CdlFILE* fp, char* name);
+int CdControl(u_char com, u_char* param, u_char* result);
+int CdControlB(u_char com, u_char* param, u_char* result);
+int CdControlF(u_char com, u_char* param);
+int CdRead(int sectors, u_long* buf, int mode);
+int CdReadSync(int mode, u_char* result);
+CdlCB CdReadyCallback(CdlCB func);
+int CdGetSector(void* madr, int size);
+CdlLOC* CdIntToPos(int i, CdlLOC* p);
+int CdPosToInt(CdlLOC* p);
+
+/* Streaming library: CdRead2 streams from the CdlSetloc position on, StGetNext returns 0 and the next whole frame if there is one. */
+int CdRead2(long mode);
+void StSetRing(u_long* ring_addr, u_long ring_size);
+void StSetStream(u_long mode, u_long start_frame, u_long end_frame, void (*func1)(), void (*func2)());
+void StClearRing(void);
+void StUnSetRing(void);
+u_long StGetNext(u_long** addr, u_long** header);
+u_long StFreeRing(u_long* base);
+
+/******************************************************/
+/* Host only */
+
+/*
+ * Builds the disc from a pack script in the format of DATA\BREAKOUT.TXT: every
+ * "build,pck" block becomes a PCK file in the root directory of the disc, made of
+ * the listed files. Paths in the script are relative to root and matched without
+ * regard to case. Returns 0 and prints the reason if the disc can't be built.
+ */
+int HostCdMount(char* script, char* root);
+
+/* Every n-th CdRead fails (CdReadSync returns -1) if this is n, none if it is 0. */
+extern int HostCdErrorEvery;
+
+/*
+ * Adds an XA file (MUSIC.XA as written by xatool or INTRO.STR as written by strtool, 2336
+ * bytes per sector: the subheader and the sector's data) to the root directory of the disc
+ * under the given name, behind the files before. Returns 0 and prints the reason if it
+ * can't be read. Data sectors read as usual. While the drive streams (CdlReadS, CdRead2)
+ * it moves on by a sector every 1/150 second at double speed, counted in vertical blanks,
+ * plays XA-ADPCM sectors if CdlModeRT is set, and passes the others to the ready callback,
+ * or to the ring buffer if they are sectors of movie frames and CdRead2 got CdlModeStream.
+ */
+int HostCdAddXaFile(char* name, char* path);
+
+typedef struct
+{
+	/* Audio sectors played, and sectors passed to the ready callback while streaming. */
+	u_long audioSectors;
+	u_long dataSectors;
+	/* Audio sectors which came later than the one before had finished playing. */
+	u_long underruns;
+	/* Streams started with CdlReadS or CdRead2. */
+	u_long streams;
+	/* Movie frames collected in the ring buffer, and frames which found no room in it or missed sectors. */
+	u_long frames;
+	u_long droppedFrames;
+} HostCdStats;
+
+extern HostCdStats HostCd;
+
+#endif
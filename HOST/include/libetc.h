@@ -0,0 +1,32 @@
+/*
+ * Host replacement for the PSY-Q <libetc.h>.
+ *
+ * Only the part of the library used by the game is declared here.
+ */
+
+#ifndef _HOST_LIBETC_H_
+#define _HOST_LIBETC_H_
+
+#include <sys/types.h>
+
+#define MODE_NTSC	0
+#define MODE_PAL	1
+
+int ResetCallback(void);
+int StopCallback(void);
+int VSync(int mode);
+int VSyncCallback(void (*f)());
+long SetVideoMode(long mode);
+long GetVideoMode(void);
+
+/*
+ * The console's BIOS says its region in its version string ('E' in "for Europe"), which
+ * the game reads from ROM. The host has a variable instead, 'E' unless a tool changes it.
+ */
+extern char HostBiosRegion;
+#define BIOS_REGION HostBiosRegion
+
+/* Host only: called by every VSync(0) before the callback, the virtual drive streams from it. */
+extern void (*HostVSyncHook)(void);
+
+#endif
@@ -0,0 +1,438 @@
+/*
+ * Host replacement for the PSY-Q <libgpu.h>.
+ *
+ * Only the part of the library used by the game is declared here.
+ */
+
+#ifndef _HOST_LIBGPU_H_
+#define _HOST_LIBGPU_H_
+
+#include <sys/types.h>
+
+typedef struct
+{
+	short x, y;
+	short w, h;
+} RECT;
+
+typedef struct
+{
+	u_long tag;
+	u_long code[15];
+} DR_ENV;
+
+typedef struct
+{
+	RECT clip;
+	short ofs[2];
+	RECT tw;
+	u_short tpage;
+	u_char dtd;
+	u_char dfe;
+	u_char isbg;
+	u_char r0, g0, b0;
+	DR_ENV dr_env;
+} DRAWENV;
+
+typedef struct
+{
+	RECT disp;
+	RECT screen;
+	u_char isinter;
+	u_char isrgb24;
+	u_char pad0, pad1;
+} DISPENV;
+
+/*
+ * Primitives. The tag keeps the 24 bit address of the next primitive and the
+ * primitive length in words, exactly like on the console.
+ */
+typedef struct
+{
+	unsigned addr : 24;
+	unsigned len : 8;
+	u_char r0, g0, b0, code;
+} P_TAG;
+
+typedef struct
+{
+	u_long tag;
+	u_char r0, g0, b0, code;
+	short x0, y0;
+	short x1, y1;
+	short x2, y2;
+} POLY_F3;
+
+typedef struct
+{
+	u_long tag;
+	u_char r0, g0, b0, code;
+	short x0, y0;
+	short x1, y1;
+	short x2, y2;
+	short x3, y3;
+} POLY_F4;
+
+typedef struct
+{
+	u_long tag;
+	u_char r0, g0, b0, code;
+	short x0, y0;
+	u_char u0, v0;
+	u_short clut;
+	short x1, y1;
+	u_char u1, v1;
+	u_short tpage;
+	short x2, y2;
+	u_char u2, v2;
+	u_short pad1;
+} POLY_FT3;
+
+typedef struct
+{
+	u_long tag;
+	u_char r0, g0, b0, code;
+	short x0, y0;
+	u_char u0, v0;
+	u_short clut;
+	short x1, y1;
+	u_char u1, v1;
+	u_short tpage;
+	short x2, y2;
+	u_char u2, v2;
+	u_short pad1;
+	short x3, y3;
+	u_char u3, v3;
+	u_short pad2;
+} POLY_FT4;
+
+typedef struct
+{
+	u_long tag;
+	u_char r0, g0, b0, code;
+	short x0, y0;
+	u_char r1, g1, b1, pad1;
+	short x1, y1;
+	u_char r2, g2, b2, pad2;
+	short x2, y2;
+} POLY_G3;
+
+typedef struct
+{
+	u_long tag;
+	u_char r0, g0, b0, code;
+	short x0, y0;
+	u_char r1, g1, b1, pad1;
+	short x1, y1;
+	u_char r2, g2, b2, pad2;
+	short x2, y2;
+	u_char r3, g3, b3, pad3;
+	short x3, y3;
+} POLY_G4;
+
+typedef struct
+{
+	u_long tag;
+	u_char r0, g0, b0, code;
+	short x0, y0;
+	u_char u0, v0;
+	u_short clut;
+	u_char r1, g1, b1, p1;
+	short x1, y1;
+	u_char u1, v1;
+	u_short tpage;
+	u_char r2, g2, b2, p2;
+	short x2, y2;
+	u_char u2, v2;
+	u_short pad2;
+} POLY_GT3;
+
+typedef struct
+{
+	u_long tag;
+	u_char r0, g0, b0, code;
+	short x0, y0;
+	u_char u0, v0;
+	u_short clut;
+	u_char r1, g1, b1, p1;
+	short x1, y1;
+	u_char u1, v1;
+	u_short tpage;
+	u_char r2, g2, b2, p2;
+	short x2, y2;
+	u_char u2, v2;
+	u_short pad2;
+	u_char r3, g3, b3, p3;
+	short x3, y3;
+	u_char u3, v3;
+	u_short pad3;
+} POLY_GT4;
+
+typedef struct
+{
+	u_long tag;
+	u_char r0, g0, b0, code;
+	short x0, y0;
+	short x1, y1;
+} LINE_F2;
+
+typedef struct
+{
+	u_long tag;
+	u_char r0, g0, b0, code;
+	short x0, y0;
+	u_char r1, g1, b1, p1;
+	short x1, y1;
+} LINE_G2;
+
+typedef struct
+{
+	u_long tag;
+	u_char r0, g0, b0, code;
+	short x0, y0;
+	u_char u0, v0;
+	u_short clut;
+	short w, h;
+} SPRT;
+
+typedef struct
+{
+	u_long tag;
+	u_char r0, g0, b0, code;
+	short x0, y0;
+	u_char u0, v0;
+	u_short clut;
+} SPRT_8, SPRT_16;
+
+typedef struct
+{
+	u_long tag;
+	u_char r0, g0, b0, code;
+	short x0, y0;
+	short w, h;
+} TILE;
+
+typedef struct
+{
+	u_long tag;
+	u_char r0, g0, b0, code;
+	short x0, y0;
+} TILE_1, TILE_8, TILE_16;
+
+typedef struct
+{
+	u_long tag;
+	u_char r0, g0, b0, code;
+	short x0, y0;
+	short w, h;
+} BLK_FILL;
+
+typedef struct
+{
+	u_long tag;
+	u_long code[2];
+} DR_MODE;
+
+typedef struct
+{
+	u_long tag;
+	u_long code[1];
+} DR_TPAGE;
+
+typedef struct
+{
+	u_long tag;
+	u_long code[2];
+} DR_AREA;
+
+typedef struct
+{
+	u_long tag;
+	u_long code[2];
+} DR_OFFSET;
+
+#define setlen(p, _len)		(((P_TAG *)(p))->len  = (u_char)(_len))
+#define setaddr(p, _addr)	(((P_TAG *)(p))->addr = (u_long)(_addr) & 0xffffff)
+#define setcode(p, _code)	(((P_TAG *)(p))->code = (u_char)(_code))
+
+#define getlen(p)			(u_char)(((P_TAG *)(p))->len)
+#define getcode(p)			(u_char)(((P_TAG *)(p))->code)
+#define getaddr(p)			(u_long)(((P_TAG *)(p))->addr)
+
+#define nextPrim(p)			(void *)(u_long)(((P_TAG *)(p))->addr)
+#define isendprim(p)		((((P_TAG *)(p))->addr) == 0xffffff)
+
+#define addPrim(ot, p)		setaddr(p, getaddr(ot)), setaddr(ot, p)
+#define addPrims(ot, p0, p1)	setaddr(p1, getaddr(ot)), setaddr(ot, p0)
+#define catPrim(p0, p1)		setaddr(p0, p1)
+#define termPrim(p)			setaddr(p, 0xffffffff)
+
+#define setSemiTrans(p, abe)	((abe) ? setcode(p, getcode(p) | 0x02) : setcode(p, getcode(p) & ~0x02))
+#define setShadeTex(p, tge)		((tge) ? setcode(p, getcode(p) | 0x01) : setcode(p, getcode(p) & ~0x01))
+
+#define getTPage(tp, abr, x, y) \
+	((((tp) & 0x3) << 7) | (((abr) & 0x3) << 5) | (((y) & 0x100) >> 4) | (((x) & 0x3ff) >> 6) | (((y) & 0x200) << 2))
+
+#define getClut(x, y)		(((y) << 6) | (((x) >> 4) & 0x3f))
+
+#define setPolyF3(p)		setlen(p, 4), setcode(p, 0x20)
+#define setPolyFT3(p)		setlen(p, 7), setcode(p, 0x24)
+#define setPolyG3(p)		setlen(p, 6), setcode(p, 0x30)
+#define setPolyGT3(p)		setlen(p, 9), setcode(p, 0x34)
+#define setPolyF4(p)		setlen(p, 5), setcode(p, 0x28)
+#define setPolyFT4(p)		setlen(p, 9), setcode(p, 0x2c)
+#define setPolyG4(p)		setlen(p, 8), setcode(p, 0x38)
+#define setPolyGT4(p)		setlen(p, 12), setcode(p, 0x3c)
+#define setLineF2(p)		setlen(p, 3), setcode(p, 0x40)
+#define setLineG2(p)		setlen(p, 4), setcode(p, 0x50)
+#define setTile(p)			setlen(p, 3), setcode(p, 0x60)
+#define setTile1(p)			setlen(p, 2), setcode(p, 0x68)
+#define setTile8(p)			setlen(p, 2), setcode(p, 0x70)
+#define setTile16(p)		setlen(p, 2), setcode(p, 0x78)
+#define setSprt(p)			setlen(p, 4), setcode(p, 0x64)
+#define setSprt8(p)			setlen(p, 3), setcode(p, 0x74)
+#define setSprt16(p)		setlen(p, 3), setcode(p, 0x7c)
+#define setBlockFill(p)		setlen(p, 3), setcode(p, 0x02)
+
+#define setRGB0(p, _r0, _g0, _b0) \
+	(p)->r0 = _r0, (p)->g0 = _g0, (p)->b0 = _b0
+
+#define setRGB1(p, _r1, _g1, _b1) \
+	(p)->r1 = _r1, (p)->g1 = _g1, (p)->b1 = _b1
+
+#define setRGB2(p, _r2, _g2, _b2) \
+	(p)->r2 = _r2, (p)->g2 = _g2, (p)->b2 = _b2
+
+#define setRGB3(p, _r3, _g3, _b3) \
+	(p)->r3 = _r3, (p)->g3 = _g3, (p)->b3 = _b3
+
+#define setXY0(p, _x0, _y0) \
+	(p)->x0 = _x0, (p)->y0 = _y0
+
+#define setXY2(p, _x0, _y0, _x1, _y1) \
+	(p)->x0 = _x0, (p)->y0 = _y0, \
+	(p)->x1 = _x1, (p)->y1 = _y1
+
+#define setXY3(p, _x0, _y0, _x1, _y1, _x2, _y2) \
+	(p)->x0 = _x0, (p)->y0 = _y0, \
+	(p)->x1 = _x1, (p)->y1 = _y1, \
+	(p)->x2 = _x2, (p)->y2 = _y2
+
+#define setXY4(p, _x0, _y0, _x1, _y1, _x2, _y2, _x3, _y3) \
+	(p)->x0 = _x0, (p)->y0 = _y0, \
+	(p)->x1 = _x1, (p)->y1 = _y1, \
+	(p)->x2 = _x2, (p)->y2 = _y2, \
+	(p)->x3 = _x3, (p)->y3 = _y3
+
+#define setWH(p, _w, _h)	(p)->w = _w, (p)->h = _h
+
+#define setXYWH(p, _x0, _y0, _w, _h) \
+	(p)->x0 = _x0, (p)->y0 = _y0, (p)->w = _w, (p)->h = _h
+
+#define setRECT(r, _x, _y, _w, _h) \
+	(r)->x = (_x), (r)->y = (_y), (r)->w = (_w), (r)->h = (_h)
+
+#define setUV0(p, _u0, _v0)	(p)->u0 = _u0, (p)->v0 = _v0
+
+#define setUV3(p, _u0, _v0, _u1, _v1, _u2, _v2) \
+	(p)->u0 = _u0, (p)->v0 = _v0, \
+	(p)->u1 = _u1, (p)->v1 = _v1, \
+	(p)->u2 = _u2, (p)->v2 = _v2
+
+#define setUV4(p, _u0, _v0, _u1, _v1, _u2, _v2, _u3, _v3) \
+	(p)->u0 = _u0, (p)->v0 = _v0, \
+	(p)->u1 = _u1, (p)->v1 = _v1, \
+	(p)->u2 = _u2, (p)->v2 = _v2, \
+	(p)->u3 = _u3, (p)->v3 = _v3
+
+#define setClut(p, x, y)	((p)->clut = getClut(x, y))
+
+/* Draw mode (E1) and texture window (E2) commands */
+#define _get_mode(dfe, dtd, tpage) \
+	((0xe1000000) | ((dtd) ? 0x0200 : 0) | ((dfe) ? 0x0400 : 0) | ((tpage) & 0x9ff))
+
+#define _get_tw(tw) \
+	((tw) ? ((0xe2000000) | ((((tw)->y & 0xff) >> 3) << 15) | ((((tw)->x & 0xff) >> 3) << 10) | \
+	(((~((tw)->h - 1)) & 0xff) >> 3) << 5 | (((~((tw)->w - 1)) & 0xff) >> 3)) : 0)
+
+#define setDrawTPage(p, dfe, dtd, tpage) \
+	setlen(p, 1), ((p)->code[0] = _get_mode(dfe, dtd, tpage))
+
+#define setDrawMode(p, dfe, dtd, tpage, tw) \
+	setlen(p, 2), ((p)->code[0] = _get_mode(dfe, dtd, tpage)), ((p)->code[1] = _get_tw(tw))
+
+int ResetGraph(int mode);
+int SetGraphDebug(int level);
+void SetDispMask(int mask);
+int DrawSync(int mode);
+
+int LoadImage(RECT* rect, u_long* p);
+int StoreImage(RECT* rect, u_long* p);
+int MoveImage(RECT* rect, int x, int y);
+int ClearImage(RECT* rect, u_char r, u_char g, u_char b);
+
+u_long* ClearOTag(u_long* ot, int n);
+u_long* ClearOTagR(u_long* ot, int n);
+void DrawOTag(u_long* p);
+void DrawPrim(void* p);
+
+DRAWENV* SetDefDrawEnv(DRAWENV* env, int x, int y, int w, int h);
+DISPENV* SetDefDispEnv(DISPENV* env, int x, int y, int w, int h);
+DRAWENV* PutDrawEnv(DRAWENV* env);
+
+/* Primitives which change the clip area (E3 and E4) and the offset (E5) while the order table is drawn. */
+void SetDrawArea(DR_AREA* p, RECT* r);
+void SetDrawOffset(DR_OFFSET* p, u_short* ofs);
+DISPENV* PutDispEnv(DISPENV* env);
+
+u_short GetTPage(int tp, int abr, int x, int y);
+u_short GetClut(int x, int y);
+
+/* Debug font. The host has no font sheet, text is written to stderr when it is flushed. */
+void FntLoad(int tx, int ty);
+int FntOpen(int x, int y, int w, int h, int isbg, int n);
+void SetDumpFnt(int id);
+int FntPrint(char* format, ...);
+u_long* FntFlush(int id);
+
+/******************************************************/
+/* Host only: the GPU state tools read back */
+
+#define HOST_VRAM_WIDTH		1024
+#define HOST_VRAM_HEIGHT	512
+
+/* Primitive kinds counted by the host GPU */
+enum
+{
+	HOST_PRIM_F3, HOST_PRIM_FT3, HOST_PRIM_G3, HOST_PRIM_GT3,
+	HOST_PRIM_F4, HOST_PRIM_FT4, HOST_PRIM_G4, HOST_PRIM_GT4,
+	HOST_PRIM_LINE, HOST_PRIM_TILE, HOST_PRIM_SPRT, HOST_PRIM_FILL, HOST_PRIM_MODE,
+	HOST_PRIM_TYPES
+};
+
+typedef struct
+{
+	/* Primitives drawn, by kind */
+	u_long prims[HOST_PRIM_TYPES];
+	/* OT entries and packets walked by DrawOTag */
+	u_long tags;
+	/* Polygons the GPU skips because they are too large, and unknown commands */
+	u_long rejected;
+	u_long unsupported;
+	/* Pixels written and texels read */
+	u_long pixels;
+	u_long texels;
+} HostGpuStats;
+
+extern u_short HostVram[HOST_VRAM_HEIGHT][HOST_VRAM_WIDTH];
+extern HostGpuStats HostGpu;
+extern const char* HostPrimNames[HOST_PRIM_TYPES];
+
+/* The display area set by PutDispEnv and whether SetDispMask turned the display on. */
+extern DISPENV HostDisplay;
+extern int HostDisplayEnabled;
+
+/* Number of FntFlush calls which printed text, the game only uses the debug font for ErrorMessage. */
+extern int HostFntFlushCount;
+
+#endif
@@ -0,0 +1,148 @@
+/*
+ * Host replacement for the PSY-Q <libgs.h>.
+ *
+ * Only the part of the library used by the game is declared here. Type layouts and
+ * attribute bits follow the PSY-Q 4.3 runtime headers.
+ */
+
+#ifndef _HOST_LIBGS_H_
+#define _HOST_LIBGS_H_
+
+#include <sys/types.h>
+
+#include <libgte.h>
+#include <libgpu.h>
+
+/* GsInitGraph modes */
+#define GsNONINTER	0
+#define GsINTER		1
+#define GsOFSGTE	0
+#define GsOFSGPU	4
+
+/* GsDOBJ2 attributes */
+#define GsDIV1		(1 << 9)
+#define GsDIV2		(2 << 9)
+#define GsDIV3		(3 << 9)
+#define GsDIV4		(4 << 9)
+#define GsDIV5		(5 << 9)
+#define GsLOFF		(1 << 6)
+
+typedef unsigned char PACKET;
+
+typedef struct GsCOORDINATE2
+{
+	u_long flg;
+	MATRIX coord;
+	MATRIX workm;
+	struct GsCOORDINATE2* super;
+	struct GsCOORDINATE2* sub;
+} GsCOORDINATE2;
+
+#define WORLD ((GsCOORDINATE2*)0)
+
+typedef struct
+{
+	MATRIX view;
+	GsCOORDINATE2* super;
+} GsVIEW2;
+
+typedef struct
+{
+	long vpx, vpy, vpz;
+	long vrx, vry, vrz;
+	long rz;
+	GsCOORDINATE2* super;
+} GsRVIEW2;
+
+typedef struct
+{
+	long vx, vy, vz;
+	u_char r, g, b;
+} GsF_LIGHT;
+
+typedef struct
+{
+	unsigned p : 24;
+	unsigned num : 8;
+} GsOT_TAG;
+
+typedef struct
+{
+	u_long length;
+	GsOT_TAG* org;
+	u_long offset;
+	u_long point;
+	GsOT_TAG* tag;
+} GsOT;
+
+typedef struct
+{
+	u_long attribute;
+	GsCOORDINATE2* coord2;
+	u_long* tmd;
+	u_long id;
+} GsDOBJ2;
+
+typedef struct
+{
+	u_long attribute;
+	short x, y;
+	u_short w, h;
+	u_short tpage;
+	u_char u, v;
+	short cx, cy;
+	u_char r, g, b;
+	short mx, my;
+	short scalex, scaley;
+	long rotate;
+} GsSPRITE;
+
+typedef struct
+{
+	u_long pmode;
+	short px, py;
+	u_short pw, ph;
+	u_long* pixel;
+	short cx, cy;
+	u_short cw, ch;
+	u_long* clut;
+} GsIMAGE;
+
+void GsInitGraph(u_short x, u_short y, u_short intmode, u_short dith, u_short varmmode);
+void GsDefDispBuff(u_short x0, u_short y0, u_short x1, u_short y1);
+void GsInit3D(void);
+void GsSetProjection(long h);
+int GsGetActiveBuff(void);
+void GsSwapDispBuff(void);
+void GsSetWorkBase(PACKET* base);
+PACKET* GsGetWorkBase(void);
+void GsClearOt(u_short offset, u_short point, GsOT* ot);
+void GsDrawOt(GsOT* ot);
+void GsSortOt(GsOT* src, GsOT* dst);
+void GsSortClear(u_char r, u_char g, u_char b, GsOT* ot);
+void GsSortFastSprite(GsSPRITE* sp, GsOT* ot, u_short pri);
+void GsGetTimInfo(u_long* im, GsIMAGE* tim);
+
+void GsInitCoordinate2(GsCOORDINATE2* super, GsCOORDINATE2* base);
+int GsSetView2(GsVIEW2* pv);
+void GsSetAmbient(long r, long g, long b);
+int GsSetLightMode(int mode);
+int GsSetFlatLight(int id, GsF_LIGHT* lt);
+void GsGetLws(GsCOORDINATE2* coord, MATRIX* lw, MATRIX* ls);
+void GsGetLs(GsCOORDINATE2* coord, MATRIX* m);
+void GsSetLightMatrix(MATRIX* mp);
+void GsSetLsMatrix(MATRIX* mp);
+void GsMapModelingData(u_long* p);
+void GsLinkObject4(u_long tmd_base, GsDOBJ2* obj, int n);
+void GsSortObject4(GsDOBJ2* obj, GsOT* ot, int shift, u_long* scratch);
+
+/* The display and drawing environments, accessed directly by InitGraphics. */
+extern DISPENV GsDISPENV;
+extern DRAWENV GsDRAWENV;
+/* World to screen matrix, set by GsSetView2. */
+extern MATRIX GsWSMATRIX;
+
+/* Host only: called after GsDrawOt drew an order table into the GsDRAWENV area, e.g. to capture the frame. */
+extern void (*HostDrawOtHook)(void);
+
+#endif
@@ -0,0 +1,111 @@
+/*
+ * Host replacement for the PSY-Q <libgte.h>.
+ *
+ * Only the part of the library used by the game is declared here. Type layouts and
+ * macros follow the PSY-Q 4.3 runtime headers so game code compiles unchanged.
+ */
+
+#ifndef _HOST_LIBGTE_H_
+#define _HOST_LIBGTE_H_
+
+#include <sys/types.h>
+
+#include <stdlib.h>
+
+#define ONE		4096	/* GTE regards 4096 as 1.0 */
+
+typedef struct
+{
+	short	m[3][3];	/* 3x3 rotation matrix */
+	long	t[3];		/* transfer vector */
+} MATRIX;
+
+typedef struct
+{
+	long	vx, vy;
+	long	vz, pad;
+} VECTOR;
+
+typedef struct
+{
+	short	vx, vy;
+	short	vz, pad;
+} SVECTOR;
+
+typedef struct
+{
+	u_char	r, g, b, cd;
+} CVECTOR;
+
+typedef struct
+{
+	short	vx, vy;
+} DVECTOR;
+
+#define setVector(v, _x, _y, _z) \
+	(v)->vx = _x, (v)->vy = _y, (v)->vz = _z
+
+#define copyVector(v0, v1) \
+	(v0)->vx = (v1)->vx, (v0)->vy = (v1)->vy, (v0)->vz = (v1)->vz
+
+#define addVector(v0, v1) \
+	(v0)->vx += (v1)->vx, (v0)->vy += (v1)->vy, (v0)->vz += (v1)->vz
+
+#define applyVector(v, _x, _y, _z, op) \
+	(v)->vx op _x, (v)->vy op _y, (v)->vz op _z
+
+/* The 1 KB data cache ("scratchpad") of the R3000. */
+extern u_long HostScratchpad[256];
+#define getScratchAddr(offset)	((u_long *)(HostScratchpad + (offset)))
+
+int rsin(int a);
+int rcos(int a);
+MATRIX* RotMatrix(SVECTOR* r, MATRIX* m);
+MATRIX* TransMatrix(MATRIX* m, VECTOR* v);
+MATRIX* CompMatrixLV(MATRIX* m0, MATRIX* m1, MATRIX* m2);
+VECTOR* ApplyMatrixLV(MATRIX* m, VECTOR* v0, VECTOR* v1);
+void VectorNormal(VECTOR* v0, VECTOR* v1);
+void VectorNormalS(VECTOR* v0, SVECTOR* v1);
+long SquareRoot0(long a);
+
+/* GTE register state */
+void SetRotMatrix(MATRIX* m);
+void SetTransMatrix(MATRIX* m);
+void SetLightMatrix(MATRIX* m);
+void SetColorMatrix(MATRIX* m);
+void SetBackColor(long rbk, long gbk, long bbk);
+void SetGeomOffset(long ofx, long ofy);
+void SetGeomScreen(long h);
+
+/* Perspective transformation and lighting */
+long RotTransPers(SVECTOR* v0, long* sxy, long* p, long* flag);
+long RotTransPers3(SVECTOR* v0, SVECTOR* v1, SVECTOR* v2, long* sxy0, long* sxy1, long* sxy2, long* p, long* flag);
+/* flag receives bits 12 - 27 of the FLAG register of each vertex. */
+void RotTransPersN(SVECTOR* v0, DVECTOR* v1, u_short* sz, u_short* p, u_short* flag, long n);
+long NormalClip(long sxy0, long sxy1, long sxy2);
+void NormalColorCol(SVECTOR* v0, CVECTOR* v1, CVECTOR* v2);
+
+/* Host only: bits of the GTE FLAG register, as returned by RotTransPers. */
+#define HOST_GTE_FLAG_ERROR			(1UL << 31)	/* Any of bits 30 - 23 and 18 - 13 */
+#define HOST_GTE_FLAG_MAC1_POSITIVE	(1UL << 30)	/* MAC1 - MAC3 overflows, bits 30 - 28 */
+#define HOST_GTE_FLAG_MAC1_NEGATIVE	(1UL << 27)	/* MAC1 - MAC3 negative overflows, bits 27 - 25 */
+#define HOST_GTE_FLAG_IR1			(1UL << 24)	/* IR1 - IR3 saturated, bits 24 - 22 */
+#define HOST_GTE_FLAG_COLOR_R		(1UL << 21)	/* Color R, G, B saturated, bits 21 - 19 */
+#define HOST_GTE_FLAG_SZ			(1UL << 18)	/* SZ3 saturated */
+#define HOST_GTE_FLAG_DIVIDE		(1UL << 17)	/* Division overflow */
+#define HOST_GTE_FLAG_MAC0_POSITIVE	(1UL << 16)
+#define HOST_GTE_FLAG_MAC0_NEGATIVE	(1UL << 15)
+#define HOST_GTE_FLAG_SX			(1UL << 14)	/* SX2 saturated */
+#define HOST_GTE_FLAG_SY			(1UL << 13)	/* SY2 saturated */
+#define HOST_GTE_FLAG_IR0			(1UL << 12)	/* IR0 saturated */
+
+/*
+ * Host only: batched versions of ApplyMatrixLV (v1[i] = m * v0[i]) and CompMatrixLV
+ * (m2[i] = m0 * m1[i]) with the same results, and the divider of the perspective
+ * transformation (h / sz3 as 1.16), which ors its overflow bits into flag.
+ */
+void HostApplyMatrixLVN(MATRIX* m, VECTOR* v0, VECTOR* v1, long n);
+void HostCompMatrixLVN(MATRIX* m0, MATRIX* m1, MATRIX* m2, long n);
+u_long HostGteDivide(u_long h, u_long sz3, u_long* flag);
+
+#endif
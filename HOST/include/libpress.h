@@ -0,0 +1,38 @@
+/*
+ * Host replacement for the PSY-Q <libpress.h>.
+ *
+ * Only the part of the library used by the game is declared here. The host MDEC decodes
+ * with the codec of the host tools (see Mdec.h), in floating point, so its pixels can be
+ * off by one from the console's. It works when DecDCTout is called, the syncs return at
+ * once.
+ */
+
+#ifndef _HOST_LIBPRESS_H_
+#define _HOST_LIBPRESS_H_
+
+#include <sys/types.h>
+
+void DecDCTReset(int mode);
+/* Decodes the bitstream of a frame (from its 8 byte header on) to run/level codes for DecDCTin. Returns 0, -1 if it is damaged. */
+int DecDCTvlc(u_long* bs, u_long* buf);
+/* Takes the codes of DecDCTvlc, mode 2 puts out 16 bit pixels with the mask bit set, 3 puts out 24 bit ones. */
+void DecDCTin(u_long* buf, int mode);
+/* Decodes the next size 32 bit words of pixels, macroblock after macroblock. */
+void DecDCTout(u_long* buf, int size);
+int DecDCTinSync(int mode);
+int DecDCToutSync(int mode);
+
+/******************************************************/
+/* Host only */
+
+typedef struct
+{
+	/* Frames decoded by DecDCTvlc and macroblocks put out, and frames or macroblocks which were damaged. */
+	u_long frames;
+	u_long macroblocks;
+	u_long errors;
+} HostMdecStats;
+
+extern HostMdecStats HostMdec;
+
+#endif
@@ -0,0 +1,143 @@
+/*
+ * Host replacement for the PSY-Q <libspu.h>.
+ *
+ * Only the part of the library used by the game is declared here. The host SPU keeps
+ * the sound RAM and the voice registers, but doesn't produce any sound.
+ */
+
+#ifndef _HOST_LIBSPU_H_
+#define _HOST_LIBSPU_H_
+
+#include <sys/types.h>
+
+#define SpuOff				0
+#define SpuOn				1
+
+#define SpuTransByDMA		0
+#define SpuTransByIO		1
+
+#define SPU_TRANSFER_PEEK	0
+#define SPU_TRANSFER_WAIT	1
+
+#define SPU_VOICECH(x)		(1L << (x))
+#define SPU_ALLCH			0xffffffL
+
+/* Voice attribute masks */
+#define SPU_VOICE_VOLL			(1L << 0)
+#define SPU_VOICE_VOLR			(1L << 1)
+#define SPU_VOICE_VOLMODEL		(1L << 2)
+#define SPU_VOICE_VOLMODER		(1L << 3)
+#define SPU_VOICE_PITCH			(1L << 4)
+#define SPU_VOICE_NOTE			(1L << 5)
+#define SPU_VOICE_SAMPLE_NOTE	(1L << 6)
+#define SPU_VOICE_WDSA			(1L << 7)
+#define SPU_VOICE_ADSR_AMODE	(1L << 8)
+#define SPU_VOICE_ADSR_SMODE	(1L << 9)
+#define SPU_VOICE_ADSR_RMODE	(1L << 10)
+#define SPU_VOICE_ADSR_AR		(1L << 11)
+#define SPU_VOICE_ADSR_DR		(1L << 12)
+#define SPU_VOICE_ADSR_SR		(1L << 13)
+#define SPU_VOICE_ADSR_RR		(1L << 14)
+#define SPU_VOICE_ADSR_SL		(1L << 15)
+#define SPU_VOICE_LSAX			(1L << 16)
+#define SPU_VOICE_ADSR_ADSR1	(1L << 17)
+#define SPU_VOICE_ADSR_ADSR2	(1L << 18)
+
+/* Envelope modes */
+#define SPU_VOICE_DIRECT		0
+#define SPU_VOICE_LINEARIncN	1
+#define SPU_VOICE_LINEARIncR	2
+#define SPU_VOICE_LINEARDecN	3
+#define SPU_VOICE_LINEARDecR	4
+#define SPU_VOICE_EXPIncN		5
+#define SPU_VOICE_EXPIncR		6
+#define SPU_VOICE_EXPDec		7
+
+/* Common attribute masks */
+#define SPU_COMMON_MVOLL		(1L << 0)
+#define SPU_COMMON_MVOLR		(1L << 1)
+#define SPU_COMMON_CDVOLL		(1L << 6)
+#define SPU_COMMON_CDVOLR		(1L << 7)
+#define SPU_COMMON_CDREV		(1L << 8)
+#define SPU_COMMON_CDMIX		(1L << 9)
+
+#define SPU_OFF		0
+#define SPU_ON		1
+
+typedef struct
+{
+	short left;
+	short right;
+} SpuVolume;
+
+typedef struct
+{
+	u_long voice;
+	u_long mask;
+	SpuVolume volume;
+	SpuVolume volmode;
+	SpuVolume volumex;
+	u_short pitch;
+	u_short note;
+	u_short sample_note;
+	short envx;
+	u_long addr;
+	u_long loop_addr;
+	long a_mode;
+	long s_mode;
+	long r_mode;
+	u_short ar;
+	u_short dr;
+	u_short sr;
+	u_short rr;
+	u_short sl;
+	u_short adsr1;
+	u_short adsr2;
+} SpuVoiceAttr;
+
+typedef struct
+{
+	SpuVolume volume;
+	long reverb;
+	long mix;
+} SpuExtAttr;
+
+typedef struct
+{
+	u_long mask;
+	SpuVolume mvol;
+	SpuVolume mvolmode;
+	SpuVolume mvolx;
+	SpuExtAttr cd;
+	SpuExtAttr ext;
+} SpuCommonAttr;
+
+void SpuInit(void);
+void SpuQuit(void);
+void SpuSetCommonAttr(SpuCommonAttr* attr);
+long SpuSetTransferMode(long mode);
+u_long SpuSetTransferStartAddr(u_long addr);
+u_long SpuWrite(u_char* addr, u_long size);
+long SpuIsTransferCompleted(long flag);
+void SpuSetVoiceAttr(SpuVoiceAttr* attr);
+void SpuSetKey(long on_off, u_long voice_bit);
+
+/* Host only: the sound RAM and the voice registers, for tools checking what the game uploaded and played. */
+#define HOST_SPU_RAM_SIZE	(512 * 1024)
+#define HOST_SPU_VOICES		24
+
+typedef struct
+{
+	u_short volumeLeft, volumeRight;
+	u_short pitch;
+	u_long address;
+	/* Number of key ons and the VSync count of the last one */
+	u_long keyOns;
+	int keyOnVSync;
+	u_char playing;
+} HostSpuVoice;
+
+extern u_char HostSpuRam[HOST_SPU_RAM_SIZE];
+extern HostSpuVoice HostSpuVoices[HOST_SPU_VOICES];
+
+#endif
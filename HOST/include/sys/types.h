@@ -0,0 +1,18 @@
+/*
+ * Host replacement for the PSY-Q <sys/types.h>.
+ *
+ * The game code relies on u_long being 32 bits wide (TIM/TMD parsing, primitive
+ * tags, packet arithmetic), so the host pins it to the console's size while still
+ * pulling in the system header for everything else.
+ */
+
+#ifndef _HOST_SYS_TYPES_H_
+#define _HOST_SYS_TYPES_H_
+
+#define u_long __host_system_u_long
+#include_next <sys/types.h>
+#undef u_long
+
+typedef unsigned int u_long;
+
+#endif
@@ -0,0 +1,316 @@
+/*
+ * Reference counted cache of the files of the main archive and of the TIM images they
+ * put into VRAM. Game states acquire what they need when they start and release it when
+ * they end; whatever is still cached when the next state asks for it costs no CD access.
+ */
+
+#include <sys/types.h>
+#include <libgpu.h>
+#include <libgs.h>
+
+#include "Engine.h"
+#include "Asset.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct
+{
+	/* Entry of the file in the main archive, -1 if the slot is free. */
+	int entry;
+
+	/* Cached contents of the file, 0 if not in RAM. */
+	u_long* data;
+	u_long size;
+	int fileRefs;
+
+	/* Where the TIM image and its CLUT are in VRAM, valid while inVram is set. */
+	GsIMAGE image;
+	RECT pixelArea;
+	RECT clutArea;
+	u_char inVram;
+	int vramRefs;
+
+	/* Value of the use clock when the asset was acquired the last time, for eviction. */
+	u_long lastUse;
+} Asset;
+
+static Asset s_assets[MAX_ASSETS];
+static int s_assetsReady = 0;
+static u_long s_useClock = 0;
+static AssetStats s_stats;
+
+static void InitAssets()
+{
+	int i;
+
+	for (i = 0; i < MAX_ASSETS; ++i)
+	{
+		memset(&s_assets[i], 0, sizeof(Asset));
+		s_assets[i].entry = -1;
+	}
+
+	memset(&s_stats, 0, sizeof(s_stats));
+	s_assetsReady = 1;
+}
+
+/* Returns the slot of an archive entry, taking a new one if the entry is not known yet. */
+static Asset* GetAsset(int entry)
+{
+	Asset* unused = 0;
+	int i;
+
+	if (!s_assetsReady)
+	{
+		InitAssets();
+	}
+
+	for (i = 0; i < MAX_ASSETS; ++i)
+	{
+		if (s_assets[i].entry == entry)
+		{
+			return &s_assets[i];
+		}
+
+		/* Slots which hold nothing any more can be given to another entry */
+		if (unused == 0 && (s_assets[i].entry == -1 || (s_assets[i].data == 0 && !s_assets[i].inVram)))
+		{
+			unused = &s_assets[i];
+		}
+	}
+
+	if (unused == 0)
+	{
+		ErrorMessage("More than %d assets in use!", MAX_ASSETS);
+		return 0;
+	}
+
+	memset(unused, 0, sizeof(Asset));
+	unused->entry = entry;
+	return unused;
+}
+
+static Asset* FindAsset(char* filename)
+{
+	int entry = FindFile(filename);
+	int i;
+
+	for (i = 0; i < MAX_ASSETS && s_assetsReady; ++i)
+	{
+		if (s_assets[i].entry == entry && entry != -1)
+		{
+			return &s_assets[i];
+		}
+	}
+
+	return 0;
+}
+
+u_long* AcquireFile(char* filename, int* size)
+{
+	Asset* asset;
+	int entry = FindFile(filename);
+	int fileSize;
+
+	if (entry == -1)
+	{
+		return 0;
+	}
+
+	asset = GetAsset(entry);
+
+	if (asset->data != 0)
+	{
+		s_stats.fileHits++;
+		if (asset->fileRefs == 0)
+		{
+			s_stats.idleBytes -= asset->size;
+		}
+	}
+	else
+	{
+		asset->data = LoadFile(filename, &fileSize);
+		if (asset->data == 0)
+		{
+			return 0;
+		}
+
+		asset->size = (u_long)fileSize;
+		s_stats.fileMisses++;
+		s_stats.residentBytes += asset->size;
+	}
+
+	asset->fileRefs++;
+	asset->lastUse = ++s_useClock;
+
+	if (size != 0)
+	{
+		*size = (int)asset->size;
+	}
+
+	return asset->data;
+}
+
+void ReleaseFile(u_long* data)
+{
+	int i;
+
+	for (i = 0; i < MAX_ASSETS && data != 0; ++i)
+	{
+		if (s_assets[i].data == data && s_assets[i].fileRefs > 0)
+		{
+			if (--s_assets[i].fileRefs == 0)
+			{
+				s_stats.idleBytes += s_assets[i].size;
+			}
+			return;
+		}
+	}
+}
+
+int AcquireTIM(char* filename, GsIMAGE* image)
+{
+	Asset* asset;
+	u_long* data;
+	int entry = FindFile(filename);
+
+	if (entry == -1)
+	{
+		return 0;
+	}
+
+	asset = GetAsset(entry);
+
+	if (asset->inVram)
+	{
+		s_stats.vramHits++;
+	}
+	else
+	{
+		/* The file is only needed for the upload, unless somebody holds it anyway */
+		data = AcquireFile(filename, 0);
+		if (data == 0)
+		{
+			return 0;
+		}
+
+		asset->image = LoadTIM(data);
+		asset->image.pixel = 0;
+		asset->image.clut = 0;
+
+		setRECT(&asset->pixelArea, asset->image.px, asset->image.py, asset->image.pw, asset->image.ph);
+		if ((asset->image.pmode >> 3) & 1)
+		{
+			setRECT(&asset->clutArea, asset->image.cx, asset->image.cy, asset->image.cw, asset->image.ch);
+		}
+		else
+		{
+			setRECT(&asset->clutArea, 0, 0, 0, 0);
+		}
+
+		asset->inVram = 1;
+		s_stats.vramUploads++;
+
+		ReleaseFile(data);
+		if (asset->fileRefs == 0)
+		{
+			s_stats.residentBytes -= asset->size;
+			s_stats.idleBytes -= asset->size;
+			free(asset->data);
+			asset->data = 0;
+		}
+	}
+
+	asset->vramRefs++;
+	asset->lastUse = ++s_useClock;
+
+	if (image != 0)
+	{
+		*image = asset->image;
+	}
+
+	return 1;
+}
+
+void ReleaseTIM(char* filename)
+{
+	Asset* asset = FindAsset(filename);
+
+	if (asset != 0 && asset->vramRefs > 0)
+	{
+		asset->vramRefs--;
+	}
+}
+
+static int Overlaps(RECT* a, RECT* b)
+{
+	return a->w > 0 && a->h > 0 && b->w > 0 && b->h > 0 &&
+		a->x < b->x + b->w && b->x < a->x + a->w &&
+		a->y < b->y + b->h && b->y < a->y + a->h;
+}
+
+void InvalidateVram(RECT* area)
+{
+	int i;
+
+	for (i = 0; i < MAX_ASSETS && s_assetsReady; ++i)
+	{
+		if (s_assets[i].inVram && (Overlaps(&s_assets[i].pixelArea, area) || Overlaps(&s_assets[i].clutArea, area)))
+		{
+			s_assets[i].inVram = 0;
+			s_stats.vramEvictions++;
+		}
+	}
+}
+
+u_long EvictAssets(u_long bytes)
+{
+	Asset* oldest;
+	u_long freed = 0;
+	int i;
+
+	while (freed < bytes && s_assetsReady)
+	{
+		oldest = 0;
+		for (i = 0; i < MAX_ASSETS; ++i)
+		{
+			if (s_assets[i].data != 0 && s_assets[i].fileRefs == 0 && (oldest == 0 || s_assets[i].lastUse < oldest->lastUse))
+			{
+				oldest = &s_assets[i];
+			}
+		}
+
+		if (oldest == 0)
+		{
+			break;
+		}
+
+		free(oldest->data);
+		oldest->data = 0;
+		freed += oldest->size;
+
+		s_stats.residentBytes -= oldest->size;
+		s_stats.idleBytes -= oldest->size;
+		s_stats.evictions++;
+	}
+
+	return freed;
+}
+
+void* AssetAlloc(u_long size)
+{
+	void* block = malloc(size);
+
+	/* Give up idle files one at a time, the heap may need several to coalesce a large enough block */
+	while (block == 0 && EvictAssets(1) != 0)
+	{
+		block = malloc(size);
+	}
+
+	return block;
+}
+
+AssetStats* GetAssetStats()
+{
+	return &s_stats;
+}
@@ -0,0 +1,61 @@
+
+#ifndef _ASSET_H_
+#define _ASSET_H_
+
+#include <sys/types.h>
+#include <libgpu.h>
+#include <libgs.h>
+
+/*
+ * Asset cache for the files of the main archive, keyed by their archive entry.
+ *
+ * Files and TIM uploads are reference counted. Releasing the last reference keeps the
+ * file in RAM and the TIM in VRAM, so the next game state which asks for the same asset
+ * gets it without reading the CD again. Idle files are only freed when memory runs out
+ * (see AssetAlloc), idle TIMs only when something else is uploaded over them.
+ */
+
+/* Number of different assets the cache keeps track of. */
+#define MAX_ASSETS 32
+
+typedef struct
+{
+	/* AcquireFile calls served from RAM and calls which had to read the CD. */
+	u_long fileHits;
+	u_long fileMisses;
+	/* AcquireTIM calls which found the image in VRAM and calls which had to upload it. */
+	u_long vramHits;
+	u_long vramUploads;
+	/* Idle files freed to make room and idle TIMs overwritten in VRAM. */
+	u_long evictions;
+	u_long vramEvictions;
+	/* Bytes of files in RAM, and the part of it nobody holds a reference to. */
+	u_long residentBytes;
+	u_long idleBytes;
+} AssetStats;
+
+/* Returns the contents of a file of the main archive and takes a reference to it, 0 if it doesn't exist. */
+u_long* AcquireFile(char* filename, int* size);
+/* Gives up a reference taken by AcquireFile. The file stays cached. */
+void ReleaseFile(u_long* data);
+
+/*
+ * Makes sure the TIM file is in VRAM and takes a reference to it. Fills image with the
+ * position and format of the image, the pixel and clut pointers are 0. Returns 0 if
+ * the file doesn't exist.
+ */
+int AcquireTIM(char* filename, GsIMAGE* image);
+/* Gives up a reference taken by AcquireTIM. The image stays in VRAM until something is uploaded over it. */
+void ReleaseTIM(char* filename);
+
+/* Tells the cache that the given VRAM area was overwritten. Called for every image upload. */
+void InvalidateVram(RECT* area);
+
+/* malloc which frees idle cached files, least recently used first, until the block fits. */
+void* AssetAlloc(u_long size);
+/* Frees idle cached files until at least the given number of bytes is freed. Returns the bytes freed. */
+u_long EvictAssets(u_long bytes);
+
+AssetStats* GetAssetStats();
+
+#endif
@@ -0,0 +1,255 @@
+/*
+ * Autopilot, see Autopilot.h. It only looks at the balls and the paddle and answers with a
+ * controller packet, so it plays by the same rules and latency as a player does.
+ */
+
+#include <sys/types.h>
+#include <libgte.h>
+
+#include <string.h>
+
+#include "Autopilot.h"
+
+/* Walls the balls bounce off (see MoveBalls), in world units. */
+#define FIELD_HALF_WIDTH	300
+#define FIELD_BACK			150
+
+/* Paddle speed at full deflection (see MovePaddle), in world units per PAL frame. */
+#define PADDLE_SPEED		10
+
+/* Farthest the paddle center gets from the middle of the field (see MovePaddle), in world units. */
+#define PADDLE_LIMIT		(FIELD_HALF_WIDTH - 32)
+
+/* Distance from the paddle center which still hits a ball, minus some room for rounding. */
+#define PADDLE_REACH		40
+
+/* Frames before the paddle meets a ball in which it swings over to the side of aim. */
+#define SWING_FRAMES		2
+
+/* Sideways speed (ONE-scaled, per PAL frame) above which the paddle slows a ball down. */
+#define FAST_SIDEWAYS		FIXED(5)
+
+/* Frames a grabbed ball is held at most before it is fired. */
+#define MAX_SERVE_DELAY		60
+
+/* The game has its own random numbers, the autopilot must not change them. */
+static long Random(Autopilot* pilot, long range)
+{
+	pilot->random = pilot->random * 1103515245 + 12345;
+	return (long)((pilot->random >> 16) & 0x7fff) % range;
+}
+
+void InitAutopilot(Autopilot* pilot, u_long seed)
+{
+	pilot->random = seed;
+	pilot->aim = 0;
+	pilot->serveX = 0;
+	pilot->serveDelay = 0;
+	pilot->lastFrames = -1;
+	pilot->player = 0;
+}
+
+/*
+ * Folds a position on the unbounded line back into the field, like the side walls do. Returns
+ * -1 if the ball bounced off the walls an odd number of times on the way, 1 otherwise.
+ */
+static int FoldIntoField(long* x)
+{
+	long u = (*x + FIELD_HALF_WIDTH) % (4 * FIELD_HALF_WIDTH);
+
+	if (u < 0)
+	{
+		u += 4 * FIELD_HALF_WIDTH;
+	}
+
+	if (u > 2 * FIELD_HALF_WIDTH)
+	{
+		*x = 3 * FIELD_HALF_WIDTH - u;
+		return -1;
+	}
+
+	*x = u - FIELD_HALF_WIDTH;
+	return 1;
+}
+
+long PredictIntercept(FixedVector* pos, FixedVector* vel, Fixed lineZ, Fixed* x, Fixed* vx)
+{
+	Fixed distance, speed;
+	long travel;
+
+	/* Distance along z until the paddle line, over the back wall if the ball moves away */
+	if (FixedCompare(vel->vz, FIXED(0)) < 0)
+	{
+		distance = FixedSub(pos->vz, lineZ);
+		speed = FixedNeg(vel->vz);
+	}
+	else if (FixedCompare(vel->vz, FIXED(0)) > 0)
+	{
+		distance = FixedAdd(FixedSub(FIXED(FIELD_BACK), pos->vz), FixedSub(FIXED(FIELD_BACK), lineZ));
+		speed = vel->vz;
+	}
+	else
+	{
+		return -1;
+	}
+
+	/* Already past the paddle */
+	if (FixedCompare(distance, FIXED(0)) < 0)
+	{
+		return -1;
+	}
+
+	/* Sideways travel until then, in world units, the ONE-scaled product would overflow */
+	travel = FixedRatio(FixedScale(vel->vx, FixedToInt(distance)), speed);
+
+	travel += FixedRatio(pos->vx, FIXED(1));
+	*vx = FixedScale(vel->vx, FoldIntoField(&travel));
+	*x = FixedFromInt(travel);
+	return FixedRatio(distance, speed);
+}
+
+/* Fills packet like a DualShock with the given buttons held and the left stick moved for the given paddle speed. */
+static void WritePacket(ControllerPacket* packet, PadData buttons, long speed)
+{
+	int deflection = 0;
+
+	if (speed > PADDLE_SPEED)
+	{
+		speed = PADDLE_SPEED;
+	}
+	if (speed < -PADDLE_SPEED)
+	{
+		speed = -PADDLE_SPEED;
+	}
+
+	/* Past the deadzone, the stick position maps linearly to the paddle speed */
+	if (speed != 0)
+	{
+		deflection = INPUT_DEADZONE + (int)((speed < 0 ? -speed : speed) * (127 - INPUT_DEADZONE) / PADDLE_SPEED);
+		deflection = speed < 0 ? -deflection : deflection;
+	}
+
+	memset(packet, 0xff, sizeof(ControllerPacket));
+	packet->status = PAD_STATUS_OK;
+	packet->data_format = (CONTROLLER_TYPE_DUALSHOCK << 4) | 3;
+	packet->data.analog.digital_buttons = (u_short)~buttons;
+	packet->data.analog.left_x = (u_char)(128 + deflection);
+	packet->data.analog.left_y = 128;
+	packet->data.analog.right_x = 128;
+	packet->data.analog.right_y = 128;
+}
+
+/* Paddle speed which brings the paddle from x to target without overshooting, both in world units. */
+static long SpeedTowards(long x, long target)
+{
+	/* Half the distance per frame, the packet only takes effect a frame later */
+	return (target - x) / 2;
+}
+
+void UpdateAutopilot(Autopilot* pilot, Ball* balls, FixedVector* paddle, ControllerPacket* packet)
+{
+	long frames, best = -1;
+	long target = 0, wait, aim;
+	Fixed x, vx, targetVx = FIXED(0);
+	/* Whole units rounded towards zero, which is what the aim was tuned with */
+	long paddleX = FixedRatio(paddle->vx, FIXED(1));
+	int i, grabbed = 0;
+
+	for (i = 0; i < MAX_BALLS; ++i)
+	{
+		if (!balls[i].enabled)
+		{
+			continue;
+		}
+
+		/* Balls held by the paddle of another player are theirs to fire */
+		if (balls[i].grabbed)
+		{
+			grabbed |= balls[i].owner == pilot->player;
+			continue;
+		}
+
+		frames = PredictIntercept(&balls[i].pos, &balls[i].vel, paddle->vz, &x, &vx);
+		if (frames >= 0 && (best < 0 || frames < best))
+		{
+			best = frames;
+			target = FixedToIntExact(x);
+			targetVx = vx;
+
+			/* A ball on its way up will likely hit a block, the paddle stays below it until then */
+			if (FixedCompare(balls[i].vel.vz, FIXED(0)) > 0)
+			{
+				target = FixedRatio(balls[i].pos.vx, FIXED(1));
+			}
+		}
+	}
+
+	if (best >= 0)
+	{
+		/* A new ball to meet, or the same one coming back: meet it from another side this time */
+		if (pilot->lastFrames < 0 || best > pilot->lastFrames)
+		{
+			pilot->aim = (short)(Random(pilot, PADDLE_REACH + 1) - PADDLE_REACH / 2);
+		}
+		pilot->lastFrames = best;
+
+		/* Every hit adds to the sideways speed, a fast ball is slowed down by swinging along with it */
+		aim = pilot->aim;
+		if (FixedCompare(FixedAbs(targetVx), FAST_SIDEWAYS) > 0)
+		{
+			aim = aim < 0 ? -aim : aim;
+			aim = FixedCompare(targetVx, FIXED(0)) < 0 ? -aim : aim;
+		}
+
+		/* Next to a wall, the paddle waits as far out as it gets */
+		wait = target - aim;
+		if (wait > PADDLE_LIMIT)
+		{
+			wait = PADDLE_LIMIT;
+		}
+		if (wait < -PADDLE_LIMIT)
+		{
+			wait = -PADDLE_LIMIT;
+		}
+
+		/*
+		 * A hit only changes the direction of a ball by a third of the paddle speed, so a
+		 * paddle standing still would send a straight ball back the same way forever. It
+		 * waits on the far side and swings through right when the ball arrives.
+		 */
+		if (best <= SWING_FRAMES)
+		{
+			WritePacket(packet, 0, target < wait ? -PADDLE_SPEED : PADDLE_SPEED);
+		}
+		else
+		{
+			WritePacket(packet, 0, SpeedTowards(paddleX, wait));
+		}
+		return;
+	}
+
+	pilot->lastFrames = -1;
+
+	if (!grabbed)
+	{
+		WritePacket(packet, 0, 0);
+		return;
+	}
+
+	/* Serve from a random place, moving, so the ball flies off at an angle */
+	if (pilot->serveDelay <= 0)
+	{
+		pilot->serveDelay = (short)(MAX_SERVE_DELAY / 2 + Random(pilot, MAX_SERVE_DELAY / 2));
+		pilot->serveX = (short)(Random(pilot, 2 * (FIELD_HALF_WIDTH - 64) + 1) - (FIELD_HALF_WIDTH - 64));
+	}
+
+	pilot->serveDelay--;
+	if (pilot->serveDelay > 0)
+	{
+		WritePacket(packet, 0, SpeedTowards(paddleX, pilot->serveX));
+	}
+	else
+	{
+		WritePacket(packet, PAD_Cross, paddleX < 0 ? PADDLE_SPEED / 2 : -PADDLE_SPEED / 2);
+	}
+}
@@ -0,0 +1,53 @@
+
+#ifndef _AUTOPILOT_H_
+#define _AUTOPILOT_H_
+
+#include <sys/types.h>
+#include <libgte.h>
+
+#include "Control.h"
+#include "Ball.h"
+
+/*
+ * Computer player for the attract mode and for unattended runs of the game.
+ *
+ * The autopilot plays through the controller: every frame it writes the packet a DualShock
+ * would deliver, so the paddle is moved by MovePaddle and balls are fired by the cross button
+ * like for a human player. Where a ball meets the paddle is computed from its position and
+ * velocity, with the reflections off the side walls, so the cost per ball is the same no
+ * matter how far away it is.
+ */
+
+typedef struct
+{
+	u_long random;
+	/* Side the paddle comes from when it meets the next ball, in world units. */
+	short aim;
+	/* Position the paddle moves to before it fires a grabbed ball, in world units. */
+	short serveX;
+	/* Frames left until a grabbed ball is fired. */
+	short serveDelay;
+	/* Frames until the ball followed in the last frame reaches the paddle line, -1 for none. */
+	long lastFrames;
+	/* Player whose grabbed balls it fires, 0 unless set after InitAutopilot. */
+	u_char player;
+} Autopilot;
+
+/* Prepares the autopilot for player 0. Two autopilots with the same seed play the same way. */
+void InitAutopilot(Autopilot* pilot, u_long seed);
+
+/*
+ * Predicts where a free ball crosses the paddle line at lineZ. x and vx receive its position
+ * and sideways velocity there (ONE-scaled), the result is the number of PAL frames until
+ * then. Balls moving away are followed over the back wall. Returns -1 if the ball never gets
+ * there.
+ */
+long PredictIntercept(FixedVector* pos, FixedVector* vel, Fixed lineZ, Fixed* x, Fixed* vx);
+
+/*
+ * Writes the controller packet of the next frame into packet, which moves the paddle at
+ * paddle (ONE-scaled) towards the ball which arrives first and fires grabbed balls.
+ */
+void UpdateAutopilot(Autopilot* pilot, Ball* balls, FixedVector* paddle, ControllerPacket* packet);
+
+#endif
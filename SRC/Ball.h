@@ -2,6 +2,7 @@
 #ifndef _BALL_H_
 #define _BALL_H_
 
+#include "Fixed.h"
 
 /* The maximum amount of balls that can be active in the game at the same time. */
 #define MAX_BALLS 8
@@ -13,11 +14,15 @@ typedef struct {
 	/* If set to 1, the ball is currently grabbed by the paddle. */
 	u_char grabbed;
 	/* The absolute position of the ball if it isn't grabbed. */
-	VECTOR pos;
+	FixedVector pos;
 	/* The position relative to the paddle position if the ball is grabbed. */
-	VECTOR grabbedPos;
+	FixedVector grabbedPos;
 	/* The ball's velocity. */
-	VECTOR vel;
+	FixedVector vel;
+	/* The player who served the ball, losing it costs them a try. */
+	u_char owner;
+	/* The player whose paddle hit the ball last, the blocks it hits score for them. */
+	u_char hitBy;
 	
 	u_char renderId;
 } Ball;
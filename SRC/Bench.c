@@ -0,0 +1,358 @@
+/*
+ * Benchmark game state. Runs a fixed set of scripted scenes of the game for a fixed
+ * number of frames each and reports the frame time percentiles, so two builds of the
+ * engine can be compared on the same scenes. The host build runs the same scenarios
+ * (render -b), with frame times taken from the processor time of the host process over
+ * several runs.
+ */
+
+#include <sys/types.h>
+#include <libetc.h>
+#include <libgte.h>
+#include <libgpu.h>
+#include <libgs.h>
+
+#include <stdio.h>
+
+#include "Engine.h"
+#include "Breakout.h"
+#include "Ball.h"
+#include "Game.h"
+#include "Bench.h"
+
+/* Lines of text of the heavy HUD scenario. */
+#define HUD_LINES 14
+
+typedef struct
+{
+	char* name;
+	int blocks;
+	int balls;
+	/* Draws HUD_LINES lines of text over the scene. */
+	u_char hud;
+	/* Moves the camera around the field instead of following the paddle. */
+	u_char sweep;
+	/* Players, each with a view of the split screen. */
+	int players;
+	/* Scenario with the same scene in one view, which the cost of the views is compared to, or -1. */
+	int single;
+} BenchScenario;
+
+static const BenchScenario s_scenarios[BENCH_SCENARIOS] =
+{
+	{ "Blocks", MAX_BLOCKS, 0, 0, 0, 1, -1 },
+	{ "Balls", MAX_BLOCKS, MAX_BALLS, 0, 0, 1, -1 },
+	{ "HUD", MAX_BLOCKS, 0, 1, 0, 1, -1 },
+	{ "Sweep", MAX_BLOCKS, MAX_BALLS, 0, 1, 1, -1 },
+	{ "Split", MAX_BLOCKS, MAX_BALLS, 0, 0, MAX_PLAYERS, 1 },
+};
+
+static BenchResult s_results[BENCH_SCENARIOS];
+static int s_finished = 0;
+
+/* Fastest time of every frame over the runs so far, and the times of the current run. */
+static u_long s_frameTimes[BENCH_FRAMES];
+static u_long s_runTimes[BENCH_FRAMES];
+
+static u_long s_primBudget = BENCH_PRIM_BUDGET;
+static u_long s_packetBudget = BENCH_PACKET_BUDGET;
+static int s_runs = BENCH_RUNS;
+
+void SetBenchBudget(u_long prims, u_long packetBytes)
+{
+	s_primBudget = prims;
+	s_packetBudget = packetBytes;
+}
+
+void SetBenchRuns(int runs)
+{
+	s_runs = runs > 0 ? runs : 1;
+}
+
+BenchResult* GetBenchResults(int* count)
+{
+	if (count != 0)
+	{
+		*count = s_finished;
+	}
+
+	return s_results;
+}
+
+/* Insertion sort of the frame times of a scenario, once per run. */
+static void SortTimes(u_long* times)
+{
+	u_long value;
+	int i, j;
+
+	for (i = 1; i < BENCH_FRAMES; ++i)
+	{
+		value = times[i];
+		for (j = i; j > 0 && times[j - 1] > value; --j)
+		{
+			times[j] = times[j - 1];
+		}
+		times[j] = value;
+	}
+}
+
+/* Nearest rank percentile of the sorted frame times. */
+static u_long Percentile(u_long* times, int percent)
+{
+	int rank = (percent * BENCH_FRAMES + 99) / 100;
+
+	return times[rank > 0 ? rank - 1 : 0];
+}
+
+static void DrawHud(u_long frame)
+{
+	char buffer[48];
+	int i;
+
+	for (i = 0; i < HUD_LINES; ++i)
+	{
+		sprintf(buffer, "Line %02d Frame %05lu Score %08lu", i, (unsigned long)frame, (unsigned long)(frame * 37 + i * 1000));
+		DrawTextColored(buffer, -152, -116 + i * 16, 128, 128 - i * 4, 64 + i * 4);
+	}
+}
+
+/*
+ * Plays one run of a scenario, with the frame times going to s_runTimes. Returns the vertical
+ * blanks it missed, shared and views receive the time the scene took over all frames.
+ */
+static u_long RunFrames(const BenchScenario* scenario, BenchResult* result, u_long* shared, u_long* views)
+{
+	u_long fieldLines = GetVideoMode() == MODE_PAL ? PAL_FIELD_LINES : NTSC_FIELD_LINES;
+	u_long frameTime, missed, dropped = 0;
+	VECTOR eye, target;
+	int frame, angle;
+
+	SetupGameScene(scenario->blocks, scenario->balls, scenario->players);
+	*shared = 0;
+	*views = 0;
+
+	for (frame = -BENCH_WARMUP_FRAMES; frame < BENCH_FRAMES; ++frame)
+	{
+		BeginFrame();
+
+		StepGameScene();
+
+		if (scenario->hud)
+		{
+			DrawHud((u_long)(frame + BENCH_WARMUP_FRAMES));
+		}
+
+		if (scenario->sweep)
+		{
+			/* Half a turn around the field, from the left side over the back to the right side */
+			angle = -1024 + (frame + BENCH_WARMUP_FRAMES) * 2048 / (BENCH_FRAMES + BENCH_WARMUP_FRAMES);
+			setVector(&eye, rsin(angle) * 450 / ONE, -300, -rcos(angle) * 450 / ONE);
+			setVector(&target, 0, 0, 0);
+			DrawGameScene(&eye, &target);
+		}
+		else
+		{
+			DrawGameScene(0, 0);
+		}
+
+		EndFrame();
+
+		if (frame < 0)
+		{
+			continue;
+		}
+
+		/* The host never waits for a vertical blank, so overruns are counted from the frame time as well */
+		frameTime = GetFrameTime();
+		missed = frameTime / fieldLines;
+		if (GetFrameVBlanks() > missed + 1)
+		{
+			missed = GetFrameVBlanks() - 1;
+		}
+
+		s_runTimes[frame] = frameTime;
+		dropped += missed;
+		*shared += GetSceneCost()->shared;
+		*views += GetSceneCost()->views;
+
+		if (GetDrawStats()->prims > result->prims)
+		{
+			result->prims = GetDrawStats()->prims;
+		}
+		if (GetDrawStats()->packetBytes > result->packetBytes)
+		{
+			result->packetBytes = GetDrawStats()->packetBytes;
+		}
+	}
+
+	return dropped;
+}
+
+static void RunScenario(const BenchScenario* scenario, BenchResult* result)
+{
+	const BenchResult* single;
+	u_long dropped, p50, shared, views;
+	int run, frame;
+
+	result->name = scenario->name;
+	result->frames = BENCH_FRAMES;
+	result->prims = 0;
+	result->packetBytes = 0;
+
+	for (run = 0; run < s_runs; ++run)
+	{
+		dropped = RunFrames(scenario, result, &shared, &views);
+
+		for (frame = 0; frame < BENCH_FRAMES; ++frame)
+		{
+			if (run == 0 || s_runTimes[frame] < s_frameTimes[frame])
+			{
+				s_frameTimes[frame] = s_runTimes[frame];
+			}
+		}
+
+		SortTimes(s_runTimes);
+		p50 = Percentile(s_runTimes, 50);
+
+		if (run == 0 || p50 < result->p50Low)
+		{
+			result->p50Low = p50;
+		}
+		if (run == 0 || p50 > result->p50High)
+		{
+			result->p50High = p50;
+		}
+		if (run == 0 || dropped < result->dropped)
+		{
+			result->dropped = dropped;
+		}
+		if (run == 0 || shared * 100 / BENCH_FRAMES < result->sharedCost)
+		{
+			result->sharedCost = shared * 100 / BENCH_FRAMES;
+		}
+		if (run == 0 || views * 100 / BENCH_FRAMES < result->viewsCost)
+		{
+			result->viewsCost = views * 100 / BENCH_FRAMES;
+		}
+	}
+
+	SortTimes(s_frameTimes);
+	result->p50 = Percentile(s_frameTimes, 50);
+	result->p95 = Percentile(s_frameTimes, 95);
+	result->p99 = Percentile(s_frameTimes, 99);
+	result->worst = s_frameTimes[BENCH_FRAMES - 1];
+	result->overBudget = result->prims > s_primBudget || result->packetBytes > s_packetBudget;
+
+	/* Everything shared between the views makes them cheaper than the same number of frames with one view */
+	result->viewCost = 0;
+	single = scenario->single >= 0 ? &s_results[scenario->single] : 0;
+	if (single != 0 && single->p50 > 0)
+	{
+		result->viewCost = result->p50 * 100 / (single->p50 * scenario->players);
+	}
+
+	printf("bench %s frames %lu runs %d p50 %lu (runs %lu-%lu) p95 %lu p99 %lu worst %lu lines dropped %lu prims %lu bytes %lu%s\n",
+		result->name, (unsigned long)result->frames, s_runs, (unsigned long)result->p50, (unsigned long)result->p50Low,
+		(unsigned long)result->p50High, (unsigned long)result->p95, (unsigned long)result->p99, (unsigned long)result->worst,
+		(unsigned long)result->dropped, (unsigned long)result->prims, (unsigned long)result->packetBytes,
+		result->overBudget ? " over budget" : "");
+
+	printf("bench %s scene lines per frame shared %lu.%02lu views %d each %lu.%02lu\n", result->name,
+		(unsigned long)(result->sharedCost / 100), (unsigned long)(result->sharedCost % 100), scenario->players,
+		(unsigned long)(result->viewsCost / scenario->players / 100), (unsigned long)(result->viewsCost / scenario->players % 100));
+
+	if (result->viewCost != 0)
+	{
+		printf("bench %s views %d cost %lu%% of %s per view\n", result->name, scenario->players,
+			(unsigned long)result->viewCost, single->name);
+	}
+}
+
+/* Prints horizontal blanks as milliseconds with one decimal. */
+static void FormatTime(char* buffer, u_long lines)
+{
+	/* 64 us per line on PAL, 63.6 us on NTSC */
+	u_long tenths = GetVideoMode() == MODE_PAL ? lines * 64 / 100 : lines * 636 / 1000;
+
+	sprintf(buffer, "%lu.%lu", (unsigned long)(tenths / 10), (unsigned long)(tenths % 10));
+}
+
+int HandleGsBench()
+{
+	char buffer[48];
+	InputState* input;
+	int i;
+
+	s_finished = 0;
+
+	/* The budget check needs the primitives of every frame */
+	SetPrimCounting(1);
+	BeginGameScene();
+
+	for (i = 0; i < BENCH_SCENARIOS; ++i)
+	{
+		RunScenario(&s_scenarios[i], &s_results[i]);
+		s_finished++;
+	}
+
+	EndGameScene();
+	SetPrimCounting(0);
+
+	SetDispMask(1);
+
+	while(1)
+	{
+		BeginFrame();
+
+		UpdateInput();
+		input = GetInput(0);
+
+		DrawText("Benchmark results (ms)", 72, 40);
+		/* The font is proportional, so every column has its own position */
+		DrawText("Scene", 32, 72);
+		DrawText("p50", 112, 72);
+		DrawText("p95", 160, 72);
+		DrawText("p99", 208, 72);
+		DrawText("drop", 256, 72);
+
+		for (i = 0; i < BENCH_SCENARIOS; ++i)
+		{
+			/* Scenes over the primitive or packet budget are marked red */
+			if (s_results[i].overBudget)
+			{
+				DrawTextColored(s_results[i].name, 32, 96 + i * 16, 160, 32, 32);
+			}
+			else
+			{
+				DrawText(s_results[i].name, 32, 96 + i * 16);
+			}
+
+			FormatTime(buffer, s_results[i].p50);
+			DrawText(buffer, 112, 96 + i * 16);
+			FormatTime(buffer, s_results[i].p95);
+			DrawText(buffer, 160, 96 + i * 16);
+			FormatTime(buffer, s_results[i].p99);
+			DrawText(buffer, 208, 96 + i * 16);
+
+			sprintf(buffer, "%lu", (unsigned long)s_results[i].dropped);
+			DrawText(buffer, 256, 96 + i * 16);
+
+			if (s_results[i].viewCost != 0)
+			{
+				sprintf(buffer, "%s: %lu%% per view", s_results[i].name, (unsigned long)s_results[i].viewCost);
+				DrawText(buffer, 32, 184);
+			}
+		}
+
+		DrawTextColored("Press X to return", 92, 208, 96, 96, 96);
+
+		EndFrame();
+
+		if (IsInputPressed(input, PAD_Cross) || IsInputPressed(input, PAD_Start))
+		{
+			break;
+		}
+	}
+
+	return GS_TITLE;
+}
@@ -0,0 +1,66 @@
+
+#ifndef _BENCH_H_
+#define _BENCH_H_
+
+#include <sys/types.h>
+
+/* Number of scenarios one benchmark run goes through. */
+#define BENCH_SCENARIOS 5
+
+/* Frames measured per scenario, after a few frames to settle. */
+#define BENCH_FRAMES		300
+#define BENCH_WARMUP_FRAMES	10
+
+/* Runs of every scenario by default. */
+#define BENCH_RUNS			1
+
+/* Default budgets of one frame, a scenario which goes over one of them fails. */
+#define BENCH_PRIM_BUDGET	3000
+#define BENCH_PACKET_BUDGET	(96 * 1024)
+
+typedef struct
+{
+	char* name;
+	u_long frames;
+	/* Frame times in horizontal blanks (see GetFrameTime), each frame the fastest of all runs. */
+	u_long p50, p95, p99, worst;
+	/* Lowest and highest p50 of the single runs, how far apart they are tells the noise. */
+	u_long p50Low, p50High;
+	/* Vertical blanks missed because a frame took longer than a field, in the run which missed the fewest. */
+	u_long dropped;
+	/* Most primitives and packet bytes of one frame (see DrawStats). */
+	u_long prims, packetBytes;
+	/* Set if prims or packetBytes went over the budget. */
+	u_char overBudget;
+	/*
+	 * Horizontal blanks the scene took per frame in hundredths, for what all views share and
+	 * for the views (see SceneCost), each the lowest of all runs.
+	 */
+	u_long sharedCost, viewsCost;
+	/*
+	 * For a scene drawn in several views, p50 in percent of the p50 of the same scene drawn
+	 * once per view, 0 for scenes with one view.
+	 */
+	u_long viewCost;
+} BenchResult;
+
+/*
+ * Handles the GS_BENCH gamestate: runs every scenario for BENCH_FRAMES frames, prints the
+ * results (printf) and shows them until a button is pressed.
+ */
+int HandleGsBench();
+
+/* Sets the primitive and packet byte budgets the next runs are checked against. */
+void SetBenchBudget(u_long prims, u_long packetBytes);
+
+/*
+ * Sets how often every scenario is run, BENCH_RUNS by default. Each run starts the scene
+ * anew with its warm-up frames, and every frame keeps the fastest time of all runs, so
+ * times which vary between runs (like on the host) can still be compared.
+ */
+void SetBenchRuns(int runs);
+
+/* Returns the results of the current or last run. count receives the number of finished scenarios. */
+BenchResult* GetBenchResults(int* count);
+
+#endif
@@ -4,22 +4,18 @@
 
 #include "Control.h"
 
-/* Display mode enum values*/
+/* Display mode enum values, AUTO follows the region of the console */
 #define PAL MODE_PAL
 #define NTSC MODE_NTSC
+#define AUTO MODE_AUTO
 
 
-/* The current display mode to use */
-#define DISPLAY_MODE PAL
+/* The display mode to use */
+#define DISPLAY_MODE AUTO
 
 
-/* SCREEN_WIDTH and SCREEN_HEIGHT macros for the given display mode. */
-#define SCREEN_WIDTH 320
-#if DISPLAY_MODE == PAL
-#	define SCREEN_HEIGHT 256
-#else
-#	define SCREEN_HEIGHT 240
-#endif
+/* Set to 1 to draw engine statistics (frame rate, culled objects, ...) on top of the game. */
+#define SHOW_STATS 0
 
 
 /* Enumerates available game states. */
@@ -29,7 +25,19 @@ enum GameStates
 	GS_TITLE,
 
 	/* This  */
-	GS_GAME
+	GS_GAME,
+
+	/* Benchmark scenes, reached from the title menu */
+	GS_BENCH,
+
+	/* The game played by the autopilot, from the title menu or when nobody touches the pad there */
+	GS_DEMO,
+
+	/* Two players on a split screen */
+	GS_VERSUS,
+
+	/* The intro movie, played once when the game starts */
+	GS_INTRO
 };
 
 ControllerPacket* GetControllerPacket(int port);
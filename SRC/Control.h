@@ -202,4 +202,49 @@ typedef struct
 /* Returns the start address of the controller packet. */
 #define GetControllerDataAddress(packet)	(&((packet)->data_format) + 1)
 
+
+/******************************************************/
+/* Latched input state */
+
+#define INPUT_AXIS_ONE		4096	/* Value of a fully deflected, normalised analog axis. */
+#define INPUT_DEADZONE		24		/* Raw distance from the stick center which still reads as 0. */
+
+/*
+ * Input of one controller port. The packets are latched in the vertical blank, edges are
+ * collected across all vertical blanks since the previous UpdateInput call, so a short tap
+ * is never lost when a frame takes longer than one vertical blank.
+ * Button bits use the PAD_ values, but are set while a button is down.
+ */
+typedef struct
+{
+	unsigned char valid;		/* Controller connected and the last transmission was fine. */
+	unsigned char type;			/* CONTROLLER_TYPE_ value of the controller. */
+	PadData held;				/* Buttons which are down. */
+	PadData pressed;			/* Buttons which went down since the previous UpdateInput. */
+	PadData released;			/* Buttons which went up since the previous UpdateInput. */
+	short leftX, leftY;			/* Analog sticks in [-INPUT_AXIS_ONE, INPUT_AXIS_ONE], right and down */
+	short rightX, rightY;		/* are positive. 0 inside the deadzone or without analog sticks. */
+	long latchVSync;			/* VSync(-1) count when the state was latched. */
+} InputState;
+
+/* Determines if the given button is down. */
+#define IsInputHeld(input, button)		((input)->held & (button))
+/* Determines if the given button went down since the previous UpdateInput call. */
+#define IsInputPressed(input, button)	((input)->pressed & (button))
+/* Determines if the given button went up since the previous UpdateInput call. */
+#define IsInputReleased(input, button)	((input)->released & (button))
+
+/* Starts latching the controller ports in the vertical blank. */
+void InitInput();
+/* Stops reading the controllers. */
+void TerminateInput();
+/* Latches the given packet for a port instead of the one of its controller, 0 switches back to the controller. */
+void SetInputSource(int port, ControllerPacket* packet);
+/* Takes over the input latched in the last vertical blank. Call once per frame, right before the simulation. */
+void UpdateInput();
+/* Returns the input of the given port (0 or 1) as of the last UpdateInput call. */
+InputState* GetInput(int port);
+/* Returns the number of vertical blanks between the last measured button press and the first frame showing its effect. */
+int GetInputLatency();
+
 #endif
@@ -7,10 +7,14 @@
 #include <libcd.h>
 
 #include "Engine.h"
+#include "Asset.h"
+#include "Music.h"
+#include "Sound.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
+#include <string.h>
 
 typedef struct
 {
@@ -19,163 +23,14 @@ typedef struct
 	unsigned char blue;
 } Color;
 
-/* Determines whether a character has a glyph for the given font. */
-#define CHAR_VALID(c) (CharIndex[c] != 255)
-/* Gets a character's X coordinate for the given font. */
-#define CHAR_X(c) CharData[(int)CharIndex[c] * 7]
-/* Gets a character's Y coordinate for the given font. */
-#define CHAR_Y(c) CharData[(int)CharIndex[c] * 7 + 1]
-/* Gets a character's width for the given font. */
-#define CHAR_W(c) CharData[(int)CharIndex[c] * 7 + 2]
-/* Gets a character's height for the given font. */
-#define CHAR_H(c) CharData[(int)CharIndex[c] * 7 + 3]
-/* Gets a character's x offset for the given font. */
-#define CHAR_XOFF(c) CharData[(int)CharIndex[c] * 7 + 4]
-/* Gets a character's y offset for the given font. */
-#define CHAR_YOFF(c) CharData[(int)CharIndex[c] * 7 + 5]
-/* Gets a character's x advance value for the given font. */
-#define CHAR_ADV(c) CharData[(int)CharIndex[c] * 7 + 6]
-
-/* 
- * Contains data for font glyphs in VRAM. Each row contains the following 7 columns in order:
- * 
- *   X: X coordinate of the glyph in it's tpage
- *   Y: Y coordinate of the glyph in it's tpage
- *   W: Width of the glyph in pixels
- *   H: Height of the glyph in pixels
- *   XOffset: Offset applied to the cursor position on the x axis when rendering that glyph
- *   YOffset: Offset applied to the cursor position on the y axis when rendering that glyph
- *   XAdvance: Amount of pixels that the cursor is moved when rendering that glyph
- */
-short CharData[] = {
-	0, 0, 0, 0, 0, 0, 3, 
-	63, 75, 6, 13, -1, -2, 3, 
-	34, 89, 8, 9, -2, -2, 4, 
-	39, 32, 14, 14, -2, -2, 11, 
-	43, 89, 6, 9, -2, -2, 2, 
-	8, 0, 8, 16, -2, -2, 4, 
-	17, 0, 8, 16, -2, -2, 4, 
-	101, 102, 9, 9, -2, -2, 5, 
-	89, 102, 11, 10, -2, 0, 7, 
-	62, 89, 6, 8, -1, 5, 3, 
-	69, 89, 8, 6, -2, 3, 4, 
-	78, 89, 6, 6, -1, 5, 3, 
-	43, 0, 10, 14, -2, -2, 7, 
-	54, 32, 8, 13, -1, -2, 7, 
-	63, 32, 10, 13, -2, -2, 7, 
-	54, 0, 10, 14, -2, -2, 7, 
-	74, 32, 10, 13, -2, -2, 7, 
-	65, 0, 11, 14, -2, -2, 7, 
-	77, 0, 10, 14, -2, -2, 7, 
-	85, 32, 11, 13, -2, -2, 7, 
-	88, 0, 11, 14, -2, -2, 7, 
-	0, 17, 11, 14, -2, -2, 7, 
-	82, 102, 6, 11, -1, 0, 3, 
-	70, 75, 6, 13, -1, 0, 3, 
-	50, 89, 11, 8, -2, 1, 7, 
-	103, 61, 10, 13, -2, -2, 7, 
-	59, 47, 12, 13, -2, -2, 7, 
-	72, 47, 11, 13, -1, -2, 8, 
-	100, 0, 13, 14, -2, -2, 9, 
-	84, 47, 11, 13, -1, -2, 9, 
-	96, 47, 11, 13, -1, -2, 8, 
-	0, 61, 10, 13, -1, -2, 7, 
-	68, 17, 13, 14, -2, -2, 9, 
-	11, 61, 11, 13, -1, -2, 9, 
-	23, 61, 6, 13, -1, -2, 3, 
-	82, 17, 9, 14, -2, -2, 6, 
-	30, 61, 11, 13, -1, -2, 8, 
-	42, 61, 10, 13, -1, -2, 7, 
-	53, 61, 12, 13, -1, -2, 9, 
-	66, 61, 11, 13, -1, -2, 9, 
-	92, 17, 13, 14, -2, -2, 9, 
-	78, 61, 11, 13, -1, -2, 8, 
-	0, 32, 13, 14, -2, -2, 9, 
-	90, 61, 12, 13, -1, -2, 9, 
-	14, 32, 12, 14, -2, -2, 8, 
-	0, 75, 11, 13, -2, -2, 7, 
-	27, 32, 11, 14, -1, -2, 9, 
-	12, 75, 12, 13, -2, -2, 7, 
-	97, 32, 16, 13, -2, -2, 11, 
-	25, 75, 12, 13, -2, -2, 7, 
-	38, 75, 12, 13, -2, -2, 7, 
-	51, 75, 11, 13, -2, -2, 7, 
-	26, 0, 8, 16, -2, -2, 3, 
-	35, 0, 7, 16, -2, -2, 3, 
-	77, 75, 11, 12, -2, 0, 7, 
-	0, 47, 11, 13, -2, -2, 7, 
-	89, 75, 10, 12, -2, 0, 6, 
-	12, 17, 10, 14, -2, -2, 7, 
-	100, 75, 11, 12, -2, 0, 7, 
-	12, 47, 8, 13, -2, -2, 3, 
-	23, 17, 10, 14, -2, 0, 7, 
-	21, 47, 10, 13, -2, -2, 7, 
-	106, 17, 6, 13, -2, -2, 3, 
-	0, 0, 7, 16, -3, -2, 3, 
-	32, 47, 10, 13, -2, -2, 6, 
-	43, 47, 6, 13, -2, -2, 3, 
-	0, 102, 14, 11, -2, 0, 11, 
-	15, 102, 10, 11, -2, 0, 7, 
-	0, 89, 11, 12, -2, 0, 7, 
-	34, 17, 11, 14, -2, 0, 7, 
-	46, 17, 10, 14, -2, 0, 7, 
-	26, 102, 8, 11, -2, 0, 4, 
-	12, 89, 10, 12, -2, 0, 7, 
-	50, 47, 8, 13, -2, -2, 3, 
-	23, 89, 10, 12, -2, 0, 7, 
-	35, 102, 10, 11, -2, 0, 5, 
-	46, 102, 13, 11, -2, 0, 9, 
-	60, 102, 10, 11, -2, 0, 5, 
-	57, 17, 10, 14, -2, 0, 5, 
-	71, 102, 10, 11, -2, 0, 5
-};
-
-/* 
- * An array for each char (0-255) which defines the index in the font glyph data array.
- * A value of 255 (0xff) means that the char is not supported and will be ignored when
- * rendering text.
-*/
-u_char CharIndex[] = {
-	255, 
-	255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 
-	255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 
-	255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 
-	255, 0, 1, 2, 255, 255, 3, 255, 4, 5, 
-	6, 7, 8, 9, 10, 11, 255, 12, 13, 14, 
-	15, 16, 17, 18, 19, 20, 21, 22, 23, 255, 
-	24, 255, 25, 255, 26, 27, 28, 29, 30, 31, 
-	32, 33, 34, 35, 36, 37, 38, 39, 40, 41, 
-	42, 43, 44, 45, 46, 47, 48, 49, 50, 51, 
-	52, 255, 53, 255, 255, 255, 54, 55, 56, 57, 
-	58, 59, 60, 61, 62, 63, 64, 65, 66, 67, 
-	68, 69, 70, 71, 72, 73, 74, 75, 76, 77, 
-	78, 79, 255, 255, 255, 255, 255, 255, 255, 255, 
-	255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 
-	255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 
-	255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 
-	255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 
-	255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 
-	255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 
-	255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 
-	255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 
-	255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 
-	255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 
-	255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 
-	255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 
-	255, 255, 255, 255
-};
-
-/* TIM params for font sheet. */
-static GsIMAGE s_fontImage;
-/* Sprite for rendering text. */
-static GsSPRITE s_fontSprite;
+/* Font used by DrawText and DrawTextColored. */
+static Font s_defaultFont;
 /* Main archive. */
 static PckTOC s_mainArchive;
 
 static Color s_clearColor;
 
 /* ordering table (OT) definition */
-#define	OT_LENGTH 1
 GsOT WorldOT[2];
 GsOT_TAG OTTags[2][1<<OT_LENGTH];
 
@@ -185,16 +40,58 @@ PACKET GpuPacketArea[2][PACKETMAX];
 
 int s_activeBuff = 0;
 
+/* Order table everything is sorted into, the one of the frame or of the view begun last. */
+static GsOT* s_activeOT = &WorldOT[0];
+
+/* Views linked into the frame being built, their clip areas are filled in by EndFrame. */
+static View* s_frameViews[MAX_VIEWS];
+static int s_frameViewCount = 0;
+
+/* View begun last and not ended yet, 0 while sorting into the frame itself. */
+static View* s_activeView = 0;
+
+/* Region letter in the BIOS version string ("... for Europe"), the host libraries provide their own. */
+#ifndef BIOS_REGION
+#define BIOS_REGION (*(volatile char*)0xbfc7ff52)
+#endif
+
+/* Video mode asked for with SetDisplayMode, the one InitGraphics set up and what follows from it. */
+static long s_requestedMode = MODE_AUTO;
+static int s_screenHeight = 240;
+static int s_refreshRate = 50;
+
+/* Width asked for with SetScreenWidth, the one of the frame being built and the one set up for the GPU. */
+static int s_requestedWidth = SCREEN_WIDTH;
+static int s_screenWidth = SCREEN_WIDTH;
+static int s_displayWidth = SCREEN_WIDTH;
+static u_char s_is3D = 0;
+
+/* Sets the display buffers up for the current video mode. */
+static void InitDisplay()
+{
+	GsInitGraph(s_displayWidth, s_screenHeight, GsINTER | GsOFSGPU, 1, 0);
+
+	/* PAL shows 256 lines and starts a bit lower than NTSC, so the picture is centered on the TV */
+	GsDISPENV.screen.x = 0;
+	GsDISPENV.screen.y = GetVideoMode() == MODE_PAL ? 8 : 0;
+	GsDISPENV.screen.w = s_displayWidth;
+	GsDISPENV.screen.h = s_screenHeight;
+}
+
 
 void SwapTo3D()
 {
+	s_is3D = 1;
 	GsInit3D();
 	GsSetProjection(160);
 }
 
 void SwapTo2D()
 {
-	GsInitGraph(320, 240, GsINTER | GsOFSGPU, 1, 0);
+	/* 2D screens are laid out for the full width */
+	s_is3D = 0;
+	s_requestedWidth = s_screenWidth = s_displayWidth = SCREEN_WIDTH;
+	InitDisplay();
 }
 
 void SetClearColor(u_char red, u_char green, u_char blue)
@@ -216,6 +113,7 @@ GsIMAGE LoadTIM(u_long *tMemAddress)
 	tRect.y = tTim.py;
 	tRect.w = tTim.pw;
 	tRect.h = tTim.ph;
+	InvalidateVram(&tRect);
 	LoadImage(&tRect, tTim.pixel);		// Load TIM data into framebuffer
 	DrawSync(0);
 
@@ -225,6 +123,7 @@ GsIMAGE LoadTIM(u_long *tMemAddress)
 		tRect.y = tTim.cy;
 		tRect.w = tTim.cw;
 		tRect.h = tTim.ch;
+		InvalidateVram(&tRect);
 		LoadImage(&tRect, tTim.clut);	// Load CLUT into framebuffer
 		DrawSync(0);
 	}
@@ -242,10 +141,17 @@ int LoadTIMFile(char* filename, GsIMAGE* image)
 		return 0;
 	}
 
-	buffer = (u_char*)malloc(s_mainArchive.File[ntoc].Size + 2047);
+	buffer = (u_char*)AssetAlloc(s_mainArchive.File[ntoc].Size + 2047);
+	if (buffer == 0)
+	{
+		return 0;
+	}
 
-	PckReadFileNum(&s_mainArchive, ntoc, (u_long*)buffer, s_mainArchive.File[ntoc].Size);
-	CdReadSync(0, 0);
+	if (!PckReadFileNum(&s_mainArchive, ntoc, (u_long*)buffer, s_mainArchive.File[ntoc].Size))
+	{
+		free(buffer);
+		return 0;
+	}
 
 	if (image != 0)
 	{
@@ -285,19 +191,85 @@ volatile int fps;
 volatile int fps_counter;
 volatile int fps_measure;
 
+/* Called at the end of every vertical blank interrupt. */
+static void (*s_vsyncHook)() = 0;
+
+/* Number of the frame which is currently being built. */
+static u_long s_frameCount = 0;
+/* Number of the frame which is on screen and the VSync count when it got there. */
+static u_long s_displayedFrame = 0;
+static long s_displayedVSync = 0;
+/* VSync count when the current frame was started, and how long the last frame took. */
+static long s_frameStartVSync = 0;
+static u_long s_frameTime = 0;
+static u_long s_frameVBlanks = 1;
+
+/* Counts of the frame being built and of the last finished one. */
+static DrawStats s_drawStats;
+static DrawStats s_lastDrawStats;
+/* Peaks of the current window and of the one before, and the frames counted into the current one. */
+static DrawStats s_peakDrawStats[2];
+static DrawStats s_peakResult;
+/* Whether FinishDrawStats follows the order table to count its primitives. */
+static int s_countPrims = 0;
+static u_long s_peakFrames = 0;
+/* Texture page, color mode and semi transparency rate of the last sorted sprite. */
+static u_long s_lastTexture;
+
 void vsync_cb()
 {
     fps_counter++;
-    if( fps_counter >= 50 )
+    if( fps_counter >= s_refreshRate )
 	{
         fps = fps_measure;
         fps_measure = 0;
         fps_counter = 0;
     }
+
+	if (s_vsyncHook != 0)
+	{
+		s_vsyncHook();
+	}
+}
+
+void SetVSyncHook(void (*hook)())
+{
+	s_vsyncHook = hook;
+}
+
+void SetDisplayMode(long mode)
+{
+	s_requestedMode = mode;
+}
+
+int GetScreenHeight()
+{
+	return s_screenHeight;
+}
+
+void SetScreenWidth(int width)
+{
+	s_requestedWidth = width;
+}
+
+int GetScreenWidth()
+{
+	return s_screenWidth;
+}
+
+int GetRefreshRate()
+{
+	return s_refreshRate;
+}
+
+long GetFrameStep()
+{
+	return s_refreshRate == 50 ? ONE : ONE * 50 / s_refreshRate;
 }
 
 void InitGraphics()
 {
+	long mode;
 	int i;
 
 	/* Reset all callbacks to 0. */
@@ -307,17 +279,20 @@ void InitGraphics()
 	ResetGraph(0);
 	SetGraphDebug(0);
 
-	#define SCREEN_WIDTH 320
-	#define SCREEN_HEIGHT 240
+	/* Set video mode, the one of the console's region unless the game chose one */
+	mode = s_requestedMode;
+	if (mode == MODE_AUTO)
+	{
+		mode = BIOS_REGION == 'E' ? MODE_PAL : MODE_NTSC;
+	}
 
-	/* Set video mode */
-	SetVideoMode(MODE_PAL);
+	SetVideoMode(mode);
+	s_screenHeight = mode == MODE_PAL ? PAL_SCREEN_HEIGHT : NTSC_SCREEN_HEIGHT;
+	s_refreshRate = mode == MODE_PAL ? 50 : 60;
 
 	/* Define display buffer and back buffer area in VRAM */
-	GsDISPENV.screen.y = 8;
-	GsDISPENV.screen.h = 256;
-	GsInitGraph(SCREEN_WIDTH, SCREEN_HEIGHT, GsINTER | GsOFSGPU, 1, 0);
-	GsDefDispBuff(0, 0, 0, SCREEN_HEIGHT);
+	InitDisplay();
+	GsDefDispBuff(0, 0, 0, s_screenHeight);
 
 	/* Initialize OT */
 	for(i = 0; i < 2; i++) 
@@ -334,9 +309,31 @@ void InitGraphics()
 	VSyncCallback(vsync_cb);
 }
 
+/* Counts a texture page change if the sprite needs another texture page or mode than the one sorted before. */
+static void CountTexture(GsSPRITE* sprite)
+{
+	u_long texture = (sprite->tpage & 0x1f) | (sprite->attribute & 0x33000000);
+
+	if (texture != s_lastTexture)
+	{
+		s_drawStats.tpageChanges++;
+		s_lastTexture = texture;
+	}
+}
+
 void DrawSprite(GsSPRITE* sprite)
 {
-	GsSortFastSprite(sprite, &WorldOT[s_activeBuff], 0);
+	GsSortFastSprite(sprite, s_activeOT, 0);
+
+	s_drawStats.sprites++;
+	CountTexture(sprite);
+}
+
+void SortObject(GsDOBJ2* object, GsOT* ot, int shift, u_long* scratch)
+{
+	GsSortObject4(object, ot, shift, scratch);
+
+	s_drawStats.objects++;
 }
 
 GsSPRITE CreateSprite(GsIMAGE TimParams, int u, int v, int w, int h, int mx, int my)
@@ -369,6 +366,9 @@ void EngineInit(char* dataImage)
 {
 	InitGraphics();
 
+	/* The SPU is set up before the CD subsystem, which routes CD audio through it */
+	InitSfx();
+
 	CdInit();
 	CdSetDebug(0);
 
@@ -378,66 +378,132 @@ void EngineInit(char* dataImage)
 		ErrorMessage("%s not found or damaged!", dataImage);
 	}
 
-	/* Load font TIM */
-	if (!LoadTIMFile("FONT.TIM", &s_fontImage))
+	/* Load default font */
+	if (!LoadFontFile("FONT.FNT", &s_defaultFont))
 	{
-		ErrorMessage("FONT.TIM not found in game archive!");
+		ErrorMessage("FONT.FNT not found in game archive!");
 	}
 
-	// Set color mode of sprite
-	s_fontSprite.attribute	= (s_fontImage.pmode & 3) << 24;
+	/* Upload the sound effects to SPU RAM */
+	if (!LoadSfxBank("SOUNDS.SFX"))
+	{
+		ErrorMessage("SOUNDS.SFX not found in game archive!");
+	}
 
-	// CLUT coords
-	s_fontSprite.cx 			= s_fontImage.cx;
-	s_fontSprite.cy 			= s_fontImage.cy;
+	/* Music streams from MUSIC.XA, if there is one on the disc */
+	InitMusic(&s_mainArchive);
+}
 
-	// Set default position, color intensity, and scale/rotation values of sprite
-	s_fontSprite.x=s_fontSprite.y			= 0;
-	s_fontSprite.mx=s_fontSprite.my			= 0;
-	s_fontSprite.r=s_fontSprite.g=s_fontSprite.b	= 128;
-	s_fontSprite.scalex=s_fontSprite.scaley	= ONE;
-	s_fontSprite.rotate					= 0;
+int LoadFontFile(char* filename, Font* font)
+{
+	u_long* data;
+	FontHeader* header;
+	u_long tableSize;
+
+	data = LoadFile(filename, 0);
+	if (data == 0)
+	{
+		return 0;
+	}
+
+	header = (FontHeader*)data;
+	if (header->id != FONT_ID || header->version != FONT_VERSION)
+	{
+		free(data);
+		return 0;
+	}
+
+	/* Upload the sheet, only the glyph table is kept in memory */
+	if (header->timSize != 0)
+	{
+		LoadTIM((u_long*)((u_char*)data + header->timOffset));
+	}
+
+	tableSize = sizeof(FontHeader) + 256 + header->glyphCount * sizeof(FontGlyph);
+	font->header = (FontHeader*)malloc(tableSize);
+	if (font->header == 0)
+	{
+		free(data);
+		return 0;
+	}
+
+	memcpy(font->header, data, tableSize);
+	free(data);
+
+	font->index = (u_char*)(font->header + 1);
+	font->glyphs = (FontGlyph*)(font->index + 256);
+
+	// Set color mode and default values of the sprite used to draw the glyphs
+	memset(&font->sprite, 0, sizeof(GsSPRITE));
+	font->sprite.attribute = ((u_long)font->header->colorMode << 24) | (1 << 30);
+	font->sprite.r = font->sprite.g = font->sprite.b = 128;
+	font->sprite.scalex = font->sprite.scaley = ONE;
+
+	return 1;
 }
 
-TextPosition DrawTextColored(char* text, short x, short y, u_char r, u_char g, u_char b)
+void FreeFont(Font* font)
+{
+	if (font->header != 0)
+	{
+		free(font->header);
+		font->header = 0;
+	}
+}
+
+TextPosition DrawTextFont(Font* font, char* text, short x, short y, u_char r, u_char g, u_char b)
 {
 	TextPosition position;
+	GsSPRITE* sprite = &font->sprite;
+	FontGlyph* glyph;
+	u_char index;
+
 	position.x = x;
 	position.y = y;
 
-	s_fontSprite.attribute |= (1 << 30);
-	s_fontSprite.r = r;
-	s_fontSprite.g = g;
-	s_fontSprite.b = b;
+	sprite->r = r;
+	sprite->g = g;
+	sprite->b = b;
 
 	while(*text != 0)
 	{
-		if (!CHAR_VALID(*text))
+		index = font->index[(u_char)*text++];
+		if (index == FONT_NO_GLYPH)
 		{
-			text++;
 			continue;
 		}
 
-		SetSpritePosition(&s_fontSprite, &s_fontImage, CHAR_X(*text), CHAR_Y(*text));
-		s_fontSprite.x = position.x + CHAR_XOFF(*text);
-		s_fontSprite.y = position.y + CHAR_YOFF(*text);
-		s_fontSprite.w = CHAR_W(*text);
-		s_fontSprite.h = CHAR_H(*text);
+		glyph = &font->glyphs[index];
+		sprite->tpage = glyph->tpage;
+		sprite->cx = glyph->cx;
+		sprite->cy = glyph->cy;
+		sprite->u = glyph->u;
+		sprite->v = glyph->v;
+		sprite->w = glyph->w;
+		sprite->h = glyph->h;
+		sprite->x = position.x + glyph->xoffset;
+		sprite->y = position.y + glyph->yoffset;
+
+		GsSortFastSprite(sprite, s_activeOT, 0);
+
+		s_drawStats.glyphs++;
+		CountTexture(sprite);
 
-		GsSortFastSprite(&s_fontSprite, &WorldOT[s_activeBuff], 0);
-		
-		position.x += CHAR_ADV(*text) + 2;
+		position.x += glyph->advance;
 		if (position.x >= 320)
 		{
 			break;
 		}
-		
-		text++;
 	}
 
 	return position;
 }
 
+TextPosition DrawTextColored(char* text, short x, short y, u_char r, u_char g, u_char b)
+{
+	return DrawTextFont(&s_defaultFont, text, x, y, r, g, b);
+}
+
 TextPosition DrawText(char* text, short x, short y)
 {
 	return DrawTextColored(text, x, y, 128, 128, 128);
@@ -485,27 +551,444 @@ void ErrorMessage(char* format, ...)
 
 void BeginFrame()
 {
+	s_frameCount++;
 	s_activeBuff = GsGetActiveBuff();
+	s_screenWidth = s_requestedWidth;
 	GsSetWorkBase((PACKET *)GpuPacketArea[s_activeBuff]);
 	GsClearOt(0, 0, &WorldOT[s_activeBuff]);
+	s_activeOT = &WorldOT[s_activeBuff];
+	s_frameViewCount = 0;
+
+	memset(&s_drawStats, 0, sizeof(DrawStats));
+	s_lastTexture = 0xffffffff;
 }
 
 void Clear()
 {
 }
 
+GsOT* GetActiveOT()
+{
+	return s_activeOT;
+}
+
+void InitView(View* view)
+{
+	int i;
+
+	memset(view, 0, sizeof(View));
+
+	for (i = 0; i < 2; ++i)
+	{
+		view->ot[i].length = OT_LENGTH;
+		view->ot[i].org = view->tags[i];
+	}
+}
+
+void BeginView(View* view, RECT* area)
+{
+	GsOT* ot = &view->ot[s_activeBuff];
+
+	view->area = *area;
+
+	/* The whole view is linked into the farthest bucket of the frame, see EndView */
+	GsClearOt(0, (1 << OT_LENGTH) - 1, ot);
+
+	/* Drawn after everything else of the view, the nearest bucket ends the list */
+	addPrim(ot->org, &view->restoreClip[s_activeBuff]);
+	addPrim(ot->org, &view->restoreOffset[s_activeBuff]);
+
+	s_activeOT = ot;
+	s_activeView = view;
+}
+
+void EndView(View* view)
+{
+	GsOT* ot = &view->ot[s_activeBuff];
+
+	if (s_frameViewCount >= MAX_VIEWS)
+	{
+		ErrorMessage("More than %d views in a frame!", MAX_VIEWS);
+	}
+
+	/* Drawn before everything else of the view */
+	addPrim(ot->org + (1 << OT_LENGTH) - 1, &view->offset[s_activeBuff]);
+	addPrim(ot->org + (1 << OT_LENGTH) - 1, &view->clip[s_activeBuff]);
+
+	GsSortOt(ot, &WorldOT[s_activeBuff]);
+	s_frameViews[s_frameViewCount++] = view;
+
+	s_activeOT = &WorldOT[s_activeBuff];
+	s_activeView = 0;
+}
+
+/*
+ * Points the clip areas of the views at the display buffer the frame is drawn into, which is
+ * only known once the buffers were swapped.
+ */
+static void FinishViews()
+{
+	View* view;
+	RECT area;
+	u_short offset[2];
+	int i;
+
+	for (i = 0; i < s_frameViewCount; ++i)
+	{
+		view = s_frameViews[i];
+
+		area = view->area;
+		area.x += GsDRAWENV.clip.x;
+		area.y += GsDRAWENV.clip.y;
+		offset[0] = (u_short)(area.x + area.w / 2);
+		offset[1] = (u_short)(area.y + area.h / 2);
+
+		SetDrawArea(&view->clip[s_activeBuff], &area);
+		SetDrawOffset(&view->offset[s_activeBuff], offset);
+		SetDrawArea(&view->restoreClip[s_activeBuff], &GsDRAWENV.clip);
+		SetDrawOffset(&view->restoreOffset[s_activeBuff], (u_short*)GsDRAWENV.ofs);
+	}
+}
+
+u_long GetFrameCount()
+{
+	return s_frameCount;
+}
+
+u_long GetFrameTime()
+{
+	return s_frameTime;
+}
+
+u_long GetFrameLines()
+{
+	return (u_long)(VSync(-1) - s_frameStartVSync) * (s_refreshRate == 50 ? PAL_FIELD_LINES : NTSC_FIELD_LINES) + VSync(1);
+}
+
+u_long GetFrameVBlanks()
+{
+	return s_frameVBlanks;
+}
+
+DrawStats* GetDrawStats()
+{
+	return &s_lastDrawStats;
+}
+
+/* Raises every field of peak to the one of stats if that is larger. */
+static void KeepPeak(DrawStats* peak, DrawStats* stats)
+{
+	if (stats->sprites > peak->sprites)
+	{
+		peak->sprites = stats->sprites;
+	}
+	if (stats->glyphs > peak->glyphs)
+	{
+		peak->glyphs = stats->glyphs;
+	}
+	if (stats->objects > peak->objects)
+	{
+		peak->objects = stats->objects;
+	}
+	if (stats->prims > peak->prims)
+	{
+		peak->prims = stats->prims;
+	}
+	if (stats->packetBytes > peak->packetBytes)
+	{
+		peak->packetBytes = stats->packetBytes;
+	}
+	if (stats->tpageChanges > peak->tpageChanges)
+	{
+		peak->tpageChanges = stats->tpageChanges;
+	}
+}
+
+DrawStats* GetPeakDrawStats()
+{
+	s_peakResult = s_peakDrawStats[1];
+	KeepPeak(&s_peakResult, &s_peakDrawStats[0]);
+
+	return &s_peakResult;
+}
+
+void ResetPeakDrawStats()
+{
+	memset(s_peakDrawStats, 0, sizeof(s_peakDrawStats));
+	s_peakFrames = 0;
+}
+
+void SetPrimCounting(int enable)
+{
+	s_countPrims = enable;
+}
+
+/*
+ * Finishes the counts of the frame which was just handed to the GPU. Only the tags are read
+ * while following the order table, one word per primitive, and the GPU is busy drawing it
+ * in the meantime; still, a frame only pays for that while somebody reads the primitives.
+ */
+static void FinishDrawStats(GsOT* ot)
+{
+	u_long* tag = (u_long*)ot->tag;
+
+	s_drawStats.packetBytes += (u_long)((u_char*)GsGetWorkBase() - (u_char*)GpuPacketArea[s_activeBuff]);
+
+	while (s_countPrims)
+	{
+		/* Entries without a packet only link the buckets */
+		if (getlen(tag) != 0)
+		{
+			s_drawStats.prims++;
+		}
+
+		if (isendprim(tag))
+		{
+			break;
+		}
+
+		tag = (u_long*)nextPrim(tag);
+	}
+
+	s_lastDrawStats = s_drawStats;
+
+	/* The peaks cover the current window and the whole one before */
+	KeepPeak(&s_peakDrawStats[0], &s_drawStats);
+	if (++s_peakFrames >= DRAW_STATS_WINDOW)
+	{
+		s_peakDrawStats[1] = s_peakDrawStats[0];
+		memset(&s_peakDrawStats[0], 0, sizeof(DrawStats));
+		s_peakFrames = 0;
+	}
+}
+
+u_long GetDisplayedFrame(long* vsync)
+{
+	if (vsync != 0)
+	{
+		*vsync = s_displayedVSync;
+	}
+
+	return s_displayedFrame;
+}
+
+int CreateStaticGeometry(StaticGeometry* geometry, u_long packetSize)
+{
+	int i;
+
+	memset(geometry, 0, sizeof(StaticGeometry));
+
+	for (i = 0; i < 2; ++i)
+	{
+		geometry->packets[i] = (PACKET*)AssetAlloc(packetSize);
+		if (geometry->packets[i] == 0)
+		{
+			FreeStaticGeometry(geometry);
+			return 0;
+		}
+
+		geometry->ot[i].length = OT_LENGTH;
+		geometry->ot[i].org = geometry->tags[i];
+	}
+
+	geometry->packetSize = packetSize;
+	return 1;
+}
+
+void FreeStaticGeometry(StaticGeometry* geometry)
+{
+	int i;
+
+	for (i = 0; i < 2; ++i)
+	{
+		if (geometry->packets[i] != 0)
+		{
+			free(geometry->packets[i]);
+			geometry->packets[i] = 0;
+		}
+
+		geometry->valid[i] = 0;
+	}
+}
+
+void InvalidateStaticGeometry(StaticGeometry* geometry)
+{
+	geometry->valid[0] = 0;
+	geometry->valid[1] = 0;
+}
+
+/* Region of the screen everything sorted now ends up in, the active view or the whole screen. */
+static void GetActiveArea(RECT* area)
+{
+	if (s_activeView != 0)
+	{
+		*area = s_activeView->area;
+		return;
+	}
+
+	setRECT(area, 0, 0, s_screenWidth, s_screenHeight);
+}
+
+/*
+ * Unlinks the polygons of an order table whose vertices are all beyond the same edge of the
+ * given region, where the GPU would clip them away anyway. The coordinates of the packets are
+ * relative to the center of the region, see FinishViews. Other primitives are kept.
+ */
+static void CullPolygons(GsOT* ot, RECT* area)
+{
+	u_long* prev = 0;
+	u_long* tag = (u_long*)ot->tag;
+	u_long* word;
+	u_char code;
+	short x, y, left, right, top, bottom;
+	int vertices, i;
+
+	while (1)
+	{
+		code = ((u_char*)tag)[7];
+
+		/* Polygons have 3 bits 001 in the top of the code, the tags of the buckets have no packet */
+		if (getlen(tag) != 0 && (code & 0xe0) == 0x20 && prev != 0)
+		{
+			vertices = (code & 0x08) ? 4 : 3;
+			left = right = top = bottom = 0;
+
+			/* The first word holds the color and the code, every vertex has its coordinates, gouraud shaded ones but the first a color and textured ones texture coordinates */
+			word = tag + 2;
+			for (i = 0; i < vertices; ++i)
+			{
+				if (i > 0 && (code & 0x10))
+				{
+					word++;
+				}
+
+				x = ((short*)word)[0];
+				y = ((short*)word)[1];
+				left += x < -area->w / 2;
+				right += x > area->w / 2;
+				top += y < -area->h / 2;
+				bottom += y > area->h / 2;
+
+				word += (code & 0x04) ? 2 : 1;
+			}
+
+			if (left == vertices || right == vertices || top == vertices || bottom == vertices)
+			{
+				setaddr(prev, getaddr(tag));
+				if (isendprim(prev))
+				{
+					break;
+				}
+
+				tag = (u_long*)nextPrim(prev);
+				continue;
+			}
+		}
+
+		if (isendprim(tag))
+		{
+			break;
+		}
+
+		prev = tag;
+		tag = (u_long*)nextPrim(tag);
+	}
+}
+
+GsOT* BeginStaticGeometry(StaticGeometry* geometry, MATRIX* view)
+{
+	RECT area;
+
+	GetActiveArea(&area);
+
+	if (geometry->valid[s_activeBuff] && memcmp(&geometry->view[s_activeBuff], view, sizeof(MATRIX)) == 0 &&
+		memcmp(&geometry->area[s_activeBuff], &area, sizeof(RECT)) == 0)
+	{
+		return 0;
+	}
+
+	geometry->view[s_activeBuff] = *view;
+	geometry->area[s_activeBuff] = area;
+	geometry->valid[s_activeBuff] = 0;
+
+	/* The whole list is linked into the farthest bucket of the frame, see DrawStaticGeometry. */
+	GsClearOt(0, (1 << OT_LENGTH) - 1, &geometry->ot[s_activeBuff]);
+
+	geometry->frameWorkBase = GsGetWorkBase();
+	GsSetWorkBase(geometry->packets[s_activeBuff]);
+
+	return &geometry->ot[s_activeBuff];
+}
+
+void EndStaticGeometry(StaticGeometry* geometry)
+{
+	u_long used = (u_long)((u_char*)GsGetWorkBase() - (u_char*)geometry->packets[s_activeBuff]);
+
+	GsSetWorkBase(geometry->frameWorkBase);
+	s_drawStats.packetBytes += used;
+
+	CullPolygons(&geometry->ot[s_activeBuff], &geometry->area[s_activeBuff]);
+
+	if (used > geometry->packetSize)
+	{
+		ErrorMessage("Static geometry needs %d bytes of packets, only %d reserved!", (int)used, (int)geometry->packetSize);
+	}
+
+	geometry->valid[s_activeBuff] = 1;
+}
+
+void DrawStaticGeometry(StaticGeometry* geometry)
+{
+	if (geometry->valid[s_activeBuff])
+	{
+		GsSortOt(&geometry->ot[s_activeBuff], s_activeOT);
+	}
+}
+
 void EndFrame()
 {
 	int vsyncsSinceGameLaunch;
 
 	DrawSync(0);
 
+	/* CPU and GPU are done with the frame: full fields since it started plus the lines of the current one */
+	s_frameTime = GetFrameLines();
+
 	VSync(0);
 	fps_measure++;
 
+	UpdateMusic();
+
+	s_frameVBlanks = (u_long)(VSync(-1) - s_frameStartVSync);
+	s_frameStartVSync = VSync(-1);
+
+	/* The GPU is idle, so a frame built for another width can get its display mode now */
+	if (s_screenWidth != s_displayWidth)
+	{
+		s_displayWidth = s_screenWidth;
+		InitDisplay();
+
+		if (s_is3D)
+		{
+			SwapTo3D();
+		}
+	}
+
+	/* The frame drawn during the last frame is shown from now on, this one gets drawn next. */
 	GsSwapDispBuff();
+	s_displayedFrame = s_frameCount - 1;
+	s_displayedVSync = VSync(-1);
+
+	FinishViews();
 	GsSortClear(s_clearColor.red, s_clearColor.green, s_clearColor.blue, &WorldOT[s_activeBuff]);
 	GsDrawOt(&WorldOT[s_activeBuff]);
+
+	FinishDrawStats(&WorldOT[s_activeBuff]);
+}
+
+int FindFile(char* filename)
+{
+	return PckSearchFile(&s_mainArchive, filename);
 }
 
 u_long* LoadFile(char* filename, int* size)
@@ -518,14 +1001,17 @@ u_long* LoadFile(char* filename, int* size)
 		return 0;
 	}
 
-	buffer = (u_char*)malloc(s_mainArchive.File[ntoc].Size + 2047);
+	buffer = (u_char*)AssetAlloc(s_mainArchive.File[ntoc].Size + 2047);
 	if (buffer == 0)
 	{
 		return 0;
 	}
 
-	PckReadFileNum(&s_mainArchive, ntoc, (u_long*)buffer, s_mainArchive.File[ntoc].Size);
-	CdReadSync(0, 0);
+	if (!PckReadFileNum(&s_mainArchive, ntoc, (u_long*)buffer, s_mainArchive.File[ntoc].Size))
+	{
+		free(buffer);
+		return 0;
+	}
 
 	if (size != 0)
 	{
@@ -3,18 +3,106 @@
 #define _ENGINE_H_
 
 #include "PckLib.h"
+#include "Font.h"
 
 #include <libgs.h>
 
+/* Depth resolution (as a power of two) of the order tables. */
+#define OT_LENGTH 1
+
 typedef struct
 {
 	short x, y;
 } TextPosition;
 
+/* A font loaded from a baked font file. */
+typedef struct
+{
+	FontHeader* header;
+	/* Glyph index of every character, FONT_NO_GLYPH if the character can't be drawn. */
+	u_char* index;
+	FontGlyph* glyphs;
+	/* Sprite used to draw the glyphs, with the color mode of the font sheet. */
+	GsSPRITE sprite;
+} Font;
+
+/*
+ * Primitives of geometry which only changes when the camera moves, like the level floor and
+ * border. Every display buffer keeps its own packets together with the view they were built
+ * for, so as long as the view stays the same, the packets of the last frame drawn from that
+ * buffer are linked into the frame again instead of being transformed and subdivided again.
+ */
+typedef struct
+{
+	GsOT ot[2];
+	GsOT_TAG tags[2][1 << OT_LENGTH];
+	PACKET* packets[2];
+	u_long packetSize;
+	MATRIX view[2];
+	/* Region of the screen the primitives were built for, see EndStaticGeometry. */
+	RECT area[2];
+	u_char valid[2];
+	PACKET* frameWorkBase;
+} StaticGeometry;
+
+/* Most views a frame can be split into. */
+#define MAX_VIEWS 2
+
+/*
+ * A region of the screen with an order table of its own, like one half of a split screen.
+ * Everything sorted between BeginView and EndView is drawn clipped to the region and with the
+ * origin in its center, so a 3D scene or text is laid out in it like on a screen of that size.
+ * The view is linked into the frame in one piece, behind the text drawn into the frame itself.
+ */
+typedef struct
+{
+	RECT area;
+	GsOT ot[2];
+	GsOT_TAG tags[2][1 << OT_LENGTH];
+	/* Switch the GPU to the region and back, filled in when the frame is finished. */
+	DR_AREA clip[2];
+	DR_OFFSET offset[2];
+	DR_AREA restoreClip[2];
+	DR_OFFSET restoreOffset[2];
+} View;
+
 /* Utility function to draw colored text on screen at a given position. */
 void EngineInit(char* dataImage);
+void InitGraphics();
 void ErrorMessage(char* format, ...);
 
+/* Width of the display buffers, and their height in each video mode. */
+#define SCREEN_WIDTH		320
+#define PAL_SCREEN_HEIGHT	256
+#define NTSC_SCREEN_HEIGHT	240
+
+/* Video mode for SetDisplayMode which picks PAL on European consoles and NTSC on all others. */
+#define MODE_AUTO (-1)
+
+/*
+ * Chooses the video mode InitGraphics sets up: MODE_PAL, MODE_NTSC or MODE_AUTO for the one
+ * of the console's region. Has to be called before EngineInit, as the sound timing depends on it.
+ */
+void SetDisplayMode(long mode);
+/* Returns the height of the display buffers, PAL_SCREEN_HEIGHT or NTSC_SCREEN_HEIGHT. */
+int GetScreenHeight();
+/*
+ * Sets the width of the display buffers for the frames from the next BeginFrame on, 256 or
+ * SCREEN_WIDTH; VRAM right of SCREEN_WIDTH holds textures. The display mode changes when the
+ * first of these frames is finished, so the frame before is shown in the new mode for one
+ * field. SwapTo2D goes back to SCREEN_WIDTH.
+ */
+void SetScreenWidth(int width);
+/* Returns the width of the frame which is currently being built. */
+int GetScreenWidth();
+/* Returns the vertical blanks per second of the video mode, 50 or 60. */
+int GetRefreshRate();
+/*
+ * Returns how far the simulation advances in one frame, relative to a PAL frame: ONE on PAL
+ * and 5/6 of ONE on NTSC. Speeds are given per PAL frame, so the game runs equally fast in both.
+ */
+long GetFrameStep();
+
 void SwapTo3D();
 void SwapTo2D();
 
@@ -23,16 +111,107 @@ void BeginFrame();
 void Clear();
 void EndFrame();
 
+/* Returns the order table everything is sorted into, the one of the current view or of the frame. */
+GsOT* GetActiveOT();
+
+void InitView(View* view);
+/*
+ * Starts sorting into the view, area is relative to the top left corner of the screen. Views
+ * are drawn in the order they are ended, at most MAX_VIEWS per frame.
+ */
+void BeginView(View* view, RECT* area);
+/* Links the view into the frame, the order table of the frame is the active one again. */
+void EndView(View* view);
+
+/* Returns the number of the frame which is currently being built, counted by BeginFrame. */
+u_long GetFrameCount();
+/* Returns the number of the frame which is currently on screen and optionally the VSync count when it was shown. */
+u_long GetDisplayedFrame(long* vsync);
+
+/* Horizontal blanks (scanlines) in one field, the unit of GetFrameTime. */
+#define PAL_FIELD_LINES		312
+#define NTSC_FIELD_LINES	262
+
+/* Returns how long the last frame took until the GPU was done with it, in horizontal blanks. */
+u_long GetFrameTime();
+/* Returns the horizontal blanks since the current frame started, the clock GetFrameTime is taken with. */
+u_long GetFrameLines();
+/* Returns the number of vertical blanks between the last two frames, more than 1 means vertical blanks were dropped. */
+u_long GetFrameVBlanks();
+
+/*
+ * What one frame handed to the GPU. Sprites, glyphs and objects are counted when they are
+ * sorted (DrawSprite, DrawTextFont and SortObject), texture page changes between consecutive
+ * sprites and glyphs. Primitives are counted in the order table when the frame is finished,
+ * so they include everything linked into it, like static geometry and particles; that costs
+ * a walk over the whole order table, so it is only done while SetPrimCounting is on, prims
+ * stay 0 otherwise. Packet bytes are the ones written during the frame, rebuilt static
+ * geometry included.
+ */
+typedef struct
+{
+	u_long sprites;
+	u_long glyphs;
+	u_long objects;
+	u_long prims;
+	u_long packetBytes;
+	u_long tpageChanges;
+} DrawStats;
+
+/* Frames after which the oldest frames drop out of GetPeakDrawStats. */
+#define DRAW_STATS_WINDOW 64
+
+/* Returns the counts of the last finished frame. */
+DrawStats* GetDrawStats();
+/* Returns the largest count of every field over the last DRAW_STATS_WINDOW frames at least. */
+DrawStats* GetPeakDrawStats();
+/* Forgets the peaks, e.g. when a new scene starts. */
+void ResetPeakDrawStats();
+/* Turns counting the primitives of every frame (DrawStats.prims) on or off, it is off at first. */
+void SetPrimCounting(int enable);
+
+/* Sorts a TMD object with GsSortObject4 into the order table and counts it. */
+void SortObject(GsDOBJ2* object, GsOT* ot, int shift, u_long* scratch);
+
+/* Sets a function which is called in every vertical blank, e.g. to latch controller input. */
+void SetVSyncHook(void (*hook)());
+
+/* Allocates the packet areas (packetSize bytes per display buffer) of static geometry. Returns 0 on failure. */
+int CreateStaticGeometry(StaticGeometry* geometry, u_long packetSize);
+void FreeStaticGeometry(StaticGeometry* geometry);
+/* Forces the primitives to be rebuilt on the next frames, e.g. after the lighting changed. */
+void InvalidateStaticGeometry(StaticGeometry* geometry);
+/*
+ * Starts rebuilding the primitives of the active display buffer if they were built for another
+ * view. Returns the order table to sort the objects into, followed by EndStaticGeometry, or 0
+ * if the primitives are still up to date.
+ */
+GsOT* BeginStaticGeometry(StaticGeometry* geometry, MATRIX* view);
+/*
+ * Finishes the primitives and drops the polygons which are completely outside the view begun
+ * last (or the screen), so a split screen only pays for the part of the level its views show.
+ */
+void EndStaticGeometry(StaticGeometry* geometry);
+/* Links the primitives into the active order table (see GetActiveOT), behind everything else. */
+void DrawStaticGeometry(StaticGeometry* geometry);
+
 GsSPRITE CreateSprite(GsIMAGE TimParams, int u, int v, int w, int h, int mx, int my);
 void DrawSprite(GsSPRITE* sprite);
 void SetSpritePosition(GsSPRITE* sprite, GsIMAGE* timParams, short x, short y);
 TextPosition DrawTextColored(char* text, short x, short y, u_char r, u_char g, u_char b);
+TextPosition DrawTextFont(Font* font, char* text, short x, short y, u_char r, u_char g, u_char b);
 TextPosition DrawText(char* text, short x, short y);
 TextPosition DrawFormat(short x, short y, char* text, ...);
 
+/* Returns the entry of a file in the main archive, -1 if it isn't there. */
+int FindFile(char* filename);
 u_long* LoadFile(char* filename, int* size);
 
 int LoadTIMFile(char* filename, GsIMAGE* image);
+
+/* Loads a baked font file (see Font.h) and uploads its sheet to VRAM. Returns 0 on failure. */
+int LoadFontFile(char* filename, Font* font);
+void FreeFont(Font* font);
 GsIMAGE LoadTIM(u_long *tMemAddress);
 
 #endif
@@ -0,0 +1,117 @@
+/*
+ * Checked fixed point math, see Fixed.h. The limits are the ones of the console, where a
+ * long has 32 bits, also when a long is wider on the host.
+ */
+
+#include <sys/types.h>
+#include <libgte.h>
+
+#include <stdlib.h>
+
+#include "Engine.h"
+#include "Fixed.h"
+
+#if FIXED_CHECKED
+
+#define LONG32_MAX	0x7fffffffL
+
+/* Halts if a result doesn't fit into the 32 bits of the console. */
+static Fixed Checked32(long raw, const char* what)
+{
+	if (raw > LONG32_MAX || raw < -LONG32_MAX - 1)
+	{
+		ErrorMessage("Fixed point overflow: %s gives %ld, no 32 bit number!", what, raw);
+	}
+
+	return FixedFromRaw(raw);
+}
+
+Fixed FixedFromInt(long i)
+{
+	if (i > FIXED_INT_MAX || i < -FIXED_INT_MAX - 1)
+	{
+		ErrorMessage("Fixed point overflow: %ld doesn't fit into 20.12!", i);
+	}
+
+	return FixedFromRaw(i << FIXED_SHIFT);
+}
+
+long FixedToInt(Fixed f)
+{
+	Checked32(f.raw, "a conversion");
+
+	return f.raw >> FIXED_SHIFT;
+}
+
+long FixedToIntExact(Fixed f)
+{
+	if (f.raw & (FIXED_ONE - 1))
+	{
+		ErrorMessage("Fixed point precision lost: %ld/%d is no whole number!", f.raw, FIXED_ONE);
+	}
+
+	return FixedToInt(f);
+}
+
+Fixed FixedMul(Fixed a, Fixed b)
+{
+	/* The product before the shift has to fit, that's what the console computes */
+	if (a.raw != 0 && labs(b.raw) > LONG32_MAX / labs(a.raw))
+	{
+		ErrorMessage("Fixed point overflow: %ld * %ld doesn't fit into 32 bits!", a.raw, b.raw);
+	}
+
+	return FixedFromRaw((a.raw * b.raw) >> FIXED_SHIFT);
+}
+
+Fixed FixedAdd(Fixed a, Fixed b)
+{
+	return Checked32(a.raw + b.raw, "a sum");
+}
+
+Fixed FixedSub(Fixed a, Fixed b)
+{
+	return Checked32(a.raw - b.raw, "a difference");
+}
+
+Fixed FixedNeg(Fixed a)
+{
+	return Checked32(-a.raw, "a negation");
+}
+
+Fixed FixedAbs(Fixed a)
+{
+	return Checked32(labs(a.raw), "an absolute value");
+}
+
+Fixed FixedScale(Fixed a, long n)
+{
+	return Checked32(a.raw * n, "a product");
+}
+
+Fixed FixedDivInt(Fixed a, long n)
+{
+	if (n == 0)
+	{
+		ErrorMessage("Fixed point division of %ld by 0!", a.raw);
+	}
+
+	return FixedFromRaw(a.raw / n);
+}
+
+long FixedRatio(Fixed a, Fixed b)
+{
+	if (b.raw == 0)
+	{
+		ErrorMessage("Fixed point division of %ld by 0!", a.raw);
+	}
+
+	return a.raw / b.raw;
+}
+
+int FixedCompare(Fixed a, Fixed b)
+{
+	return (a.raw > b.raw) - (a.raw < b.raw);
+}
+
+#endif
@@ -0,0 +1,120 @@
+#ifndef _FIXED_H_
+#define _FIXED_H_
+
+#include <sys/types.h>
+
+/*
+ * Fixed point math of the game.
+ *
+ * Positions and velocities of the game are 20.12 fixed point numbers (Fixed, 1.0 is ONE),
+ * while the GTE and the libgs calls which place models and the camera take whole world
+ * units (plain long). Going from one to the other is a shift, never a divide, so it costs a
+ * single instruction on the R3000. Note that FixedToInt rounds down, also for negative
+ * numbers, where dividing by ONE would round towards zero.
+ *
+ * With FIXED_CHECKED set Fixed is a struct of its own and the operations below are functions
+ * which halt with an error message when a value doesn't fit into the 32 bits the console has,
+ * or when a value expected to be whole has a fraction. The host build turns it on, so mixing
+ * up whole and 20.12 units doesn't compile there, and the soak tests catch scaling mistakes
+ * which would only overflow on the console. On the console Fixed is a long and the operations
+ * are the plain operators, so both builds compute the same.
+ *
+ * The game keeps its state in Fixed and FixedVector. The libgte and libgs calls take VECTORs
+ * of whole units, converted with FixedVectorToInt where they are called. Interfaces which
+ * take or return ONE-scaled VECTORs, like EmitParticles and VectorNormal, go through
+ * FixedVectorToScaled and FixedVectorFromScaled.
+ */
+
+/* Set to 1 to check the fixed point math, see above. */
+#ifndef FIXED_CHECKED
+#define FIXED_CHECKED 0
+#endif
+
+#define FIXED_SHIFT	12
+#define FIXED_ONE	(1 << FIXED_SHIFT)
+
+/* Largest whole number a Fixed holds. */
+#define FIXED_INT_MAX	((1L << (31 - FIXED_SHIFT)) - 1)
+
+#if FIXED_CHECKED
+
+typedef struct
+{
+	long raw;
+} Fixed;
+
+/* The 20.12 bits of a Fixed, for storage and the ONE-scaled interfaces, and back. */
+#define FIXED_RAW(f)		((f).raw)
+#define FixedFromRaw(r)		((Fixed){ (long)(r) })
+
+/* A constant number of whole units. */
+#define FIXED(i)	((Fixed){ (long)(i) * FIXED_ONE })
+
+/* Converts whole units to fixed point. */
+Fixed FixedFromInt(long i);
+
+/* Converts fixed point to whole units, rounding down. */
+long FixedToInt(Fixed f);
+
+/* Converts fixed point which has to be a whole number to whole units. */
+long FixedToIntExact(Fixed f);
+
+/* Multiplies two fixed point numbers. */
+Fixed FixedMul(Fixed a, Fixed b);
+
+Fixed FixedAdd(Fixed a, Fixed b);
+Fixed FixedSub(Fixed a, Fixed b);
+Fixed FixedNeg(Fixed a);
+Fixed FixedAbs(Fixed a);
+
+/* Multiplies and divides by a plain number, the quotient is rounded towards zero like in C. */
+Fixed FixedScale(Fixed a, long n);
+Fixed FixedDivInt(Fixed a, long n);
+
+/* Quotient of two fixed point numbers as a plain number, rounded towards zero. */
+long FixedRatio(Fixed a, Fixed b);
+
+/* Returns less than, equal to or greater than 0 like strcmp, e.g. FixedCompare(a, b) < 0 for a < b. */
+int FixedCompare(Fixed a, Fixed b);
+
+#else
+
+typedef long Fixed;
+
+#define FIXED_RAW(f)		(f)
+#define FixedFromRaw(r)		((Fixed)(r))
+
+/* A constant number of whole units, folded by the compiler. */
+#define FIXED(i)	((Fixed)(i) * FIXED_ONE)
+
+#define FixedFromInt(i)		((Fixed)(i) << FIXED_SHIFT)
+#define FixedToInt(f)		((long)(f) >> FIXED_SHIFT)
+#define FixedToIntExact(f)	((long)(f) >> FIXED_SHIFT)
+#define FixedMul(a, b)		(((Fixed)(a) * (b)) >> FIXED_SHIFT)
+
+#define FixedAdd(a, b)		((a) + (b))
+#define FixedSub(a, b)		((a) - (b))
+#define FixedNeg(a)			(-(a))
+#define FixedAbs(a)			((a) < 0 ? -(a) : (a))
+#define FixedScale(a, n)	((a) * (n))
+#define FixedDivInt(a, n)	((a) / (n))
+#define FixedRatio(a, b)	((a) / (b))
+#define FixedCompare(a, b)	(((a) > (b)) - ((a) < (b)))
+
+#endif
+
+/* A position or velocity of the game, the fixed point counterpart of a libgte VECTOR. */
+typedef struct
+{
+	Fixed vx, vy, vz;
+} FixedVector;
+
+/* Converts a vector from whole units to fixed point and back. */
+#define FixedVectorFromInt(in, out)	setVector((out), FixedFromInt((in)->vx), FixedFromInt((in)->vy), FixedFromInt((in)->vz))
+#define FixedVectorToInt(in, out)	setVector((out), FixedToInt((in)->vx), FixedToInt((in)->vy), FixedToInt((in)->vz))
+
+/* Copies a vector to and from a VECTOR which keeps the 20.12 scaling, for the ONE-scaled interfaces. */
+#define FixedVectorToScaled(in, out)	setVector((out), FIXED_RAW((in)->vx), FIXED_RAW((in)->vy), FIXED_RAW((in)->vz))
+#define FixedVectorFromScaled(in, out)	setVector((out), FixedFromRaw((in)->vx), FixedFromRaw((in)->vy), FixedFromRaw((in)->vz))
+
+#endif
@@ -0,0 +1,53 @@
+
+#ifndef _FONT_H_
+#define _FONT_H_
+
+#include <sys/types.h>
+
+/*
+ * Layout of a baked font file (*.FNT), written by the fontbake host tool.
+ *
+ *   FontHeader
+ *   u_char index[256]            glyph index of every character, FONT_NO_GLYPH if missing
+ *   FontGlyph glyphs[glyphCount]
+ *   TIM file of the font sheet   (timSize bytes, may be 0 if another font brings the sheet)
+ *
+ * Everything the GPU needs to draw a glyph is precomputed for the VRAM position of the
+ * sheet, so drawing text is a table lookup per character.
+ */
+
+#define FONT_ID			0x544e4f46	/* "FONT" */
+#define FONT_VERSION	1
+#define FONT_NO_GLYPH	255
+
+typedef struct
+{
+	u_long id;
+	u_short version;
+	u_short glyphCount;
+	/* Color mode of the sheet (pmode of the TIM, 0 = 4 bit, 1 = 8 bit, 2 = 16 bit). */
+	u_char colorMode;
+	/* Distance between two lines of text in pixels. */
+	u_char lineHeight;
+	u_short reserved;
+	/* Size in bytes and offset from the start of the file of the embedded TIM file. */
+	u_long timSize;
+	u_long timOffset;
+} FontHeader;
+
+typedef struct
+{
+	/* Texture page (GetTPage value) and CLUT position of the glyph. */
+	u_short tpage;
+	u_short cx, cy;
+	/* Position of the glyph inside its texture page and size in pixels. */
+	u_char u, v;
+	u_char w, h;
+	/* Offset from the cursor to the top left corner of the glyph. */
+	char xoffset, yoffset;
+	/* Amount of pixels the cursor moves after the glyph, spacing included. */
+	u_char advance;
+	u_char reserved;
+} FontGlyph;
+
+#endif
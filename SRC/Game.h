@@ -2,6 +2,121 @@
 #ifndef _GAME_H_
 #define _GAME_H_
 
+#include <sys/types.h>
+#include <libgte.h>
+
+#include "Ball.h"
+
+/* Maximum number of blocks in a level. */
+#define MAX_BLOCKS 32
+
+/* Players of a versus game. */
+#define MAX_PLAYERS 2
+
+/*
+ * Snapshot of the game state: the blocks, balls and paddles, scores, tries and the level.
+ * Positions and velocities are stored in fixed point as they are, so a snapshot
+ * restores the simulation exactly. What is the same for every frame of a game is left out:
+ * everything happens on the ground plane, the paddles stay on their line and blocks sit on
+ * whole world units. Particles and sounds are not part of it.
+ */
+typedef struct {
+	/* Position, or the position relative to the paddle if the ball is grabbed. */
+	Fixed x, z;
+	Fixed vx, vz;
+	/* SNAPSHOT_BALL_* bits. */
+	u_char flags;
+	u_char owner;
+	u_char hitBy;
+	u_char pad;
+} SnapshotBall;
+
+#define SNAPSHOT_BALL_ENABLED	1
+#define SNAPSHOT_BALL_GRABBED	2
+
+typedef struct {
+	/* Center in world units. */
+	short x, z;
+	/* 0 for no block, the whole entry is 0 then. */
+	u_char type;
+	u_char power;
+} SnapshotBlock;
+
+typedef struct {
+	/* Paddle position and speed. */
+	Fixed x, vx;
+	long score;
+	short tries;
+	short pad;
+} SnapshotPlayer;
+
+typedef struct {
+	u_char level;
+	/* Level whose blocks are set up, the next frame sets up level if it differs. */
+	u_char loadedLevel;
+	u_char playerCount;
+	u_char pad;
+	SnapshotPlayer players[MAX_PLAYERS];
+	SnapshotBlock blocks[MAX_BLOCKS];
+	SnapshotBall balls[MAX_BALLS];
+} GameSnapshot;
+
+/*
+ * Captures the game state after the last frame. Unused entries are all 0, so two snapshots of
+ * the same state are equal byte for byte.
+ */
+void SaveGameSnapshot(GameSnapshot* snapshot);
+
+/*
+ * Puts the game back into the state of a snapshot taken in the same game, the particles are
+ * cleared. The number of players has to be the same.
+ */
+void LoadGameSnapshot(GameSnapshot* snapshot);
+
 int HandleGsGame();
 
+/*
+ * Handles the GS_DEMO gamestate, the game played by the autopilot (see Autopilot.h). It
+ * returns to the title when a button is pressed, after the game is over or after
+ * DEMO_SECONDS.
+ */
+int HandleGsDemo();
+
+/* Longest time the autopilot plays before the title comes back. */
+#define DEMO_SECONDS 90
+
+/*
+ * Handles the GS_VERSUS gamestate, two players on a split screen with a paddle each. Blocks
+ * score for the player who hit the ball last. The autopilot plays the second paddle if there
+ * is no controller in port 2.
+ */
+int HandleGsVersus();
+
+/*
+ * The game scene without the game around it, used by the benchmark (see Bench.c).
+ * BeginGameScene loads and sets up everything HandleGsGame draws and EndGameScene gives it
+ * back. SetupGameScene replaces the level with a field of the given number of blocks and
+ * balls in flight and players, each with a view of their own like in a versus game,
+ * StepGameScene moves the balls (lost balls are launched again) and DrawGameScene sorts the
+ * scene into the frame, seen from eye towards target (world units), or from the cameras of
+ * the game if they are 0. Text has to be drawn before the scene.
+ */
+void BeginGameScene();
+void EndGameScene();
+void SetupGameScene(int blocks, int balls, int players);
+void StepGameScene();
+void DrawGameScene(VECTOR* eye, VECTOR* target);
+
+/*
+ * Horizontal blanks (see GetFrameLines) the last scene drawn took, for what all views of the
+ * frame share (BuildScene) and for all views together.
+ */
+typedef struct
+{
+	u_long shared;
+	u_long views;
+} SceneCost;
+
+SceneCost* GetSceneCost();
+
 #endif
@@ -0,0 +1,153 @@
+/*
+ * Frame time governor, see Governor.h. It only picks the level, the game applies the
+ * settings of it to the scene.
+ */
+
+#include <sys/types.h>
+#include <libgte.h>
+#include <libgpu.h>
+#include <libgs.h>
+
+#include "Governor.h"
+#include "Particle.h"
+
+/* Average frame time, in percent of a field, above which the level is lowered and below which it is raised. */
+#define DROP_PERCENT	90
+#define RAISE_PERCENT	65
+
+/* The average follows every frame by 1/8 of the difference. */
+#define AVERAGE_SHIFT	3
+
+/* Frames after a change in which the level stays, the average has to settle first. */
+#define HOLD_FRAMES		30
+
+/* Short frames in a row before the level is raised, and the most it can grow to. */
+#define RAISE_FRAMES		120
+#define MAX_RAISE_FRAMES	(RAISE_FRAMES * 8)
+
+static const QualityLevel s_levels[QUALITY_LEVELS] =
+{
+	{ 256, GsDIV1, PARTICLE_PRIM_BUDGET / 4, PARTICLE_EMIT_BUDGET / 4 },
+	{ 320, GsDIV1, PARTICLE_PRIM_BUDGET / 2, PARTICLE_EMIT_BUDGET / 2 },
+	{ 320, GsDIV2, PARTICLE_PRIM_BUDGET, PARTICLE_EMIT_BUDGET },
+	{ 320, GsDIV3, PARTICLE_PRIM_BUDGET, PARTICLE_EMIT_BUDGET },
+};
+
+static int s_level = QUALITY_DEFAULT;
+static int s_lockedLevel = -1;
+
+static u_long s_holdFrames = 0;
+static u_long s_shortFrames = 0;
+static u_long s_levelFrames = 0;
+/* Short frames needed before each level is raised to. */
+static u_long s_raiseFrames[QUALITY_LEVELS];
+
+static GovernorStats s_stats;
+
+const QualityLevel* GetQualityLevel(int level)
+{
+	return &s_levels[level];
+}
+
+void ResetGovernor()
+{
+	int i;
+
+	s_level = s_lockedLevel >= 0 ? s_lockedLevel : QUALITY_DEFAULT;
+	s_holdFrames = HOLD_FRAMES;
+	s_shortFrames = 0;
+	s_levelFrames = 0;
+
+	for (i = 0; i < QUALITY_LEVELS; ++i)
+	{
+		s_raiseFrames[i] = RAISE_FRAMES;
+	}
+
+	s_stats.averageTime = 0;
+	s_stats.drops = 0;
+	s_stats.raises = 0;
+}
+
+void LockQuality(int level)
+{
+	s_lockedLevel = level < QUALITY_LEVELS ? level : QUALITY_LEVELS - 1;
+	ResetGovernor();
+}
+
+/* Switches to another level and holds it until the average settled. */
+static void ChangeLevel(int level)
+{
+	s_level = level;
+	s_holdFrames = HOLD_FRAMES;
+	s_shortFrames = 0;
+	s_levelFrames = 0;
+}
+
+int UpdateGovernor(u_long frameTime, u_long budget)
+{
+	u_long average;
+
+	if (frameTime > s_stats.averageTime)
+	{
+		s_stats.averageTime += (frameTime - s_stats.averageTime) >> AVERAGE_SHIFT;
+	}
+	else
+	{
+		s_stats.averageTime -= (s_stats.averageTime - frameTime) >> AVERAGE_SHIFT;
+	}
+
+	average = s_stats.averageTime;
+	s_levelFrames++;
+
+	if (s_lockedLevel >= 0)
+	{
+		return 0;
+	}
+
+	if (s_holdFrames > 0)
+	{
+		s_holdFrames--;
+		return 0;
+	}
+
+	if (average * 100 > budget * DROP_PERCENT && s_level > 0)
+	{
+		/* Left again before it was kept as long as it took to get there, so it waits longer next time */
+		if (s_levelFrames < s_raiseFrames[s_level] && s_raiseFrames[s_level] < MAX_RAISE_FRAMES)
+		{
+			s_raiseFrames[s_level] *= 2;
+		}
+
+		ChangeLevel(s_level - 1);
+		s_stats.drops++;
+		return 1;
+	}
+
+	if (average * 100 < budget * RAISE_PERCENT)
+	{
+		s_shortFrames++;
+	}
+	else
+	{
+		s_shortFrames = 0;
+	}
+
+	if (s_level < QUALITY_LEVELS - 1 && s_shortFrames >= s_raiseFrames[s_level + 1])
+	{
+		ChangeLevel(s_level + 1);
+		s_stats.raises++;
+		return 1;
+	}
+
+	return 0;
+}
+
+int GetQuality()
+{
+	return s_level;
+}
+
+GovernorStats* GetGovernorStats()
+{
+	return &s_stats;
+}
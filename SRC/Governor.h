@@ -0,0 +1,65 @@
+#ifndef _GOVERNOR_H_
+#define _GOVERNOR_H_
+
+#include <sys/types.h>
+
+/*
+ * Frame time governor.
+ *
+ * The detail of the game scene comes in quality levels, from the cheapest to the best
+ * looking. The governor watches how long the frames take and steps down a level when the
+ * frames get close to the length of a field, so the game keeps its refresh rate with many
+ * balls and effects on screen, and steps up again once the frames have been short for a
+ * while. The gap between the two thresholds, the frames it waits after every change and
+ * the longer wait before a level is tried again which was just left keep it from going back
+ * and forth between two levels.
+ */
+
+/* Quality levels, QUALITY_DEFAULT is the one of a new game. */
+#define QUALITY_LEVELS	4
+#define QUALITY_DEFAULT	2
+
+typedef struct
+{
+	/* Width of the display buffers (see SetScreenWidth). */
+	short screenWidth;
+	/* Subdivision of the floor polygons, a GsDIVn attribute. */
+	u_long floorDivision;
+	/* Particle primitives and emits per frame (see SetParticleBudgets). */
+	short particlePrims;
+	short particleEmits;
+} QualityLevel;
+
+typedef struct
+{
+	/* Frame time averaged over the last frames, in horizontal blanks. */
+	u_long averageTime;
+	/* Times the level was lowered and raised. */
+	u_long drops;
+	u_long raises;
+} GovernorStats;
+
+/* Returns the settings of a quality level. */
+const QualityLevel* GetQualityLevel(int level);
+
+/* Starts over at QUALITY_DEFAULT, or at the locked level. */
+void ResetGovernor();
+
+/*
+ * Keeps the governor at the given level, -1 lets it choose again. Used where frame times
+ * don't tell anything about the console, like the host tools.
+ */
+void LockQuality(int level);
+
+/*
+ * Takes the time of the last frame (see GetFrameTime) into account and returns 1 if the
+ * quality level changed. budget is the length of a field, both in horizontal blanks.
+ */
+int UpdateGovernor(u_long frameTime, u_long budget);
+
+/* Returns the current quality level. */
+int GetQuality();
+
+GovernorStats* GetGovernorStats();
+
+#endif
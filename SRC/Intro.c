@@ -0,0 +1,215 @@
+/*
+ * Breakanoid
+ * Copyright (C) 2022, Kyoril. All rights reserved.
+ * ================================================
+ * This file contains function implementations for
+ * the intro state, which plays the intro movie before
+ * the title.
+ */
+
+#include <sys/types.h>
+#include <libetc.h>
+#include <libgte.h>
+#include <libgpu.h>
+#include <libgs.h>
+#include <libcd.h>
+#include <libpress.h>
+
+#include <stdlib.h>
+
+#include "Intro.h"
+#include "Engine.h"
+#include "Asset.h"
+#include "Breakout.h"
+#include "PckLib.h"
+
+/*
+ * Frames are decoded into one of two movie buffers in VRAM while the other one is shown,
+ * right of the display buffers. Each is 320x256, drawn as two 16 bit sprites since a
+ * texture page is 256 pixels wide.
+ */
+#define MOVIE_X			512
+#define MOVIE_Y(buffer)	((buffer) * 256)
+
+/* Sectors of the ring buffer the drive streams into, room for a few frames. */
+#define RING_SECTORS	48
+
+/* Run/level codes of a frame at most, in 32 bit words: the MDEC command and the count its header can hold. */
+#define VLC_WORDS		(1 + 0xffff)
+
+/* Output of the MDEC: 16 bit pixels with the mask bit set, so black isn't transparent. */
+#define DCT_MODE		2
+
+/* The MDEC puts out a column of macroblocks at a time, 16 pixels wide. */
+#define SLICE_WIDTH		16
+
+/* Two slice buffers: one is uploaded to VRAM while the MDEC fills the other. */
+static u_long s_slices[2][SLICE_WIDTH * INTRO_MAX_HEIGHT / 2];
+
+/* Decodes a frame of the stream into the given movie buffer. Returns 0 if it is damaged or too large. */
+static int DecodeFrame(u_long* frame, StrHeader* header, u_long* vlc, int buffer)
+{
+	RECT slice;
+	int x, i = 0;
+
+	if (header->width > INTRO_MAX_WIDTH || header->height > INTRO_MAX_HEIGHT ||
+		header->width % SLICE_WIDTH != 0 || header->height % SLICE_WIDTH != 0)
+	{
+		StFreeRing(frame);
+		return 0;
+	}
+
+	/* The codes are all the MDEC needs, the ring can take the next sectors */
+	if (DecDCTvlc(frame, vlc) != 0)
+	{
+		StFreeRing(frame);
+		return 0;
+	}
+	StFreeRing(frame);
+
+	DecDCTin(vlc, DCT_MODE);
+	setRECT(&slice, MOVIE_X, MOVIE_Y(buffer), SLICE_WIDTH, header->height);
+
+	for (x = 0; x < header->width; x += SLICE_WIDTH, i ^= 1)
+	{
+		DecDCTout(s_slices[i], SLICE_WIDTH * header->height / 2);
+		DecDCToutSync(0);
+
+		/* The upload of the other slice has to finish before the next one is decoded into it */
+		DrawSync(0);
+		slice.x = MOVIE_X + x;
+		LoadImage(&slice, s_slices[i]);
+	}
+
+	return 1;
+}
+
+/* Creates the sprites which show a movie buffer, centred on the screen. */
+static void CreateMovieSprites(GsSPRITE* sprites, int buffer, int width, int height)
+{
+	GsIMAGE image;
+	int i, w;
+
+	for (i = 0; i < 2; ++i)
+	{
+		w = width - i * 256 < 256 ? width - i * 256 : 256;
+
+		image.pmode = 2;
+		image.px = MOVIE_X + i * 256;
+		image.py = MOVIE_Y(buffer);
+		image.pw = w;
+		image.ph = height;
+		image.cx = image.cy = 0;
+
+		sprites[i] = CreateSprite(image, 0, 0, w > 0 ? w : 0, height, 0, 0);
+		sprites[i].tpage = GetTPage(2, 0, image.px, image.py);
+		sprites[i].x = (GetScreenWidth() - width) / 2 + i * 256;
+		sprites[i].y = (GetScreenHeight() - height) / 2;
+	}
+}
+
+int HandleGsIntro()
+{
+	CdlFILE file;
+	RECT movieArea;
+	GsSPRITE sprites[2];
+	StrHeader* header;
+	StrHeader info;
+	InputState* input;
+	u_long* ring;
+	u_long* vlc;
+	u_long* frame;
+	u_long frames = 0, lastFrame = 0;
+	int back = 0, shown = 0, stall = 0, interval = 0, sinceFrame = 0;
+
+	/* A read ahead of PckLib may still be going on, the drive has to be idle to search and seek */
+	PckFlush();
+
+	/* Without a movie the game starts at the title */
+	if (CdSearchFile(&file, INTRO_FILE) == 0)
+	{
+		return GS_TITLE;
+	}
+
+	ring = (u_long*)AssetAlloc(RING_SECTORS * 2048);
+	vlc = (u_long*)AssetAlloc(VLC_WORDS * 4);
+	if (ring == 0 || vlc == 0)
+	{
+		free(ring);
+		free(vlc);
+		return GS_TITLE;
+	}
+
+	/* TIMs in the way of the movie buffers have to be uploaded again */
+	setRECT(&movieArea, MOVIE_X, 0, INTRO_MAX_WIDTH, MOVIE_Y(2));
+	InvalidateVram(&movieArea);
+
+	DecDCTReset(0);
+	StSetRing(ring, RING_SECTORS);
+	StSetStream(0, 1, 0xffffffff, 0, 0);
+	CdControl(CdlSetloc, (u_char*)&file.pos, 0);
+	CdRead2(CdlModeStream | CdlModeSpeed | CdlModeRT);
+
+	SetDispMask(1);
+
+	while(1)
+	{
+		BeginFrame();
+
+		UpdateInput();
+		input = GetInput(0);
+		if (IsInputPressed(input, PAD_Start))
+		{
+			break;
+		}
+
+		sinceFrame++;
+
+		if (StGetNext(&frame, (u_long**)&header) == 0)
+		{
+			/* The header goes back to the ring with the frame */
+			info = *header;
+
+			/* Every frame takes as many sectors as the first one, which tells where the movie ends */
+			if (frames == 0 && info.sectors != 0)
+			{
+				frames = file.size / 2048 / info.sectors;
+			}
+
+			if (DecodeFrame(frame, &info, vlc, back))
+			{
+				CreateMovieSprites(sprites, back, info.width, info.height);
+				back ^= 1;
+				shown = 1;
+			}
+
+			lastFrame = info.frame;
+			interval = sinceFrame;
+			sinceFrame = 0;
+			stall = 0;
+		}
+		/* The last frame is shown as long as the ones before, a stream which stops ends the intro after a second */
+		else if (++stall > (frames != 0 && lastFrame >= frames ? interval : GetRefreshRate()))
+		{
+			break;
+		}
+
+		if (shown)
+		{
+			DrawSprite(&sprites[0]);
+			if (sprites[1].w > 0)
+			{
+				DrawSprite(&sprites[1]);
+			}
+		}
+
+		EndFrame();
+	}
+
+	CdControlB(CdlPause, 0, 0);
+	StUnSetRing();
+	free(vlc);
+	free(ring);
+
+	return GS_TITLE;
+}
@@ -0,0 +1,49 @@
+#ifndef _INTRO_H_
+#define _INTRO_H_
+
+#include <sys/types.h>
+
+/*
+ * Intro movie, played from INTRO.STR before the title. Start skips it, without the file
+ * the game goes straight to the title.
+ *
+ * INTRO.STR (written by the strtool host tool) is a movie of MDEC frames (see HOST/Mdec.h)
+ * without sound. Every frame takes the same number of sectors, so the drive delivers them
+ * at a steady rate: 10 sectors at double speed are 15 frames a second. Each sector starts
+ * with a StrHeader, the rest of it holds the next part of the frame.
+ */
+
+#define INTRO_FILE			"\\INTRO.STR;1"
+
+/* Sector header of a movie. */
+#define STR_ID				0x0160
+#define STR_TYPE			0x8001
+#define STR_HEADER_SIZE		32
+#define STR_PAYLOAD			(2048 - STR_HEADER_SIZE)
+
+/* Largest frame the intro shows, and the sectors a frame takes unless strtool is told otherwise. */
+#define INTRO_MAX_WIDTH		320
+#define INTRO_MAX_HEIGHT	256
+#define INTRO_FRAME_SECTORS	10
+
+typedef struct
+{
+	u_short id;
+	u_short type;
+	/* Sector of the frame, and the sectors it takes. */
+	u_short sector;
+	u_short sectors;
+	/* Number of the frame, from 1 on, and its size in bytes. */
+	u_long frame;
+	u_long frameSize;
+	u_short width;
+	u_short height;
+	/* The first 8 bytes of the frame. */
+	u_long mdecHeader[2];
+	u_long pad;
+} StrHeader;
+
+/* Plays the intro, returns the state which follows. */
+int HandleGsIntro();
+
+#endif
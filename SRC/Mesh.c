@@ -0,0 +1,460 @@
+/*
+ * Instanced mesh rendering. Models which are drawn many times with the same rotation
+ * (the level blocks) are transformed with the GTE directly and their primitives are
+ * written straight into the GPU packet area, instead of going through GsSortObject4
+ * with a full coordinate system setup for every single instance. Models which are only
+ * a few pixels across (the balls) are drawn as impostors the same way.
+ */
+
+#include <sys/types.h>
+#include <libgte.h>
+#include <libgpu.h>
+#include <libgs.h>
+
+#include "Engine.h"
+#include "Mesh.h"
+
+/* TMD primitive mode bits and the flag of primitives without light calculation. */
+#define TMD_MODE_POLY		0x20
+#define TMD_MODE_GOURAUD	0x10
+#define TMD_MODE_QUAD		0x08
+#define TMD_MODE_TEXTURE	0x04
+#define TMD_FLAG_UNLIT		0x01
+
+/* Screen coordinates and depths of the instance currently being drawn. One spare entry keeps
+   NormalClip's 32 bit loads inside the array on 64 bit hosts. */
+static DVECTOR s_screen[MAX_MESH_VERTICES + 1];
+static u_short s_depth[MAX_MESH_VERTICES];
+static u_short s_interpolation[MAX_MESH_VERTICES];
+static u_short s_flags[MAX_MESH_VERTICES];
+
+int CreateInstancedMesh(u_long* tmd, InstancedMesh* mesh)
+{
+	u_long* objectTable;
+	SVECTOR* vertices;
+	u_char* primitive;
+	u_char* data;
+	u_short* indices;
+	MeshFace* face;
+	int numVertices, numPrimitives;
+	int i, j, n, colors, mode;
+
+	/* Skip ID and flags, the first object follows the object count. */
+	objectTable = tmd + 3;
+
+	/* Once GsMapModelingData ran, the object table holds addresses instead of offsets. */
+	if (tmd[1] & 1)
+	{
+		vertices = (SVECTOR*)objectTable[0];
+		primitive = (u_char*)objectTable[4];
+	}
+	else
+	{
+		vertices = (SVECTOR*)((u_char*)objectTable + objectTable[0]);
+		primitive = (u_char*)objectTable + objectTable[4];
+	}
+
+	numVertices = objectTable[1];
+	numPrimitives = objectTable[5];
+
+	if (numVertices > MAX_MESH_VERTICES || numPrimitives > MAX_MESH_FACES)
+	{
+		return 0;
+	}
+
+	for (i = 0; i < numVertices; ++i)
+	{
+		mesh->vertices[i] = vertices[i];
+	}
+
+	mesh->vertexCount = numVertices;
+	mesh->faceCount = 0;
+
+	for (i = 0; i < numPrimitives; ++i)
+	{
+		/* Primitive header: olen, ilen, flag, mode. Only single sided polygons with baked light are supported. */
+		mode = primitive[3];
+		if ((mode & 0xe0) != TMD_MODE_POLY || primitive[2] != TMD_FLAG_UNLIT)
+		{
+			return 0;
+		}
+
+		face = &mesh->faces[mesh->faceCount++];
+		face->flags = ((mode & TMD_MODE_QUAD) ? MESH_FACE_QUAD : 0) | ((mode & TMD_MODE_TEXTURE) ? MESH_FACE_TEXTURED : 0) |
+			((mode & TMD_MODE_GOURAUD) ? MESH_FACE_GOURAUD : 0);
+		n = (face->flags & MESH_FACE_QUAD) ? 4 : 3;
+		data = primitive + 4;
+
+		if (face->flags & MESH_FACE_TEXTURED)
+		{
+			/* U0 V0 CBA, U1 V1 TSB, U2 V2 pad, (U3 V3 pad) */
+			for (j = 0; j < n; ++j, data += 4)
+			{
+				face->u[j] = data[0];
+				face->v[j] = data[1];
+			}
+
+			face->clut = *(u_short*)(primitive + 4 + 2);
+			face->tpage = *(u_short*)(primitive + 8 + 2);
+		}
+
+		/* R G B mode/pad, one per vertex for gouraud faces */
+		colors = (face->flags & MESH_FACE_GOURAUD) ? n : 1;
+		for (j = 0; j < colors; ++j, data += 4)
+		{
+			face->color[j].r = data[0];
+			face->color[j].g = data[1];
+			face->color[j].b = data[2];
+			face->color[j].cd = (u_char)mode;
+		}
+
+		/* Vert0 Vert1, Vert2 (Vert3 or pad) */
+		indices = (u_short*)data;
+		for (j = 0; j < 4; ++j)
+		{
+			face->vertex[j] = j < n ? (u_char)indices[j] : 0;
+		}
+
+		primitive += 4 + primitive[1] * 4;
+	}
+
+	return 1;
+}
+
+void DrawMeshInstances(InstancedMesh* mesh, SVECTOR* positions, int count)
+{
+	GsOT* ot;
+	MATRIX local;
+	VECTOR position, translation;
+	MeshFace* face;
+	PACKET* packet;
+	POLY_F3* f3;
+	POLY_F4* f4;
+	POLY_FT3* ft3;
+	POLY_FT4* ft4;
+	POLY_G3* g3;
+	POLY_G4* g4;
+	POLY_GT3* gt3;
+	POLY_GT4* gt4;
+	CVECTOR* c;
+	int i, j, otz, otMax;
+	u_char* v;
+
+	if (count <= 0)
+	{
+		return;
+	}
+
+	ot = GetActiveOT();
+	otMax = (1 << ot->length) - 1;
+
+	/* The view rotation is set once, each instance only changes the translation. */
+	local = GsWSMATRIX;
+	SetRotMatrix(&local);
+
+	packet = GsGetWorkBase();
+
+	for (i = 0; i < count; ++i)
+	{
+		setVector(&position, positions[i].vx, positions[i].vy, positions[i].vz);
+		ApplyMatrixLV(&GsWSMATRIX, &position, &translation);
+		local.t[0] = translation.vx + GsWSMATRIX.t[0];
+		local.t[1] = translation.vy + GsWSMATRIX.t[1];
+		local.t[2] = translation.vz + GsWSMATRIX.t[2];
+		SetTransMatrix(&local);
+
+		RotTransPersN(mesh->vertices, s_screen, s_depth, s_interpolation, s_flags, mesh->vertexCount);
+
+		for (j = 0; j < mesh->faceCount; ++j)
+		{
+			face = &mesh->faces[j];
+			v = face->vertex;
+			c = face->color;
+
+			/* Vertices on or behind the near plane end up with a depth of 0. */
+			if (s_depth[v[0]] == 0 || s_depth[v[1]] == 0 || s_depth[v[2]] == 0)
+			{
+				continue;
+			}
+
+			/* Back face culling */
+			if (NormalClip(*(long*)&s_screen[v[0]], *(long*)&s_screen[v[1]], *(long*)&s_screen[v[2]]) <= 0)
+			{
+				continue;
+			}
+
+			if (face->flags & MESH_FACE_QUAD)
+			{
+				if (s_depth[v[3]] == 0)
+				{
+					continue;
+				}
+
+				otz = (s_depth[v[0]] + s_depth[v[1]] + s_depth[v[2]] + s_depth[v[3]]) >> 2;
+			}
+			else
+			{
+				otz = ((s_depth[v[0]] + s_depth[v[1]] + s_depth[v[2]]) * 1365) >> 12;
+			}
+
+			/* Same OT resolution as GsSortObject4 with a shift of 14 - length */
+			otz >>= 14 - ot->length;
+			if (otz > otMax)
+			{
+				otz = otMax;
+			}
+
+			switch (face->flags)
+			{
+			case 0:
+				f3 = (POLY_F3*)packet;
+				setPolyF3(f3);
+				setRGB0(f3, c[0].r, c[0].g, c[0].b);
+				setXY3(f3, s_screen[v[0]].vx, s_screen[v[0]].vy, s_screen[v[1]].vx, s_screen[v[1]].vy,
+					s_screen[v[2]].vx, s_screen[v[2]].vy);
+				addPrim(ot->org + otz, f3);
+				packet += sizeof(POLY_F3);
+				break;
+
+			case MESH_FACE_QUAD:
+				f4 = (POLY_F4*)packet;
+				setPolyF4(f4);
+				setRGB0(f4, c[0].r, c[0].g, c[0].b);
+				setXY4(f4, s_screen[v[0]].vx, s_screen[v[0]].vy, s_screen[v[1]].vx, s_screen[v[1]].vy,
+					s_screen[v[2]].vx, s_screen[v[2]].vy, s_screen[v[3]].vx, s_screen[v[3]].vy);
+				addPrim(ot->org + otz, f4);
+				packet += sizeof(POLY_F4);
+				break;
+
+			case MESH_FACE_TEXTURED:
+				ft3 = (POLY_FT3*)packet;
+				setPolyFT3(ft3);
+				setRGB0(ft3, c[0].r, c[0].g, c[0].b);
+				setXY3(ft3, s_screen[v[0]].vx, s_screen[v[0]].vy, s_screen[v[1]].vx, s_screen[v[1]].vy,
+					s_screen[v[2]].vx, s_screen[v[2]].vy);
+				setUV3(ft3, face->u[0], face->v[0], face->u[1], face->v[1], face->u[2], face->v[2]);
+				ft3->tpage = face->tpage;
+				ft3->clut = face->clut;
+				addPrim(ot->org + otz, ft3);
+				packet += sizeof(POLY_FT3);
+				break;
+
+			case MESH_FACE_TEXTURED | MESH_FACE_QUAD:
+				ft4 = (POLY_FT4*)packet;
+				setPolyFT4(ft4);
+				setRGB0(ft4, c[0].r, c[0].g, c[0].b);
+				setXY4(ft4, s_screen[v[0]].vx, s_screen[v[0]].vy, s_screen[v[1]].vx, s_screen[v[1]].vy,
+					s_screen[v[2]].vx, s_screen[v[2]].vy, s_screen[v[3]].vx, s_screen[v[3]].vy);
+				setUV4(ft4, face->u[0], face->v[0], face->u[1], face->v[1], face->u[2], face->v[2],
+					face->u[3], face->v[3]);
+				ft4->tpage = face->tpage;
+				ft4->clut = face->clut;
+				addPrim(ot->org + otz, ft4);
+				packet += sizeof(POLY_FT4);
+				break;
+
+			case MESH_FACE_GOURAUD:
+				g3 = (POLY_G3*)packet;
+				setPolyG3(g3);
+				setRGB0(g3, c[0].r, c[0].g, c[0].b);
+				setRGB1(g3, c[1].r, c[1].g, c[1].b);
+				setRGB2(g3, c[2].r, c[2].g, c[2].b);
+				setXY3(g3, s_screen[v[0]].vx, s_screen[v[0]].vy, s_screen[v[1]].vx, s_screen[v[1]].vy,
+					s_screen[v[2]].vx, s_screen[v[2]].vy);
+				addPrim(ot->org + otz, g3);
+				packet += sizeof(POLY_G3);
+				break;
+
+			case MESH_FACE_GOURAUD | MESH_FACE_QUAD:
+				g4 = (POLY_G4*)packet;
+				setPolyG4(g4);
+				setRGB0(g4, c[0].r, c[0].g, c[0].b);
+				setRGB1(g4, c[1].r, c[1].g, c[1].b);
+				setRGB2(g4, c[2].r, c[2].g, c[2].b);
+				setRGB3(g4, c[3].r, c[3].g, c[3].b);
+				setXY4(g4, s_screen[v[0]].vx, s_screen[v[0]].vy, s_screen[v[1]].vx, s_screen[v[1]].vy,
+					s_screen[v[2]].vx, s_screen[v[2]].vy, s_screen[v[3]].vx, s_screen[v[3]].vy);
+				addPrim(ot->org + otz, g4);
+				packet += sizeof(POLY_G4);
+				break;
+
+			case MESH_FACE_GOURAUD | MESH_FACE_TEXTURED:
+				gt3 = (POLY_GT3*)packet;
+				setPolyGT3(gt3);
+				setRGB0(gt3, c[0].r, c[0].g, c[0].b);
+				setRGB1(gt3, c[1].r, c[1].g, c[1].b);
+				setRGB2(gt3, c[2].r, c[2].g, c[2].b);
+				setXY3(gt3, s_screen[v[0]].vx, s_screen[v[0]].vy, s_screen[v[1]].vx, s_screen[v[1]].vy,
+					s_screen[v[2]].vx, s_screen[v[2]].vy);
+				setUV3(gt3, face->u[0], face->v[0], face->u[1], face->v[1], face->u[2], face->v[2]);
+				gt3->tpage = face->tpage;
+				gt3->clut = face->clut;
+				addPrim(ot->org + otz, gt3);
+				packet += sizeof(POLY_GT3);
+				break;
+
+			default:
+				gt4 = (POLY_GT4*)packet;
+				setPolyGT4(gt4);
+				setRGB0(gt4, c[0].r, c[0].g, c[0].b);
+				setRGB1(gt4, c[1].r, c[1].g, c[1].b);
+				setRGB2(gt4, c[2].r, c[2].g, c[2].b);
+				setRGB3(gt4, c[3].r, c[3].g, c[3].b);
+				setXY4(gt4, s_screen[v[0]].vx, s_screen[v[0]].vy, s_screen[v[1]].vx, s_screen[v[1]].vy,
+					s_screen[v[2]].vx, s_screen[v[2]].vy, s_screen[v[3]].vx, s_screen[v[3]].vy);
+				setUV4(gt4, face->u[0], face->v[0], face->u[1], face->v[1], face->u[2], face->v[2],
+					face->u[3], face->v[3]);
+				gt4->tpage = face->tpage;
+				gt4->clut = face->clut;
+				addPrim(ot->org + otz, gt4);
+				packet += sizeof(POLY_GT4);
+				break;
+			}
+		}
+	}
+
+	GsSetWorkBase(packet);
+}
+
+int CreateImpostorMesh(u_long* tmd, long radius, ImpostorMesh* impostor)
+{
+	u_long* objectTable = tmd + 3;
+	u_char* primitive;
+	u_char* data;
+	u_long sum[3] = { 0, 0, 0 };
+	u_long count = 0;
+	int numPrimitives, i, j, colors, brightest = -1;
+
+	primitive = (tmd[1] & 1) ? (u_char*)objectTable[4] : (u_char*)objectTable + objectTable[4];
+	numPrimitives = objectTable[5];
+
+	for (i = 0; i < numPrimitives; ++i)
+	{
+		if ((primitive[3] & 0xe0) != TMD_MODE_POLY || primitive[2] != TMD_FLAG_UNLIT)
+		{
+			return 0;
+		}
+
+		/* The colors follow the texture coordinates, see CreateInstancedMesh */
+		data = primitive + 4;
+		colors = (primitive[3] & TMD_MODE_GOURAUD) ? ((primitive[3] & TMD_MODE_QUAD) ? 4 : 3) : 1;
+		if (primitive[3] & TMD_MODE_TEXTURE)
+		{
+			data += ((primitive[3] & TMD_MODE_QUAD) ? 4 : 3) * 4;
+		}
+
+		for (j = 0; j < colors; ++j, data += 4)
+		{
+			sum[0] += data[0];
+			sum[1] += data[1];
+			sum[2] += data[2];
+			count++;
+
+			if (data[0] + data[1] + data[2] > brightest)
+			{
+				brightest = data[0] + data[1] + data[2];
+				impostor->center.r = data[0];
+				impostor->center.g = data[1];
+				impostor->center.b = data[2];
+			}
+		}
+
+		primitive += 4 + primitive[1] * 4;
+	}
+
+	if (count == 0)
+	{
+		return 0;
+	}
+
+	impostor->radius = radius;
+	impostor->rim.r = (u_char)(sum[0] / count);
+	impostor->rim.g = (u_char)(sum[1] / count);
+	impostor->rim.b = (u_char)(sum[2] / count);
+
+	for (i = 0; i <= IMPOSTOR_SEGMENTS; ++i)
+	{
+		impostor->rimX[i] = (short)rcos(i * 4096 / IMPOSTOR_SEGMENTS);
+		impostor->rimY[i] = (short)rsin(i * 4096 / IMPOSTOR_SEGMENTS);
+	}
+
+	return 1;
+}
+
+void DrawImpostors(ImpostorMesh* impostor, SVECTOR* positions, int count)
+{
+	GsOT* ot;
+	MATRIX view;
+	PACKET* packet;
+	POLY_G3* g3;
+	CVECTOR* center = &impostor->center;
+	CVECTOR* rim = &impostor->rim;
+	short rimX[IMPOSTOR_SEGMENTS + 1], rimY[IMPOSTOR_SEGMENTS + 1];
+	int first, n, i, j, otz, otMax, rx, ry;
+	short x, y;
+
+	if (count <= 0)
+	{
+		return;
+	}
+
+	ot = GetActiveOT();
+	otMax = (1 << ot->length) - 1;
+
+	/* Positions are in world coordinates, so the view is the whole transformation */
+	view = GsWSMATRIX;
+	SetRotMatrix(&view);
+	SetTransMatrix(&view);
+
+	packet = GsGetWorkBase();
+
+	for (first = 0; first < count; first += MAX_MESH_VERTICES)
+	{
+		n = count - first < MAX_MESH_VERTICES ? count - first : MAX_MESH_VERTICES;
+		RotTransPersN(positions + first, s_screen, s_depth, s_interpolation, s_flags, n);
+
+		for (i = 0; i < n; ++i)
+		{
+			if (s_depth[i] == 0)
+			{
+				continue;
+			}
+
+			/* Projected radius with the projection distance of SwapTo3D, pixels get wider in narrower modes */
+			ry = impostor->radius * 160 / s_depth[i];
+			rx = ry * GetScreenWidth() / SCREEN_WIDTH;
+			if (ry < 1)
+			{
+				ry = rx = 1;
+			}
+
+			x = s_screen[i].vx;
+			y = s_screen[i].vy;
+			for (j = 0; j <= IMPOSTOR_SEGMENTS; ++j)
+			{
+				rimX[j] = (short)(x + impostor->rimX[j] * rx / ONE);
+				rimY[j] = (short)(y + impostor->rimY[j] * ry / ONE);
+			}
+
+			otz = s_depth[i] >> (14 - ot->length);
+			if (otz > otMax)
+			{
+				otz = otMax;
+			}
+
+			for (j = 0; j < IMPOSTOR_SEGMENTS; ++j)
+			{
+				g3 = (POLY_G3*)packet;
+				setPolyG3(g3);
+				setRGB0(g3, center->r, center->g, center->b);
+				setRGB1(g3, rim->r, rim->g, rim->b);
+				setRGB2(g3, rim->r, rim->g, rim->b);
+				setXY3(g3, x, y, rimX[j], rimY[j], rimX[j + 1], rimY[j + 1]);
+				addPrim(ot->org + otz, g3);
+				packet += sizeof(POLY_G3);
+			}
+		}
+	}
+
+	GsSetWorkBase(packet);
+}
@@ -0,0 +1,82 @@
+
+#ifndef _MESH_H_
+#define _MESH_H_
+
+#include <sys/types.h>
+#include <libgte.h>
+#include <libgpu.h>
+#include <libgs.h>
+
+/* Maximum number of vertices of an instanced mesh. */
+#define MAX_MESH_VERTICES 32
+/* Maximum number of faces of an instanced mesh. */
+#define MAX_MESH_FACES 48
+
+/* Face flags */
+#define MESH_FACE_QUAD		0x01	/* Face has four vertices instead of three. */
+#define MESH_FACE_TEXTURED	0x02	/* Face is textured (POLY_FT3/POLY_FT4). */
+#define MESH_FACE_GOURAUD	0x04	/* Face has a color per vertex (POLY_G3/POLY_G4/POLY_GT3/POLY_GT4). */
+
+/* A single face of an instanced mesh, with the light baked into its colors. */
+typedef struct
+{
+	u_char flags;
+	u_char vertex[4];
+	u_char u[4], v[4];
+	u_short tpage, clut;
+	/* Colors from the TMD, only the first one is used by flat faces. */
+	CVECTOR color[4];
+} MeshFace;
+
+/*
+ * A model which is drawn many times with the same rotation, like the level blocks.
+ * The geometry is taken from the first object of a TMD file and primitives are written
+ * straight into the GPU packet area, bypassing GsSortObject4. The TMD has to have its
+ * light baked in (HOST/tmdlight), lit primitives aren't supported.
+ */
+typedef struct
+{
+	SVECTOR vertices[MAX_MESH_VERTICES];
+	int vertexCount;
+	MeshFace faces[MAX_MESH_FACES];
+	int faceCount;
+} InstancedMesh;
+
+/* Builds an instanced mesh from a loaded TMD file. Returns 0 if the TMD uses unsupported or lit primitives. */
+int CreateInstancedMesh(u_long* tmd, InstancedMesh* mesh);
+
+/*
+ * Draws the mesh once for every position (world units, not scaled by ONE) using the view set by
+ * GsSetView2. The view matrix is set up once, then each instance only needs a translation
+ * and one batched perspective transformation of the shared vertices.
+ */
+void DrawMeshInstances(InstancedMesh* mesh, SVECTOR* positions, int count);
+
+/* Triangles of the fan an impostor is drawn with. */
+#define IMPOSTOR_SEGMENTS 8
+
+/*
+ * A round model which is only a few pixels across on screen, like the balls, drawn as a fan
+ * of gouraud triangles around its projected center: one perspective transformation per
+ * instance instead of one per vertex and a handful of primitives instead of hundreds of
+ * faces smaller than a pixel. The center has the brightest color of the model and the rim
+ * the mean of all its colors.
+ */
+typedef struct
+{
+	/* Radius in world units. */
+	long radius;
+	CVECTOR center;
+	CVECTOR rim;
+	/* Directions of the rim vertices, ONE-scaled. */
+	short rimX[IMPOSTOR_SEGMENTS + 1];
+	short rimY[IMPOSTOR_SEGMENTS + 1];
+} ImpostorMesh;
+
+/* Builds an impostor of the given radius from a loaded TMD file. Returns 0 if the TMD uses lit primitives. */
+int CreateImpostorMesh(u_long* tmd, long radius, ImpostorMesh* impostor);
+
+/* Draws the impostor once for every position (world units, not scaled by ONE) using the view set by GsSetView2. */
+void DrawImpostors(ImpostorMesh* impostor, SVECTOR* positions, int count);
+
+#endif
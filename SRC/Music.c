@@ -0,0 +1,336 @@
+/*
+ * Background music, see Music.h. The drive delivers the data sectors of MUSIC.XA with their
+ * header (CdlModeSize1), SectorReady finds out from its position which sector of the pack
+ * one is and copies it if a read waits for it. Everything else, looping and resuming, is
+ * done outside of the callback by Step.
+ */
+
+#include <sys/types.h>
+#include <libetc.h>
+#include <libcd.h>
+#include <libspu.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "Music.h"
+
+/* Most sectors a single read through the stream waits for. */
+#define MAX_STREAM_READ		512
+
+/* Vertical blanks without a data sector after which the stream is started again. */
+#define STALL_VBLANKS		30
+
+/* Volume of the CD input of the SPU. */
+#define MUSIC_VOLUME		0x3fff
+
+static int s_enabled = 0;
+
+/* First sector and length of MUSIC.XA, and of the pack it holds. */
+static int s_startSector;
+static int s_sectors;
+static int s_packStart;
+static int s_packSectors;
+
+/* Vertical blanks a read waits for at most, two trips through the pack. */
+static long s_readTimeout;
+
+/* Track which is played, -1 for none. */
+static int s_track = -1;
+
+/* The drive reads MUSIC.XA, and where it should go on when it doesn't. */
+static volatile int s_streaming = 0;
+static int s_resumeSector = 0;
+
+/* Sector of MUSIC.XA the last data sector came from, and the VSync count then. */
+static volatile int s_position = 0;
+static volatile long s_positionVSync = 0;
+
+/* Read waiting for pack sectors s_readFirst on, one bit for every sector which is there. */
+static u_long* s_readBuff;
+static int s_readFirst;
+static int s_readCount;
+static volatile int s_readLeft = 0;
+static volatile u_long s_readDone[MAX_STREAM_READ / 32];
+
+static MusicStats s_stats;
+
+static int StreamRead(int sector, int count, u_long* buff);
+static int StreamReadSync(void);
+static void StreamPause(void);
+
+static PckSTREAM s_stream = { StreamRead, StreamReadSync, StreamPause };
+
+/* Ready callback of the drive while it streams. */
+static void SectorReady(u_char intr, u_char* result)
+{
+	u_long header[3];
+	int sector, index;
+
+	if (intr != CdlDataReady)
+	{
+		return;
+	}
+
+	/* Header and subheader: the position (BCD minute, second and sector), then file and channel */
+	CdGetSector(header, 3);
+	sector = CdPosToInt((CdlLOC*)header) - s_startSector;
+
+	s_position = sector;
+	s_positionVSync = VSync(-1);
+
+	if (s_readLeft == 0 || sector < 0 || sector >= s_sectors || MUSIC_IS_AUDIO(sector))
+	{
+		return;
+	}
+
+	index = MUSIC_DATA_INDEX(sector) % s_packSectors - s_readFirst;
+	if (index < 0 || index >= s_readCount || (s_readDone[index / 32] & (1 << (index % 32))) != 0)
+	{
+		return;
+	}
+
+	CdGetSector(s_readBuff + index * 512, 512);
+	s_readDone[index / 32] |= 1 << (index % 32);
+	s_readLeft--;
+}
+
+/* Starts reading MUSIC.XA at the given sector, playing the current track. */
+static void StartStream(int sector)
+{
+	CdlFILTER filter;
+	CdlLOC pos;
+	u_char mode = CdlModeSpeed | CdlModeRT | CdlModeSF | CdlModeSize1;
+
+	filter.file = MUSIC_XA_FILE;
+	filter.chan = (u_char)s_track;
+	CdControlB(CdlSetfilter, (u_char*)&filter, 0);
+	CdControlB(CdlSetmode, &mode, 0);
+
+	s_position = sector;
+	s_positionVSync = VSync(-1);
+	s_streaming = 1;
+
+	CdReadyCallback(SectorReady);
+	CdIntToPos(s_startSector + sector, &pos);
+	CdControlF(CdlReadS, (u_char*)&pos);
+}
+
+/* Stops the drive, the music goes on from the current group when the stream starts again. */
+static void StopStream()
+{
+	if (!s_streaming)
+	{
+		return;
+	}
+
+	CdControlB(CdlPause, 0, 0);
+	CdReadyCallback(0);
+	s_streaming = 0;
+
+	s_resumeSector = (s_position + 1) / MUSIC_INTERLEAVE * MUSIC_INTERLEAVE;
+	if (s_resumeSector < 0 || s_resumeSector >= s_sectors)
+	{
+		s_resumeSector = 0;
+	}
+}
+
+/* Loops the stream at the end of MUSIC.XA, starts it again if it stalled or was paused. */
+static void Step()
+{
+	if (s_track < 0)
+	{
+		return;
+	}
+
+	if (!s_streaming)
+	{
+		StartStream(s_resumeSector);
+		return;
+	}
+
+	/* The drive reads on past the end of the file, back to the start */
+	if (s_position >= s_sectors - 1)
+	{
+		s_stats.loops++;
+		StartStream(0);
+	}
+	else if (VSync(-1) - s_positionVSync > STALL_VBLANKS)
+	{
+		s_stats.pauses++;
+		StopStream();
+		StartStream(s_resumeSector);
+	}
+}
+
+static int StreamRead(int sector, int count, u_long* buff)
+{
+	int i;
+
+	sector -= s_packStart;
+	if (s_track < 0 || sector < 0 || count > MAX_STREAM_READ || sector + count > s_packSectors)
+	{
+		return 0;
+	}
+
+	for (i = 0; i < MAX_STREAM_READ / 32; ++i)
+	{
+		s_readDone[i] = 0;
+	}
+
+	s_readBuff = buff;
+	s_readFirst = sector;
+	s_readCount = count;
+	s_readLeft = count;
+
+	Step();
+	return 1;
+}
+
+static int StreamReadSync(void)
+{
+	long start = VSync(-1);
+	long waited;
+
+	while (s_readLeft > 0)
+	{
+		if (VSync(-1) - start > s_readTimeout)
+		{
+			s_readLeft = 0;
+			return -1;
+		}
+
+		Step();
+		VSync(0);
+	}
+
+	waited = VSync(-1) - start;
+	s_stats.waitVBlanks += waited;
+	if ((u_long)waited > s_stats.longestWait)
+	{
+		s_stats.longestWait = waited;
+	}
+	s_stats.streamedSectors += s_readCount;
+
+	return 0;
+}
+
+static void StreamPause(void)
+{
+	if (s_streaming)
+	{
+		s_stats.pauses++;
+		StopStream();
+	}
+
+	s_readLeft = 0;
+	s_stats.directReads++;
+}
+
+int InitMusic(PckTOC* toc)
+{
+	CdlFILE file;
+	CdlLOC pos;
+	SpuCommonAttr common;
+	u_long* check;
+	int i, end, match;
+
+	s_enabled = 0;
+
+	PckFlush();
+	if (CdSearchFile(&file, MUSIC_FILE) == 0)
+	{
+		return 0;
+	}
+
+	s_startSector = CdPosToInt(&file.pos);
+	s_sectors = (file.size + 2047) / 2048;
+
+	s_packStart = toc->BasePos;
+	s_packSectors = 1;
+	for (i = 0; i < toc->NumFiles; ++i)
+	{
+		end = toc->File[i].Pos + (toc->File[i].Size + 2047) / 2048;
+		if (end > s_packSectors)
+		{
+			s_packSectors = end;
+		}
+	}
+
+	/* The first data sector is the TOC of the pack, if MUSIC.XA was made for another one its music still plays */
+	check = (u_long*)malloc(2048);
+	if (check == 0)
+	{
+		return 0;
+	}
+
+	CdIntToPos(s_startSector + 1, &pos);
+	match = CdControl(CdlSetloc, (u_char*)&pos, 0) != 0 && CdRead(1, check, CdlModeSpeed) != 0 &&
+		CdReadSync(0, 0) == 0 && memcmp(check, toc, sizeof(PckTOC) - sizeof(toc->BasePos)) == 0;
+	free(check);
+
+	if (!match)
+	{
+		s_packSectors = 0;
+	}
+
+	/* A trip through the pack at double speed, 150 sectors a second, in NTSC vertical blanks */
+	s_readTimeout = (long)s_packSectors * MUSIC_INTERLEAVE / MUSIC_DATA_SLOTS * 60 / 150 * 2 + 60;
+
+	common.mask = SPU_COMMON_CDVOLL | SPU_COMMON_CDVOLR | SPU_COMMON_CDMIX;
+	common.cd.volume.left = MUSIC_VOLUME;
+	common.cd.volume.right = MUSIC_VOLUME;
+	common.cd.mix = SPU_ON;
+	SpuSetCommonAttr(&common);
+
+	s_enabled = 1;
+	return 1;
+}
+
+void PlayMusic(int track)
+{
+	CdlFILTER filter;
+
+	if (!s_enabled || track == s_track)
+	{
+		return;
+	}
+
+	if (track < 0)
+	{
+		PckSetStream(0);
+		StopStream();
+		s_track = -1;
+		return;
+	}
+
+	s_track = track;
+
+	/* Another channel of the same stream, the drive doesn't have to move */
+	if (s_streaming)
+	{
+		filter.file = MUSIC_XA_FILE;
+		filter.chan = (u_char)track;
+		CdControlB(CdlSetfilter, (u_char*)&filter, 0);
+	}
+	else
+	{
+		StartStream(s_resumeSector);
+	}
+
+	/* Without the pack in MUSIC.XA every read pauses the music, StreamRead has none of its sectors */
+	PckSetStream(&s_stream);
+}
+
+void UpdateMusic()
+{
+	if (s_enabled)
+	{
+		Step();
+	}
+}
+
+MusicStats* GetMusicStats()
+{
+	return &s_stats;
+}
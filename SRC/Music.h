@@ -0,0 +1,79 @@
+#ifndef _MUSIC_H_
+#define _MUSIC_H_
+
+#include <sys/types.h>
+
+#include "PckLib.h"
+
+/*
+ * Background music, XA-ADPCM streamed from the disc.
+ *
+ * MUSIC.XA (written by the xatool host tool) is read from start to end at double speed,
+ * in groups of MUSIC_INTERLEAVE sectors. One sector of every group is XA audio of each
+ * track, on its own channel: the drive plays the sectors of the channel set with
+ * CdlSetfilter through the SPU and skips the others, so switching tracks doesn't seek.
+ * The other sectors of a group are data sectors holding the sectors of BREAKOUT.PCK, one
+ * after the other and starting over at its end, so that every sector of the pack passes
+ * by again and again.
+ *
+ * While the music plays, PckLib reads through the stream (see PckSetStream): the sectors
+ * it asks for are picked out of the data sectors as they pass, in any order, and the drive
+ * never leaves the music. Loading a file takes at most one trip through the pack, which is
+ * about as long as seeking and reading it, and the music goes on without a gap. Sectors
+ * which aren't in the stream are read the usual way, the music pauses for that and goes
+ * on where it stopped. Without MUSIC.XA on the disc there is no music, nothing else changes.
+ */
+
+#define MUSIC_FILE			"\\MUSIC.XA;1"
+
+/* Tracks, the XA channels of MUSIC.XA. */
+#define MUSIC_TRACKS		2
+#define MUSIC_TITLE			0
+#define MUSIC_GAME			1
+
+/* Sectors of a group, one of them carries audio of each track (37.8 kHz stereo at double speed). */
+#define MUSIC_INTERLEAVE	8
+#define MUSIC_DATA_SLOTS	(MUSIC_INTERLEAVE - MUSIC_TRACKS)
+#define MUSIC_STRIDE		(MUSIC_INTERLEAVE / MUSIC_TRACKS)
+
+/*
+ * Layout of a group, by the number of a sector from the start of MUSIC.XA: the audio of
+ * track t is in slot t * MUSIC_STRIDE, data sector n of the stream (counted without the
+ * audio sectors) holds sector n % (sectors of the pack) of the pack.
+ */
+#define MUSIC_IS_AUDIO(sector)		((sector) % MUSIC_STRIDE == 0)
+#define MUSIC_AUDIO_TRACK(sector)	((sector) % MUSIC_INTERLEAVE / MUSIC_STRIDE)
+#define MUSIC_DATA_INDEX(sector)	((sector) / MUSIC_INTERLEAVE * MUSIC_DATA_SLOTS + \
+	(sector) % MUSIC_INTERLEAVE - (sector) % MUSIC_INTERLEAVE / MUSIC_STRIDE - 1)
+
+/* XA file number of all sectors of MUSIC.XA. */
+#define MUSIC_XA_FILE		1
+
+typedef struct
+{
+	/* Pack sectors read through the stream, and reads which had to pause the music. */
+	u_long streamedSectors;
+	u_long directReads;
+	/* Times the music paused for the drive, and times it went back to its start. */
+	u_long pauses;
+	u_long loops;
+	/* Vertical blanks the reads through the stream waited, and the longest single read. */
+	u_long waitVBlanks;
+	u_long longestWait;
+} MusicStats;
+
+/*
+ * Looks for MUSIC.XA and checks that its data sectors hold the pack of the given TOC. Call
+ * after PckGetToc. Returns 0 if there is no music, which isn't an error.
+ */
+int InitMusic(PckTOC* toc);
+
+/* Starts the given track, or switches to it without a gap. -1 stops the music. */
+void PlayMusic(int track);
+
+/* Keeps the music going: loops it at the end of MUSIC.XA and resumes it after a pause. Call once per frame. */
+void UpdateMusic();
+
+MusicStats* GetMusicStats();
+
+#endif
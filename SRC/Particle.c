@@ -0,0 +1,342 @@
+/*
+ * Particle pool. The particles are stored as one array per attribute, so the update loop
+ * streams through positions and velocities only, and integrated in fixed point (ONE-scaled
+ * world units, velocities per PAL frame scaled by GetFrameStep). Drawing transforms them in
+ * batches with the GTE and writes one flat primitive per particle into the packet area.
+ */
+
+#include <sys/types.h>
+#include <libgte.h>
+#include <libgpu.h>
+#include <libgs.h>
+
+#include "Engine.h"
+#include "Particle.h"
+
+/* Particles transformed by one RotTransPersN call. */
+#define PARTICLE_BATCH 32
+
+/* Lifetimes in PAL frames, and the frames at the end of it in which a particle fades out. */
+#define DEBRIS_LIFE		45
+#define SPARK_LIFE		12
+#define FADE_FRAMES		12
+
+/* Gravity in ONE-scaled units per PAL frame, squared. Positive y points down. */
+#define DEBRIS_GRAVITY	(ONE / 3)
+#define SPARK_GRAVITY	(ONE / 8)
+
+/* Sizes in world units. */
+#define DEBRIS_SIZE		12
+#define SPARK_SIZE		3
+
+/* Positions and velocities (ONE-scaled) and the remaining lifetime (ONE-scaled frames). */
+static long s_posX[MAX_PARTICLES];
+static long s_posY[MAX_PARTICLES];
+static long s_posZ[MAX_PARTICLES];
+static long s_velX[MAX_PARTICLES];
+static long s_velY[MAX_PARTICLES];
+static long s_velZ[MAX_PARTICLES];
+static long s_life[MAX_PARTICLES];
+/* Rotation and rotation speed of debris, in 4096 per turn. */
+static short s_angle[MAX_PARTICLES];
+static short s_spin[MAX_PARTICLES];
+static CVECTOR s_color[MAX_PARTICLES];
+static u_char s_kind[MAX_PARTICLES];
+
+/* Particles in use are always the first s_count ones. */
+static int s_count = 0;
+static int s_emitBudget = PARTICLE_EMIT_BUDGET;
+/* Budgets set with SetParticleBudgets. */
+static int s_primLimit = PARTICLE_PRIM_BUDGET;
+static int s_emitLimit = PARTICLE_EMIT_BUDGET;
+/* Primitives left to the views of this frame which are not drawn yet (see BeginParticleDraw). */
+static int s_primBudget = PARTICLE_PRIM_BUDGET;
+static int s_viewsLeft = 1;
+static u_long s_random = 1;
+
+static ParticleStats s_stats;
+
+/* Work arrays of one transformed batch. */
+static SVECTOR s_batch[PARTICLE_BATCH];
+static DVECTOR s_screen[PARTICLE_BATCH];
+static u_short s_depth[PARTICLE_BATCH];
+static u_short s_interpolation[PARTICLE_BATCH];
+static u_short s_flags[PARTICLE_BATCH];
+
+/* The game has its own random numbers, particles must not change them. */
+static long Random(long range)
+{
+	s_random = s_random * 1103515245 + 12345;
+	return (long)((s_random >> 16) & 0x7fff) % range;
+}
+
+void SetParticleBudgets(int prims, int emits)
+{
+	s_primLimit = prims < PARTICLE_PRIM_BUDGET ? prims : PARTICLE_PRIM_BUDGET;
+	s_emitLimit = emits < PARTICLE_EMIT_BUDGET ? emits : PARTICLE_EMIT_BUDGET;
+
+	if (s_emitBudget > s_emitLimit)
+	{
+		s_emitBudget = s_emitLimit;
+	}
+}
+
+void ClearParticles()
+{
+	s_count = 0;
+	s_emitBudget = s_emitLimit;
+	s_random = 1;
+
+	s_stats.live = 0;
+	s_stats.peak = 0;
+	s_stats.emitted = 0;
+	s_stats.dropped = 0;
+	s_stats.prims = 0;
+	s_stats.packetBytes = 0;
+	s_stats.skipped = 0;
+}
+
+int EmitParticles(int kind, VECTOR* position, VECTOR* push, long speed, CVECTOR* color, int count)
+{
+	int emitted = count;
+	int i, angle;
+	long horizontal;
+
+	if (emitted > s_emitBudget)
+	{
+		emitted = s_emitBudget;
+	}
+	if (emitted > MAX_PARTICLES - s_count)
+	{
+		emitted = MAX_PARTICLES - s_count;
+	}
+
+	s_stats.dropped += count - emitted;
+	s_stats.emitted += emitted;
+	s_emitBudget -= emitted;
+
+	for (i = s_count; i < s_count + emitted; ++i)
+	{
+		/* A random direction on the ground plane, thrown upwards */
+		angle = (int)Random(4096);
+		horizontal = speed / 2 + Random(speed / 2 + 1);
+
+		s_posX[i] = position->vx;
+		s_posY[i] = position->vy;
+		s_posZ[i] = position->vz;
+		s_velX[i] = rcos(angle) * horizontal / ONE;
+		s_velY[i] = -(speed / 2 + Random(speed / 2 + 1));
+		s_velZ[i] = rsin(angle) * horizontal / ONE;
+
+		if (push != 0)
+		{
+			s_velX[i] += push->vx;
+			s_velY[i] += push->vy;
+			s_velZ[i] += push->vz;
+		}
+
+		s_kind[i] = (u_char)kind;
+		s_life[i] = (kind == PARTICLE_DEBRIS ? DEBRIS_LIFE : SPARK_LIFE) * ONE + Random(8) * ONE;
+		s_angle[i] = (short)angle;
+		s_spin[i] = (short)(Random(512) - 256);
+		s_color[i] = *color;
+	}
+
+	s_count += emitted;
+
+	s_stats.live = (u_long)s_count;
+	if (s_stats.live > s_stats.peak)
+	{
+		s_stats.peak = s_stats.live;
+	}
+
+	return emitted;
+}
+
+void UpdateParticles()
+{
+	long step = GetFrameStep();
+	int i = 0;
+
+	while (i < s_count)
+	{
+		s_life[i] -= step;
+
+		if (s_life[i] <= 0)
+		{
+			/* The last particle takes the place of the dead one, so the live ones stay packed */
+			s_count--;
+			s_posX[i] = s_posX[s_count];
+			s_posY[i] = s_posY[s_count];
+			s_posZ[i] = s_posZ[s_count];
+			s_velX[i] = s_velX[s_count];
+			s_velY[i] = s_velY[s_count];
+			s_velZ[i] = s_velZ[s_count];
+			s_life[i] = s_life[s_count];
+			s_angle[i] = s_angle[s_count];
+			s_spin[i] = s_spin[s_count];
+			s_color[i] = s_color[s_count];
+			s_kind[i] = s_kind[s_count];
+			continue;
+		}
+
+		s_velY[i] += (s_kind[i] == PARTICLE_DEBRIS ? DEBRIS_GRAVITY : SPARK_GRAVITY) * step / ONE;
+
+		s_posX[i] += s_velX[i] * step / ONE;
+		s_posY[i] += s_velY[i] * step / ONE;
+		s_posZ[i] += s_velZ[i] * step / ONE;
+		s_angle[i] += (short)(s_spin[i] * step / ONE);
+
+		/* Bounce on the floor, losing half of the speed */
+		if (s_posY[i] > PARTICLE_FLOOR_Y * ONE)
+		{
+			s_posY[i] = PARTICLE_FLOOR_Y * ONE;
+			s_velX[i] = s_velX[i] * 3 / 4;
+			s_velY[i] = -s_velY[i] / 2;
+			s_velZ[i] = s_velZ[i] * 3 / 4;
+			s_spin[i] /= 2;
+		}
+
+		++i;
+	}
+
+	s_emitBudget = s_emitLimit;
+	s_stats.live = (u_long)s_count;
+}
+
+void BeginParticleDraw(int views)
+{
+	s_primBudget = s_primLimit;
+	s_viewsLeft = views > 0 ? views : 1;
+
+	s_stats.prims = 0;
+	s_stats.packetBytes = 0;
+	s_stats.skipped = 0;
+}
+
+void DrawParticles()
+{
+	GsOT* ot;
+	MATRIX view;
+	PACKET* packet;
+	PACKET* start;
+	POLY_F3* f3;
+	TILE* tile;
+	CVECTOR color;
+	int first, count, share, i, j, otz, otMax, size, angle;
+	long fade;
+	short x, y;
+
+	/* Views drawn later get what the ones before didn't use */
+	share = s_primBudget / s_viewsLeft;
+	if (s_viewsLeft > 1)
+	{
+		s_viewsLeft--;
+	}
+
+	/* Over the budget, the particles at the end of the pool are left out for this view */
+	count = s_count;
+	if (count > share)
+	{
+		s_stats.skipped += (u_long)(count - share);
+		count = share;
+	}
+
+	if (count == 0)
+	{
+		return;
+	}
+
+	ot = GetActiveOT();
+	otMax = (1 << ot->length) - 1;
+
+	/* Particle positions are in world coordinates, so the view is the whole transformation */
+	view = GsWSMATRIX;
+	SetRotMatrix(&view);
+	SetTransMatrix(&view);
+
+	packet = GsGetWorkBase();
+	start = packet;
+
+	for (first = 0; first < count; first += PARTICLE_BATCH)
+	{
+		j = count - first < PARTICLE_BATCH ? count - first : PARTICLE_BATCH;
+
+		for (i = 0; i < j; ++i)
+		{
+			setVector(&s_batch[i], s_posX[first + i] >> 12, s_posY[first + i] >> 12, s_posZ[first + i] >> 12);
+		}
+
+		RotTransPersN(s_batch, s_screen, s_depth, s_interpolation, s_flags, j);
+
+		for (i = 0; i < j; ++i)
+		{
+			/* On or behind the near plane */
+			if (s_depth[i] == 0)
+			{
+				continue;
+			}
+
+			/* Projected size, with the same projection distance as SwapTo3D */
+			size = (s_kind[first + i] == PARTICLE_DEBRIS ? DEBRIS_SIZE : SPARK_SIZE) * 160 / s_depth[i];
+			if (size < 1)
+			{
+				size = 1;
+			}
+
+			color = s_color[first + i];
+			if (s_life[first + i] < FADE_FRAMES * ONE)
+			{
+				fade = s_life[first + i] / FADE_FRAMES;
+				color.r = (u_char)(color.r * fade / ONE);
+				color.g = (u_char)(color.g * fade / ONE);
+				color.b = (u_char)(color.b * fade / ONE);
+			}
+
+			otz = s_depth[i] >> (14 - ot->length);
+			if (otz > otMax)
+			{
+				otz = otMax;
+			}
+
+			x = s_screen[i].vx;
+			y = s_screen[i].vy;
+
+			if (s_kind[first + i] == PARTICLE_DEBRIS)
+			{
+				angle = s_angle[first + i];
+
+				f3 = (POLY_F3*)packet;
+				setPolyF3(f3);
+				setRGB0(f3, color.r, color.g, color.b);
+				setXY3(f3,
+					x + rcos(angle) * size / ONE, y + rsin(angle) * size / ONE,
+					x + rcos(angle + 1365) * size / ONE, y + rsin(angle + 1365) * size / ONE,
+					x + rcos(angle + 2731) * size / ONE, y + rsin(angle + 2731) * size / ONE);
+				addPrim(ot->org + otz, f3);
+				packet += sizeof(POLY_F3);
+			}
+			else
+			{
+				tile = (TILE*)packet;
+				setTile(tile);
+				setRGB0(tile, color.r, color.g, color.b);
+				setXY0(tile, x - size / 2, y - size / 2);
+				setWH(tile, size, size);
+				addPrim(ot->org + otz, tile);
+				packet += sizeof(TILE);
+			}
+
+			s_stats.prims++;
+			s_primBudget--;
+		}
+	}
+
+	s_stats.packetBytes += (u_long)((u_char*)packet - (u_char*)start);
+	GsSetWorkBase(packet);
+}
+
+ParticleStats* GetParticleStats()
+{
+	return &s_stats;
+}
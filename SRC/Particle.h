@@ -0,0 +1,77 @@
+
+#ifndef _PARTICLE_H_
+#define _PARTICLE_H_
+
+#include <sys/types.h>
+#include <libgte.h>
+
+/*
+ * Particle effects like the debris of broken blocks.
+ *
+ * Particles live in a fixed pool and are drawn as single flat primitives written straight
+ * into the GPU packet area. Both the particles emitted and the primitives drawn per frame
+ * are limited, so many effects in the same frame cost fewer particles instead of a slower
+ * frame.
+ */
+
+/* Number of particles alive at the same time. */
+#define MAX_PARTICLES			96
+/* Particles which can be emitted in one frame, shared by all effects of that frame. */
+#define PARTICLE_EMIT_BUDGET	32
+/* Primitives DrawParticles writes per frame at most, shared by the views of the frame. */
+#define PARTICLE_PRIM_BUDGET	64
+
+/* Particle kinds */
+#define PARTICLE_DEBRIS	0	/* Tumbling triangle (POLY_F3) which falls and bounces on the floor. */
+#define PARTICLE_SPARK	1	/* Small square (TILE) which flies fast and fades out quickly. */
+
+/* Height (y) of the floor particles bounce on, in world units. */
+#define PARTICLE_FLOOR_Y 14
+
+typedef struct
+{
+	/* Particles alive now and the most at the same time since ClearParticles. */
+	u_long live;
+	u_long peak;
+	/* Particles emitted, and the ones which were not because of the budget or a full pool. */
+	u_long emitted;
+	u_long dropped;
+	/* Primitives and packet bytes of the frame over all its views, and particles they left out. */
+	u_long prims;
+	u_long packetBytes;
+	u_long skipped;
+} ParticleStats;
+
+/*
+ * Lowers the primitives drawn and particles emitted per frame below PARTICLE_PRIM_BUDGET and
+ * PARTICLE_EMIT_BUDGET, e.g. to keep the frame rate. Values over them are clamped.
+ */
+void SetParticleBudgets(int prims, int emits);
+
+/* Removes all particles and resets the statistics. */
+void ClearParticles();
+
+/*
+ * Emits count particles of the given kind at position (ONE-scaled world coordinates). They
+ * fly out in random directions with up to speed (ONE-scaled units per PAL frame), plus
+ * push if it isn't 0. Returns the number of particles emitted, which is less than count
+ * once the budget of the frame is used up.
+ */
+int EmitParticles(int kind, VECTOR* position, VECTOR* push, long speed, CVECTOR* color, int count);
+
+/* Moves all particles by one frame and renews the emit budget. */
+void UpdateParticles();
+
+/*
+ * Starts drawing the particles of a frame which shows the given number of views. Each view
+ * gets an even share of what is left of the primitive budget, and the statistics add up
+ * all views of the frame.
+ */
+void BeginParticleDraw(int views);
+
+/* Writes the particles into the active order table, using the view set by GsSetView2. */
+void DrawParticles();
+
+ParticleStats* GetParticleStats();
+
+#endif
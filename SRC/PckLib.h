@@ -17,11 +17,39 @@ typedef struct {
 	int			BasePos;
 } PckTOC;
 
+// Sectors kept in the read cache and read ahead at once (see PckReadSectors)
+#define PCK_CACHE_SECTORS	16
+#define PCK_READ_AHEAD		8
+// Times a failed read is tried again before giving up
+#define PCK_MAX_RETRIES		4
+
+typedef struct {
+	u_long	Hits;		// Sectors served from the cache
+	u_long	Misses;		// Sectors asked for which weren't in the cache
+	u_long	ReadAhead;	// Sectors read ahead into the cache
+	u_long	Retries;	// Reads which failed and were tried again
+	u_long	Failures;	// Reads which still failed after PCK_MAX_RETRIES retries
+} PckSTATS;
+
+// Another way to the sectors of the pack, which keeps the drive on a stream (see Music.h).
+// Read starts reading sectors like CdRead and returns 1, or returns 0 if the stream doesn't
+// have them. ReadSync waits for them like CdReadSync, 0 is success. Pause lets go of the
+// drive before PckLib uses it itself.
+typedef struct {
+	int		(*Read)(int Sector, int NumSectors, u_long *Buff);
+	int		(*ReadSync)(void);
+	void	(*Pause)(void);
+} PckSTREAM;
+
 // Prototypes
 int		PckGetToc(char *filename, PckTOC *toc);
 int		PckGetSubToc(PckTOC *SearchToc, char *FileName, PckTOC *Toc);
 int		PckReadFile(PckTOC *Toc, char *FileName, u_long *Buff, int NumBytes);
-void	PckReadFileNum(PckTOC *Toc, int Num, u_long *Buff, int NumBytes);
+int		PckReadFileNum(PckTOC *Toc, int Num, u_long *Buff, int NumBytes);
 int		PckSearchFile(PckTOC *Toc, char *FileName);
+int		PckReadSectors(int Sector, int NumSectors, u_long *Buff);
+void	PckFlush(void);
+PckSTATS*	PckGetStats(void);
+void	PckSetStream(PckSTREAM *Stream);
 
 #endif
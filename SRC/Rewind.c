@@ -0,0 +1,302 @@
+/*
+ * Rewind buffer, see Rewind.h. A delta is a list of runs, each a byte with the number of
+ * bytes which are the same as in the keyframe, a byte with the number of bytes which follow
+ * and the bytes themselves. Nothing after the last run changed. Frames are stored one after
+ * the other in the buffer and never wrap around its end.
+ */
+
+#include <sys/types.h>
+#include <libgte.h>
+
+#include <string.h>
+
+#include "Rewind.h"
+
+/* Longest run of a delta, both counts are a byte. */
+#define MAX_RUN	255
+
+/* Equal bytes inside a run of changed bytes which are cheaper to copy than to start a new run. */
+#define RUN_GAP	2
+
+typedef struct
+{
+	/* Position and length of the frame in s_buffer. */
+	u_short offset;
+	u_short size;
+	/* 1 for a whole snapshot, 0 for a delta against the keyframe before it. */
+	u_char key;
+} RewindEntry;
+
+static u_char s_buffer[REWIND_BUFFER_SIZE];
+
+/* Recorded frames, a ring starting at s_oldest. The oldest frame is always a keyframe. */
+static RewindEntry s_entries[REWIND_MAX_FRAMES];
+static int s_oldest = 0;
+static int s_count = 0;
+
+/* Where the next frame goes in s_buffer. */
+static u_long s_head = 0;
+
+/* The newest keyframe, and the frames recorded since (-1 if there is none). */
+static GameSnapshot s_key;
+static int s_keyAge = -1;
+
+static u_char s_delta[sizeof(GameSnapshot)];
+
+static RewindStats s_stats;
+
+void ResetRewind()
+{
+	s_oldest = 0;
+	s_count = 0;
+	s_head = 0;
+	s_keyAge = -1;
+
+	s_stats.frames = 0;
+	s_stats.bytes = 0;
+	s_stats.keyframes = 0;
+	s_stats.lastSize = 0;
+}
+
+/* Returns the frame recorded framesBack frames before the newest one. */
+static RewindEntry* GetEntry(int framesBack)
+{
+	return &s_entries[(s_oldest + s_count - 1 - framesBack) % REWIND_MAX_FRAMES];
+}
+
+/* Returns how many frames before the newest one the keyframe of the given frame is. */
+static int FindKey(int framesBack)
+{
+	while (!GetEntry(framesBack)->key)
+	{
+		framesBack++;
+	}
+
+	return framesBack;
+}
+
+/* Gives up the oldest keyframe and the deltas against it. */
+static void DropOldest()
+{
+	RewindEntry* entry;
+
+	do
+	{
+		entry = &s_entries[s_oldest];
+		s_stats.bytes -= entry->size;
+		s_stats.keyframes -= entry->key;
+
+		s_oldest = (s_oldest + 1) % REWIND_MAX_FRAMES;
+		s_count--;
+	}
+	while (s_count > 0 && !s_entries[s_oldest].key);
+}
+
+/* Makes room for size bytes at s_head, giving up the oldest frames in the way. */
+static void Reserve(u_long size)
+{
+	RewindEntry* entry;
+
+	if (s_head + size > REWIND_BUFFER_SIZE)
+	{
+		/* The end of the buffer stays unused, the frames there are the oldest */
+		while (s_count > 0 && s_entries[s_oldest].offset >= s_head)
+		{
+			DropOldest();
+		}
+		s_head = 0;
+	}
+
+	while (s_count > 0)
+	{
+		entry = &s_entries[s_oldest];
+		if (entry->offset >= s_head + size || entry->offset + entry->size <= s_head)
+		{
+			break;
+		}
+
+		DropOldest();
+	}
+}
+
+/*
+ * Writes the bytes of frame which differ from key into s_delta. Returns the size of the delta,
+ * or sizeof(GameSnapshot) if it would not be smaller than the frame itself.
+ */
+static u_long EncodeDelta(const u_char* frame, const u_char* key)
+{
+	u_long pos = 0, size = 0, skip, count, gap;
+
+	while (pos < sizeof(GameSnapshot))
+	{
+		for (skip = 0; pos < sizeof(GameSnapshot) && frame[pos] == key[pos] && skip < MAX_RUN; ++skip)
+		{
+			pos++;
+		}
+
+		if (pos == sizeof(GameSnapshot))
+		{
+			break;
+		}
+
+		/* The run goes on over a few equal bytes if more changed bytes follow them */
+		count = 0;
+		while (pos + count < sizeof(GameSnapshot) && count < MAX_RUN)
+		{
+			for (gap = 0; gap <= RUN_GAP && pos + count + gap < sizeof(GameSnapshot); ++gap)
+			{
+				if (frame[pos + count + gap] != key[pos + count + gap])
+				{
+					break;
+				}
+			}
+
+			if (gap > RUN_GAP || pos + count + gap == sizeof(GameSnapshot))
+			{
+				break;
+			}
+
+			count += gap + 1;
+			if (count > MAX_RUN)
+			{
+				count = MAX_RUN;
+			}
+		}
+
+		if (size + 2 + count >= sizeof(GameSnapshot))
+		{
+			return sizeof(GameSnapshot);
+		}
+
+		s_delta[size++] = (u_char)skip;
+		s_delta[size++] = (u_char)count;
+		memcpy(&s_delta[size], &frame[pos], count);
+		size += count;
+		pos += count;
+	}
+
+	return size;
+}
+
+/* Applies a delta written by EncodeDelta to frame, which holds its keyframe. */
+static void DecodeDelta(u_char* frame, const u_char* delta, u_long size)
+{
+	const u_char* end = delta + size;
+	u_long pos = 0, count;
+
+	while (delta < end)
+	{
+		pos += delta[0];
+		count = delta[1];
+		delta += 2;
+
+		memcpy(&frame[pos], delta, count);
+		delta += count;
+		pos += count;
+	}
+}
+
+void RecordRewind(GameSnapshot* snapshot)
+{
+	RewindEntry* entry;
+	u_long size = sizeof(GameSnapshot);
+	u_char key = 1;
+
+	if (s_keyAge >= 0 && s_keyAge < REWIND_KEY_INTERVAL)
+	{
+		size = EncodeDelta((const u_char*)snapshot, (const u_char*)&s_key);
+		key = size >= sizeof(GameSnapshot);
+	}
+
+	if (s_count == REWIND_MAX_FRAMES)
+	{
+		DropOldest();
+	}
+
+	Reserve(size);
+
+	/* Making room gave up the keyframe of the delta, which is only the case in a tiny buffer */
+	if (!key && s_count == 0)
+	{
+		key = 1;
+		size = sizeof(GameSnapshot);
+		Reserve(size);
+	}
+
+	memcpy(&s_buffer[s_head], key ? (const u_char*)snapshot : s_delta, size);
+
+	entry = &s_entries[(s_oldest + s_count) % REWIND_MAX_FRAMES];
+	entry->offset = (u_short)s_head;
+	entry->size = (u_short)size;
+	entry->key = key;
+	s_count++;
+	s_head += size;
+
+	if (key)
+	{
+		memcpy(&s_key, snapshot, sizeof(GameSnapshot));
+		s_keyAge = 0;
+	}
+	s_keyAge++;
+
+	s_stats.bytes += size;
+	s_stats.keyframes += key;
+	s_stats.lastSize = size;
+}
+
+int GetRewindSnapshot(int framesBack, GameSnapshot* snapshot)
+{
+	RewindEntry* entry;
+	int keyBack;
+
+	if (framesBack < 0 || framesBack >= s_count)
+	{
+		return 0;
+	}
+
+	keyBack = FindKey(framesBack);
+	memcpy(snapshot, &s_buffer[GetEntry(keyBack)->offset], sizeof(GameSnapshot));
+
+	if (keyBack != framesBack)
+	{
+		entry = GetEntry(framesBack);
+		DecodeDelta((u_char*)snapshot, &s_buffer[entry->offset], entry->size);
+	}
+
+	return 1;
+}
+
+void TruncateRewind(int framesBack)
+{
+	RewindEntry* entry;
+	int keyBack;
+
+	for (; framesBack > 0 && s_count > 0; --framesBack)
+	{
+		entry = GetEntry(0);
+		s_stats.bytes -= entry->size;
+		s_stats.keyframes -= entry->key;
+		s_count--;
+	}
+
+	if (s_count == 0)
+	{
+		s_head = 0;
+		s_keyAge = -1;
+		return;
+	}
+
+	entry = GetEntry(0);
+	s_head = entry->offset + entry->size;
+
+	/* Deltas from now on are against the keyframe of the frame which is the newest again */
+	keyBack = FindKey(0);
+	memcpy(&s_key, &s_buffer[GetEntry(keyBack)->offset], sizeof(GameSnapshot));
+	s_keyAge = keyBack + 1;
+}
+
+RewindStats* GetRewindStats()
+{
+	s_stats.frames = s_count;
+	return &s_stats;
+}
@@ -0,0 +1,57 @@
+#ifndef _REWIND_H_
+#define _REWIND_H_
+
+#include <sys/types.h>
+
+#include "Game.h"
+
+/*
+ * Rewind buffer of the game state.
+ *
+ * Every frame of a game is recorded as a snapshot (see GameSnapshot) into a ring buffer of a
+ * fixed size. Most frames only keep the bytes which differ from the last keyframe, a whole
+ * snapshot stored every REWIND_KEY_INTERVAL frames or when the changes get as large as a
+ * snapshot. Any recorded frame is restored from its keyframe and at most one delta, so going
+ * back costs the same no matter how far. When the buffer is full the oldest frames are given
+ * up, always up to the next keyframe.
+ */
+
+/* Bytes of snapshot data kept, and the most frames recorded at a time. */
+#define REWIND_BUFFER_SIZE	(32 * 1024)
+#define REWIND_MAX_FRAMES	512
+
+/* Frames after which the next frame is recorded as a keyframe. */
+#define REWIND_KEY_INTERVAL	50
+
+typedef struct
+{
+	/* Frames which can be restored. */
+	u_long frames;
+	/* Bytes of the buffer they use, and how many of them are keyframes. */
+	u_long bytes;
+	u_long keyframes;
+	/* Bytes the last recorded frame took. */
+	u_long lastSize;
+} RewindStats;
+
+/* Forgets all recorded frames, the next one is a keyframe. */
+void ResetRewind();
+
+/* Records the snapshot as the newest frame. */
+void RecordRewind(GameSnapshot* snapshot);
+
+/*
+ * Writes the frame recorded framesBack frames before the newest one (0 is the newest) into
+ * snapshot. Returns 0 if that frame is no longer kept.
+ */
+int GetRewindSnapshot(int framesBack, GameSnapshot* snapshot);
+
+/*
+ * Forgets the newest framesBack frames, so recording goes on after the frame which was
+ * restored with the same framesBack.
+ */
+void TruncateRewind(int framesBack);
+
+RewindStats* GetRewindStats();
+
+#endif
@@ -0,0 +1,54 @@
+/*
+ * Scratchpad memory manager. The 1 KB scratchpad is as fast as a register access, while
+ * every access to main RAM which misses the tiny caches stalls the CPU. It is handed out
+ * per phase of a frame: a phase allocates what it needs for its hot loop with a simple
+ * bump allocator, and the next phase starts over from the beginning.
+ */
+
+#include <sys/types.h>
+#include <libgte.h>
+
+#include "Engine.h"
+#include "Scratch.h"
+
+static int s_phase = SCRATCH_PHASE_NONE;
+static u_long s_used = 0;
+static u_long s_peak = 0;
+
+void ScratchBegin(int phase)
+{
+	s_phase = phase;
+	s_used = 0;
+}
+
+void* ScratchAlloc(u_long size)
+{
+	void* block;
+
+	size = (size + 3) & ~3;
+	if (s_used + size > SCRATCH_SIZE)
+	{
+		ErrorMessage("Scratchpad exhausted in phase %d (%d of %d bytes)!", s_phase, (int)(s_used + size), SCRATCH_SIZE);
+		return 0;
+	}
+
+	block = getScratchAddr(s_used / 4);
+	s_used += size;
+
+	if (s_used > s_peak)
+	{
+		s_peak = s_used;
+	}
+
+	return block;
+}
+
+int ScratchPhase()
+{
+	return s_phase;
+}
+
+u_long ScratchPeak()
+{
+	return s_peak;
+}
@@ -0,0 +1,30 @@
+
+#ifndef _SCRATCH_H_
+#define _SCRATCH_H_
+
+#include <sys/types.h>
+
+/* Size of the scratchpad (the data cache of the R3000 used as fast RAM) in bytes. */
+#define SCRATCH_SIZE 1024
+
+/* Phases of a frame which use the scratchpad. Each phase owns the whole scratchpad. */
+#define SCRATCH_PHASE_NONE		0
+#define SCRATCH_PHASE_COLLISION	1	/* Ball and block collision in MoveBalls. */
+#define SCRATCH_PHASE_SORT		2	/* Work area of GsSortObject4. */
+
+/* Starts a new phase. Everything allocated in the previous phase is given up. */
+void ScratchBegin(int phase);
+
+/*
+ * Allocates a word aligned block of the scratchpad for the current phase. Running out of
+ * scratchpad is a programming error and halts with an error message.
+ */
+void* ScratchAlloc(u_long size);
+
+/* Returns the phase which currently owns the scratchpad. */
+int ScratchPhase();
+
+/* Returns the highest number of bytes used by a single phase so far. */
+u_long ScratchPeak();
+
+#endif
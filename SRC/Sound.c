@@ -0,0 +1,407 @@
+/*
+ * Sound effects. A bank of SPU ADPCM effects is uploaded to SPU RAM in one DMA transfer,
+ * effects triggered during a frame are queued and started together with a single key on
+ * in UpdateSfx. When all effect voices are busy, the voice playing the least important
+ * (and then the oldest) effect is taken over, unless the new effect is even less important.
+ */
+
+#include <sys/types.h>
+#include <libetc.h>
+#include <libspu.h>
+
+#include "Engine.h"
+#include "Sound.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* Size of the SPU RAM in bytes. */
+#define SPU_RAM_SIZE	(512 * 1024)
+/* The CD and voice capture buffers and the silent block of libspu come first. */
+#define SPU_RAM_BASE	0x1010
+/* Maximum number of blocks (free or used) the allocator keeps track of. */
+#define MAX_SPU_BLOCKS	32
+
+/* Full volume of a voice. */
+#define SPU_VOLUME_MAX	0x3fff
+
+typedef struct
+{
+	u_long address;
+	u_long size;
+	u_char used;
+} SpuBlock;
+
+/* State of an effect voice. */
+typedef struct
+{
+	int sfx;
+	u_char priority;
+	/* VSync counts when the effect was started and when it has finished playing. */
+	long started;
+	long ends;
+} SfxVoice;
+
+/* An effect waiting for the next UpdateSfx call. */
+typedef struct
+{
+	short sfx;
+	short left, right;
+} SfxRequest;
+
+/* Blocks of SPU RAM, sorted by address and covering all of it. */
+static SpuBlock s_spuBlocks[MAX_SPU_BLOCKS];
+static int s_spuBlockCount = 0;
+
+/* Effects of the loaded bank. */
+static SfxEntry s_sfx[MAX_SFX];
+static u_long s_sfxAddress[MAX_SFX];
+static long s_sfxLength[MAX_SFX];
+static int s_sfxCount = 0;
+static u_long s_bankAddress = 0;
+
+static SfxVoice s_voices[SFX_VOICE_COUNT];
+
+static SfxRequest s_queue[SFX_VOICE_COUNT];
+static int s_queueCount = 0;
+/* One bit per effect which is already queued. */
+static u_long s_queuedSfx = 0;
+
+/******************************************************/
+/* SPU RAM allocator */
+
+static void InitSpuRam()
+{
+	s_spuBlocks[0].address = SPU_RAM_BASE;
+	s_spuBlocks[0].size = SPU_RAM_SIZE - SPU_RAM_BASE;
+	s_spuBlocks[0].used = 0;
+	s_spuBlockCount = 1;
+}
+
+u_long SpuRamAlloc(u_long size)
+{
+	int i;
+
+	/* Voices address SPU RAM in 8 byte units, ADPCM blocks are 16 bytes. */
+	size = (size + 15) & ~15;
+	if (size == 0)
+	{
+		return 0;
+	}
+
+	for (i = 0; i < s_spuBlockCount; ++i)
+	{
+		if (s_spuBlocks[i].used || s_spuBlocks[i].size < size)
+		{
+			continue;
+		}
+
+		/* Split off the rest, if there is room in the table. Otherwise the whole block is handed out. */
+		if (s_spuBlocks[i].size > size && s_spuBlockCount < MAX_SPU_BLOCKS)
+		{
+			memmove(&s_spuBlocks[i + 2], &s_spuBlocks[i + 1], (s_spuBlockCount - i - 1) * sizeof(SpuBlock));
+			s_spuBlocks[i + 1].address = s_spuBlocks[i].address + size;
+			s_spuBlocks[i + 1].size = s_spuBlocks[i].size - size;
+			s_spuBlocks[i + 1].used = 0;
+			s_spuBlocks[i].size = size;
+			s_spuBlockCount++;
+		}
+
+		s_spuBlocks[i].used = 1;
+		return s_spuBlocks[i].address;
+	}
+
+	return 0;
+}
+
+/* Merges block i with the block after it. */
+static void MergeSpuBlock(int i)
+{
+	s_spuBlocks[i].size += s_spuBlocks[i + 1].size;
+	memmove(&s_spuBlocks[i + 1], &s_spuBlocks[i + 2], (s_spuBlockCount - i - 2) * sizeof(SpuBlock));
+	s_spuBlockCount--;
+}
+
+void SpuRamFree(u_long address)
+{
+	int i;
+
+	for (i = 0; i < s_spuBlockCount; ++i)
+	{
+		if (s_spuBlocks[i].address != address || !s_spuBlocks[i].used)
+		{
+			continue;
+		}
+
+		s_spuBlocks[i].used = 0;
+
+		if (i + 1 < s_spuBlockCount && !s_spuBlocks[i + 1].used)
+		{
+			MergeSpuBlock(i);
+		}
+
+		if (i > 0 && !s_spuBlocks[i - 1].used)
+		{
+			MergeSpuBlock(i - 1);
+		}
+
+		return;
+	}
+}
+
+u_long SpuRamAvailable(u_long* largest)
+{
+	int i;
+	u_long total = 0, max = 0;
+
+	for (i = 0; i < s_spuBlockCount; ++i)
+	{
+		if (!s_spuBlocks[i].used)
+		{
+			total += s_spuBlocks[i].size;
+			if (s_spuBlocks[i].size > max)
+			{
+				max = s_spuBlocks[i].size;
+			}
+		}
+	}
+
+	if (largest != 0)
+	{
+		*largest = max;
+	}
+
+	return total;
+}
+
+/******************************************************/
+/* Effects */
+
+void InitSfx()
+{
+	SpuCommonAttr common;
+	SpuVoiceAttr voice;
+	int i;
+
+	SpuInit();
+	InitSpuRam();
+
+	common.mask = SPU_COMMON_MVOLL | SPU_COMMON_MVOLR;
+	common.mvol.left = SPU_VOLUME_MAX;
+	common.mvol.right = SPU_VOLUME_MAX;
+	SpuSetCommonAttr(&common);
+
+	/* Effects play at full level right away, the end flag of their last block mutes them. */
+	memset(&voice, 0, sizeof(voice));
+	voice.mask = SPU_VOICE_ADSR_AMODE | SPU_VOICE_ADSR_SMODE | SPU_VOICE_ADSR_RMODE |
+		SPU_VOICE_ADSR_AR | SPU_VOICE_ADSR_DR | SPU_VOICE_ADSR_SR | SPU_VOICE_ADSR_RR | SPU_VOICE_ADSR_SL;
+	voice.a_mode = SPU_VOICE_LINEARIncN;
+	voice.s_mode = SPU_VOICE_LINEARIncN;
+	voice.r_mode = SPU_VOICE_LINEARDecN;
+	voice.sl = 0xf;
+
+	for (i = 0; i < SFX_VOICE_COUNT; ++i)
+	{
+		voice.voice |= SPU_VOICECH(i);
+		s_voices[i].sfx = -1;
+		s_voices[i].ends = 0;
+	}
+
+	SpuSetVoiceAttr(&voice);
+}
+
+int LoadSfxBank(char* filename)
+{
+	u_long* data;
+	SfxBankHeader* header;
+	SfxEntry* entries;
+	long vsyncRate;
+	long samples;
+	int i;
+
+	data = LoadFile(filename, 0);
+	if (data == 0)
+	{
+		return 0;
+	}
+
+	header = (SfxBankHeader*)data;
+	if (header->id != SFX_BANK_ID || header->version != SFX_BANK_VERSION || header->count > MAX_SFX)
+	{
+		free(data);
+		return 0;
+	}
+
+	FreeSfxBank();
+
+	s_bankAddress = SpuRamAlloc(header->dataSize);
+	if (s_bankAddress == 0)
+	{
+		free(data);
+		return 0;
+	}
+
+	SpuSetTransferMode(SpuTransByDMA);
+	SpuSetTransferStartAddr(s_bankAddress);
+	SpuWrite((u_char*)data + header->dataOffset, header->dataSize);
+	SpuIsTransferCompleted(SPU_TRANSFER_WAIT);
+
+	vsyncRate = GetVideoMode() == MODE_PAL ? 50 : 60;
+	entries = (SfxEntry*)(header + 1);
+
+	for (i = 0; i < header->count; ++i)
+	{
+		s_sfx[i] = entries[i];
+		s_sfxAddress[i] = s_bankAddress + entries[i].offset;
+
+		/* Playing time in vertical blanks, rounded up */
+		samples = (long)(entries[i].size / 16) * 28;
+		s_sfxLength[i] = (samples * vsyncRate + entries[i].rate - 1) / entries[i].rate;
+	}
+
+	s_sfxCount = header->count;
+	free(data);
+
+	return 1;
+}
+
+void FreeSfxBank()
+{
+	int i;
+
+	/* Voices must not keep reading the memory once it is handed out again. */
+	SpuSetKey(SpuOff, SPU_ALLCH);
+	for (i = 0; i < SFX_VOICE_COUNT; ++i)
+	{
+		s_voices[i].sfx = -1;
+		s_voices[i].ends = 0;
+	}
+
+	s_queueCount = 0;
+	s_queuedSfx = 0;
+	s_sfxCount = 0;
+
+	if (s_bankAddress != 0)
+	{
+		SpuRamFree(s_bankAddress);
+		s_bankAddress = 0;
+	}
+}
+
+int GetSfx(char* name)
+{
+	int i;
+
+	for (i = 0; i < s_sfxCount; ++i)
+	{
+		if (strncmp(s_sfx[i].name, name, SFX_NAME_LENGTH) == 0)
+		{
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+void PlaySfx(int sfx, int volume, int pan)
+{
+	SfxRequest* request;
+
+	if (sfx < 0 || sfx >= s_sfxCount || (s_queuedSfx & (1 << sfx)) || s_queueCount >= SFX_VOICE_COUNT)
+	{
+		return;
+	}
+
+	/* Bank volume 0 - 127, scaled by the volume of the call */
+	volume = ((int)s_sfx[sfx].volume * volume * SPU_VOLUME_MAX) / (127 * 128);
+
+	request = &s_queue[s_queueCount++];
+	request->sfx = (short)sfx;
+	request->left = (short)(pan > 0 ? volume * (64 - pan) / 64 : volume);
+	request->right = (short)(pan < 0 ? volume * (64 + pan) / 64 : volume);
+
+	s_queuedSfx |= 1 << sfx;
+}
+
+/* Returns the voice for a new effect of the given priority, or -1 if all voices play more important effects. */
+static int PickVoice(u_char priority, long now, u_long taken)
+{
+	int i, best = -1;
+
+	for (i = 0; i < SFX_VOICE_COUNT; ++i)
+	{
+		if (taken & SPU_VOICECH(i))
+		{
+			continue;
+		}
+
+		if (s_voices[i].ends <= now)
+		{
+			return i;
+		}
+
+		if (s_voices[i].priority > priority)
+		{
+			continue;
+		}
+
+		if (best < 0 || s_voices[i].priority < s_voices[best].priority ||
+			(s_voices[i].priority == s_voices[best].priority && s_voices[i].started < s_voices[best].started))
+		{
+			best = i;
+		}
+	}
+
+	return best;
+}
+
+void UpdateSfx()
+{
+	SpuVoiceAttr attr;
+	SfxRequest* request;
+	u_long keyOn = 0;
+	long now;
+	int i, voice;
+
+	if (s_queueCount == 0)
+	{
+		return;
+	}
+
+	now = VSync(-1);
+	attr.mask = SPU_VOICE_VOLL | SPU_VOICE_VOLR | SPU_VOICE_PITCH | SPU_VOICE_WDSA;
+
+	for (i = 0; i < s_queueCount; ++i)
+	{
+		request = &s_queue[i];
+
+		voice = PickVoice(s_sfx[request->sfx].priority, now, keyOn);
+		if (voice < 0)
+		{
+			continue;
+		}
+
+		attr.voice = SPU_VOICECH(voice);
+		attr.volume.left = request->left;
+		attr.volume.right = request->right;
+		attr.pitch = s_sfx[request->sfx].pitch;
+		attr.addr = s_sfxAddress[request->sfx];
+		SpuSetVoiceAttr(&attr);
+
+		s_voices[voice].sfx = request->sfx;
+		s_voices[voice].priority = s_sfx[request->sfx].priority;
+		s_voices[voice].started = now;
+		s_voices[voice].ends = now + s_sfxLength[request->sfx];
+
+		keyOn |= SPU_VOICECH(voice);
+	}
+
+	/* Key on restarts voices which are still playing, so stolen voices need no key off. */
+	if (keyOn != 0)
+	{
+		SpuSetKey(SpuOn, keyOn);
+	}
+
+	s_queueCount = 0;
+	s_queuedSfx = 0;
+}
@@ -0,0 +1,89 @@
+
+#ifndef _SOUND_H_
+#define _SOUND_H_
+
+#include <sys/types.h>
+
+/*
+ * Layout of a sound effect bank file (*.SFX), written by the sfxtool host tool.
+ *
+ *   SfxBankHeader
+ *   SfxEntry entries[count]
+ *   SPU ADPCM data of all effects (dataSize bytes at dataOffset)
+ *
+ * Effects are raw SPU ADPCM blocks (16 bytes for 28 samples) without VAG headers, the
+ * last block of every effect has the loop end flag set so the voice mutes by itself.
+ */
+
+#define SFX_BANK_ID			0x4b4e4253	/* "SBNK" */
+#define SFX_BANK_VERSION	1
+#define SFX_NAME_LENGTH		8
+
+typedef struct
+{
+	u_long id;
+	u_short version;
+	u_short count;
+	u_long dataSize;
+	u_long dataOffset;
+} SfxBankHeader;
+
+typedef struct
+{
+	/* Name of the effect, padded with zeros (not terminated if all 8 characters are used). */
+	char name[SFX_NAME_LENGTH];
+	/* Position of the ADPCM data, relative to the start of the bank's data. */
+	u_long offset;
+	u_long size;
+	/* Sample rate in Hz and the matching SPU pitch (4096 = 44100 Hz). */
+	u_short rate;
+	u_short pitch;
+	/* Voices playing effects of lower priority are taken over first when all voices are busy. */
+	u_char priority;
+	/* Default volume, 0 - 127. */
+	u_char volume;
+	u_short reserved;
+} SfxEntry;
+
+/******************************************************/
+/* Runtime */
+
+/* Number of SPU voices used for sound effects. */
+#define SFX_VOICE_COUNT		16
+
+/* Maximum number of effects in a bank. */
+#define MAX_SFX				32
+
+/* Volume passed to PlaySfx to use the default volume of the effect. */
+#define SFX_VOLUME_DEFAULT	128
+
+/* Initializes the SPU, the SPU RAM allocator and the effect voices. */
+void InitSfx();
+
+/* Loads a bank from the game archive into SPU RAM, replacing the current one. Returns 0 on failure. */
+int LoadSfxBank(char* filename);
+void FreeSfxBank();
+
+/* Returns the number of the effect with the given name, or -1 if the bank has no such effect. */
+int GetSfx(char* name);
+
+/*
+ * Queues an effect for the next UpdateSfx call. Volume is 0 - 128 relative to the bank volume,
+ * pan goes from -64 (left) to 64 (right). Effects of the same kind triggered more than once in
+ * a frame only play once. Unknown effects (-1) are ignored.
+ */
+void PlaySfx(int sfx, int volume, int pan);
+
+/* Starts all effects queued since the last call with a single key on. Call once per frame. */
+void UpdateSfx();
+
+/******************************************************/
+/* SPU RAM allocator */
+
+/* Returns the SPU RAM address of a block of the given size, or 0 if there is no room left. */
+u_long SpuRamAlloc(u_long size);
+void SpuRamFree(u_long address);
+/* Returns the number of free bytes and optionally the size of the largest free block. */
+u_long SpuRamAvailable(u_long* largest);
+
+#endif
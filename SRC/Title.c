@@ -13,8 +13,12 @@
 
 #include "Title.h"
 #include "Engine.h"
+#include "Asset.h"
 #include "Breakout.h"
 
+/* Seconds without any button held on the title before the autopilot starts a demo. */
+#define ATTRACT_SECONDS 20
+
 int HandleGsTitle()
 {
 	int i;
@@ -23,22 +27,21 @@ int HandleGsTitle()
 	u_char direction = 0;
 	u_char textColor = 128;
 	int selection = 0;
-	u_char startPressed = 0;
-	ControllerPacket* controllerPacket = 0;
-
-	u_char downPressed = 0;
-	u_char upPressed = 0;
-	u_char leftAxis = 128;
-	u_char tmpAxis = 128;
+	u_char menuVisible = 0;
+	InputState* input = 0;
+	long idleFrames = 0;
 
-	int menuItemCount = 2;
+	int menuItemCount = 4;
 	char* menuItems[] =
 	{
+		"Start Game",
+		"Versus",
 		"Start Demo",
-		"Options"
+		"Benchmark"
 	};
 
-	if (!LoadTIMFile("TITLE.TIM", &titleImage))
+	/* Stays in VRAM while the game runs, so coming back to the title reads nothing from CD */
+	if (!AcquireTIM("TITLE.TIM", &titleImage))
 	{
 		ErrorMessage("TITLE.TIM not found");
 	}
@@ -76,66 +79,58 @@ int HandleGsTitle()
 			}
 		}
 
-		controllerPacket = GetControllerPacket(0);
+		UpdateInput();
+		input = GetInput(0);
+
+		/* Attract mode */
+		idleFrames = input->held != 0 ? 0 : idleFrames + 1;
+		if (idleFrames >= ATTRACT_SECONDS * GetRefreshRate())
+		{
+			ReleaseTIM("TITLE.TIM");
+			return GS_DEMO;
+		}
 
-		if (!startPressed)
+		if (!menuVisible)
 		{
 			DrawTextColored("Press START!", 110, 148, textColor, textColor, textColor);
 
-			if (ControllerPacketIsValid(controllerPacket))
+			if (IsInputPressed(input, PAD_Start))
 			{
-				if (IsPadButtonPressed(controllerPacket, PAD_Start))
-				{
-					startPressed = 1;
-				}
+				menuVisible = 1;
 			}
 		}
 		else
 		{
-			if (ControllerPacketIsValid(controllerPacket))
+			if (IsInputPressed(input, PAD_Select))
 			{
-				if (IsPadButtonPressed(controllerPacket, PAD_Select))
-				{
-					startPressed = 0;
-				}
-				else
-				{
-					if (IsPadButtonPressed(controllerPacket, PAD_Down))
-					{
-						if (!downPressed)
-						{
-							selection = (selection + 1) % menuItemCount;
-						}
-						downPressed = 1;
-					}
-					else
-					{
-						downPressed = 0;
-					}
-				}
-				
-				if (IsPadButtonPressed(controllerPacket, PAD_Up))
-				{
-					if (!upPressed)
-					{
-						selection = (selection + menuItemCount - 1) % menuItemCount;
-					}
-					upPressed = 1;
-				}
-				else
-				{
-					upPressed = 0;
-				}
+				menuVisible = 0;
+			}
+			else if (IsInputPressed(input, PAD_Down))
+			{
+				selection = (selection + 1) % menuItemCount;
+			}
+
+			if (IsInputPressed(input, PAD_Up))
+			{
+				selection = (selection + menuItemCount - 1) % menuItemCount;
+			}
+
+			if (IsInputPressed(input, PAD_Cross))
+			{
+				ReleaseTIM("TITLE.TIM");
 
-				if (IsPadButtonPressed(controllerPacket, PAD_Cross))
+				switch(selection)
 				{
-					switch(selection)
-					{
-					case 0:
-						return GS_GAME;
-					default:
-						return -1;
-					}
+				case 0:
+					return GS_GAME;
+				case 1:
+					return GS_VERSUS;
+				case 2:
+					return GS_DEMO;
+				case 3:
+					return GS_BENCH;
+				default:
+					return -1;
 				}
 			}
 
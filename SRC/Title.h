@@ -2,7 +2,7 @@
 #ifndef _TITLE_H_
 #define _TITLE_H_
 
-/* Called when the intro state is entered to initialize it. */
+/* Called when the title state is entered to initialize it. */
 int HandleGsTitle();
 
 #endif
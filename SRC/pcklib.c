@@ -5,9 +5,29 @@
 #include <libetc.h>
 #include <libcd.h>
 
+#include <ctype.h>
+#include <string.h>
+
 // To keep track of the last sector read because CdRead() won't work properly when called without a seek first
 static int PckNextSector;
 
+// The sector cache is a ring, sector n is kept in slot n % PCK_CACHE_SECTORS. It holds the
+// sectors PckCacheFirst to PckCacheFirst+PckCacheCount-1.
+static u_long	PckCacheData[PCK_CACHE_SECTORS][512];
+static int		PckCacheFirst;
+static int		PckCacheCount;
+
+// Read-ahead which may still be running, it continues the cache at its end
+static int		PckPendingCount;
+
+// Sector after the end of the PCK file, nothing past it is read ahead
+static int		PckCacheLimit;
+
+static PckSTATS	PckStats;
+
+// Stream the pack is read through if it has the sectors, 0 for none
+static PckSTREAM	*PckStream;
+
 int PckGetToc(char *FileName, PckTOC *Toc) {
 	
 	/*	Description:
@@ -23,18 +43,23 @@ int PckGetToc(char *FileName, PckTOC *Toc) {
 			
 	*/
 	
-	u_char	Mode=CdlModeSpeed;
 	CdlFILE File={0};
 	
+	// The drive must not be busy with a read-ahead while searching
+	PckFlush();
+	
 	// Search if the file exists and get its parameters if so
 	if (CdSearchFile(&File, FileName) == 0) {
 		return(0);
 	}
 	
-	// Seek to the file so we can get the TOC
-	CdControl(CdlSetloc, (u_char*)&File.pos, 0);
-	CdRead(1, (u_long*)Toc, Mode);
-	CdReadSync(0, 0);
+	// Read-ahead stops at the end of this file
+	PckCacheLimit = CdPosToInt(&File.pos) + (File.size+2047)/2048;
+	
+	// Read the TOC, the first files of the pack come along with it
+	if (PckReadSectors(CdPosToInt(&File.pos), 1, (u_long*)Toc) == 0) {
+		return(0);
+	}
 	
 	// Make sure that the file is a PCK file
 	if (Toc->ID[0] != 'P') {
@@ -68,8 +93,7 @@ int PckGetSubToc(PckTOC *SearchToc, char *FileName, PckTOC *Toc) {
 	*/
 	
 	int		FileNum=0;
-	CdlLOC	ReadPos;
-	u_char	Mode=CdlModeSpeed;
+	int		ReadPos;
 	
 	
 	// Search if the file exists in the PCK file
@@ -78,11 +102,11 @@ int PckGetSubToc(PckTOC *SearchToc, char *FileName, PckTOC *Toc) {
 		return(0);
 	}
 	
-	// Seek to the pack file and get its TOC
-	CdIntToPos(SearchToc->BasePos + SearchToc->File[FileNum].Pos, &ReadPos);
-	CdControl(CdlSetloc, (u_char*)&ReadPos, 0);
-	CdRead(1, (u_long*)Toc, Mode);
-	CdReadSync(0, 0);
+	// Get the TOC of the pack file
+	ReadPos = SearchToc->BasePos + SearchToc->File[FileNum].Pos;
+	if (PckReadSectors(ReadPos, 1, (u_long*)Toc) == 0) {
+		return(0);
+	}
 	
 	// Make sure that the file is a PCK pack file
 	if (Toc->ID[0] != 'P') {
@@ -96,7 +120,7 @@ int PckGetSubToc(PckTOC *SearchToc, char *FileName, PckTOC *Toc) {
 	}
 	
 	// Save the pack file's sector position for later
-	Toc->BasePos = CdPosToInt(&ReadPos);
+	Toc->BasePos = ReadPos;
 	
 	return(1);
 	
@@ -117,6 +141,10 @@ int PckReadFile(PckTOC *Toc, char *FileName, u_long *Buff, int NumBytes) {
 		Take note that NumBytes will be quantized automatically to a multiple of 2048 bytes
 		so if NumBytes is 1 for example, it'll read 2048 bytes instead.
 		
+	Returns:
+		1 - File read.
+		0 - File not found or read error.
+		
 	*/
 	
 	int Num=0;
@@ -127,12 +155,11 @@ int PckReadFile(PckTOC *Toc, char *FileName, u_long *Buff, int NumBytes) {
 		if (Num == -1) return(0);
 	}
 	
-	PckReadFileNum(Toc, Num, Buff, NumBytes);
-	return(1);
+	return(PckReadFileNum(Toc, Num, Buff, NumBytes));
 	
 }
 
-void PckReadFileNum(PckTOC *Toc, int Num, u_long *Buff, int NumBytes) {
+int PckReadFileNum(PckTOC *Toc, int Num, u_long *Buff, int NumBytes) {
 	
 	/*	Description:
 		
@@ -148,16 +175,21 @@ void PckReadFileNum(PckTOC *Toc, int Num, u_long *Buff, int NumBytes) {
 		Take note that NumBytes will be quantized automatically to a multiple of 2048 bytes
 		so if NumBytes is 1 for example, it'll read 2048 bytes instead.
 		
+		Unlike CdReadFile(), the data is in the buffer when this function returns. It goes
+		through PckReadSectors(), so small files often come from the read cache.
+		
+	Returns:
+		1 - File read.
+		0 - Invalid file number or read error.
+		
 	*/
 	
-	u_char	Mode=CdlModeSpeed;
 	int		NumSectors;
 	int		DestSector;
-	CdlLOC	Pos;
 	
 	
 	// Avoid invalid file numbers
-	if (Num < 0) return;
+	if (Num < 0) return(0);
 	
 	// Calculate where the file to load is located
 	if (Toc != 0) {
@@ -166,24 +198,21 @@ void PckReadFileNum(PckTOC *Toc, int Num, u_long *Buff, int NumBytes) {
 		DestSector = PckNextSector; // Seek to the next sector from the last read
 	}
 	
-	// Seek to it!
-	CdIntToPos(DestSector, &Pos);
-	CdControl(CdlSetloc, (u_char*)&Pos, 0);
-	
 	// Convert bytes into sector multiples
 	if ((NumBytes == 0) && (Toc != 0)) {
 		NumSectors = (Toc->File[Num].Size+2047)/2048;
 	} else {
 		NumSectors = (NumBytes+2047)/2048;
-		if (NumSectors == 0) return;
 	}
 	
-	// Begin reading!
-	CdRead(NumSectors, Buff, Mode);
-	
 	// Save last sector for proper sequential reading
 	PckNextSector = DestSector + NumSectors;
 	
+	if (NumSectors == 0) return(1);
+	
+	// Begin reading!
+	return(PckReadSectors(DestSector, NumSectors, Buff));
+	
 }
 
 int PckSearchFile(PckTOC *Toc, char *FileName) {
@@ -220,4 +249,233 @@ int PckSearchFile(PckTOC *Toc, char *FileName) {
 	
 	return(-1);
 	
-}
\ No newline at end of file
+}
+
+static int PckReadRetry(int Sector, int NumSectors, u_long *Buff) {
+	
+	// Reads sectors from the disc and waits for them, retrying failed reads. Returns 0 if
+	// the read still fails after PCK_MAX_RETRIES retries.
+	
+	int		Try;
+	CdlLOC	Pos;
+	
+	
+	// The stream doesn't move the drive, if it fails the sectors are read the usual way
+	if ((PckStream != 0) && (PckStream->Read(Sector, NumSectors, Buff) != 0)) {
+		if (PckStream->ReadSync() == 0) {
+			return(1);
+		}
+		PckStats.Retries += 1;
+	}
+	
+	if (PckStream != 0) PckStream->Pause();
+	
+	for (Try=0; Try<=PCK_MAX_RETRIES; Try+=1) {
+		
+		// Give the drive some time before trying again, twice as long on every retry
+		// (VSync(1) doesn't wait, so it's 2, 4, 8 and 16 vertical blanks)
+		if (Try > 0) {
+			PckStats.Retries += 1;
+			VSync(1<<Try);
+		}
+		
+		// CdRead() needs a seek before every read
+		CdIntToPos(Sector, &Pos);
+		if (CdControl(CdlSetloc, (u_char*)&Pos, 0) == 0) continue;
+		if (CdRead(NumSectors, Buff, CdlModeSpeed) == 0) continue;
+		
+		if (CdReadSync(0, 0) == 0) {
+			return(1);
+		}
+		
+	}
+	
+	PckStats.Failures += 1;
+	return(0);
+	
+}
+
+static void PckFinishReadAhead(void) {
+	
+	// Waits for the read-ahead to end. The sectors of a failed read-ahead are dropped, they
+	// are read again once they're needed.
+	
+	if (PckPendingCount == 0) return;
+	
+	if ((PckStream != 0 ? PckStream->ReadSync() : CdReadSync(0, 0)) == 0) {
+		PckCacheCount += PckPendingCount;
+		PckStats.ReadAhead += PckPendingCount;
+	}
+	
+	PckPendingCount = 0;
+	
+}
+
+static void PckMakeRoom(int EndSector) {
+	
+	// Drops the oldest sectors from the cache so that it can grow up to EndSector
+	
+	int Drop = EndSector - PCK_CACHE_SECTORS - PckCacheFirst;
+	
+	if (Drop > 0) {
+		PckCacheFirst += Drop;
+		PckCacheCount -= Drop;
+	}
+	
+}
+
+static void PckStartReadAhead(void) {
+	
+	// Starts reading the sectors after the end of the cache, without waiting for them
+	
+	int		Sector = PckCacheFirst + PckCacheCount;
+	int		Slot = Sector % PCK_CACHE_SECTORS;
+	int		Count = PCK_READ_AHEAD;
+	CdlLOC	Pos;
+	
+	
+	// One read never wraps around the end of the ring
+	if (Count > PCK_CACHE_SECTORS - Slot) Count = PCK_CACHE_SECTORS - Slot;
+	if (Count > PckCacheLimit - Sector) Count = PckCacheLimit - Sector;
+	if (Count <= 0) return;
+	
+	PckMakeRoom(Sector + Count);
+	
+	// A stream reads ahead without a seek, the drive isn't taken away from it for this
+	if (PckStream != 0) {
+		if (PckStream->Read(Sector, Count, PckCacheData[Slot]) == 0) return;
+		PckPendingCount = Count;
+		return;
+	}
+	
+	CdIntToPos(Sector, &Pos);
+	if (CdControl(CdlSetloc, (u_char*)&Pos, 0) == 0) return;
+	if (CdRead(Count, PckCacheData[Slot], CdlModeSpeed) == 0) return;
+	
+	PckPendingCount = Count;
+	
+}
+
+int PckReadSectors(int Sector, int NumSectors, u_long *Buff) {
+	
+	/*	Description:
+		
+		Sector		- Sector number to start reading from (see CdPosToInt()).
+		NumSectors	- Number of sectors to read.
+		*Buff		- Pointer to where the read data will be stored.
+		
+		This is what all reads of PckLib go through. Sectors are served from a ring of
+		PCK_CACHE_SECTORS sectors in RAM if they are in it, the others are read from the
+		disc while the caller waits. Reads of PCK_READ_AHEAD sectors or more go straight
+		into *Buff, smaller ones fill the cache with the sectors after them as well.
+		
+		Once the data is there, the next PCK_READ_AHEAD sectors are read into the cache in
+		the background, so the next file of the pack is usually in RAM already when it's
+		loaded. Failed reads are tried again PCK_MAX_RETRIES times, waiting a bit longer
+		every time.
+		
+	Returns:
+		1 - Sectors read.
+		0 - Read error.
+		
+	*/
+	
+	int Slot;
+	int Count;
+	
+	
+	PckFinishReadAhead();
+	
+	while (NumSectors > 0) {
+		
+		// Hit, no need to bother the drive
+		if ((Sector >= PckCacheFirst) && (Sector < PckCacheFirst+PckCacheCount)) {
+			memcpy(Buff, PckCacheData[Sector % PCK_CACHE_SECTORS], 2048);
+			PckStats.Hits += 1;
+			Sector += 1;
+			NumSectors -= 1;
+			Buff += 512;
+			continue;
+		}
+		
+		// The cache only continues where it ends
+		if (Sector != PckCacheFirst+PckCacheCount) {
+			PckCacheFirst = Sector;
+			PckCacheCount = 0;
+		}
+		
+		// Big reads are not worth keeping, the cache goes on after them
+		if (NumSectors >= PCK_READ_AHEAD) {
+			PckStats.Misses += NumSectors;
+			if (PckReadRetry(Sector, NumSectors, Buff) == 0) return(0);
+			PckCacheFirst = Sector + NumSectors;
+			PckCacheCount = 0;
+			break;
+		}
+		
+		// Fill the cache up to the end of the ring or the pack, at least with what's needed
+		Slot = Sector % PCK_CACHE_SECTORS;
+		Count = PCK_READ_AHEAD;
+		if (Count > PckCacheLimit - Sector) Count = PckCacheLimit - Sector;
+		if (Count < NumSectors) Count = NumSectors;
+		if (Count > PCK_CACHE_SECTORS - Slot) Count = PCK_CACHE_SECTORS - Slot;
+		
+		PckMakeRoom(Sector + Count);
+		if (PckReadRetry(Sector, Count, PckCacheData[Slot]) == 0) return(0);
+		PckCacheCount += Count;
+		
+		// Copy what was asked for, the rest stays in the cache
+		Count = NumSectors < Count ? NumSectors : Count;
+		PckStats.Misses += Count;
+		memcpy(Buff, PckCacheData[Slot], Count*2048);
+		Sector += Count;
+		NumSectors -= Count;
+		Buff += Count*512;
+		
+	}
+	
+	PckStartReadAhead();
+	
+	return(1);
+	
+}
+
+void PckFlush(void) {
+	
+	/*	Description:
+		
+		Waits for a read-ahead to end and empties the sector cache. Call this before using
+		the drive for anything else than PckLib, like searching files or streaming.
+		
+	*/
+	
+	PckFinishReadAhead();
+	PckCacheCount = 0;
+	
+}
+
+PckSTATS* PckGetStats(void) {
+	
+	/*	Description:
+		
+		Returns the counters of the sector cache. The hit rate is Hits/(Hits+Misses).
+		
+	*/
+	
+	return(&PckStats);
+	
+}
+
+void PckSetStream(PckSTREAM *Stream) {
+	
+	/*	Description:
+		
+		Makes all reads go through *Stream first, or directly to the drive again if *Stream
+		is zero. A read-ahead which is still running is waited for before.
+		
+	*/
+	
+	PckFinishReadAhead();
+	PckStream = Stream;
+	
+}